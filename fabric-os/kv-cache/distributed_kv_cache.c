@@ -0,0 +1,5402 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "distributed_kv_cache.h"
+
+/*
+ * Distributed KV Cache Coordinator Implementation
+ *
+ * Blocks live in a fixed slot array and sequences in slot chunks added
+ * as they are needed, both split into shards, each with its own lock and
+ * free slot stack. Sequences are found through a
+ * per-shard Robin Hood index keyed by sequence_id; block ids carry their
+ * slot, so finding a block is a bounds check. Operations on different
+ * sequences therefore only meet on the (lock-free) page pool and on the
+ * prefix tree, which the decode path does not touch.
+ */
+
+/* Shard holding @sequence_id */
+static struct kv_sequence_shard *seq_shard(struct kv_cache_coordinator *coord,
+                                           uint64_t sequence_id)
+{
+    return &coord->sequence_shards[kv_hash64(sequence_id) &
+                                   (coord->num_sequence_shards - 1)];
+}
+
+/* Sequence in @slot (shard lock held); chunks never move */
+static struct kv_sequence *seq_slot(struct kv_sequence_shard *shard, uint32_t slot)
+{
+    return &shard->chunks[slot / KV_CACHE_SEQUENCE_CHUNK]
+                         [slot % KV_CACHE_SEQUENCE_CHUNK];
+}
+
+/* Sequence lookup (shard lock held) */
+static struct kv_sequence *seq_lookup(struct kv_sequence_shard *shard,
+                                      uint64_t sequence_id)
+{
+    uint32_t slot;
+
+    if (!kv_index_lookup(&shard->index, sequence_id, &slot))
+        return NULL;
+    return seq_slot(shard, slot);
+}
+
+/* Shard owning @block_id's slot, NULL if it cannot be a block id */
+static struct kv_block_shard *block_shard(struct kv_cache_coordinator *coord,
+                                          uint64_t block_id)
+{
+    uint32_t slot = (uint32_t)block_id;
+
+    /* Generations start at 1 */
+    if (slot >= coord->block_capacity || (block_id >> 32) == 0)
+        return NULL;
+    return &coord->block_shards[slot / coord->block_shard_slots];
+}
+
+/* Block lookup (@shard locked, may be NULL) */
+static struct kv_cache_block *block_lookup(struct kv_cache_coordinator *coord,
+                                           struct kv_block_shard *shard,
+                                           uint64_t block_id)
+{
+    struct kv_cache_block *block;
+
+    if (!shard)
+        return NULL;
+
+    block = &coord->blocks[(uint32_t)block_id];
+    return block->block_id == block_id ? block : NULL;
+}
+
+/*
+ * Id of @seq's @index'th block, 0 if its retention policy dropped it
+ * (sequence shard locked). The table only stores the slot; the
+ * sequence's reference keeps the slot from being reused, so the id read
+ * back is the one it was given.
+ */
+static uint64_t seq_block_id(struct kv_cache_coordinator *coord,
+                             const struct kv_sequence *seq, uint32_t index)
+{
+    uint32_t slot = kv_block_table_get(&seq->blocks, index);
+
+    return slot != KV_BLOCK_TABLE_NONE ? coord->blocks[slot].block_id : 0;
+}
+
+/* @blocks more of @seq's positions are filled, no longer reserved */
+static void seq_fill_reserved(struct kv_cache_coordinator *coord,
+                              struct kv_sequence *seq, uint32_t blocks)
+{
+    uint32_t n = blocks < seq->reserved_blocks ? blocks : seq->reserved_blocks;
+
+    if (n == 0)
+        return;
+
+    seq->reserved_blocks -= n;
+    atomic_fetch_sub_explicit(&coord->reserved_blocks, n, memory_order_relaxed);
+}
+
+/*
+ * Requeue @seq at the most recently used end of its shard's preemption
+ * list, or take it off if it holds no blocks or is preempted (@seq's
+ * shard locked).
+ */
+static void seq_lru_update(struct kv_cache_coordinator *coord,
+                           struct kv_sequence *seq)
+{
+    struct kv_sequence_shard *shard = seq_shard(coord, seq->sequence_id);
+
+    if (seq->on_lru) {
+        if (seq->lru_prev)
+            seq->lru_prev->lru_next = seq->lru_next;
+        else
+            shard->lru_head = seq->lru_next;
+        if (seq->lru_next)
+            seq->lru_next->lru_prev = seq->lru_prev;
+        else
+            shard->lru_tail = seq->lru_prev;
+        seq->lru_prev = NULL;
+        seq->lru_next = NULL;
+        seq->on_lru = false;
+    }
+
+    if (seq->num_blocks == 0 || seq->preempted != KV_PREEMPT_NONE)
+        return;
+
+    seq->lru_prev = shard->lru_tail;
+    if (shard->lru_tail)
+        shard->lru_tail->lru_next = seq;
+    else
+        shard->lru_head = seq;
+    shard->lru_tail = seq;
+    seq->on_lru = true;
+}
+
+/* @seq was used at @now (@seq's shard locked) */
+static void seq_touch_locked(struct kv_cache_coordinator *coord,
+                             struct kv_sequence *seq, uint64_t now)
+{
+    seq->last_access_time_ns = now;
+    seq_lru_update(coord, seq);
+}
+
+/*
+ * Lock the shard owning @block_id, keeping @held if it is the same one
+ * and releasing it otherwise (so id 0 just releases @held). Walking a
+ * sequence's blocks this way holds one shard lock at a time and takes it
+ * once per run of blocks.
+ */
+static struct kv_block_shard *block_shard_switch(struct kv_cache_coordinator *coord,
+                                                 struct kv_block_shard *held,
+                                                 uint64_t block_id)
+{
+    struct kv_block_shard *shard = block_shard(coord, block_id);
+
+    if (shard == held)
+        return held;
+    if (held)
+        pthread_mutex_unlock(&held->lock);
+    if (shard)
+        pthread_mutex_lock(&shard->lock);
+    return shard;
+}
+
+/* Block shard new blocks of @sequence_id are taken from first */
+static uint32_t block_home_shard(struct kv_cache_coordinator *coord,
+                                 uint64_t sequence_id)
+{
+    return (uint32_t)(kv_hash64(sequence_id) >> 32) % coord->num_block_shards;
+}
+
+static void node_account(struct kv_cache_coordinator *coord, uint32_t node_id,
+                         int64_t bytes, int32_t blocks)
+{
+    if (node_id >= KV_CACHE_MAX_NODES)
+        return;
+
+    if (bytes)
+        atomic_fetch_add_explicit(&coord->node_used_bytes[node_id], bytes,
+                                  memory_order_relaxed);
+    if (blocks)
+        atomic_fetch_add_explicit(&coord->node_num_blocks[node_id], blocks,
+                                  memory_order_relaxed);
+}
+
+/* Fold hot-path node accounting into nodes[] (node_lock held) */
+static void node_sync_locked(struct kv_cache_coordinator *coord)
+{
+    for (uint32_t i = 0; i < coord->num_nodes; i++) {
+        struct kv_cache_node *node = &coord->nodes[i];
+
+        node->used_capacity_bytes = (uint64_t)atomic_load_explicit(
+            &coord->node_used_bytes[i], memory_order_relaxed);
+        node->num_blocks = (uint32_t)atomic_load_explicit(
+            &coord->node_num_blocks[i], memory_order_relaxed);
+        node->network_transfers_bytes = atomic_load_explicit(
+            &coord->node_transfer_bytes[i], memory_order_relaxed);
+        node->utilization_percent = kv_cache_node_utilization(node);
+    }
+}
+
+/* Sequences a node may hold, ceil((1 + eps) x average) counting one
+ * more (routing_lock read-held, ring not empty) */
+static uint32_t route_cap_locked(struct kv_cache_coordinator *coord)
+{
+    uint32_t total = atomic_load_explicit(&coord->route_total,
+                                          memory_order_relaxed) + 1;
+    uint32_t nodes = coord->ring.num_nodes;
+
+    return (uint32_t)(((double)(1.0f + coord->config.route_load_epsilon) * total +
+                       nodes - 1) / nodes);
+}
+
+/*
+ * Node for @sequence_id: its successor on the ring, or failing that the
+ * next node clockwise still under the load cap (route_cap_locked()).
+ * With @prefer, the first node under the cap in that set wins over the
+ * others (nodes already holding the sequence's data). Charges the node
+ * if @commit (routing_lock read-held). Node 0 while no node is online.
+ */
+static uint32_t route_pick_locked(struct kv_cache_coordinator *coord,
+                                  uint64_t sequence_id, uint64_t prefer,
+                                  bool commit)
+{
+    struct kv_ring *ring = &coord->ring;
+    uint32_t cap, pos, node;
+    bool found = false;
+
+    if (ring->num_nodes == 0)
+        return 0;
+
+    cap = route_cap_locked(coord);
+
+    pos = kv_ring_successor(ring, kv_hash64(sequence_id));
+    node = ring->points[pos].node;
+    for (uint32_t i = 0; i < ring->num_points; i++, pos = kv_ring_next(ring, pos)) {
+        uint32_t candidate = ring->points[pos].node;
+
+        if (atomic_load_explicit(&coord->route_load[candidate],
+                                 memory_order_relaxed) >= cap)
+            continue;
+        if (!found) {
+            node = candidate;
+            found = true;
+        }
+        if (!prefer || (prefer & kv_repl_node_bit(candidate))) {
+            node = candidate;
+            break;
+        }
+    }
+
+    if (commit) {
+        atomic_fetch_add_explicit(&coord->route_load[node], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&coord->route_total, 1, memory_order_relaxed);
+    }
+
+    return node;
+}
+
+/* Whether @seq's cached route still stands: its node has not left */
+static bool route_valid(struct kv_cache_coordinator *coord,
+                        const struct kv_sequence *seq)
+{
+    return seq->route_epoch != 0 && seq->preferred_node_id < KV_CACHE_MAX_NODES &&
+           seq->route_epoch == atomic_load_explicit(
+               &coord->route_epoch[seq->preferred_node_id], memory_order_relaxed) + 1;
+}
+
+/* Stop counting @seq against its node (@seq's shard locked) */
+static void route_release_locked(struct kv_cache_coordinator *coord,
+                                 struct kv_sequence *seq)
+{
+    uint32_t node = seq->preferred_node_id;
+
+    if (seq->route_epoch == 0)
+        return;
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    if (route_valid(coord, seq)) {
+        atomic_fetch_sub_explicit(&coord->route_load[node], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&coord->route_total, 1, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    seq->route_epoch = 0;
+}
+
+/* Route @seq to @node regardless of load (@seq's shard locked) */
+static void route_pin_locked(struct kv_cache_coordinator *coord,
+                             struct kv_sequence *seq, uint32_t node)
+{
+    route_release_locked(coord, seq);
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    if (kv_ring_contains(&coord->ring, node)) {
+        atomic_fetch_add_explicit(&coord->route_load[node], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&coord->route_total, 1, memory_order_relaxed);
+        seq->route_epoch = atomic_load_explicit(&coord->route_epoch[node],
+                                                memory_order_relaxed) + 1;
+    }
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    seq->preferred_node_id = node;
+}
+
+/* @seq's node, routing it afresh only if its node left (@seq's shard
+ * locked), to one of its replicas or this node if possible. The common
+ * case takes no lock. */
+static uint32_t route_sequence_locked(struct kv_cache_coordinator *coord,
+                                      struct kv_sequence *seq)
+{
+    uint64_t prefer = 0;
+    uint32_t node;
+
+    if (route_valid(coord, seq))
+        return seq->preferred_node_id;
+
+    /* A route lost with its node goes where the data still is */
+    if (seq->route_epoch != 0)
+        prefer = seq->replica_nodes | kv_repl_node_bit(coord->config.local_node_id);
+    route_release_locked(coord, seq);
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    node = route_pick_locked(coord, seq->sequence_id, prefer,
+                             coord->ring.num_nodes > 0);
+    if (coord->ring.num_nodes > 0)
+        seq->route_epoch = atomic_load_explicit(&coord->route_epoch[node],
+                                                memory_order_relaxed) + 1;
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    seq->preferred_node_id = node;
+    return node;
+}
+
+/*
+ * Replica nodes for @sequence_id: the first replication_factor distinct
+ * nodes clockwise from its ring position, leaving out this node
+ * (routing_lock not held). None unless replication is enabled.
+ */
+static uint64_t route_replicas(struct kv_cache_coordinator *coord,
+                               uint64_t sequence_id)
+{
+    struct kv_ring *ring = &coord->ring;
+    uint32_t want = coord->config.replication_factor, found = 0, pos;
+    uint64_t nodes = 0;
+
+    if (!coord->config.enable_replication || want == 0)
+        return 0;
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    if (ring->num_nodes > 0) {
+        pos = kv_ring_successor(ring, kv_hash64(sequence_id));
+        for (uint32_t i = 0; i < ring->num_points && found < want;
+             i++, pos = kv_ring_next(ring, pos)) {
+            uint32_t node = ring->points[pos].node;
+
+            if (node == coord->config.local_node_id ||
+                (nodes & kv_repl_node_bit(node)))
+                continue;
+            nodes |= kv_repl_node_bit(node);
+            found++;
+        }
+    }
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    return nodes;
+}
+
+/* A node came online: new sequences may land on it, cached routes stay */
+static void route_node_join(struct kv_cache_coordinator *coord, uint32_t node)
+{
+    pthread_rwlock_wrlock(&coord->routing_lock);
+    kv_ring_add(&coord->ring, node);
+    pthread_rwlock_unlock(&coord->routing_lock);
+}
+
+/* A node went away: invalidate exactly the routes that pointed at it */
+static void route_node_leave(struct kv_cache_coordinator *coord, uint32_t node)
+{
+    pthread_rwlock_wrlock(&coord->routing_lock);
+    if (kv_ring_contains(&coord->ring, node)) {
+        kv_ring_remove(&coord->ring, node);
+        atomic_fetch_add_explicit(&coord->route_epoch[node], 1, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&coord->route_total,
+                                  atomic_load_explicit(&coord->route_load[node],
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+        atomic_store_explicit(&coord->route_load[node], 0, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&coord->routing_lock);
+}
+
+/* Raise or clear the global pressure signal after hot pages changed hands */
+static void pressure_update(struct kv_cache_coordinator *coord)
+{
+    bool low;
+
+    if (coord->low_watermark_pages == 0)
+        return;
+
+    low = kv_page_pool_free_pages(&coord->page_pool) < coord->low_watermark_pages;
+    if (atomic_load_explicit(&coord->page_pressure, memory_order_relaxed) != low)
+        atomic_store_explicit(&coord->page_pressure, low, memory_order_relaxed);
+}
+
+/* Give a block a hot page (block's shard locked) */
+static void block_take_page(struct kv_cache_coordinator *coord,
+                            struct kv_cache_block *block, uint32_t page)
+{
+    block->page = page;
+    block->key_data = kv_page_addr(&coord->page_pool, page);
+    block->value_data = (uint8_t *)block->key_data + block->key_size_bytes;
+
+    atomic_fetch_add_explicit(&coord->used_capacity_bytes, coord->block_bytes,
+                              memory_order_relaxed);
+    node_account(coord, block->node_id, coord->block_bytes, 0);
+}
+
+/* Return a block's hot page to the pool (block's shard locked) */
+static void block_release_page(struct kv_cache_coordinator *coord,
+                               struct kv_cache_block *block)
+{
+    kv_page_free(&coord->page_pool, block->page);
+    block->page = KV_PAGE_NONE;
+    block->key_data = NULL;
+    block->value_data = NULL;
+
+    atomic_fetch_sub_explicit(&coord->used_capacity_bytes, coord->block_bytes,
+                              memory_order_relaxed);
+    node_account(coord, block->node_id, -(int64_t)coord->block_bytes, 0);
+    pressure_update(coord);
+}
+
+/* Index of @block in its shard's eviction set */
+static uint32_t evict_index(struct kv_cache_coordinator *coord,
+                            struct kv_block_shard *shard,
+                            const struct kv_cache_block *block)
+{
+    return (uint32_t)(block - coord->blocks) - shard->first_slot;
+}
+
+/* Milliseconds to recompute @block if its data were lost */
+static float block_recompute_cost(const struct kv_cache_block *block)
+{
+    /* Unknown: prefill of a block attends over everything before it */
+    if (block->recompute_cost_ms <= 0.0f)
+        return KV_CACHE_RECOMPUTE_MS_PER_TOKEN * (float)block->num_tokens *
+               (float)(block->position + 1);
+    return block->recompute_cost_ms;
+}
+
+/*
+ * Cost-aware key: expected cost of evicting @block per byte it frees,
+ * recompute cost x reuse probability / bytes. Reuse probability is
+ * f / (f + 1) for TinyLFU estimate f, so blocks seen once score half of
+ * what steadily reused blocks do.
+ */
+static float evict_score(struct kv_cache_coordinator *coord,
+                         struct kv_block_shard *shard,
+                         const struct kv_cache_block *block)
+{
+    uint32_t freq = kv_sketch_estimate(&shard->sketch, block->block_id);
+    float cost = block_recompute_cost(block);
+
+    return cost * ((float)freq / (float)(freq + 1)) / (float)coord->block_bytes;
+}
+
+/* Record an access for recency, frequency and cost (@shard locked) */
+static void block_touch_locked(struct kv_cache_coordinator *coord,
+                               struct kv_block_shard *shard,
+                               struct kv_cache_block *block)
+{
+    uint32_t idx = evict_index(coord, shard, block);
+
+    kv_sketch_increment(&shard->sketch, block->block_id);
+    if (!kv_evict_queued(&shard->evict, idx))
+        return;
+
+    if (coord->config.eviction_policy != KV_EVICT_FIFO)
+        kv_evict_touch(&shard->evict, idx);
+    kv_evict_rescore(&shard->evict, idx, evict_score(coord, shard, block));
+}
+
+/* Resident blocks are eviction candidates (@shard, the owner, locked) */
+static void evict_track(struct kv_cache_coordinator *coord,
+                        struct kv_block_shard *shard,
+                        struct kv_cache_block *block)
+{
+    kv_evict_insert(&shard->evict, evict_index(coord, shard, block),
+                    evict_score(coord, shard, block));
+}
+
+static void evict_untrack(struct kv_cache_coordinator *coord,
+                          struct kv_block_shard *shard,
+                          struct kv_cache_block *block)
+{
+    kv_evict_remove(&shard->evict, evict_index(coord, shard, block));
+}
+
+/* Locked blocks are in use; shared ones are worth more than one owner */
+static bool evict_eligible(const struct kv_cache_block *block)
+{
+    return !block->locked && block->ref_count <= 1;
+}
+
+/*
+ * Victim among @shard's resident blocks under @policy (@shard locked),
+ * NULL if every one is locked or shared.
+ */
+static struct kv_cache_block *evict_pick_locked(struct kv_cache_coordinator *coord,
+                                                struct kv_block_shard *shard,
+                                                enum kv_eviction_policy policy)
+{
+    struct kv_evict_set *set = &shard->evict;
+    struct kv_cache_block *best = NULL;
+    uint32_t skipped[KV_CACHE_HEAP_SKIP];
+    uint32_t idx, n = 0;
+
+    switch (policy) {
+    case KV_EVICT_COST_AWARE:
+        /* Cheapest first; pinned blocks are set aside and put back */
+        while (n < KV_CACHE_HEAP_SKIP &&
+               (idx = kv_evict_heap_pop(set)) != KV_EVICT_END) {
+            struct kv_cache_block *blk = &coord->blocks[shard->first_slot + idx];
+
+            skipped[n++] = idx;
+            if (evict_eligible(blk)) {
+                best = blk;
+                break;
+            }
+        }
+        while (n > 0)
+            kv_evict_heap_push(set, skipped[--n]);
+        if (best)
+            return best;
+        return evict_pick_locked(coord, shard, KV_EVICT_LRU);
+
+    case KV_EVICT_LFU: {
+        uint32_t best_freq = UINT32_MAX;
+
+        /* Least frequent of the few least recent candidates */
+        for (idx = kv_evict_lru_first(set);
+             idx != KV_EVICT_END && n < KV_CACHE_LFU_SAMPLE;
+             idx = kv_evict_lru_next(set, idx)) {
+            struct kv_cache_block *blk = &coord->blocks[shard->first_slot + idx];
+            uint32_t freq;
+
+            if (!evict_eligible(blk))
+                continue;
+
+            n++;
+            freq = kv_sketch_estimate(&shard->sketch, blk->block_id);
+            if (freq < best_freq) {
+                best = blk;
+                best_freq = freq;
+            }
+        }
+        return best;
+    }
+
+    default:
+        /* LRU and FIFO differ only in whether an access requeues */
+        for (idx = kv_evict_lru_first(set); idx != KV_EVICT_END;
+             idx = kv_evict_lru_next(set, idx)) {
+            struct kv_cache_block *blk = &coord->blocks[shard->first_slot + idx];
+
+            if (evict_eligible(blk))
+                return blk;
+        }
+        return NULL;
+    }
+}
+
+/*
+ * Where an evicted block goes: a spill tier while there is room, else
+ * dropped. Under LFU, blocks seen only once are dropped outright so one-
+ * hit wonders do not take spill slots from reused blocks.
+ */
+static enum kv_block_tier evict_tier(struct kv_cache_coordinator *coord,
+                                     struct kv_block_shard *shard,
+                                     enum kv_eviction_policy policy,
+                                     const struct kv_cache_block *block)
+{
+    if (policy == KV_EVICT_LFU &&
+        kv_sketch_estimate(&shard->sketch, block->block_id) <= 1)
+        return KV_TIER_NONE;
+
+    if (kv_tier_free_slots(&coord->tiers, KV_TIER_HOST) > 0 ||
+        kv_tier_free_slots(&coord->tiers, KV_TIER_FILE) > 0)
+        return KV_TIER_HOST;
+
+    return KV_TIER_NONE;
+}
+
+/* Copy out @node's address; @host holds a hostname[]. Returns false if
+ * the node is not online (node_lock not held). */
+static bool node_address(struct kv_cache_coordinator *coord, uint32_t node,
+                         char *host, uint32_t *port)
+{
+    const size_t len = sizeof(coord->nodes[0].hostname);
+    bool online;
+
+    pthread_mutex_lock(&coord->node_lock);
+    online = node < coord->num_nodes && coord->nodes[node].online;
+    if (online) {
+        memcpy(host, coord->nodes[node].hostname, len);
+        host[len - 1] = '\0';
+        *port = coord->nodes[node].port;
+    }
+    pthread_mutex_unlock(&coord->node_lock);
+
+    return online;
+}
+
+/* home_index and replica_index key of a copy: generations stay far
+ * below 2^26, leaving the top bits for the node it came from */
+static uint64_t coh_home_key(uint32_t home_node, uint64_t home_block_id)
+{
+    return home_block_id ^ ((uint64_t)home_node << 58);
+}
+
+/* Send @node's batch (coherency_lock held). Returns the ticket or -1. */
+static int64_t coh_send_locked(struct kv_cache_coordinator *coord, uint32_t node)
+{
+    char host[sizeof(coord->nodes[0].hostname)];
+    uint32_t port, count, bytes;
+    void *payload;
+
+    payload = kv_coh_take(&coord->outbox, node, &count, &bytes);
+    if (!payload)
+        return -1;
+
+    if (!node_address(coord, node, host, &port)) {
+        free(payload);
+        return -1;
+    }
+
+    return kv_transport_send(&coord->transport, node, host, port,
+                             KV_XFER_CONTROL_COHERENCY, payload, bytes, count);
+}
+
+/* Queue a notice for @node, sending its batch once full. Returns true
+ * if it was queued. */
+static bool coh_queue(struct kv_cache_coordinator *coord, uint32_t node,
+                      enum kv_coh_op op, uint64_t block_id, uint32_t num_tokens,
+                      const void *data)
+{
+    bool queued;
+
+    if (node == coord->config.local_node_id)
+        return false;
+
+    pthread_mutex_lock(&coord->coherency_lock);
+    queued = kv_coh_queue(&coord->outbox, node, op, block_id, num_tokens, data) == 0;
+    if (queued && kv_coh_batch_full(&coord->outbox, node)) {
+        int64_t ticket = coh_send_locked(coord, node);
+
+        if (ticket > 0)
+            coord->coherency_tickets[node] = (uint64_t)ticket;
+    }
+    if (coord->outbox.pending)
+        atomic_store_explicit(&coord->coherency_pending, true, memory_order_relaxed);
+    pthread_mutex_unlock(&coord->coherency_lock);
+
+    return queued;
+}
+
+/*
+ * Send every queued batch. With @wait, also wait for every batch sent
+ * so far (by any thread) to be acknowledged. Returns -1 if a batch
+ * could not be sent or was refused.
+ */
+static int coh_flush(struct kv_cache_coordinator *coord, bool wait,
+                     uint32_t timeout_ms)
+{
+    uint64_t tickets[KV_CACHE_MAX_NODES];
+    uint64_t pending;
+    int ret = 0;
+
+    pthread_mutex_lock(&coord->coherency_lock);
+    pending = coord->outbox.pending;
+    while (pending) {
+        uint32_t node = (uint32_t)__builtin_ctzll(pending);
+        int64_t ticket = coh_send_locked(coord, node);
+
+        pending &= pending - 1;
+        if (ticket > 0)
+            coord->coherency_tickets[node] = (uint64_t)ticket;
+        else
+            ret = -1;
+    }
+    memcpy(tickets, coord->coherency_tickets, sizeof(tickets));
+    atomic_store_explicit(&coord->coherency_pending, false, memory_order_relaxed);
+    pthread_mutex_unlock(&coord->coherency_lock);
+
+    /* Acks come back in order per peer: the last ticket covers the rest */
+    for (uint32_t node = 0; wait && node < KV_CACHE_MAX_NODES; node++) {
+        if (tickets[node] &&
+            kv_transport_wait(&coord->transport, tickets[node], timeout_ms) != 0)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+/* Invalidate @block's sharers other than @keep (@block's shard locked) */
+static bool coh_invalidate_sharers_locked(struct kv_cache_coordinator *coord,
+                                          struct kv_cache_block *block,
+                                          uint32_t keep)
+{
+    uint64_t sharers = block->sharers & ~kv_coh_node_bit(keep);
+    bool queued = false;
+
+    block->sharers &= kv_coh_node_bit(keep);
+    while (sharers) {
+        uint32_t node = (uint32_t)__builtin_ctzll(sharers);
+
+        sharers &= sharers - 1;
+        queued |= coh_queue(coord, node, KV_COH_INVALIDATE, block->block_id, 0, NULL);
+    }
+
+    return queued;
+}
+
+/*
+ * Directory side of a local write to @block, before its state changes
+ * (@block's shard locked). Copies on other nodes are invalidated; a copy
+ * homed elsewhere asks its home for ownership when first written.
+ * Returns true if a notice was queued.
+ */
+static bool coh_write_locked(struct kv_cache_coordinator *coord,
+                             struct kv_cache_block *block)
+{
+    bool queued;
+
+    if (coord->config.coherency_protocol == KV_COHERENCY_NONE)
+        return false;
+
+    queued = coh_invalidate_sharers_locked(coord, block, KV_CACHE_MAX_NODES);
+    if (block->home_block_id && block->state != KV_BLOCK_MODIFIED)
+        queued |= coh_queue(coord, block->home_node, KV_COH_UPGRADE,
+                            block->home_block_id, 0, NULL);
+
+    return queued;
+}
+
+/* @block's data is about to leave this node: a modified copy is written
+ * back to its home first (@block's shard locked) */
+static void coh_writeback_locked(struct kv_cache_coordinator *coord,
+                                 struct kv_cache_block *block)
+{
+    if (coord->config.coherency_protocol == KV_COHERENCY_NONE ||
+        !block->home_block_id || block->state != KV_BLOCK_MODIFIED ||
+        block->tier != KV_TIER_HOT)
+        return;
+
+    coh_queue(coord, block->home_node, KV_COH_WRITEBACK, block->home_block_id,
+              block->num_tokens, block->key_data);
+}
+
+/* @block is being freed: write it back and forget its home (@block's
+ * shard locked) */
+static void coh_release_locked(struct kv_cache_coordinator *coord,
+                               struct kv_cache_block *block)
+{
+    uint32_t slot;
+
+    if (!block->home_block_id)
+        return;
+
+    coh_writeback_locked(coord, block);
+
+    pthread_mutex_lock(&coord->coherency_lock);
+    if (kv_index_lookup(&coord->home_index,
+                        coh_home_key(block->home_node, block->home_block_id), &slot) &&
+        slot == (uint32_t)block->block_id)
+        kv_index_remove(&coord->home_index,
+                        coh_home_key(block->home_node, block->home_block_id), NULL);
+    pthread_mutex_unlock(&coord->coherency_lock);
+}
+
+/* Have the coordinator thread flush the queued blocks within
+ * KV_CACHE_REPLICATION_FLUSH_MS, or at once if @urgent
+ * (replication_lock held) */
+static void repl_schedule_locked(struct kv_cache_coordinator *coord, bool urgent)
+{
+    uint64_t due = atomic_load_explicit(&coord->replication_due_ns,
+                                        memory_order_relaxed);
+    uint64_t now;
+
+    if (!coord->repl_outbox.pending)
+        return;
+
+    now = kv_cache_get_time_ns();
+    if (urgent && (due == 0 || due > now))
+        due = now;
+    else if (due == 0)
+        due = now + KV_CACHE_REPLICATION_FLUSH_MS * 1000000ULL;
+    atomic_store_explicit(&coord->replication_due_ns, due, memory_order_relaxed);
+}
+
+/*
+ * @block was written (@block's shard locked): queue it for each replica
+ * node not already owed an update. Writes until the flush copies it ride
+ * along with the queued one.
+ */
+static void repl_dirty_locked(struct kv_cache_coordinator *coord,
+                              struct kv_cache_block *block)
+{
+    uint64_t owed = block->replicas & ~block->replica_pending;
+    bool urgent = false;
+
+    if (!owed)
+        return;
+
+    pthread_mutex_lock(&coord->replication_lock);
+    while (owed) {
+        uint32_t node = (uint32_t)__builtin_ctzll(owed);
+
+        owed &= owed - 1;
+        if (kv_repl_queue(&coord->repl_outbox, node, KV_REPL_UPDATE,
+                          block->block_id) == 0) {
+            block->replica_pending |= kv_repl_node_bit(node);
+            urgent |= coord->repl_outbox.queues[node].count >= KV_REPL_BATCH_BLOCKS;
+        }
+    }
+    repl_schedule_locked(coord, urgent);
+    pthread_mutex_unlock(&coord->replication_lock);
+}
+
+/* @block is being freed: its replicas are dropped, and a replica held
+ * for a peer is forgotten (@block's shard locked) */
+static void repl_release_locked(struct kv_cache_coordinator *coord,
+                                struct kv_cache_block *block)
+{
+    uint64_t replicas = block->replicas;
+    uint32_t slot;
+
+    if (!replicas && !block->replica_of)
+        return;
+
+    pthread_mutex_lock(&coord->replication_lock);
+    while (replicas) {
+        uint32_t node = (uint32_t)__builtin_ctzll(replicas);
+
+        replicas &= replicas - 1;
+        kv_repl_queue(&coord->repl_outbox, node, KV_REPL_DROP, block->block_id);
+    }
+    if (block->replica_of &&
+        kv_index_lookup(&coord->replica_index,
+                        coh_home_key(block->replica_src, block->replica_of), &slot) &&
+        slot == (uint32_t)block->block_id)
+        kv_index_remove(&coord->replica_index,
+                        coh_home_key(block->replica_src, block->replica_of), NULL);
+    repl_schedule_locked(coord, false);
+    pthread_mutex_unlock(&coord->replication_lock);
+}
+
+/* @block's data in the hot encoding, as replicas and the snapshot keep
+ * it: the hot page, or a spill slot still in that encoding; NULL if it
+ * has none (@block's shard locked) */
+static const void *block_hot_data(struct kv_cache_coordinator *coord,
+                                  const struct kv_cache_block *block)
+{
+    if (block->state == KV_BLOCK_INVALID || block->tier == KV_TIER_NONE)
+        return NULL;
+    if (block->tier == KV_TIER_HOT)
+        return block->key_data;
+    if (coord->cold_layout.tensor_bytes)
+        return NULL;
+    return kv_tier_addr(&coord->tiers, block->tier, block->tier_slot);
+}
+
+/* Send the batch to @node (replication_flush_lock held). Returns -1 if
+ * it could not be queued. */
+static int repl_send_batch(struct kv_cache_coordinator *coord, uint32_t node,
+                           const char *host, uint32_t port)
+{
+    uint32_t count, bytes;
+    int64_t ticket;
+    void *payload;
+
+    payload = kv_repl_batch_take(&coord->repl_batch, &count, &bytes);
+    if (!payload)
+        return -1;
+
+    ticket = kv_transport_send(&coord->transport, node, host, port,
+                               KV_XFER_CONTROL_REPLICATION, payload, bytes, count);
+    if (ticket < 0)
+        return -1;
+
+    coord->replication_tickets[node] = (uint64_t)ticket;
+    return 0;
+}
+
+/*
+ * Send @node the blocks in @queue (replication_flush_lock held). An
+ * update carries the block's data as it is now, so every write since it
+ * was queued goes with it; blocks freed meanwhile are skipped.
+ */
+static int repl_send_queue(struct kv_cache_coordinator *coord, uint32_t node,
+                           const struct kv_repl_queue *queue)
+{
+    char host[sizeof(coord->nodes[0].hostname)];
+    struct kv_repl_batch *batch = &coord->repl_batch;
+    struct kv_block_shard *held = NULL;
+    uint64_t bit = kv_repl_node_bit(node);
+    uint32_t port = 0, sent = 0;
+    bool online;
+    int ret = 0;
+
+    online = node_address(coord, node, host, &port);
+
+    for (uint32_t i = 0; i < queue->count; i++) {
+        const struct kv_repl_item *item = &queue->items[i];
+        struct kv_repl_entry entry = { .block_id = item->block_id, .op = item->op };
+        const void *data = NULL;
+
+        if (kv_repl_batch_full(batch)) {
+            held = block_shard_switch(coord, held, 0);
+            if (repl_send_batch(coord, node, host, port) != 0)
+                ret = -1;
+
+            /* A long queue (re-replication after a failure) must not fill
+             * the transport queue: let the peer catch up now and then */
+            if (++sent % KV_CACHE_REPLICATION_WINDOW == 0 &&
+                coord->replication_tickets[node] &&
+                kv_transport_wait(&coord->transport, coord->replication_tickets[node],
+                                  KV_CACHE_REPLICATION_TIMEOUT_MS) != 0)
+                ret = -1;
+        }
+
+        if (item->op == KV_REPL_UPDATE) {
+            struct kv_cache_block *blk;
+
+            held = block_shard_switch(coord, held, item->block_id);
+            blk = block_lookup(coord, held, item->block_id);
+            if (!blk || !(blk->replica_pending & bit))
+                continue;
+            blk->replica_pending &= ~bit;
+
+            entry.sequence_id = blk->sequence_id;
+            entry.position = blk->position;
+            entry.num_tokens = blk->num_tokens;
+            entry.recompute_cost_ms = blk->recompute_cost_ms;
+            data = block_hot_data(coord, blk);
+        }
+
+        if (!online || kv_repl_batch_add(batch, &entry, data) != 0)
+            ret = -1;
+    }
+    block_shard_switch(coord, held, 0);
+
+    if (batch->count && repl_send_batch(coord, node, host, port) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+/*
+ * Send every queued block, then wait up to @timeout_ms for each node in
+ * @wait_nodes to acknowledge (apply) everything sent to it so far.
+ * Returns -1 if a batch could not be sent or was refused.
+ */
+static int repl_flush(struct kv_cache_coordinator *coord, uint64_t wait_nodes,
+                      uint32_t timeout_ms)
+{
+    uint64_t tickets[KV_CACHE_MAX_NODES];
+    uint64_t pending;
+    int ret = 0;
+
+    pthread_mutex_lock(&coord->replication_flush_lock);
+
+    pthread_mutex_lock(&coord->replication_lock);
+    pending = coord->repl_outbox.pending;
+    pthread_mutex_unlock(&coord->replication_lock);
+
+    while (pending) {
+        uint32_t node = (uint32_t)__builtin_ctzll(pending);
+
+        pending &= pending - 1;
+        pthread_mutex_lock(&coord->replication_lock);
+        kv_repl_detach(&coord->repl_outbox, node, &coord->repl_spare);
+        pthread_mutex_unlock(&coord->replication_lock);
+
+        if (repl_send_queue(coord, node, &coord->repl_spare) != 0)
+            ret = -1;
+        coord->repl_spare.count = 0;
+    }
+
+    /* Blocks queued behind the flush wait for the next one */
+    pthread_mutex_lock(&coord->replication_lock);
+    atomic_store_explicit(&coord->replication_due_ns, 0, memory_order_relaxed);
+    repl_schedule_locked(coord, false);
+    pthread_mutex_unlock(&coord->replication_lock);
+
+    memcpy(tickets, coord->replication_tickets, sizeof(tickets));
+    pthread_mutex_unlock(&coord->replication_flush_lock);
+
+    /* Acks come back in order per peer: the last ticket covers the rest */
+    for (uint32_t node = 0; node < KV_CACHE_MAX_NODES; node++) {
+        if ((wait_nodes & kv_repl_node_bit(node)) && tickets[node] &&
+            kv_transport_wait(&coord->transport, tickets[node], timeout_ms) != 0)
+            ret = -1;
+    }
+
+    return ret;
+}
+
+/* Copy a resident block's data into a spill slot, re-encoding it for
+ * the cold tier when one is configured (@shard locked) */
+static void block_copy_down(struct kv_cache_coordinator *coord,
+                            struct kv_block_shard *shard, void *dst,
+                            const struct kv_cache_block *block)
+{
+    const struct kv_quant_layout *hot = &coord->hot_layout;
+    const struct kv_quant_layout *cold = &coord->cold_layout;
+
+    if (cold->tensor_bytes == 0) {
+        memcpy(dst, block->key_data, coord->block_bytes);
+        return;
+    }
+
+    kv_quant_read(hot, block->key_data, 0, block->num_tokens, shard->quant_scratch);
+    kv_quant_write(cold, dst, 0, block->num_tokens, 0, shard->quant_scratch);
+    kv_quant_read(hot, block->value_data, 0, block->num_tokens, shard->quant_scratch);
+    kv_quant_write(cold, (uint8_t *)dst + cold->tensor_bytes, 0,
+                   block->num_tokens, 0, shard->quant_scratch);
+}
+
+/* Inverse of block_copy_down() into the block's hot page */
+static void block_copy_up(struct kv_cache_coordinator *coord,
+                          struct kv_block_shard *shard,
+                          struct kv_cache_block *block, const void *src)
+{
+    const struct kv_quant_layout *hot = &coord->hot_layout;
+    const struct kv_quant_layout *cold = &coord->cold_layout;
+
+    if (cold->tensor_bytes == 0) {
+        memcpy(block->key_data, src, coord->block_bytes);
+        return;
+    }
+
+    kv_quant_read(cold, src, 0, block->num_tokens, shard->quant_scratch);
+    kv_quant_write(hot, block->key_data, 0, block->num_tokens, 0,
+                   shard->quant_scratch);
+    kv_quant_read(cold, (const uint8_t *)src + cold->tensor_bytes, 0,
+                  block->num_tokens, shard->quant_scratch);
+    kv_quant_write(hot, block->value_data, 0, block->num_tokens, 0,
+                   shard->quant_scratch);
+}
+
+/*
+ * Move a resident block's data down to @tier (@shard, its owner, locked).
+ * KV_TIER_HOST falls through to the file tier when the host tier is
+ * full. When recomputing is known to be cheaper than swapping back in,
+ * or @tier is KV_TIER_NONE, the data is dropped and the block goes
+ * INVALID instead. Returns 0 if the block's hot page was released.
+ */
+static int block_demote_locked(struct kv_cache_coordinator *coord,
+                               struct kv_block_shard *shard,
+                               struct kv_cache_block *block,
+                               enum kv_block_tier tier)
+{
+    uint32_t slot = KV_PAGE_NONE;
+
+    if (block->tier != KV_TIER_HOT || block->locked || block->send_pins)
+        return -1;
+
+    if (tier == KV_TIER_HOST && kv_tier_free_slots(&coord->tiers, tier) == 0)
+        tier = KV_TIER_FILE;
+
+    if (tier != KV_TIER_NONE && block->recompute_cost_ms > 0.0f &&
+        block->recompute_cost_ms <= kv_tier_swap_in_cost_ms(tier, coord->block_bytes))
+        tier = KV_TIER_NONE;
+
+    if (tier != KV_TIER_NONE) {
+        slot = kv_tier_alloc(&coord->tiers, tier);
+        if (slot == KV_PAGE_NONE)
+            return -1;
+
+        block_copy_down(coord, shard, kv_tier_addr(&coord->tiers, tier, slot), block);
+        block->precision = coord->cold_layout.tensor_bytes ?
+                           coord->cold_layout.precision : block->precision;
+        shard->stats.swap_outs++;
+    } else {
+        coh_writeback_locked(coord, block);
+        block->state = KV_BLOCK_INVALID;
+        shard->stats.recompute_drops++;
+    }
+
+    evict_untrack(coord, shard, block);
+    block_release_page(coord, block);
+    block->tier = tier;
+    block->tier_slot = slot;
+
+    return 0;
+}
+
+/*
+ * Demote the configured policy's victim in @shard to free a hot page
+ * (@shard locked). Only runs while a spill tier has room; past that,
+ * callers drop prefix cache blocks rather than running sequences'.
+ */
+static int evict_demote_locked(struct kv_cache_coordinator *coord,
+                               struct kv_block_shard *shard)
+{
+    enum kv_eviction_policy policy = coord->config.eviction_policy;
+    struct kv_cache_block *victim;
+
+    if (kv_tier_free_slots(&coord->tiers, KV_TIER_HOST) == 0 &&
+        kv_tier_free_slots(&coord->tiers, KV_TIER_FILE) == 0)
+        return -1;
+
+    victim = evict_pick_locked(coord, shard, policy);
+    if (!victim ||
+        block_demote_locked(coord, shard, victim,
+                            evict_tier(coord, shard, policy, victim)) != 0)
+        return -1;
+
+    shard->stats.evictions++;
+    return 0;
+}
+
+/*
+ * @self has nothing left to demote: free a hot page from another shard.
+ * Their locks are only tried, never waited on, since @self is held.
+ */
+static int reclaim_remote(struct kv_cache_coordinator *coord,
+                          struct kv_block_shard *self)
+{
+    uint32_t n = coord->num_block_shards;
+    uint32_t first = (uint32_t)(self - coord->block_shards);
+
+    for (uint32_t i = 1; i < n; i++) {
+        struct kv_block_shard *shard = &coord->block_shards[(first + i) % n];
+        int ret;
+
+        if (pthread_mutex_trylock(&shard->lock) != 0)
+            continue;
+        ret = evict_demote_locked(coord, shard);
+        pthread_mutex_unlock(&shard->lock);
+
+        if (ret == 0)
+            return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Every tier is full: trade places with cold resident @victim, which
+ * takes over @block's spill slot (@shard owns @block and lends its
+ * buffers, @vshard owns @victim; both locked).
+ */
+static void block_exchange_locked(struct kv_cache_coordinator *coord,
+                                  struct kv_block_shard *shard,
+                                  struct kv_cache_block *block,
+                                  struct kv_block_shard *vshard,
+                                  struct kv_cache_block *victim)
+{
+    void *spill = kv_tier_addr(&coord->tiers, block->tier, block->tier_slot);
+
+    block_copy_down(coord, shard, shard->swap_buffer, victim);
+    evict_untrack(coord, vshard, victim);
+
+    block->page = victim->page;
+    block->key_data = victim->key_data;
+    block->value_data = victim->value_data;
+    block_copy_up(coord, shard, block, spill);
+    memcpy(spill, shard->swap_buffer, coord->tiers.slot_bytes);
+
+    block->precision = victim->precision;
+    victim->precision = coord->cold_layout.tensor_bytes ?
+                        coord->cold_layout.precision : victim->precision;
+    node_account(coord, block->node_id, coord->block_bytes, 0);
+    node_account(coord, victim->node_id, -(int64_t)coord->block_bytes, 0);
+
+    victim->tier = block->tier;
+    victim->tier_slot = block->tier_slot;
+    victim->page = KV_PAGE_NONE;
+    victim->key_data = NULL;
+    victim->value_data = NULL;
+
+    block->tier = KV_TIER_HOT;
+    block->tier_slot = KV_PAGE_NONE;
+    evict_track(coord, shard, block);
+
+    shard->stats.swap_outs++;
+    shard->stats.swap_ins++;
+}
+
+/* Find a victim for block_exchange_locked(), locally first (@shard locked) */
+static int block_exchange(struct kv_cache_coordinator *coord,
+                          struct kv_block_shard *shard,
+                          struct kv_cache_block *block)
+{
+    uint32_t n = coord->num_block_shards;
+    uint32_t first = (uint32_t)(shard - coord->block_shards);
+    struct kv_cache_block *victim;
+
+    if (block->tier == KV_TIER_NONE)
+        return -1;
+
+    victim = evict_pick_locked(coord, shard, coord->config.eviction_policy);
+    if (victim) {
+        block_exchange_locked(coord, shard, block, shard, victim);
+        return 0;
+    }
+
+    for (uint32_t i = 1; i < n; i++) {
+        struct kv_block_shard *other = &coord->block_shards[(first + i) % n];
+
+        if (pthread_mutex_trylock(&other->lock) != 0)
+            continue;
+        victim = evict_pick_locked(coord, other, coord->config.eviction_policy);
+        if (victim)
+            block_exchange_locked(coord, shard, block, other, victim);
+        pthread_mutex_unlock(&other->lock);
+
+        if (victim)
+            return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Bring a block's data back into the hot tier (@shard, its owner,
+ * locked). Returns 0 if the data was restored, 1 if the block had been
+ * dropped and now has a fresh page whose contents must be recomputed,
+ * and -1 if no hot page could be freed.
+ */
+static int block_promote_locked(struct kv_cache_coordinator *coord,
+                                struct kv_block_shard *shard,
+                                struct kv_cache_block *block)
+{
+    uint32_t page;
+    int ret = 0;
+
+    if (block->tier == KV_TIER_HOT)
+        return 0;
+
+    while ((page = kv_page_alloc(&coord->page_pool, -1)) == KV_PAGE_NONE) {
+        if (evict_demote_locked(coord, shard) != 0 &&
+            reclaim_remote(coord, shard) != 0)
+            return block_exchange(coord, shard, block);
+    }
+
+    block_take_page(coord, block, page);
+
+    if (block->tier == KV_TIER_NONE) {
+        block->state = KV_BLOCK_EXCLUSIVE;
+        ret = 1;
+    } else {
+        block_copy_up(coord, shard, block,
+                      kv_tier_addr(&coord->tiers, block->tier, block->tier_slot));
+        kv_tier_free(&coord->tiers, block->tier, block->tier_slot);
+        shard->stats.swap_ins++;
+    }
+
+    block->tier = KV_TIER_HOT;
+    block->tier_slot = KV_PAGE_NONE;
+    block->precision = coord->config.kv_precision;
+    evict_track(coord, shard, block);
+
+    pressure_update(coord);
+    return ret;
+}
+
+/* Take a free slot in @shard and give it data (@shard locked) */
+static struct kv_cache_block *block_alloc_locked(struct kv_cache_coordinator *coord,
+                                                 struct kv_block_shard *shard,
+                                                 uint64_t sequence_id,
+                                                 uint32_t position,
+                                                 uint32_t node_id)
+{
+    struct kv_cache_block *block;
+    uint32_t slot, page;
+
+    if (shard->free_count == 0)
+        return NULL;
+
+    /* Under global pressure every allocation pays for one demotion */
+    if (atomic_load_explicit(&coord->page_pressure, memory_order_relaxed))
+        evict_demote_locked(coord, shard);
+
+    while ((page = kv_page_alloc(&coord->page_pool, -1)) == KV_PAGE_NONE) {
+        if (evict_demote_locked(coord, shard) != 0 &&
+            reclaim_remote(coord, shard) != 0)
+            return NULL;
+    }
+
+    slot = shard->free_slots[--shard->free_count];
+    block = &coord->blocks[slot];
+    memset(block, 0, sizeof(*block));
+
+    block->block_id = ((uint64_t)shard->next_generation << 32) | slot;
+    if (++shard->next_generation == 0)
+        shard->next_generation = 1;
+
+    block->key_size_bytes = coord->config.page_size_bytes;
+    block->value_size_bytes = coord->config.page_size_bytes;
+    block->precision = coord->config.kv_precision;
+    block->sequence_id = sequence_id;
+    block->position = position;
+    block->state = KV_BLOCK_EXCLUSIVE;
+    block->last_access_time_ns = kv_cache_get_time_ns();
+    block->ref_count = 1;
+    block->node_id = node_id;
+    block->tier = KV_TIER_HOT;
+    block->tier_slot = KV_PAGE_NONE;
+
+    block_take_page(coord, block, page);
+    evict_track(coord, shard, block);
+    block_touch_locked(coord, shard, block);
+    node_account(coord, node_id, 0, 1);
+    shard->num_blocks++;
+
+    pressure_update(coord);
+    return block;
+}
+
+/*
+ * Take @refs more references on @block (its shard locked). Blocks the
+ * prefix tree alone references are counted for admission, which may
+ * reclaim them; this one no longer is.
+ */
+static void block_get_locked(struct kv_cache_coordinator *coord,
+                             struct kv_cache_block *block, uint32_t refs)
+{
+    if (block->prefix_ref && block->ref_count == 1)
+        atomic_fetch_sub_explicit(&coord->prefix_only_blocks, 1,
+                                  memory_order_relaxed);
+    block->ref_count += refs;
+}
+
+/* Drop one reference; release the slot at zero (@shard, its owner, locked) */
+static void block_put_locked(struct kv_cache_coordinator *coord,
+                             struct kv_block_shard *shard,
+                             struct kv_cache_block *block)
+{
+    uint32_t slot = (uint32_t)block->block_id;
+
+    if (block->ref_count > 1) {
+        block->ref_count--;
+        if (block->prefix_ref && block->ref_count == 1)
+            atomic_fetch_add_explicit(&coord->prefix_only_blocks, 1,
+                                      memory_order_relaxed);
+        return;
+    }
+
+    if (block->prefix_ref)
+        atomic_fetch_sub_explicit(&coord->prefix_only_blocks, 1,
+                                  memory_order_relaxed);
+    coh_release_locked(coord, block);
+    repl_release_locked(coord, block);
+    if (block->tier == KV_TIER_HOT) {
+        evict_untrack(coord, shard, block);
+        block_release_page(coord, block);
+    } else
+        kv_tier_free(&coord->tiers, block->tier, block->tier_slot);
+    node_account(coord, block->node_id, 0, -1);
+    memset(block, 0, sizeof(*block));
+
+    shard->free_slots[shard->free_count++] = slot;
+    shard->num_blocks--;
+}
+
+/*
+ * Allocate a block for @sequence_id from its home shard, or the next
+ * shard with a free slot. Returns it with *@shardp locked, or NULL when
+ * no shard has a slot and no cold block could give up its page.
+ */
+static struct kv_cache_block *block_alloc(struct kv_cache_coordinator *coord,
+                                          uint64_t sequence_id,
+                                          uint32_t position,
+                                          uint32_t node_id,
+                                          struct kv_block_shard **shardp)
+{
+    uint32_t n = coord->num_block_shards;
+    uint32_t home = block_home_shard(coord, sequence_id);
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct kv_block_shard *shard = &coord->block_shards[(home + i) % n];
+        struct kv_cache_block *blk;
+
+        pthread_mutex_lock(&shard->lock);
+        blk = block_alloc_locked(coord, shard, sequence_id, position, node_id);
+        if (blk) {
+            *shardp = shard;
+            return blk;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return NULL;
+}
+
+/* Queue a snapshot store or drop of @prefix_hash (no block shard held) */
+static void snapshot_note(struct kv_cache_coordinator *coord, enum kv_snap_op op,
+                          uint64_t prefix_hash)
+{
+    if (!kv_snapshot_enabled(&coord->snapshot))
+        return;
+
+    pthread_mutex_lock(&coord->snapshot_lock);
+    kv_snapshot_note(&coord->snapshot, op, prefix_hash);
+    pthread_mutex_unlock(&coord->snapshot_lock);
+}
+
+/* Leaf filter for reclaim: does dropping the tree's reference to
+ * @block_id free it? (prefix_lock held, no block shard) */
+static bool prefix_block_only(void *ctx, uint64_t block_id)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    struct kv_block_shard *shard = block_shard(coord, block_id);
+    struct kv_cache_block *blk;
+    bool only;
+
+    if (!shard)
+        return true;
+
+    pthread_mutex_lock(&shard->lock);
+    blk = block_lookup(coord, shard, block_id);
+    only = !blk || (blk->prefix_ref && blk->ref_count == 1);
+    pthread_mutex_unlock(&shard->lock);
+
+    return only;
+}
+
+/*
+ * Evict up to @max_nodes prefix leaves and drop their block references.
+ * With @reclaim, only leaves holding their block's last reference are
+ * taken, and none once no block is left that only the tree references
+ * (prefix_lock held, no block shard).
+ */
+static uint32_t prefix_evict_locked(struct kv_cache_coordinator *coord,
+                                    uint32_t max_nodes, bool reclaim)
+{
+    uint32_t evicted = 0;
+    uint64_t block_id, hash;
+
+    while (evicted < max_nodes &&
+           (!reclaim || atomic_load_explicit(&coord->prefix_only_blocks,
+                                             memory_order_relaxed) > 0) &&
+           kv_prefix_tree_evict_leaf(&coord->prefix_tree,
+                                     reclaim ? prefix_block_only : NULL, coord,
+                                     &block_id, &hash)) {
+        struct kv_block_shard *shard = block_shard(coord, block_id);
+        struct kv_cache_block *blk;
+
+        if (shard) {
+            pthread_mutex_lock(&shard->lock);
+            blk = block_lookup(coord, shard, block_id);
+            if (blk) {
+                if (blk->ref_count == 1)
+                    atomic_fetch_sub_explicit(&coord->prefix_only_blocks, 1,
+                                              memory_order_relaxed);
+                blk->prefix_ref = false;
+                block_put_locked(coord, shard, blk);
+            }
+            pthread_mutex_unlock(&shard->lock);
+        }
+        kv_summary_remove(&coord->summary, hash);
+        snapshot_note(coord, KV_SNAP_DROP, hash);
+        evicted++;
+    }
+
+    return evicted;
+}
+
+/* block_alloc(), reclaiming unused prefix blocks while every shard is
+ * full (no prefix or block shard lock held) */
+static struct kv_cache_block *block_alloc_reclaim(struct kv_cache_coordinator *coord,
+                                                  uint64_t sequence_id,
+                                                  uint32_t position,
+                                                  uint32_t node_id,
+                                                  struct kv_block_shard **shardp)
+{
+    struct kv_cache_block *blk;
+    uint32_t evicted;
+
+    while (!(blk = block_alloc(coord, sequence_id, position, node_id, shardp))) {
+        pthread_mutex_lock(&coord->prefix_lock);
+        evicted = prefix_evict_locked(coord, 1, true);
+        pthread_mutex_unlock(&coord->prefix_lock);
+
+        if (evicted == 0)
+            break;
+    }
+
+    return blk;
+}
+
+/*
+ * Continue a prefix match of @matched blocks of @tokens into the
+ * snapshot: while the next chunk has a restored record, load it into a
+ * new block and publish that in the tree. @block_ids has room for
+ * @max_blocks + 1. Returns the new match length (prefix_lock held, no
+ * block shard).
+ */
+static uint32_t snapshot_load_locked(struct kv_cache_coordinator *coord,
+                                     const uint32_t *tokens,
+                                     uint64_t *block_ids,
+                                     uint32_t matched,
+                                     uint32_t max_blocks)
+{
+    struct kv_snapshot *snap = &coord->snapshot;
+    uint32_t bs = coord->config.block_size_tokens;
+    uint64_t hash = 0;
+
+    if (!kv_snapshot_enabled(snap) || matched >= max_blocks)
+        return matched;
+
+    pthread_mutex_lock(&coord->snapshot_lock);
+    if (!snap->num_cold) {
+        pthread_mutex_unlock(&coord->snapshot_lock);
+        return matched;
+    }
+
+    for (uint32_t i = 0; i < matched; i++)
+        hash = kv_prefix_hash_block(hash, &tokens[(size_t)i * bs], bs);
+
+    while (matched < max_blocks && kv_prefix_tree_free_nodes(&coord->prefix_tree)) {
+        const uint32_t *chunk = &tokens[(size_t)matched * bs];
+        uint64_t next = kv_prefix_hash_block(hash, chunk, bs);
+        const struct kv_snap_record *rec;
+        struct kv_block_shard *shard;
+        struct kv_cache_block *blk;
+        uint32_t slot, first_new;
+
+        slot = kv_snapshot_claim(snap, next, hash, chunk);
+        if (slot == KV_SNAP_NONE)
+            break;
+        rec = &snap->records[slot];
+
+        blk = block_alloc(coord, rec->owner_sequence_id, matched,
+                          coord->config.local_node_id, &shard);
+        if (!blk) {
+            kv_snapshot_unclaim(snap, slot);
+            break;
+        }
+        memcpy(blk->key_data, kv_snapshot_data(snap, slot), coord->block_bytes);
+        blk->num_tokens = bs;
+        blk->recompute_cost_ms = rec->recompute_cost_ms;
+        blk->state = KV_BLOCK_SHARED;
+
+        /* The block's one reference is the tree's */
+        block_ids[matched] = blk->block_id;
+        if (kv_prefix_tree_insert(&coord->prefix_tree, tokens, matched + 1, block_ids,
+                                  rec->owner_sequence_id, &first_new,
+                                  kv_cache_get_time_ns()) != 1 ||
+            first_new != matched) {
+            block_put_locked(coord, shard, blk);
+            pthread_mutex_unlock(&shard->lock);
+            kv_snapshot_unclaim(snap, slot);
+            break;
+        }
+        blk->prefix_ref = true;
+        atomic_fetch_add_explicit(&coord->prefix_only_blocks, 1,
+                                  memory_order_relaxed);
+        pthread_mutex_unlock(&shard->lock);
+        kv_summary_add(&coord->summary, next);
+
+        hash = next;
+        matched++;
+    }
+    pthread_mutex_unlock(&coord->snapshot_lock);
+
+    return matched;
+}
+
+/* Lock two block shards, lower index first (no block shard held) */
+static void block_shard_lock_pair(struct kv_block_shard *a,
+                                  struct kv_block_shard *b)
+{
+    if (a > b) {
+        struct kv_block_shard *tmp = a;
+
+        a = b;
+        b = tmp;
+    }
+
+    pthread_mutex_lock(&a->lock);
+    if (b != a)
+        pthread_mutex_lock(&b->lock);
+}
+
+/*
+ * Copy-on-write: give @seq a private copy of its last block, which is
+ * shared with other sequences or the prefix tree (sequence shard locked,
+ * no block shard). Only this one block's data is copied. Returns the
+ * block to append into with *@shardp locked, NULL on failure.
+ */
+static struct kv_cache_block *block_cow(struct kv_cache_coordinator *coord,
+                                        struct kv_sequence *seq,
+                                        struct kv_block_shard **shardp)
+{
+    uint32_t last = seq->num_blocks - 1;
+    uint64_t old_id = seq_block_id(coord, seq, last);
+    struct kv_block_shard *oshard, *nshard;
+    struct kv_cache_block *old, *copy;
+
+    copy = block_alloc_reclaim(coord, seq->sequence_id, last,
+                               seq->preferred_node_id, &nshard);
+    if (!copy)
+        return NULL;
+
+    /* Keep the copy out of reclaim until it has data */
+    copy->locked = true;
+
+    oshard = block_shard(coord, old_id);
+    if (oshard != nshard) {
+        pthread_mutex_unlock(&nshard->lock);
+        if (!oshard) {
+            pthread_mutex_lock(&nshard->lock);
+            block_put_locked(coord, nshard, copy);
+            pthread_mutex_unlock(&nshard->lock);
+            return NULL;
+        }
+        block_shard_lock_pair(nshard, oshard);
+    }
+
+    old = block_lookup(coord, oshard, old_id);
+
+    if (old && old->ref_count == 1) {
+        /* The other sharers let go meanwhile: write in place */
+        block_put_locked(coord, nshard, copy);
+        if (nshard != oshard)
+            pthread_mutex_unlock(&nshard->lock);
+        *shardp = oshard;
+        return old;
+    }
+
+    if (!old || block_promote_locked(coord, oshard, old) < 0) {
+        block_put_locked(coord, nshard, copy);
+        if (nshard != oshard)
+            pthread_mutex_unlock(&oshard->lock);
+        pthread_mutex_unlock(&nshard->lock);
+        return NULL;
+    }
+
+    memcpy(copy->key_data, old->key_data, coord->block_bytes);
+    copy->num_tokens = old->num_tokens;
+    copy->recompute_cost_ms = old->recompute_cost_ms;
+    copy->dirty = old->dirty;
+    copy->locked = false;
+
+    kv_block_table_set(&seq->blocks, last, (uint32_t)copy->block_id);
+    block_put_locked(coord, oshard, old);
+    if (nshard != oshard)
+        pthread_mutex_unlock(&oshard->lock);
+
+    *shardp = nshard;
+    return copy;
+}
+
+/* What a forked sequence inherits besides its block table */
+struct seq_fork_state {
+    uint32_t num_blocks;
+    uint32_t sequence_length;
+    uint64_t prefix_hash;
+    uint32_t prefix_length;
+    bool prefix_cached;
+    uint32_t preferred_node_id;
+};
+
+/*
+ * Copy out @sequence_id's block ids into a malloc()ed array (the caller
+ * frees it) and take @refs more references on each block, marking them
+ * shared (no locks held). Returns -1 if there is no such sequence.
+ */
+static int seq_share_refs(struct kv_cache_coordinator *coord,
+                          uint64_t sequence_id, uint32_t refs,
+                          uint64_t **block_idsp, struct seq_fork_state *state)
+{
+    struct kv_sequence_shard *shard = seq_shard(coord, sequence_id);
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    uint64_t *block_ids;
+
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    block_ids = seq ? malloc(((size_t)seq->num_blocks + 1) * sizeof(uint64_t)) : NULL;
+    if (!block_ids) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        struct kv_cache_block *blk;
+
+        block_ids[i] = seq_block_id(coord, seq, i);
+        held = block_shard_switch(coord, held, block_ids[i]);
+        blk = block_lookup(coord, held, block_ids[i]);
+        if (blk) {
+            block_get_locked(coord, blk, refs);
+            blk->state = KV_BLOCK_SHARED;
+        }
+    }
+    block_shard_switch(coord, held, 0);
+
+    *block_idsp = block_ids;
+    state->num_blocks = seq->num_blocks;
+    state->sequence_length = seq->sequence_length;
+    state->prefix_hash = seq->prefix_hash;
+    state->prefix_length = seq->prefix_length;
+    state->prefix_cached = seq->prefix_cached;
+    state->preferred_node_id = seq->preferred_node_id;
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/* Drop @refs references on each block (no locks held) */
+static void blocks_put(struct kv_cache_coordinator *coord,
+                       const uint64_t *block_ids, uint32_t num_blocks,
+                       uint32_t refs)
+{
+    struct kv_block_shard *held = NULL;
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        held = block_shard_switch(coord, held, block_ids[i]);
+        for (uint32_t r = 0; r < refs; r++) {
+            struct kv_cache_block *blk = block_lookup(coord, held, block_ids[i]);
+
+            if (blk)
+                block_put_locked(coord, held, blk);
+        }
+    }
+    block_shard_switch(coord, held, 0);
+}
+
+/* Hand a block table (shared, or received from a peer) to empty
+ * sequence @sequence_id (no locks held) */
+static int seq_install_shared(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id, const uint64_t *block_ids,
+                              const struct seq_fork_state *state)
+{
+    struct kv_sequence_shard *shard = seq_shard(coord, sequence_id);
+    struct kv_sequence *seq;
+
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq || seq->num_blocks != 0 ||
+        kv_block_table_reserve(&seq->blocks, state->num_blocks) != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < state->num_blocks; i++)
+        kv_block_table_set(&seq->blocks, i, block_ids[i] ? (uint32_t)block_ids[i] :
+                                                           KV_BLOCK_TABLE_NONE);
+    seq->num_blocks = state->num_blocks;
+    seq_fill_reserved(coord, seq, state->num_blocks);
+    seq->sequence_length = state->sequence_length;
+    seq->prefix_hash = state->prefix_hash;
+    seq->prefix_length = state->prefix_length;
+    seq->prefix_cached = state->prefix_cached;
+    if (seq->preferred_node_id != state->preferred_node_id)
+        route_pin_locked(coord, seq, state->preferred_node_id);
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/* Queue blocks for background promotion; drops what does not fit */
+static void prefetch_enqueue(struct kv_cache_coordinator *coord,
+                             const uint64_t *block_ids, uint32_t count)
+{
+    pthread_mutex_lock(&coord->prefetch_lock);
+    for (uint32_t i = 0; i < count &&
+         coord->prefetch_count < KV_CACHE_PREFETCH_QUEUE; i++) {
+        uint32_t tail = (coord->prefetch_head + coord->prefetch_count) %
+                        KV_CACHE_PREFETCH_QUEUE;
+
+        coord->prefetch_queue[tail] = block_ids[i];
+        coord->prefetch_count++;
+    }
+    if (count > 0)
+        pthread_cond_signal(&coord->prefetch_cond);
+    pthread_mutex_unlock(&coord->prefetch_lock);
+}
+
+/* Queue the spilled blocks among @seq's blocks [first, first + count)
+ * (sequence shard locked) */
+static void prefetch_sequence_locked(struct kv_cache_coordinator *coord,
+                                     struct kv_sequence *seq,
+                                     uint32_t first, uint32_t count)
+{
+    struct kv_block_shard *held = NULL;
+    uint64_t ids[64];
+    uint32_t n = 0;
+
+    if (first >= seq->num_blocks ||
+        (!coord->tiers.host_enabled && !coord->tiers.file_base))
+        return;
+    if (count > seq->num_blocks - first)
+        count = seq->num_blocks - first;
+
+    for (uint32_t i = first; i < first + count; i++) {
+        struct kv_cache_block *blk;
+        uint64_t id = seq_block_id(coord, seq, i);
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+
+        if (kv_cache_block_is_cached(blk) && blk->tier != KV_TIER_HOT) {
+            ids[n++] = blk->block_id;
+            if (n == 64) {
+                held = block_shard_switch(coord, held, 0);
+                prefetch_enqueue(coord, ids, n);
+                n = 0;
+            }
+        }
+    }
+    block_shard_switch(coord, held, 0);
+
+    prefetch_enqueue(coord, ids, n);
+}
+
+/* A block short of replicas after a node failure */
+struct failover_need {
+    uint64_t block_id;
+    uint64_t add;                   /* Replica nodes to add */
+    float cost;                     /* To recompute, ms */
+    uint32_t left;                  /* Replicas it still has */
+};
+
+struct failover_needs {
+    struct failover_need *items;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/* A replica held for the failed node */
+struct failover_replica {
+    uint64_t sequence_id;
+    uint32_t position;
+    uint32_t num_tokens;
+    uint64_t block_id;              /* Ours */
+};
+
+static void failover_need_add(struct failover_needs *needs,
+                              const struct kv_cache_block *block, uint64_t add)
+{
+    struct failover_need *need;
+
+    if (needs->count == needs->capacity) {
+        uint32_t cap = needs->capacity ? needs->capacity * 2 : 256;
+        struct failover_need *items = realloc(needs->items, cap * sizeof(*items));
+
+        if (!items)
+            return;
+        needs->items = items;
+        needs->capacity = cap;
+    }
+
+    need = &needs->items[needs->count++];
+    need->block_id = block->block_id;
+    need->add = add;
+    need->cost = block_recompute_cost(block);
+    need->left = (uint32_t)__builtin_popcountll(block->replicas);
+}
+
+/* Fewest replicas left first, then the most expensive to recompute */
+static int failover_need_cmp(const void *a, const void *b)
+{
+    const struct failover_need *x = a, *y = b;
+
+    if (x->left != y->left)
+        return x->left < y->left ? -1 : 1;
+    if (x->cost != y->cost)
+        return x->cost > y->cost ? -1 : 1;
+    return 0;
+}
+
+static int failover_replica_cmp(const void *a, const void *b)
+{
+    const struct failover_replica *x = a, *y = b;
+
+    if (x->sequence_id != y->sequence_id)
+        return x->sequence_id < y->sequence_id ? -1 : 1;
+    return x->position < y->position ? -1 : x->position > y->position;
+}
+
+/*
+ * Our sequences that replicated to @dead get a replacement replica
+ * node; note each of their blocks that needs a copy there (no locks
+ * held).
+ */
+static void failover_sequences(struct kv_cache_coordinator *coord, uint32_t dead,
+                               struct failover_needs *needs)
+{
+    uint64_t bit = kv_repl_node_bit(dead);
+
+    for (uint32_t i = 0; i < coord->num_sequence_shards; i++) {
+        struct kv_sequence_shard *shard = &coord->sequence_shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        for (uint32_t slot = 0; slot < shard->num_chunks * KV_CACHE_SEQUENCE_CHUNK; slot++) {
+            struct kv_sequence *seq = seq_slot(shard, slot);
+            struct kv_block_shard *held = NULL;
+            uint32_t live;
+
+            if (!(seq->replica_nodes & bit) ||
+                !kv_index_lookup(&shard->index, seq->sequence_id, &live) ||
+                live != slot)
+                continue;
+
+            seq->replica_nodes = route_replicas(coord, seq->sequence_id);
+            for (uint32_t b = 0; b < seq->num_blocks; b++) {
+                uint64_t id = seq_block_id(coord, seq, b);
+                struct kv_cache_block *blk;
+                uint64_t add;
+
+                held = block_shard_switch(coord, held, id);
+                blk = block_lookup(coord, held, id);
+                if (!blk)
+                    continue;
+                blk->replicas &= ~bit;
+                add = seq->replica_nodes & ~blk->replicas;
+                if (add)
+                    failover_need_add(needs, blk, add);
+            }
+            block_shard_switch(coord, held, 0);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/* Turn our replicas @reps[0..n) of one sequence into that sequence's own
+ * blocks. Returns how many were taken (no locks held). */
+static uint32_t failover_adopt_sequence(struct kv_cache_coordinator *coord,
+                                        uint32_t dead,
+                                        const struct failover_replica *reps,
+                                        uint32_t n, struct failover_needs *needs)
+{
+    uint64_t sequence_id = reps[0].sequence_id;
+    struct seq_fork_state state = { 0 };
+    struct kv_block_shard *held = NULL;
+    uint64_t *ids, nodes;
+    uint32_t taken = 0;
+
+    ids = malloc(n * sizeof(*ids));
+    if (!ids || kv_cache_create_sequence(coord, sequence_id, 0) != 0) {
+        free(ids);
+        return 0;
+    }
+
+    for (; taken < n; taken++) {
+        struct kv_cache_block *blk;
+        uint32_t slot;
+
+        held = block_shard_switch(coord, held, reps[taken].block_id);
+        blk = block_lookup(coord, held, reps[taken].block_id);
+        if (!blk || blk->replica_src != dead || !blk->replica_of)
+            break;
+
+        pthread_mutex_lock(&coord->replication_lock);
+        if (kv_index_lookup(&coord->replica_index,
+                            coh_home_key(dead, blk->replica_of), &slot) &&
+            slot == (uint32_t)blk->block_id)
+            kv_index_remove(&coord->replica_index,
+                            coh_home_key(dead, blk->replica_of), NULL);
+        pthread_mutex_unlock(&coord->replication_lock);
+
+        /* The replica store's reference becomes the sequence's */
+        blk->replica_of = 0;
+        blk->replica_src = 0;
+        if (blk->state != KV_BLOCK_INVALID)
+            blk->state = KV_BLOCK_EXCLUSIVE;
+        ids[taken] = blk->block_id;
+        state.sequence_length += blk->num_tokens;
+    }
+    held = block_shard_switch(coord, held, 0);
+
+    state.num_blocks = taken;
+    state.preferred_node_id = coord->config.local_node_id;
+    if (taken == 0 || seq_install_shared(coord, sequence_id, ids, &state) != 0) {
+        blocks_put(coord, ids, taken, 1);
+        kv_cache_free_sequence(coord, sequence_id);
+        free(ids);
+        return taken;
+    }
+
+    /* Our turn to keep replicas of it */
+    nodes = route_replicas(coord, sequence_id);
+    for (uint32_t i = 0; i < taken && nodes; i++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, ids[i]);
+        blk = block_lookup(coord, held, ids[i]);
+        if (blk)
+            failover_need_add(needs, blk, nodes & ~blk->replicas);
+    }
+    block_shard_switch(coord, held, 0);
+
+    atomic_fetch_add_explicit(&coord->failover_sequences, 1, memory_order_relaxed);
+    free(ids);
+    return taken;
+}
+
+/*
+ * Take over what @dead replicated to us. A sequence whose ring successor
+ * is now this node (its first surviving replica, on every holder's ring)
+ * is rebuilt from its leading run of full blocks; other holders, and
+ * blocks that do not continue the run, drop their copies (no locks held).
+ */
+static void failover_adopt(struct kv_cache_coordinator *coord, uint32_t dead,
+                           struct failover_needs *needs)
+{
+    struct failover_replica *reps = NULL;
+    uint32_t count = 0, capacity = 0;
+
+    for (uint32_t i = 0; i < coord->num_block_shards; i++) {
+        struct kv_block_shard *shard = &coord->block_shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        for (uint32_t slot = shard->first_slot;
+             slot < shard->first_slot + shard->num_slots; slot++) {
+            struct kv_cache_block *blk = &coord->blocks[slot];
+
+            if (!blk->block_id || !blk->replica_of || blk->replica_src != dead)
+                continue;
+            if (count == capacity) {
+                uint32_t cap = capacity ? capacity * 2 : 256;
+                struct failover_replica *r = realloc(reps, cap * sizeof(*r));
+
+                if (!r)
+                    break;
+                reps = r;
+                capacity = cap;
+            }
+            reps[count].sequence_id = blk->sequence_id;
+            reps[count].position = blk->position;
+            reps[count].num_tokens = blk->num_tokens;
+            reps[count].block_id = blk->block_id;
+            count++;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    if (count)
+        qsort(reps, count, sizeof(*reps), failover_replica_cmp);
+
+    for (uint32_t first = 0, last; first < count; first = last) {
+        uint32_t run = 0, taken = 0;
+        bool ours;
+
+        for (last = first; last < count &&
+             reps[last].sequence_id == reps[first].sequence_id; last++)
+            ;
+
+        pthread_rwlock_rdlock(&coord->routing_lock);
+        ours = coord->ring.num_nodes > 0 &&
+               coord->ring.points[kv_ring_successor(
+                   &coord->ring, kv_hash64(reps[first].sequence_id))].node ==
+               coord->config.local_node_id;
+        pthread_rwlock_unlock(&coord->routing_lock);
+
+        /* Blocks 0, 1, ... with every one but the last full */
+        while (first + run < last && reps[first + run].position == run) {
+            run++;
+            if (reps[first + run - 1].num_tokens < coord->config.block_size_tokens)
+                break;
+        }
+        if (ours && run > 0)
+            taken = failover_adopt_sequence(coord, dead, &reps[first], run, needs);
+
+        for (uint32_t i = first + taken; i < last; i++) {
+            struct kv_block_shard *shard = block_shard_switch(coord, NULL,
+                                                              reps[i].block_id);
+            struct kv_cache_block *blk = block_lookup(coord, shard, reps[i].block_id);
+
+            if (blk && blk->replica_of && blk->replica_src == dead)
+                block_put_locked(coord, shard, blk);
+            block_shard_switch(coord, shard, 0);
+        }
+    }
+
+    free(reps);
+}
+
+/* Queue the copies in @needs in priority order and flush them at once */
+static void failover_rereplicate(struct kv_cache_coordinator *coord,
+                                 struct failover_needs *needs)
+{
+    struct kv_block_shard *held = NULL;
+    uint64_t queued = 0;
+
+    if (needs->count)
+        qsort(needs->items, needs->count, sizeof(*needs->items),
+              failover_need_cmp);
+
+    for (uint32_t i = 0; i < needs->count; i++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, needs->items[i].block_id);
+        blk = block_lookup(coord, held, needs->items[i].block_id);
+        if (!blk || blk->replica_of)
+            continue;
+        blk->replicas |= needs->items[i].add;
+        repl_dirty_locked(coord, blk);
+        queued++;
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_lock(&coord->replication_lock);
+    repl_schedule_locked(coord, true);
+    pthread_mutex_unlock(&coord->replication_lock);
+
+    atomic_fetch_add_explicit(&coord->rereplicated_blocks, queued,
+                              memory_order_relaxed);
+}
+
+/* @dead stopped sending heartbeats and is offline: route around it and
+ * restore what it held (no locks held) */
+static void failover_node(struct kv_cache_coordinator *coord, uint32_t dead)
+{
+    struct failover_needs needs = { 0 };
+
+    fprintf(stderr, "KV cache node %u failed: no heartbeat\n", dead);
+    atomic_fetch_add_explicit(&coord->node_failures, 1, memory_order_relaxed);
+
+    route_node_leave(coord, dead);
+    failover_adopt(coord, dead, &needs);
+    failover_sequences(coord, dead, &needs);
+    failover_rereplicate(coord, &needs);
+
+    free(needs.items);
+}
+
+/* Declare dead the nodes whose heartbeat silence passed the phi
+ * threshold (no locks held) */
+static void failure_check(struct kv_cache_coordinator *coord)
+{
+    float threshold = coord->config.failure_phi_threshold;
+    uint64_t now = kv_cache_get_time_ns();
+    uint64_t dead = 0;
+
+    pthread_mutex_lock(&coord->node_lock);
+    for (uint32_t node = 0; node < coord->num_nodes; node++) {
+        if (node == coord->config.local_node_id || !coord->nodes[node].online ||
+            kv_phi_value(&coord->node_phi[node], now) < threshold)
+            continue;
+        coord->nodes[node].online = false;
+        dead |= kv_repl_node_bit(node);
+    }
+    pthread_mutex_unlock(&coord->node_lock);
+
+    while (dead) {
+        uint32_t node = (uint32_t)__builtin_ctzll(dead);
+
+        dead &= dead - 1;
+        failover_node(coord, node);
+    }
+}
+
+/*
+ * Apply the queued stores and drops to the snapshot, and start the
+ * write-back (or with @wait, finish it). A store copies the prefix
+ * node's chunk and its block's data out under their own locks, then
+ * writes the record under snapshot_lock alone, so page faults on the
+ * file never hold up the tree or a block shard. Nodes and blocks gone
+ * by then are skipped; their drop follows in the queue (no locks held,
+ * one flusher at a time).
+ */
+static void snapshot_flush(struct kv_cache_coordinator *coord, bool wait)
+{
+    struct kv_snapshot *snap = &coord->snapshot;
+    uint32_t count;
+
+    if (!kv_snapshot_enabled(snap))
+        return;
+
+    pthread_mutex_lock(&coord->snapshot_lock);
+    count = kv_snapshot_take_pending(snap, &coord->snapshot_items,
+                                     &coord->snapshot_items_capacity);
+    pthread_mutex_unlock(&coord->snapshot_lock);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const struct kv_snap_item *item = &coord->snapshot_items[i];
+        uint64_t block_id, owner = 0, parent = 0;
+        struct kv_block_shard *shard;
+        struct kv_cache_block *blk;
+        const void *data = NULL;
+        float cost = 0.0f;
+        bool found;
+
+        if (item->op == KV_SNAP_STORE) {
+            pthread_mutex_lock(&coord->prefix_lock);
+            found = kv_prefix_tree_get(&coord->prefix_tree, item->prefix_hash,
+                                       &block_id, &owner, &parent,
+                                       coord->snapshot_tokens);
+            pthread_mutex_unlock(&coord->prefix_lock);
+            if (!found)
+                continue;
+
+            shard = block_shard_switch(coord, NULL, block_id);
+            blk = block_lookup(coord, shard, block_id);
+            if (blk && (data = block_hot_data(coord, blk))) {
+                memcpy(coord->snapshot_buffer, data, coord->block_bytes);
+                cost = blk->recompute_cost_ms;
+            }
+            block_shard_switch(coord, shard, 0);
+            if (!data)
+                continue;
+        }
+
+        pthread_mutex_lock(&coord->snapshot_lock);
+        if (item->op == KV_SNAP_STORE)
+            kv_snapshot_store(snap, item->prefix_hash, parent, owner, cost,
+                              coord->snapshot_tokens, coord->snapshot_buffer);
+        else
+            kv_snapshot_drop(snap, item->prefix_hash);
+        pthread_mutex_unlock(&coord->snapshot_lock);
+    }
+
+    if (count || wait) {
+        pthread_mutex_lock(&coord->snapshot_lock);
+        kv_snapshot_sync(snap, wait);
+        pthread_mutex_unlock(&coord->snapshot_lock);
+    }
+}
+
+/*
+ * Publish this node's prefix summary: to every online peer when it
+ * changed since the last round, otherwise only to peers that came
+ * online since. This node's own view is refreshed with it, and the
+ * views of nodes gone offline are dropped (coordinator thread).
+ */
+static void summary_publish(struct kv_cache_coordinator *coord)
+{
+    char host[sizeof(coord->nodes[0].hostname)];
+    uint32_t local = coord->config.local_node_id, bytes = 0, port;
+    uint64_t online = 0, targets, sent = 0, version;
+    void *payload = NULL;
+
+    for (uint32_t node = 0; node < KV_CACHE_MAX_NODES; node++) {
+        if (node != local && node_address(coord, node, host, &port) && port)
+            online |= kv_repl_node_bit(node);
+    }
+
+    pthread_mutex_lock(&coord->prefix_lock);
+    version = coord->summary.version;
+    targets = version != coord->summary_sent_version ? online :
+              online & ~coord->summary_sent_nodes;
+    if (targets || version != coord->summary_sent_version)
+        payload = kv_summary_encode(&coord->summary, &bytes);
+    pthread_mutex_unlock(&coord->prefix_lock);
+
+    if (!payload) {
+        coord->summary_sent_nodes &= online;
+        return;
+    }
+
+    pthread_rwlock_wrlock(&coord->summary_lock);
+    for (uint32_t node = 0; node < KV_CACHE_MAX_NODES; node++) {
+        if (node == local)
+            kv_summary_view_decode(&coord->node_summary[node], payload, bytes);
+        else if (!(online & kv_repl_node_bit(node)))
+            kv_summary_view_destroy(&coord->node_summary[node]);
+    }
+    pthread_rwlock_unlock(&coord->summary_lock);
+
+    for (uint32_t node = 0; node < KV_CACHE_MAX_NODES; node++) {
+        void *copy;
+
+        if (!(targets & kv_repl_node_bit(node)) ||
+            !node_address(coord, node, host, &port))
+            continue;
+
+        /* The transport takes ownership of what it sends */
+        copy = malloc(bytes);
+        if (!copy)
+            break;
+        memcpy(copy, payload, bytes);
+        if (kv_transport_send(&coord->transport, node, host, port,
+                              KV_XFER_CONTROL_SUMMARY, copy, bytes, 1) >= 0)
+            sent |= kv_repl_node_bit(node);
+    }
+    free(payload);
+
+    if (version != coord->summary_sent_version)
+        coord->summary_sent_nodes = 0;
+    coord->summary_sent_nodes = (coord->summary_sent_nodes & online) | sent;
+    coord->summary_sent_version = version;
+}
+
+/* Sleep on prefetch_cond, for at most one coherency or replication
+ * flush interval when either is on, and no later than a replication
+ * flush or timed task already due (prefetch_lock held) */
+static void coordinator_wait_locked(struct kv_cache_coordinator *coord,
+                                    uint64_t timer_ns)
+{
+    uint64_t due = atomic_load_explicit(&coord->replication_due_ns,
+                                        memory_order_relaxed);
+    struct timespec deadline;
+    uint64_t wait_ns = 0;
+
+    if (coord->config.coherency_protocol != KV_COHERENCY_NONE)
+        wait_ns = KV_CACHE_COHERENCY_FLUSH_MS * 1000000ULL;
+    else if (coord->config.enable_replication)
+        wait_ns = KV_CACHE_REPLICATION_FLUSH_MS * 1000000ULL;
+    if (due || timer_ns) {
+        uint64_t now = kv_cache_get_time_ns();
+
+        if ((due && due <= now) || (timer_ns && timer_ns <= now))
+            return;
+        if (due && (wait_ns == 0 || due - now < wait_ns))
+            wait_ns = due - now;
+        if (timer_ns && (wait_ns == 0 || timer_ns - now < wait_ns))
+            wait_ns = timer_ns - now;
+    }
+
+    if (wait_ns == 0) {
+        pthread_cond_wait(&coord->prefetch_cond, &coord->prefetch_lock);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(wait_ns / 1000000000ULL);
+    deadline.tv_nsec += (long)(wait_ns % 1000000000ULL);
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&coord->prefetch_cond, &coord->prefetch_lock, &deadline);
+}
+
+/* Background work: promote prefetched blocks, send coherency and
+ * replication batches, watch node heartbeats, write the snapshot,
+ * publish the prefix summary */
+static void *coordinator_thread_fn(void *arg)
+{
+    struct kv_cache_coordinator *coord = arg;
+    uint64_t check_period = coord->config.heartbeat_interval_ms * 1000000ULL / 2;
+    uint64_t check_ns = check_period ? kv_cache_get_time_ns() + check_period : 0;
+    uint64_t snapshot_period = kv_snapshot_enabled(&coord->snapshot) ?
+                               coord->config.snapshot_interval_ms * 1000000ULL : 0;
+    uint64_t snapshot_ns = snapshot_period ? kv_cache_get_time_ns() + snapshot_period : 0;
+    uint64_t summary_period = coord->config.summary_interval_ms * 1000000ULL;
+    uint64_t summary_ns = kv_cache_get_time_ns();
+
+    pthread_mutex_lock(&coord->prefetch_lock);
+    while (coord->running) {
+        struct kv_block_shard *shard;
+        struct kv_cache_block *blk;
+        uint64_t block_id, due;
+
+        if (atomic_load_explicit(&coord->coherency_pending, memory_order_relaxed)) {
+            pthread_mutex_unlock(&coord->prefetch_lock);
+            coh_flush(coord, false, 0);
+            pthread_mutex_lock(&coord->prefetch_lock);
+            continue;
+        }
+
+        due = atomic_load_explicit(&coord->replication_due_ns, memory_order_relaxed);
+        if (due && due <= kv_cache_get_time_ns()) {
+            pthread_mutex_unlock(&coord->prefetch_lock);
+            repl_flush(coord, 0, 0);
+            pthread_mutex_lock(&coord->prefetch_lock);
+            continue;
+        }
+
+        if (check_ns && check_ns <= kv_cache_get_time_ns()) {
+            pthread_mutex_unlock(&coord->prefetch_lock);
+            failure_check(coord);
+            pthread_mutex_lock(&coord->prefetch_lock);
+            check_ns = kv_cache_get_time_ns() + check_period;
+            continue;
+        }
+
+        if (snapshot_ns && snapshot_ns <= kv_cache_get_time_ns()) {
+            pthread_mutex_unlock(&coord->prefetch_lock);
+            snapshot_flush(coord, false);
+            pthread_mutex_lock(&coord->prefetch_lock);
+            snapshot_ns = kv_cache_get_time_ns() + snapshot_period;
+            continue;
+        }
+
+        if (summary_ns <= kv_cache_get_time_ns()) {
+            pthread_mutex_unlock(&coord->prefetch_lock);
+            summary_publish(coord);
+            pthread_mutex_lock(&coord->prefetch_lock);
+            summary_ns = kv_cache_get_time_ns() + summary_period;
+            continue;
+        }
+
+        if (coord->prefetch_count == 0) {
+            uint64_t timer_ns = summary_ns;
+
+            if (check_ns && check_ns < timer_ns)
+                timer_ns = check_ns;
+            if (snapshot_ns && snapshot_ns < timer_ns)
+                timer_ns = snapshot_ns;
+            coordinator_wait_locked(coord, timer_ns);
+            continue;
+        }
+
+        block_id = coord->prefetch_queue[coord->prefetch_head];
+        coord->prefetch_head = (coord->prefetch_head + 1) % KV_CACHE_PREFETCH_QUEUE;
+        coord->prefetch_count--;
+        pthread_mutex_unlock(&coord->prefetch_lock);
+
+        shard = block_shard_switch(coord, NULL, block_id);
+        blk = block_lookup(coord, shard, block_id);
+        if (kv_cache_block_is_cached(blk) && blk->tier != KV_TIER_HOT &&
+            block_promote_locked(coord, shard, blk) == 0)
+            shard->stats.prefetches++;
+        block_shard_switch(coord, shard, 0);
+
+        pthread_mutex_lock(&coord->prefetch_lock);
+    }
+    pthread_mutex_unlock(&coord->prefetch_lock);
+
+    return NULL;
+}
+
+/*
+ * Make a received copy findable by its home block (@block's shard
+ * locked). Only one local copy per home block is tracked: a second
+ * copy received later replaces the first in the index.
+ */
+static void coh_track_locked(struct kv_cache_coordinator *coord,
+                             struct kv_cache_block *block)
+{
+    pthread_mutex_lock(&coord->coherency_lock);
+    kv_index_insert(&coord->home_index,
+                    coh_home_key(block->home_node, block->home_block_id),
+                    (uint32_t)block->block_id);
+    pthread_mutex_unlock(&coord->coherency_lock);
+}
+
+/* The data of @block is stale: drop it for recompute (@shard locked).
+ * A page still being sent or received is kept until then. */
+static void block_invalidate_locked(struct kv_cache_coordinator *coord,
+                                    struct kv_block_shard *shard,
+                                    struct kv_cache_block *block)
+{
+    block->state = KV_BLOCK_INVALID;
+    block->dirty = false;
+
+    if (block->tier == KV_TIER_HOT) {
+        if (block->locked || block->send_pins)
+            return;
+        evict_untrack(coord, shard, block);
+        block_release_page(coord, block);
+    } else if (block->tier != KV_TIER_NONE) {
+        kv_tier_free(&coord->tiers, block->tier, block->tier_slot);
+    }
+
+    block->tier = KV_TIER_NONE;
+    block->tier_slot = KV_PAGE_NONE;
+}
+
+/* Lock and return the local copy of @src's block @home_block_id, or NULL */
+static struct kv_cache_block *coh_find_copy(struct kv_cache_coordinator *coord,
+                                            uint32_t src, uint64_t home_block_id,
+                                            struct kv_block_shard **shardp)
+{
+    struct kv_cache_block *blk;
+    uint32_t slot;
+    bool found;
+
+    pthread_mutex_lock(&coord->coherency_lock);
+    found = kv_index_lookup(&coord->home_index, coh_home_key(src, home_block_id),
+                            &slot);
+    pthread_mutex_unlock(&coord->coherency_lock);
+    if (!found || slot >= coord->block_capacity)
+        return NULL;
+
+    *shardp = &coord->block_shards[slot / coord->block_shard_slots];
+    pthread_mutex_lock(&(*shardp)->lock);
+    blk = &coord->blocks[slot];
+    if (blk->block_id == 0 || blk->home_node != src ||
+        blk->home_block_id != home_block_id) {
+        pthread_mutex_unlock(&(*shardp)->lock);
+        return NULL;
+    }
+
+    return blk;
+}
+
+/*
+ * Apply one directory notice from @src. Concurrent writers are ordered
+ * by the home: whichever notice it processes last wins, and the other
+ * copy is invalidated.
+ */
+static void coh_apply(struct kv_cache_coordinator *coord, uint32_t src,
+                      const struct kv_coh_entry *entry, const uint8_t *data)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+
+    if (entry->op == KV_COH_INVALIDATE) {
+        /* Our home overwrote the block: so are any copies made from ours */
+        blk = coh_find_copy(coord, src, entry->block_id, &shard);
+        if (!blk)
+            return;
+        coh_invalidate_sharers_locked(coord, blk, KV_CACHE_MAX_NODES);
+        block_invalidate_locked(coord, shard, blk);
+        pthread_mutex_unlock(&shard->lock);
+        return;
+    }
+
+    shard = block_shard_switch(coord, NULL, entry->block_id);
+    blk = block_lookup(coord, shard, entry->block_id);
+    if (!blk) {
+        block_shard_switch(coord, shard, 0);
+        return;
+    }
+
+    if (entry->op == KV_COH_UPGRADE) {
+        /* @src owns the block now; every other copy, ours included, is
+         * stale, and so is the copy our own home has */
+        coh_invalidate_sharers_locked(coord, blk, src);
+        blk->sharers |= kv_coh_node_bit(src);
+        if (blk->home_block_id && blk->state != KV_BLOCK_INVALID)
+            coh_queue(coord, blk->home_node, KV_COH_UPGRADE, blk->home_block_id,
+                      0, NULL);
+        block_invalidate_locked(coord, shard, blk);
+    } else if (entry->op == KV_COH_WRITEBACK &&
+               (blk->sharers & kv_coh_node_bit(src)) &&
+               !blk->locked && !blk->send_pins &&
+               entry->num_tokens <= coord->config.block_size_tokens &&
+               block_promote_locked(coord, shard, blk) >= 0) {
+        /* The owner gave its copy up: ours is current again. A copy homed
+         * elsewhere now owes that home the writeback. */
+        memcpy(blk->key_data, data, coord->block_bytes);
+        blk->num_tokens = entry->num_tokens;
+        blk->sharers &= ~kv_coh_node_bit(src);
+        blk->dirty = true;
+        if (blk->home_block_id)
+            blk->state = KV_BLOCK_MODIFIED;
+        else
+            blk->state = blk->sharers ? KV_BLOCK_SHARED : KV_BLOCK_EXCLUSIVE;
+        block_touch_locked(coord, shard, blk);
+        repl_dirty_locked(coord, blk);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/* Lock and return our replica of @src's block @block_id, or NULL */
+static struct kv_cache_block *repl_find(struct kv_cache_coordinator *coord,
+                                        uint32_t src, uint64_t block_id,
+                                        struct kv_block_shard **shardp)
+{
+    struct kv_cache_block *blk;
+    uint32_t slot;
+    bool found;
+
+    pthread_mutex_lock(&coord->replication_lock);
+    found = kv_index_lookup(&coord->replica_index, coh_home_key(src, block_id),
+                            &slot);
+    pthread_mutex_unlock(&coord->replication_lock);
+    if (!found || slot >= coord->block_capacity)
+        return NULL;
+
+    *shardp = &coord->block_shards[slot / coord->block_shard_slots];
+    pthread_mutex_lock(&(*shardp)->lock);
+    blk = &coord->blocks[slot];
+    if (blk->block_id == 0 || blk->replica_src != src ||
+        blk->replica_of != block_id) {
+        pthread_mutex_unlock(&(*shardp)->lock);
+        return NULL;
+    }
+
+    return blk;
+}
+
+/*
+ * Apply one replica update or drop from @src; @data is NULL for an
+ * update without data. A replica is an ordinary shared block holding
+ * one reference of its own until the source drops it, so it spills and
+ * recomputes like any other.
+ */
+static void repl_apply(struct kv_cache_coordinator *coord, uint32_t src,
+                       const struct kv_repl_entry *entry, const uint8_t *data)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+    bool indexed;
+
+    blk = repl_find(coord, src, entry->block_id, &shard);
+
+    if (entry->op == KV_REPL_DROP) {
+        if (blk) {
+            block_put_locked(coord, shard, blk);
+            pthread_mutex_unlock(&shard->lock);
+        }
+        return;
+    }
+
+    if (!blk) {
+        if (entry->num_tokens > coord->config.block_size_tokens)
+            return;
+        blk = block_alloc_reclaim(coord, entry->sequence_id, entry->position,
+                                  coord->config.local_node_id, &shard);
+        if (!blk)
+            return;
+
+        blk->replica_src = src;
+        blk->replica_of = entry->block_id;
+        pthread_mutex_lock(&coord->replication_lock);
+        indexed = kv_index_insert(&coord->replica_index,
+                                  coh_home_key(src, entry->block_id),
+                                  (uint32_t)blk->block_id) == 0;
+        pthread_mutex_unlock(&coord->replication_lock);
+        if (!indexed) {
+            block_put_locked(coord, shard, blk);
+            pthread_mutex_unlock(&shard->lock);
+            return;
+        }
+    }
+
+    if (entry->num_tokens <= coord->config.block_size_tokens) {
+        blk->sequence_id = entry->sequence_id;
+        blk->position = entry->position;
+        blk->num_tokens = entry->num_tokens;
+        blk->recompute_cost_ms = entry->recompute_cost_ms;
+    }
+
+    if (data && entry->num_tokens <= coord->config.block_size_tokens &&
+        !blk->locked && !blk->send_pins &&
+        block_promote_locked(coord, shard, blk) >= 0) {
+        memcpy(blk->key_data, data, coord->block_bytes);
+        blk->state = KV_BLOCK_SHARED;
+        blk->dirty = false;
+        block_touch_locked(coord, shard, blk);
+    } else {
+        /* Nothing current to keep: recompute it if it is ever needed */
+        block_invalidate_locked(coord, shard, blk);
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/* Transport: a batch of replica updates from a peer */
+static int repl_recv(struct kv_cache_coordinator *coord,
+                     const struct kv_xfer_msg *msg, const void *payload)
+{
+    const struct kv_repl_entry *entries;
+    const uint8_t *data;
+
+    if (kv_repl_parse(payload, msg->payload_count, msg->payload_bytes,
+                      coord->block_bytes, &entries, &data) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < msg->payload_count; i++) {
+        bool has_data = kv_repl_entry_has_data(&entries[i]);
+
+        repl_apply(coord, msg->src_node, &entries[i], has_data ? data : NULL);
+        if (has_data)
+            data += coord->block_bytes;
+    }
+
+    return 0;
+}
+
+/* Transport: a peer's prefix summary */
+static int summary_recv(struct kv_cache_coordinator *coord,
+                        const struct kv_xfer_msg *msg, const void *payload)
+{
+    int ret;
+
+    if (msg->src_node >= KV_CACHE_MAX_NODES ||
+        msg->src_node == coord->config.local_node_id)
+        return -1;
+
+    pthread_rwlock_wrlock(&coord->summary_lock);
+    ret = kv_summary_view_decode(&coord->node_summary[msg->src_node], payload,
+                                 msg->payload_bytes);
+    pthread_rwlock_unlock(&coord->summary_lock);
+
+    if (ret == 0)
+        atomic_fetch_add_explicit(&coord->summaries_received, 1, memory_order_relaxed);
+    return ret;
+}
+
+/* Transport: a batch of directory notices or replica updates, or a
+ * prefix summary, from a peer */
+static int xfer_recv_control(void *ctx, const struct kv_xfer_msg *msg,
+                             const void *payload)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    const struct kv_coh_entry *entries;
+    const uint8_t *data;
+
+    if (msg->flags == KV_XFER_CONTROL_REPLICATION)
+        return repl_recv(coord, msg, payload);
+    if (msg->flags == KV_XFER_CONTROL_SUMMARY)
+        return summary_recv(coord, msg, payload);
+
+    if (msg->flags != KV_XFER_CONTROL_COHERENCY ||
+        coord->config.coherency_protocol == KV_COHERENCY_NONE ||
+        kv_coh_parse(payload, msg->payload_count, msg->payload_bytes,
+                     coord->block_bytes, &entries, &data) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < msg->payload_count; i++) {
+        coh_apply(coord, msg->src_node, &entries[i], data);
+        if (entries[i].op == KV_COH_WRITEBACK)
+            data += coord->block_bytes;
+    }
+
+    /* STRONG: the sender's write completes once everything it made
+     * stale downstream is gone too */
+    if (coord->config.coherency_protocol == KV_COHERENCY_STRONG)
+        return coh_flush(coord, true, KV_CACHE_COHERENCY_TIMEOUT_MS);
+
+    coh_flush(coord, false, 0);
+    return 0;
+}
+
+/* Drop transfer pins on @n blocks, marking them shared with @node if
+ * the transfer went through (no locks held) */
+static void xfer_unpin(struct kv_cache_coordinator *coord,
+                       const uint64_t *block_ids, uint32_t n, bool sent,
+                       uint32_t node)
+{
+    bool track = coord->config.coherency_protocol != KV_COHERENCY_NONE;
+    struct kv_block_shard *held = NULL;
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, block_ids[i]);
+        blk = block_lookup(coord, held, block_ids[i]);
+        if (!blk)
+            continue;
+
+        blk->send_pins--;
+        if (sent && kv_cache_block_is_cached(blk)) {
+            /* A modified copy still owes its own home a writeback */
+            if (!track || !blk->home_block_id || blk->state != KV_BLOCK_MODIFIED)
+                blk->state = KV_BLOCK_SHARED;
+            if (track)
+                blk->sharers |= kv_coh_node_bit(node);
+        }
+        block_put_locked(coord, held, blk);
+    }
+    block_shard_switch(coord, held, 0);
+}
+
+/*
+ * Transport: pin @job's sequence for sending. Each block gets a reference
+ * (so it is immutable and outlives a concurrent free) and a send pin (so
+ * it is not demoted); spilled blocks are brought back first so the
+ * socket reads straight from hot pages.
+ */
+static int xfer_prepare(void *ctx, struct kv_xfer_job *job)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    struct kv_sequence_shard *shard = seq_shard(coord, job->sequence_id);
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    uint32_t i;
+
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, job->sequence_id);
+    if (!seq || kv_xfer_job_reserve(job, seq->num_blocks) != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    job->sequence_length = seq->sequence_length;
+    job->block_bytes = coord->block_bytes;
+    job->precision = coord->config.kv_precision;
+
+    for (i = 0; i < seq->num_blocks; i++) {
+        struct kv_xfer_desc *desc = &job->descs[i];
+        struct kv_cache_block *blk;
+        uint64_t id = seq_block_id(coord, seq, i);
+
+        if (!id) {
+            /* Dropped by retention: the peer leaves the same gap */
+            desc->position = i;
+            desc->flags = KV_XFER_NO_DATA | KV_XFER_HOLE;
+            continue;
+        }
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (!blk || (blk->tier != KV_TIER_HOT && blk->tier != KV_TIER_NONE &&
+                     block_promote_locked(coord, held, blk) < 0))
+            break;
+
+        block_get_locked(coord, blk, 1);
+        blk->send_pins++;
+        job->handles[i] = blk->block_id;
+
+        desc->position = blk->position;
+        desc->num_tokens = blk->num_tokens;
+        desc->state = blk->state;
+        desc->recompute_cost_ms = blk->recompute_cost_ms;
+        desc->block_id = blk->block_id;
+        if (blk->tier == KV_TIER_HOT)
+            job->data[i] = blk->key_data;
+        else
+            desc->flags = KV_XFER_NO_DATA;
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    if (i < job->num_blocks) {
+        xfer_unpin(coord, job->handles, i, false, job->node_id);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Transport: @job is acknowledged (or failed); release its blocks */
+static void xfer_complete(void *ctx, struct kv_xfer_job *job)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    uint64_t bytes = sizeof(struct kv_xfer_msg);
+
+    xfer_unpin(coord, job->handles, job->num_blocks, job->status == 0,
+               job->node_id);
+
+    if (job->status != 0 || job->node_id >= KV_CACHE_MAX_NODES)
+        return;
+
+    for (uint32_t i = 0; i < job->num_blocks; i++)
+        bytes += sizeof(struct kv_xfer_desc) + (job->data[i] ? job->block_bytes : 0);
+    atomic_fetch_add_explicit(&coord->node_transfer_bytes[job->node_id], bytes,
+                              memory_order_relaxed);
+}
+
+/*
+ * Transport: allocate local blocks for an arriving chunk and aim the
+ * socket reads at their pages. Blocks stay locked, out of reclaim and
+ * unreachable until recv_end installs the sequence.
+ */
+static void xfer_recv_chunk(void *ctx, struct kv_xfer_rx *rx,
+                            const struct kv_xfer_msg *msg,
+                            const struct kv_xfer_desc *descs, struct iovec *iov)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    uint32_t node = coord->config.local_node_id;
+
+    if (msg->block_bytes != coord->block_bytes ||
+        msg->precision != (uint32_t)coord->config.kv_precision) {
+        rx->status = -1;
+        return;
+    }
+
+    for (uint32_t i = 0; i < msg->num_blocks; i++) {
+        struct kv_block_shard *shard;
+        struct kv_cache_block *blk;
+
+        if (descs[i].flags & KV_XFER_HOLE) {
+            if (kv_xfer_rx_add(rx, 0) != 0) {
+                rx->status = -1;
+                return;
+            }
+            continue;
+        }
+
+        blk = block_alloc_reclaim(coord, msg->sequence_id, descs[i].position,
+                                  node, &shard);
+        if (!blk) {
+            rx->status = -1;
+            return;
+        }
+
+        if (kv_xfer_rx_add(rx, blk->block_id) != 0) {
+            block_put_locked(coord, shard, blk);
+            pthread_mutex_unlock(&shard->lock);
+            rx->status = -1;
+            return;
+        }
+
+        blk->num_tokens = descs[i].num_tokens;
+        blk->recompute_cost_ms = descs[i].recompute_cost_ms;
+        blk->home_node = msg->src_node;
+        blk->home_block_id = descs[i].block_id;
+        if (descs[i].flags & KV_XFER_NO_DATA) {
+            /* Dropped at the source: arrives needing recompute here too,
+             * which is not an eviction of ours */
+            evict_untrack(coord, shard, blk);
+            block_release_page(coord, blk);
+            blk->state = KV_BLOCK_INVALID;
+            blk->tier = KV_TIER_NONE;
+            blk->tier_slot = KV_PAGE_NONE;
+        } else {
+            blk->state = descs[i].state == KV_BLOCK_INVALID ?
+                         KV_BLOCK_INVALID : KV_BLOCK_SHARED;
+            iov[i].iov_base = blk->key_data;
+        }
+        blk->locked = true;
+
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/* Transport: a sequence arrived in full, or not; install or release it */
+static int xfer_recv_end(void *ctx, struct kv_xfer_rx *rx,
+                         const struct kv_xfer_msg *msg)
+{
+    struct kv_cache_coordinator *coord = ctx;
+    bool track = coord->config.coherency_protocol != KV_COHERENCY_NONE;
+    struct kv_block_shard *held = NULL;
+    struct seq_fork_state state;
+    int status = rx->status;
+    uint64_t bytes;
+
+    memset(&state, 0, sizeof(state));
+    state.num_blocks = rx->count;
+    state.sequence_length = msg->sequence_length;
+    state.preferred_node_id = coord->config.local_node_id;
+
+    if (status == 0 &&
+        kv_cache_create_sequence(coord, rx->sequence_id, 0) != 0)
+        status = -1;
+    else if (status == 0 &&
+             seq_install_shared(coord, rx->sequence_id, rx->handles, &state) != 0) {
+        kv_cache_free_sequence(coord, rx->sequence_id);
+        status = -1;
+    }
+
+    /* Count as the sender does: payloads only for blocks that had one */
+    bytes = sizeof(struct kv_xfer_msg) +
+            (uint64_t)rx->count * sizeof(struct kv_xfer_desc);
+    for (uint32_t i = 0; i < rx->count; i++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, rx->handles[i]);
+        blk = block_lookup(coord, held, rx->handles[i]);
+        if (!blk)
+            continue;
+
+        if (blk->tier != KV_TIER_NONE)
+            bytes += coord->block_bytes;
+        blk->locked = false;
+        if (status != 0)
+            block_put_locked(coord, held, blk);
+        else if (track && blk->home_block_id)
+            coh_track_locked(coord, blk);
+    }
+    block_shard_switch(coord, held, 0);
+
+    if (status == 0 && msg->src_node < KV_CACHE_MAX_NODES)
+        atomic_fetch_add_explicit(&coord->node_transfer_bytes[msg->src_node],
+                                  bytes, memory_order_relaxed);
+
+    return status;
+}
+
+/* Sum the per-shard counters */
+static void shard_stats_sum(struct kv_cache_coordinator *coord,
+                            struct kv_shard_stats *sum)
+{
+    memset(sum, 0, sizeof(*sum));
+
+    for (uint32_t i = 0; i < coord->num_block_shards; i++) {
+        struct kv_block_shard *shard = &coord->block_shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        sum->requests += shard->stats.requests;
+        sum->hits += shard->stats.hits;
+        sum->misses += shard->stats.misses;
+        sum->evictions += shard->stats.evictions;
+        sum->swap_outs += shard->stats.swap_outs;
+        sum->swap_ins += shard->stats.swap_ins;
+        sum->recompute_drops += shard->stats.recompute_drops;
+        sum->retention_drops += shard->stats.retention_drops;
+        sum->prefetches += shard->stats.prefetches;
+        sum->quant_drift_events += shard->stats.quant_drift_events;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/* Free the tables; safe on a partially initialized coordinator */
+static void coordinator_free(struct kv_cache_coordinator *coord)
+{
+    if (coord->block_shards) {
+        for (uint32_t i = 0; i < coord->num_block_shards; i++) {
+            struct kv_block_shard *shard = &coord->block_shards[i];
+
+            free(shard->free_slots);
+            free(shard->swap_buffer);
+            free(shard->quant_scratch);
+            kv_evict_destroy(&shard->evict);
+            kv_sketch_destroy(&shard->sketch);
+            pthread_mutex_destroy(&shard->lock);
+        }
+        free(coord->block_shards);
+        coord->block_shards = NULL;
+    }
+
+    if (coord->sequence_shards) {
+        for (uint32_t i = 0; i < coord->num_sequence_shards; i++) {
+            struct kv_sequence_shard *shard = &coord->sequence_shards[i];
+
+            for (uint32_t c = 0; c < shard->num_chunks; c++) {
+                for (uint32_t s = 0; s < KV_CACHE_SEQUENCE_CHUNK; s++) {
+                    kv_block_table_destroy(&shard->chunks[c][s].blocks);
+                    free(shard->chunks[c][s].retained);
+                }
+                free(shard->chunks[c]);
+            }
+            free(shard->chunks);
+            free(shard->free_slots);
+            kv_index_destroy(&shard->index);
+            pthread_mutex_destroy(&shard->lock);
+        }
+        free(coord->sequence_shards);
+        coord->sequence_shards = NULL;
+    }
+
+    kv_page_pool_destroy(&coord->page_pool);
+    kv_tier_store_destroy(&coord->tiers);
+    kv_prefix_tree_destroy(&coord->prefix_tree);
+    kv_summary_destroy(&coord->summary);
+    for (uint32_t i = 0; i < KV_CACHE_MAX_NODES; i++)
+        kv_summary_view_destroy(&coord->node_summary[i]);
+    kv_ring_destroy(&coord->ring);
+    kv_coh_outbox_destroy(&coord->outbox);
+    kv_index_destroy(&coord->home_index);
+    kv_repl_outbox_destroy(&coord->repl_outbox);
+    kv_repl_queue_destroy(&coord->repl_spare);
+    kv_repl_batch_destroy(&coord->repl_batch);
+    kv_index_destroy(&coord->replica_index);
+    if (kv_snapshot_enabled(&coord->snapshot))
+        kv_snapshot_close(&coord->snapshot);
+    free(coord->snapshot_items);
+    free(coord->snapshot_tokens);
+    free(coord->snapshot_buffer);
+    free(coord->blocks);
+    coord->blocks = NULL;
+}
+
+/* Carve the block slots into shards of consecutive slots */
+static int block_shards_init(struct kv_cache_coordinator *coord, uint32_t shards)
+{
+    uint32_t per = (coord->block_capacity + shards - 1) / shards;
+    uint32_t n = (coord->block_capacity + per - 1) / per;
+    size_t scratch = coord->hot_layout.tensor_bytes ?
+                     (size_t)kv_quant_elements(&coord->hot_layout) * 2 * sizeof(float) : 0;
+
+    coord->block_shards = aligned_alloc(KV_CACHE_LINE_BYTES,
+                                        n * sizeof(struct kv_block_shard));
+    if (!coord->block_shards)
+        return -1;
+    memset(coord->block_shards, 0, n * sizeof(struct kv_block_shard));
+    coord->num_block_shards = n;
+    coord->block_shard_slots = per;
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct kv_block_shard *shard = &coord->block_shards[i];
+
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->first_slot = i * per;
+        shard->num_slots = i + 1 < n ? per : coord->block_capacity - i * per;
+        shard->next_generation = 1;
+        shard->free_slots = malloc(shard->num_slots * sizeof(uint32_t));
+        shard->swap_buffer = malloc(coord->block_bytes);
+        if (scratch)
+            shard->quant_scratch = malloc(scratch);
+        if (!shard->free_slots || !shard->swap_buffer ||
+            (scratch && !shard->quant_scratch))
+            return -1;
+        if (kv_evict_init(&shard->evict, &coord->blocks[shard->first_slot],
+                          sizeof(struct kv_cache_block),
+                          offsetof(struct kv_cache_block, evict),
+                          shard->num_slots) != 0 ||
+            kv_sketch_init(&shard->sketch, shard->num_slots) != 0)
+            return -1;
+
+        /* Stacks pop low slots first */
+        for (uint32_t s = 0; s < shard->num_slots; s++)
+            shard->free_slots[s] = shard->first_slot + shard->num_slots - 1 - s;
+        shard->free_count = shard->num_slots;
+    }
+
+    return 0;
+}
+
+/* Add a chunk of free slots to @shard (shard lock held) */
+static int seq_shard_grow(struct kv_sequence_shard *shard)
+{
+    uint32_t base = shard->num_chunks * KV_CACHE_SEQUENCE_CHUNK;
+    struct kv_sequence *chunk;
+    uint32_t *free_slots;
+
+    if (shard->num_chunks == shard->dir_capacity) {
+        uint32_t cap = shard->dir_capacity ? shard->dir_capacity * 2 : 4;
+        struct kv_sequence **dir = realloc(shard->chunks, cap * sizeof(*dir));
+
+        if (!dir)
+            return -1;
+        shard->chunks = dir;
+        shard->dir_capacity = cap;
+    }
+
+    free_slots = realloc(shard->free_slots,
+                         (base + KV_CACHE_SEQUENCE_CHUNK) * sizeof(uint32_t));
+    if (!free_slots)
+        return -1;
+    shard->free_slots = free_slots;
+
+    chunk = calloc(KV_CACHE_SEQUENCE_CHUNK, sizeof(*chunk));
+    if (!chunk)
+        return -1;
+    shard->chunks[shard->num_chunks++] = chunk;
+
+    /* Stacks pop low slots first */
+    for (uint32_t s = 0; s < KV_CACHE_SEQUENCE_CHUNK; s++)
+        shard->free_slots[shard->free_count++] = base + KV_CACHE_SEQUENCE_CHUNK - 1 - s;
+    return 0;
+}
+
+/*
+ * Sequence shards start empty and gain slots a chunk at a time as they
+ * fill; the global count enforces KV_CACHE_MAX_SEQUENCES.
+ */
+static int sequence_shards_init(struct kv_cache_coordinator *coord, uint32_t shards)
+{
+    coord->sequence_shards = aligned_alloc(KV_CACHE_LINE_BYTES,
+                                           shards * sizeof(struct kv_sequence_shard));
+    if (!coord->sequence_shards)
+        return -1;
+    memset(coord->sequence_shards, 0, shards * sizeof(struct kv_sequence_shard));
+    coord->num_sequence_shards = shards;
+
+    for (uint32_t i = 0; i < shards; i++) {
+        struct kv_sequence_shard *shard = &coord->sequence_shards[i];
+
+        pthread_mutex_init(&shard->lock, NULL);
+        if (kv_index_init(&shard->index, KV_INDEX_MIN_CAPACITY) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Map the prefix cache snapshot, indexing the records a previous run
+ * left behind. The snapshot is optional: failing to open it only
+ * disables it.
+ */
+static void snapshot_init(struct kv_cache_coordinator *coord)
+{
+    struct kv_cache_config *config = &coord->config;
+    uint64_t capacity, start;
+    int restored;
+
+    config->snapshot_path[sizeof(config->snapshot_path) - 1] = '\0';
+    if (!config->snapshot_path[0])
+        return;
+    if (config->snapshot_interval_ms == 0)
+        config->snapshot_interval_ms = KV_CACHE_SNAPSHOT_INTERVAL_MS;
+
+    capacity = config->snapshot_bytes ? config->snapshot_bytes / coord->block_bytes :
+               coord->page_pool.total_pages;
+    if (capacity > coord->block_capacity)
+        capacity = coord->block_capacity;
+
+    coord->snapshot_tokens = malloc(config->block_size_tokens * sizeof(uint32_t));
+    coord->snapshot_buffer = malloc(coord->block_bytes);
+    if (!coord->snapshot_tokens || !coord->snapshot_buffer || capacity == 0) {
+        fprintf(stderr, "KV cache snapshot disabled: %s\n",
+                capacity ? "out of memory" : "smaller than one block");
+        return;
+    }
+
+    start = kv_cache_get_time_ns();
+    restored = kv_snapshot_open(&coord->snapshot, config->snapshot_path,
+                                (uint32_t)capacity, coord->block_bytes,
+                                config->block_size_tokens,
+                                (uint32_t)config->kv_precision);
+    if (restored < 0) {
+        fprintf(stderr, "KV cache snapshot disabled: cannot use %s\n",
+                config->snapshot_path);
+        return;
+    }
+
+    coord->snapshot_restore_ns = kv_cache_get_time_ns() - start;
+    printf("KV cache snapshot %s: %d prefix blocks restored in %.2f ms\n",
+           config->snapshot_path, restored, coord->snapshot_restore_ns / 1e6);
+}
+
+/* Initialize coordinator */
+int kv_cache_init(struct kv_cache_coordinator *coord,
+                 struct kv_cache_config *config)
+{
+    uint64_t hot_pages, slots;
+    uint32_t shards;
+
+    if (!coord || !config)
+        return -1;
+
+    memset(coord, 0, sizeof(*coord));
+    memcpy(&coord->config, config, sizeof(*config));
+
+    if (coord->config.page_size_bytes == 0)
+        coord->config.page_size_bytes = KV_CACHE_PAGE_SIZE;
+    if (coord->config.block_size_tokens == 0)
+        coord->config.block_size_tokens = KV_CACHE_DEFAULT_BLOCK_TOKENS;
+    if (coord->config.enable_prefetch && coord->config.prefetch_distance == 0)
+        coord->config.prefetch_distance = KV_CACHE_DEFAULT_PREFETCH_DISTANCE;
+    if (coord->config.route_load_epsilon <= 0.0f)
+        coord->config.route_load_epsilon = KV_CACHE_ROUTE_EPSILON;
+    if (coord->config.summary_interval_ms == 0)
+        coord->config.summary_interval_ms = KV_CACHE_SUMMARY_INTERVAL_MS;
+    if (coord->config.failure_phi_threshold <= 0.0f)
+        coord->config.failure_phi_threshold = KV_PHI_DEFAULT_THRESHOLD;
+
+    /* Shard counts are powers of two so a sequence hash masks to one */
+    if (coord->config.num_shards == 0)
+        coord->config.num_shards = KV_CACHE_DEFAULT_SHARDS;
+    if (coord->config.num_shards > KV_CACHE_MAX_SHARDS)
+        coord->config.num_shards = KV_CACHE_MAX_SHARDS;
+    for (shards = 1; shards < coord->config.num_shards; shards <<= 1)
+        ;
+    coord->config.num_shards = shards;
+
+    if (coord->config.kv_precision != KV_PRECISION_RAW) {
+        if (kv_quant_layout_init(&coord->hot_layout, coord->config.kv_precision,
+                                 coord->config.block_size_tokens,
+                                 coord->config.num_kv_heads,
+                                 coord->config.head_dim) != 0) {
+            fprintf(stderr, "Unsupported KV shape for %s\n",
+                    kv_precision_name(coord->config.kv_precision));
+            return -1;
+        }
+        coord->config.page_size_bytes = coord->hot_layout.tensor_bytes;
+
+        if (coord->config.cold_precision != KV_PRECISION_RAW &&
+            coord->config.cold_precision != coord->config.kv_precision &&
+            kv_quant_layout_init(&coord->cold_layout, coord->config.cold_precision,
+                                 coord->config.block_size_tokens,
+                                 coord->config.num_kv_heads,
+                                 coord->config.head_dim) != 0) {
+            fprintf(stderr, "Unsupported KV shape for %s\n",
+                    kv_precision_name(coord->config.cold_precision));
+            return -1;
+        }
+    }
+
+    coord->block_bytes = 2 * coord->config.page_size_bytes;
+    hot_pages = coord->config.total_capacity_bytes / coord->block_bytes;
+    if (hot_pages == 0) {
+        fprintf(stderr, "KV cache capacity below one block\n");
+        return -1;
+    }
+
+    coord->config.file_tier_path[sizeof(coord->config.file_tier_path) - 1] = '\0';
+    if (kv_tier_store_init(&coord->tiers,
+                           coord->cold_layout.tensor_bytes ?
+                           2 * coord->cold_layout.tensor_bytes : coord->block_bytes,
+                           coord->config.host_tier_bytes,
+                           coord->config.file_tier_path,
+                           coord->config.file_tier_bytes) != 0) {
+        fprintf(stderr, "Failed to set up KV cache spill tiers\n");
+        return -1;
+    }
+
+    /* Block metadata outlives residency: one slot per page in any tier */
+    slots = hot_pages + kv_tier_free_slots(&coord->tiers, KV_TIER_HOST) +
+            kv_tier_free_slots(&coord->tiers, KV_TIER_FILE);
+    if (slots > UINT32_MAX - 1) {
+        fprintf(stderr, "KV cache capacity too large\n");
+        kv_tier_store_destroy(&coord->tiers);
+        return -1;
+    }
+    coord->block_capacity = (uint32_t)slots;
+
+    /* Keep ~1/64 of the hot tier free when there is somewhere to spill */
+    if (slots > hot_pages)
+        coord->low_watermark_pages = (uint32_t)(hot_pages / 64) + 1;
+
+    coord->blocks = calloc(coord->block_capacity, sizeof(struct kv_cache_block));
+
+    if (!coord->blocks ||
+        block_shards_init(coord, shards) != 0 ||
+        sequence_shards_init(coord, shards) != 0 ||
+        kv_prefix_tree_init(&coord->prefix_tree, coord->config.block_size_tokens,
+                            coord->block_capacity) != 0 ||
+        kv_summary_init(&coord->summary, coord->block_capacity) != 0 ||
+        kv_ring_init(&coord->ring, KV_CACHE_MAX_NODES, 0) != 0 ||
+        kv_coh_outbox_init(&coord->outbox, coord->block_bytes) != 0 ||
+        kv_index_init(&coord->home_index, KV_INDEX_MIN_CAPACITY) != 0 ||
+        kv_index_init(&coord->replica_index, KV_INDEX_MIN_CAPACITY) != 0 ||
+        kv_repl_batch_init(&coord->repl_batch, coord->block_bytes) != 0 ||
+        kv_page_pool_init(&coord->page_pool, coord->block_bytes,
+                          (uint32_t)hot_pages, coord->config.numa_nodes) != 0) {
+        fprintf(stderr, "Failed to allocate KV cache tables\n");
+        coordinator_free(coord);
+        return -1;
+    }
+
+    pthread_mutex_init(&coord->node_lock, NULL);
+    pthread_mutex_init(&coord->prefix_lock, NULL);
+    pthread_rwlock_init(&coord->routing_lock, NULL);
+    pthread_rwlock_init(&coord->summary_lock, NULL);
+    pthread_mutex_init(&coord->coherency_lock, NULL);
+    pthread_mutex_init(&coord->replication_lock, NULL);
+    pthread_mutex_init(&coord->replication_flush_lock, NULL);
+    pthread_mutex_init(&coord->snapshot_lock, NULL);
+    pthread_mutex_init(&coord->prefetch_lock, NULL);
+    pthread_cond_init(&coord->prefetch_cond, NULL);
+
+    snapshot_init(coord);
+
+    {
+        const struct kv_xfer_ops ops = {
+            .ctx = coord,
+            .prepare = xfer_prepare,
+            .complete = xfer_complete,
+            .recv_chunk = xfer_recv_chunk,
+            .recv_end = xfer_recv_end,
+            .recv_control = xfer_recv_control,
+        };
+
+        if (kv_transport_init(&coord->transport, &ops,
+                              coord->config.local_node_id) != 0)
+            fprintf(stderr, "KV cache transfers disabled: no transport\n");
+    }
+
+    coord->running = true;
+    if (pthread_create(&coord->coordinator_thread, NULL,
+                       coordinator_thread_fn, coord) != 0) {
+        fprintf(stderr, "Failed to start KV cache coordinator thread\n");
+        coord->running = false;
+    }
+
+    printf("KV cache initialized: %u hot blocks x %u bytes (%s), %u tokens/block, "
+           "%u arena(s)%s, %u host + %u file spill slots, %u shards\n",
+           coord->page_pool.total_pages, coord->block_bytes,
+           kv_precision_name(coord->config.kv_precision),
+           coord->config.block_size_tokens, coord->page_pool.num_arenas,
+           coord->page_pool.arenas[0].hugepages ? " on hugepages" : "",
+           kv_tier_free_slots(&coord->tiers, KV_TIER_HOST),
+           kv_tier_free_slots(&coord->tiers, KV_TIER_FILE),
+           coord->num_block_shards);
+
+    return 0;
+}
+
+/* Cleanup coordinator */
+void kv_cache_cleanup(struct kv_cache_coordinator *coord)
+{
+    struct kv_shard_stats sum;
+
+    if (!coord || !coord->blocks)
+        return;
+
+    /* Last notices and replica updates go out before the connections close */
+    if (coord->config.coherency_protocol != KV_COHERENCY_NONE)
+        coh_flush(coord, false, 0);
+    repl_flush(coord, 0, 0);
+
+    /* Unpins in-flight sends and releases half-received sequences */
+    kv_transport_shutdown(&coord->transport);
+
+    if (coord->running) {
+        pthread_mutex_lock(&coord->prefetch_lock);
+        coord->running = false;
+        pthread_cond_broadcast(&coord->prefetch_cond);
+        pthread_mutex_unlock(&coord->prefetch_lock);
+        pthread_join(coord->coordinator_thread, NULL);
+    }
+
+    /* What the flusher had not written yet, and the write-back */
+    snapshot_flush(coord, true);
+
+    shard_stats_sum(coord, &sum);
+    printf("KV cache cleanup complete: %llu requests, %.1f%% hit rate\n",
+           (unsigned long long)sum.requests,
+           kv_cache_calculate_hit_rate(coord));
+
+    coordinator_free(coord);
+
+    pthread_mutex_destroy(&coord->node_lock);
+    pthread_mutex_destroy(&coord->prefix_lock);
+    pthread_rwlock_destroy(&coord->routing_lock);
+    pthread_rwlock_destroy(&coord->summary_lock);
+    pthread_mutex_destroy(&coord->coherency_lock);
+    pthread_mutex_destroy(&coord->replication_lock);
+    pthread_mutex_destroy(&coord->replication_flush_lock);
+    pthread_mutex_destroy(&coord->snapshot_lock);
+    pthread_mutex_destroy(&coord->prefetch_lock);
+    pthread_cond_destroy(&coord->prefetch_cond);
+}
+
+/* Register a cache node */
+int kv_cache_register_node(struct kv_cache_coordinator *coord,
+                          struct kv_cache_node *node)
+{
+    uint32_t node_id;
+
+    if (!coord || !node)
+        return -1;
+
+    pthread_mutex_lock(&coord->node_lock);
+
+    if (coord->num_nodes >= KV_CACHE_MAX_NODES) {
+        pthread_mutex_unlock(&coord->node_lock);
+        return -1;
+    }
+
+    node_id = coord->num_nodes;
+    memcpy(&coord->nodes[node_id], node, sizeof(*node));
+    coord->nodes[node_id].node_id = node_id;
+    coord->nodes[node_id].used_capacity_bytes = 0;
+    coord->nodes[node_id].num_blocks = 0;
+    coord->nodes[node_id].online = true;
+    coord->nodes[node_id].last_heartbeat_ns = kv_cache_get_time_ns();
+    kv_phi_init(&coord->node_phi[node_id], coord->nodes[node_id].last_heartbeat_ns,
+                coord->config.heartbeat_interval_ms * 1000000ULL);
+    coord->num_nodes++;
+
+    pthread_mutex_unlock(&coord->node_lock);
+
+    route_node_join(coord, node_id);
+
+    printf("Registered KV cache node %u: %s:%u\n", node_id, node->hostname,
+           node->port);
+
+    return node_id;
+}
+
+/* Take a node out of service (its id is never reused) */
+int kv_cache_unregister_node(struct kv_cache_coordinator *coord,
+                            uint32_t node_id)
+{
+    if (!coord)
+        return -1;
+
+    pthread_mutex_lock(&coord->node_lock);
+
+    if (node_id >= coord->num_nodes) {
+        pthread_mutex_unlock(&coord->node_lock);
+        return -1;
+    }
+
+    coord->nodes[node_id].online = false;
+
+    pthread_mutex_unlock(&coord->node_lock);
+
+    route_node_leave(coord, node_id);
+
+    return 0;
+}
+
+/* Record a node heartbeat */
+int kv_cache_node_heartbeat(struct kv_cache_coordinator *coord,
+                           uint32_t node_id)
+{
+    bool rejoined;
+
+    if (!coord)
+        return -1;
+
+    pthread_mutex_lock(&coord->node_lock);
+
+    if (node_id >= coord->num_nodes) {
+        pthread_mutex_unlock(&coord->node_lock);
+        return -1;
+    }
+
+    coord->nodes[node_id].last_heartbeat_ns = kv_cache_get_time_ns();
+    rejoined = !coord->nodes[node_id].online;
+    coord->nodes[node_id].online = true;
+
+    /* A node back from the dead starts a fresh interval history */
+    if (rejoined)
+        kv_phi_init(&coord->node_phi[node_id], coord->nodes[node_id].last_heartbeat_ns,
+                    coord->config.heartbeat_interval_ms * 1000000ULL);
+    else
+        kv_phi_heartbeat(&coord->node_phi[node_id],
+                         coord->nodes[node_id].last_heartbeat_ns);
+    node_sync_locked(coord);
+
+    pthread_mutex_unlock(&coord->node_lock);
+
+    if (rejoined)
+        route_node_join(coord, node_id);
+
+    return 0;
+}
+
+/* Allocate a block at the end of a sequence */
+int kv_cache_allocate_block(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           struct kv_cache_block **block)
+{
+    struct kv_sequence_shard *sshard;
+    struct kv_block_shard *bshard;
+    struct kv_sequence *seq;
+    struct kv_cache_block *blk;
+
+    if (!coord || !block)
+        return -1;
+
+    sshard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&sshard->lock);
+
+    seq = seq_lookup(sshard, sequence_id);
+    if (!seq || kv_block_table_reserve(&seq->blocks, seq->num_blocks + 1) != 0) {
+        pthread_mutex_unlock(&sshard->lock);
+        return -1;
+    }
+
+    blk = block_alloc_reclaim(coord, sequence_id, seq->num_blocks,
+                              seq->preferred_node_id, &bshard);
+    if (!blk) {
+        pthread_mutex_unlock(&sshard->lock);
+        return -1;
+    }
+
+    kv_block_table_set(&seq->blocks, seq->num_blocks++, (uint32_t)blk->block_id);
+    seq_touch_locked(coord, seq, blk->last_access_time_ns);
+    blk->replicas = seq->replica_nodes;
+    pthread_mutex_unlock(&bshard->lock);
+
+    pthread_mutex_unlock(&sshard->lock);
+
+    *block = blk;
+    return 0;
+}
+
+/* Look up a block by id, counting a hit or a miss */
+int kv_cache_get_block(struct kv_cache_coordinator *coord,
+                      uint64_t block_id,
+                      struct kv_cache_block **block)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+
+    if (!coord || !block)
+        return -1;
+
+    *block = NULL;
+
+    /* Ids that cannot name a slot count as misses against shard 0 */
+    shard = block_shard(coord, block_id);
+    if (!shard)
+        shard = &coord->block_shards[0];
+
+    pthread_mutex_lock(&shard->lock);
+
+    blk = block_lookup(coord, shard, block_id);
+    shard->stats.requests++;
+
+    if (!kv_cache_block_is_cached(blk)) {
+        shard->stats.misses++;
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    /* Spilled: swap back in on demand */
+    if (blk->tier != KV_TIER_HOT && block_promote_locked(coord, shard, blk) != 0) {
+        shard->stats.misses++;
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    shard->stats.hits++;
+    blk->last_access_time_ns = kv_cache_get_time_ns();
+    blk->access_count++;
+    block_touch_locked(coord, shard, blk);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    *block = blk;
+    return 0;
+}
+
+/* Look up the @block_index'th block of a sequence */
+int kv_cache_get_sequence_block(struct kv_cache_coordinator *coord,
+                               uint64_t sequence_id,
+                               uint32_t block_index,
+                               struct kv_cache_block **block)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    uint64_t block_id;
+
+    if (!coord || !block)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq || block_index >= seq->num_blocks) {
+        pthread_mutex_unlock(&shard->lock);
+        *block = NULL;
+        return -1;
+    }
+
+    block_id = seq_block_id(coord, seq, block_index);
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    if (coord->config.enable_prefetch)
+        prefetch_sequence_locked(coord, seq, block_index + 1,
+                                 coord->config.prefetch_distance);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return kv_cache_get_block(coord, block_id, block);
+}
+
+/* Drop a reference to a block, freeing it when unreferenced. Only for
+ * references the caller took; a sequence's go with the sequence. */
+int kv_cache_free_block(struct kv_cache_coordinator *coord,
+                       uint64_t block_id)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+
+    if (!coord)
+        return -1;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+
+    blk = block_lookup(coord, shard, block_id);
+    if (!blk) {
+        block_shard_switch(coord, shard, 0);
+        return -1;
+    }
+
+    block_put_locked(coord, shard, blk);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/* Drop @seq's block at @index back to the pool (sequence shard locked,
+ * @held as for block_shard_switch()) */
+static struct kv_block_shard *retention_drop_locked(struct kv_cache_coordinator *coord,
+                                                    struct kv_sequence *seq,
+                                                    uint32_t index,
+                                                    struct kv_block_shard *held)
+{
+    uint64_t id = seq_block_id(coord, seq, index);
+    struct kv_cache_block *blk;
+
+    if (!id)
+        return held;
+
+    held = block_shard_switch(coord, held, id);
+    blk = block_lookup(coord, held, id);
+    if (blk) {
+        block_put_locked(coord, held, blk);
+        held->stats.retention_drops++;
+    }
+    kv_block_table_set(&seq->blocks, index, KV_BLOCK_TABLE_NONE);
+
+    return held;
+}
+
+/* Take the lowest scored of @seq's retained heavy blocks off the list
+ * and return its index (sequence shard locked, @held as above) */
+static uint32_t retention_weakest(struct kv_cache_coordinator *coord,
+                                  struct kv_sequence *seq,
+                                  struct kv_block_shard **held)
+{
+    uint32_t weakest = 0, index;
+    float low = 0.0f;
+
+    for (uint32_t i = 0; i < seq->num_retained; i++) {
+        uint64_t id = seq_block_id(coord, seq, seq->retained[i]);
+        struct kv_cache_block *blk;
+        float score;
+
+        *held = block_shard_switch(coord, *held, id);
+        blk = block_lookup(coord, *held, id);
+        score = blk ? blk->attention_score : 0.0f;
+        if (i == 0 || score < low) {
+            weakest = i;
+            low = score;
+        }
+    }
+
+    index = seq->retained[weakest];
+    seq->retained[weakest] = seq->retained[--seq->num_retained];
+    return index;
+}
+
+/*
+ * Drop the blocks @seq's retention policy no longer keeps: those wholly
+ * behind the window, past the sinks and not among the heavy_blocks
+ * highest scored of them. Each block is judged once, when it falls
+ * behind (sequence shard locked, no block shard).
+ */
+static void retention_apply_locked(struct kv_cache_coordinator *coord,
+                                   struct kv_sequence *seq)
+{
+    const struct kv_retention_policy *policy = &seq->retention;
+    uint32_t bs = coord->config.block_size_tokens;
+    uint32_t sinks = policy->sink_tokens / bs + (policy->sink_tokens % bs != 0);
+    struct kv_block_shard *held = NULL;
+    uint32_t behind;
+
+    if (!policy->window_tokens || seq->sequence_length <= policy->window_tokens)
+        return;
+
+    behind = (seq->sequence_length - policy->window_tokens) / bs;
+    if (behind > seq->num_blocks)
+        behind = seq->num_blocks;
+    if (seq->retain_next < sinks)
+        seq->retain_next = sinks;
+
+    for (; seq->retain_next < behind; seq->retain_next++) {
+        uint32_t index = seq->retain_next;
+
+        if (policy->heavy_blocks && seq_block_id(coord, seq, index)) {
+            seq->retained[seq->num_retained++] = index;
+            if (seq->num_retained <= policy->heavy_blocks)
+                continue;
+            index = retention_weakest(coord, seq, &held);
+        }
+        held = retention_drop_locked(coord, seq, index, held);
+    }
+    block_shard_switch(coord, held, 0);
+}
+
+/*
+ * Reserve @blocks for a new sequence if the cache can hold them on top
+ * of the blocks in use and every other reservation. Blocks only the
+ * prefix cache references count as free, since allocation reclaims them;
+ * ones a sequence also holds do not (no lock held).
+ */
+static bool admission_reserve(struct kv_cache_coordinator *coord, uint32_t blocks)
+{
+    uint64_t reserved, used = 0, reclaimable;
+
+    if (blocks == 0)
+        return true;
+
+    reserved = atomic_fetch_add_explicit(&coord->reserved_blocks, blocks,
+                                         memory_order_relaxed) + blocks;
+
+    for (uint32_t i = 0; i < KV_CACHE_MAX_NODES; i++)
+        used += (uint32_t)atomic_load_explicit(&coord->node_num_blocks[i],
+                                               memory_order_relaxed);
+
+    reclaimable = atomic_load_explicit(&coord->prefix_only_blocks,
+                                       memory_order_relaxed);
+    used = used > reclaimable ? used - reclaimable : 0;
+    if (used + reserved <= coord->block_capacity)
+        return true;
+
+    atomic_fetch_sub_explicit(&coord->reserved_blocks, blocks, memory_order_relaxed);
+    atomic_fetch_add_explicit(&coord->admission_rejects, 1, memory_order_relaxed);
+    return false;
+}
+
+/*
+ * Preempt @seq to free what @slots says is short: block slots, or only
+ * hot pages. Swapping keeps its blocks in a spill tier and costs moving
+ * them out and back in; recomputing drops them and costs a prefill of
+ * the same blocks. Swapping is taken when the tiers have room for the
+ * sequence's private hot blocks, it frees what is short and it is the
+ * cheaper of the two. Blocks shared with the prefix cache or other
+ * sequences stay where they are (@seq's shard locked, no block shard).
+ */
+static enum kv_preemption preempt_locked(struct kv_cache_coordinator *coord,
+                                         struct kv_sequence *seq, bool slots)
+{
+    struct kv_block_shard *held = NULL;
+    uint32_t hot = 0, room;
+    enum kv_block_tier tier;
+    float recompute = 0.0f;
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        uint64_t id = seq_block_id(coord, seq, i);
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (!blk || blk->ref_count > 1)
+            continue;
+        recompute += block_recompute_cost(blk);
+        hot += blk->tier == KV_TIER_HOT;
+    }
+    held = block_shard_switch(coord, held, 0);
+
+    tier = kv_tier_free_slots(&coord->tiers, KV_TIER_HOST) >= hot ?
+           KV_TIER_HOST : KV_TIER_FILE;
+    room = kv_tier_free_slots(&coord->tiers, KV_TIER_HOST) +
+           kv_tier_free_slots(&coord->tiers, KV_TIER_FILE);
+
+    if (!slots && hot > 0 && room >= hot &&
+        2.0f * (float)hot * kv_tier_swap_in_cost_ms(tier, coord->block_bytes) < recompute) {
+        for (uint32_t i = 0; i < seq->num_blocks; i++) {
+            uint64_t id = seq_block_id(coord, seq, i);
+            struct kv_cache_block *blk;
+
+            held = block_shard_switch(coord, held, id);
+            blk = block_lookup(coord, held, id);
+            if (blk && blk->ref_count == 1 && blk->tier == KV_TIER_HOT)
+                block_demote_locked(coord, held, blk, tier);
+        }
+        block_shard_switch(coord, held, 0);
+
+        seq->preempted = KV_PREEMPT_SWAP;
+        seq_lru_update(coord, seq);
+        atomic_fetch_add_explicit(&coord->preempt_swaps, 1, memory_order_relaxed);
+        return KV_PREEMPT_SWAP;
+    }
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        uint64_t id = seq_block_id(coord, seq, i);
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (blk)
+            block_put_locked(coord, held, blk);
+    }
+    block_shard_switch(coord, held, 0);
+
+    seq->recompute_tokens = seq->sequence_length;
+    seq->num_blocks = 0;
+    seq->sequence_length = 0;
+    seq->prefix_hash = 0;
+    seq->prefix_length = 0;
+    seq->prefix_cached = false;
+    seq->retain_next = 0;
+    seq->num_retained = 0;
+    kv_block_table_trim(&seq->blocks, KV_BLOCK_TABLE_CHUNK);
+
+    seq->preempted = KV_PREEMPT_RECOMPUTE;
+    seq_lru_update(coord, seq);
+    atomic_fetch_add_explicit(&coord->preempt_recomputes, 1, memory_order_relaxed);
+    return KV_PREEMPT_RECOMPUTE;
+}
+
+/*
+ * Preempt the least recently used sequence holding blocks, other than
+ * @sequence_id and those already preempted, to make room for one more
+ * block. Only the head of each shard's list is looked at. Returns false
+ * if there was none (no lock held).
+ */
+static bool preempt_victim(struct kv_cache_coordinator *coord, uint64_t sequence_id)
+{
+    bool slots = kv_page_pool_free_pages(&coord->page_pool) > 0;
+    uint64_t victim = 0, oldest = UINT64_MAX;
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    bool found = false;
+
+    for (uint32_t i = 0; i < coord->num_sequence_shards; i++) {
+        shard = &coord->sequence_shards[i];
+
+        pthread_mutex_lock(&shard->lock);
+        seq = shard->lru_head;
+        if (seq && seq->sequence_id == sequence_id)
+            seq = seq->lru_next;
+        if (seq && seq->last_access_time_ns < oldest) {
+            victim = seq->sequence_id;
+            oldest = seq->last_access_time_ns;
+            found = true;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    if (!found)
+        return false;
+
+    shard = seq_shard(coord, victim);
+    pthread_mutex_lock(&shard->lock);
+    seq = seq_lookup(shard, victim);
+    found = seq && seq->preempted == KV_PREEMPT_NONE && seq->num_blocks > 0;
+    if (found)
+        preempt_locked(coord, seq, slots);
+    pthread_mutex_unlock(&shard->lock);
+
+    return found;
+}
+
+/* Create a sequence */
+int kv_cache_create_sequence(struct kv_cache_coordinator *coord,
+                            uint64_t sequence_id,
+                            uint32_t estimated_length)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    uint32_t slot, reserve = 0;
+
+    if (!coord)
+        return -1;
+
+    if (coord->config.enable_admission_control) {
+        reserve = estimated_length / coord->config.block_size_tokens +
+                  (estimated_length % coord->config.block_size_tokens != 0);
+        if (!admission_reserve(coord, reserve))
+            return -1;
+    }
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    if (seq_lookup(shard, sequence_id) ||
+        (shard->free_count == 0 && seq_shard_grow(shard) != 0))
+        goto fail;
+
+    if (atomic_fetch_add_explicit(&coord->num_sequences, 1,
+                                  memory_order_relaxed) >= KV_CACHE_MAX_SEQUENCES) {
+        atomic_fetch_sub_explicit(&coord->num_sequences, 1, memory_order_relaxed);
+        goto fail;
+    }
+
+    slot = shard->free_slots[shard->free_count - 1];
+    if (kv_index_insert(&shard->index, sequence_id, slot) != 0) {
+        atomic_fetch_sub_explicit(&coord->num_sequences, 1, memory_order_relaxed);
+        goto fail;
+    }
+    shard->free_count--;
+
+    seq = seq_slot(shard, slot);
+    seq->sequence_id = sequence_id;
+    seq->num_blocks = 0;
+    seq->sequence_length = 0;
+    seq->created_time_ns = kv_cache_get_time_ns();
+    seq->last_access_time_ns = seq->created_time_ns;
+    seq->prefix_hash = 0;
+    seq->prefix_length = 0;
+    seq->prefix_cached = false;
+    seq->route_epoch = 0;
+    route_sequence_locked(coord, seq);
+    seq->cache_hit_rate = 0.0f;
+    seq->replica_nodes = route_replicas(coord, sequence_id);
+    memset(&seq->retention, 0, sizeof(seq->retention));
+    seq->retain_next = 0;
+    seq->num_retained = 0;
+    seq->reserved_blocks = reserve;
+    seq->preempted = KV_PREEMPT_NONE;
+    seq->recompute_tokens = 0;
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+
+fail:
+    pthread_mutex_unlock(&shard->lock);
+    if (reserve)
+        atomic_fetch_sub_explicit(&coord->reserved_blocks, reserve, memory_order_relaxed);
+    return -1;
+}
+
+/* Extend a sequence, allocating blocks as token boundaries are crossed */
+int kv_cache_append_tokens(struct kv_cache_coordinator *coord,
+                          uint64_t sequence_id,
+                          uint32_t num_tokens)
+{
+    struct kv_sequence_shard *sshard;
+    uint32_t tokens_per_block, preempted = 0;
+    struct kv_sequence *seq;
+    bool notified = false;
+    int ret = 0;
+
+    if (!coord)
+        return -1;
+
+    tokens_per_block = coord->config.block_size_tokens;
+
+    sshard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&sshard->lock);
+
+    seq = seq_lookup(sshard, sequence_id);
+    if (!seq || seq->preempted != KV_PREEMPT_NONE) {
+        pthread_mutex_unlock(&sshard->lock);
+        return -1;
+    }
+
+    while (num_tokens > 0) {
+        uint32_t offset = seq->sequence_length % tokens_per_block;
+        struct kv_block_shard *bshard;
+        struct kv_cache_block *blk;
+        uint32_t take;
+
+        if (offset == 0) {
+            /* Current block is full (or none yet): start a new one */
+            if (kv_block_table_reserve(&seq->blocks, seq->num_blocks + 1) != 0) {
+                ret = -1;
+                break;
+            }
+
+            blk = block_alloc_reclaim(coord, sequence_id, seq->num_blocks,
+                                      seq->preferred_node_id, &bshard);
+            if (!blk) {
+                bool freed;
+
+                if (!coord->config.enable_preemption ||
+                    preempted++ == KV_CACHE_PREEMPT_MAX) {
+                    ret = -1;
+                    break;
+                }
+
+                /* Make room at another sequence's expense, then retry */
+                pthread_mutex_unlock(&sshard->lock);
+                freed = preempt_victim(coord, sequence_id);
+                pthread_mutex_lock(&sshard->lock);
+
+                seq = seq_lookup(sshard, sequence_id);
+                if (!seq) {
+                    pthread_mutex_unlock(&sshard->lock);
+                    return -1;
+                }
+                if (!freed || seq->preempted != KV_PREEMPT_NONE) {
+                    ret = -1;
+                    break;
+                }
+                continue;
+            }
+            kv_block_table_set(&seq->blocks, seq->num_blocks++,
+                               (uint32_t)blk->block_id);
+            seq_fill_reserved(coord, seq, 1);
+        } else {
+            uint64_t last = seq_block_id(coord, seq, seq->num_blocks - 1);
+
+            bshard = block_shard_switch(coord, NULL, last);
+            blk = block_lookup(coord, bshard, last);
+            if (blk && blk->ref_count > 1) {
+                /* Shared and immutable: append into a private copy */
+                block_shard_switch(coord, bshard, 0);
+                blk = block_cow(coord, seq, &bshard);
+                if (!blk) {
+                    ret = -1;
+                    break;
+                }
+            } else if (!blk) {
+                block_shard_switch(coord, bshard, 0);
+                ret = -1;
+                break;
+            }
+        }
+
+        take = tokens_per_block - offset;
+        if (take > num_tokens)
+            take = num_tokens;
+
+        blk->num_tokens += take;
+        block_touch_locked(coord, bshard, blk);
+        notified |= coh_write_locked(coord, blk);
+        blk->dirty = true;
+        blk->state = KV_BLOCK_MODIFIED;
+        blk->last_access_time_ns = kv_cache_get_time_ns();
+        blk->replicas |= seq->replica_nodes;
+        repl_dirty_locked(coord, blk);
+        pthread_mutex_unlock(&bshard->lock);
+
+        seq->sequence_length += take;
+        num_tokens -= take;
+    }
+
+    if (seq->retention.window_tokens)
+        retention_apply_locked(coord, seq);
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    pthread_mutex_unlock(&sshard->lock);
+
+    /* STRONG: no stale copy survives the call */
+    if (notified && coord->config.coherency_protocol == KV_COHERENCY_STRONG &&
+        coh_flush(coord, true, KV_CACHE_COHERENCY_TIMEOUT_MS) != 0)
+        ret = -1;
+
+    return ret;
+}
+
+/* Free a sequence and drop its references to its blocks */
+int kv_cache_free_sequence(struct kv_cache_coordinator *coord,
+                          uint64_t sequence_id)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    uint32_t slot;
+
+    if (!coord)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    if (!kv_index_remove(&shard->index, sequence_id, &slot)) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    seq = seq_slot(shard, slot);
+    route_release_locked(coord, seq);
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        struct kv_cache_block *blk;
+        uint64_t id = seq_block_id(coord, seq, i);
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (blk)
+            block_put_locked(coord, held, blk);
+    }
+    block_shard_switch(coord, held, 0);
+
+    seq->num_blocks = 0;
+    seq->sequence_length = 0;
+    seq_lru_update(coord, seq);
+    kv_block_table_trim(&seq->blocks, KV_BLOCK_TABLE_CHUNK);
+    free(seq->retained);
+    seq->retained = NULL;
+    seq->retained_capacity = 0;
+    seq->num_retained = 0;
+    seq_fill_reserved(coord, seq, seq->reserved_blocks);
+    shard->free_slots[shard->free_count++] = slot;
+    atomic_fetch_sub_explicit(&coord->num_sequences, 1, memory_order_relaxed);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/*
+ * Give empty sequence @seq_id_2 everything @seq_id_1 holds so far. Both
+ * then reference the same immutable blocks; whichever appends into the
+ * shared partial last block first copies that one block. Returns the
+ * number of tokens shared.
+ */
+int kv_cache_share_prefix(struct kv_cache_coordinator *coord,
+                         uint64_t seq_id_1,
+                         uint64_t seq_id_2)
+{
+    struct seq_fork_state state;
+    uint64_t *block_ids;
+    int ret;
+
+    if (!coord || seq_id_1 == seq_id_2)
+        return -1;
+
+    if (seq_share_refs(coord, seq_id_1, 1, &block_ids, &state) != 0)
+        return -1;
+
+    ret = (int)state.sequence_length;
+    if (seq_install_shared(coord, seq_id_2, block_ids, &state) != 0) {
+        blocks_put(coord, block_ids, state.num_blocks, 1);
+        ret = -1;
+    }
+
+    free(block_ids);
+    return ret;
+}
+
+/* Create @child_id as a copy-on-write clone of @parent_id */
+int kv_cache_fork_sequence(struct kv_cache_coordinator *coord,
+                           uint64_t parent_id,
+                           uint64_t child_id)
+{
+    return kv_cache_fork_beams(coord, parent_id, &child_id, 1);
+}
+
+/*
+ * Create @num_children copy-on-write clones of @parent_id (beam search,
+ * parallel sampling). Cost is one reference update per parent block per
+ * child; no KV data is copied. Either every child is created or none
+ * is. Returns the number of tokens each child starts with.
+ */
+int kv_cache_fork_beams(struct kv_cache_coordinator *coord,
+                        uint64_t parent_id,
+                        const uint64_t *child_ids,
+                        uint32_t num_children)
+{
+    struct seq_fork_state state;
+    uint64_t *block_ids;
+    uint32_t i;
+
+    if (!coord || !child_ids || num_children == 0)
+        return -1;
+
+    if (seq_share_refs(coord, parent_id, num_children, &block_ids, &state) != 0)
+        return -1;
+
+    for (i = 0; i < num_children; i++) {
+        if (child_ids[i] == parent_id ||
+            kv_cache_create_sequence(coord, child_ids[i], 0) != 0)
+            break;
+        if (seq_install_shared(coord, child_ids[i], block_ids, &state) != 0) {
+            kv_cache_free_sequence(coord, child_ids[i]);
+            break;
+        }
+    }
+
+    if (i < num_children) {
+        /* Children made so far give back their references when freed */
+        for (uint32_t j = 0; j < i; j++)
+            kv_cache_free_sequence(coord, child_ids[j]);
+        blocks_put(coord, block_ids, state.num_blocks, num_children - i);
+        free(block_ids);
+        return -1;
+    }
+
+    free(block_ids);
+    return (int)state.sequence_length;
+}
+
+/*
+ * Give @sequence_id a retention policy (NULL keeps every block again)
+ * and apply it at once: every block already behind the new window is
+ * judged afresh. Dropped blocks stay dropped.
+ */
+int kv_cache_set_retention(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const struct kv_retention_policy *policy)
+{
+    static const struct kv_retention_policy keep_all;
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+
+    if (!coord)
+        return -1;
+    if (!policy)
+        policy = &keep_all;
+    if (policy->heavy_blocks >= coord->block_capacity)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    /* Room for one candidate over the budget */
+    if (policy->heavy_blocks + 1 > seq->retained_capacity) {
+        uint32_t *retained = realloc(seq->retained,
+                                     (policy->heavy_blocks + 1) * sizeof(*retained));
+
+        if (!retained) {
+            pthread_mutex_unlock(&shard->lock);
+            return -1;
+        }
+        seq->retained = retained;
+        seq->retained_capacity = policy->heavy_blocks + 1;
+    }
+
+    seq->retention = *policy;
+    seq->retain_next = 0;
+    seq->num_retained = 0;
+    retention_apply_locked(coord, seq);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/*
+ * Preempt @sequence_id now, as allocation does under pressure. Returns
+ * how (enum kv_preemption), or -1 if there is no such sequence or it is
+ * preempted already.
+ */
+int kv_cache_preempt_sequence(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    int ret = -1;
+
+    if (!coord)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+    seq = seq_lookup(shard, sequence_id);
+    if (seq && seq->preempted == KV_PREEMPT_NONE)
+        ret = (int)preempt_locked(coord, seq, false);
+    pthread_mutex_unlock(&shard->lock);
+
+    return ret;
+}
+
+/*
+ * Let a preempted sequence run again. A swapped one has its blocks
+ * queued to come back in; a dropped one is empty, and the return value
+ * is the number of tokens to prefill again (kv_cache_attach_prefix()
+ * first may cover some). 0 if it was not preempted, -1 if there is no
+ * such sequence.
+ */
+int kv_cache_resume_sequence(struct kv_cache_coordinator *coord,
+                             uint64_t sequence_id)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    int ret = 0;
+
+    if (!coord)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    if (seq->preempted == KV_PREEMPT_SWAP)
+        prefetch_sequence_locked(coord, seq, 0, seq->num_blocks);
+    else if (seq->preempted == KV_PREEMPT_RECOMPUTE)
+        ret = (int)seq->recompute_tokens;
+    seq->preempted = KV_PREEMPT_NONE;
+    seq->recompute_tokens = 0;
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return ret;
+}
+
+/*
+ * Add the engine's attention scores for blocks [first_block, first_block
+ * + num_blocks) of @sequence_id, e.g. the attention each block received
+ * in the last step summed over heads and queries. Scores accumulate
+ * (a block shared between sequences pools theirs); retention keeps the
+ * heavy_blocks highest totals behind the window.
+ */
+int kv_cache_update_attention(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              uint32_t first_block,
+                              const float *scores,
+                              uint32_t num_blocks)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+
+    if (!coord || (!scores && num_blocks))
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < num_blocks && first_block + i < seq->num_blocks; i++) {
+        uint64_t id = seq_block_id(coord, seq, first_block + i);
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (blk)
+            blk->attention_score += scores[i];
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/*
+ * Quantize @num_tokens tokens of keys and values into a block starting
+ * at @token_offset. Tokens before the offset are kept (scales widen as
+ * needed); offset 0 rewrites the block from scratch.
+ */
+int kv_cache_write_kv(struct kv_cache_coordinator *coord,
+                     uint64_t block_id,
+                     uint32_t token_offset,
+                     uint32_t num_tokens,
+                     const float *keys,
+                     const float *values)
+{
+    const struct kv_quant_layout *layout;
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+    bool notified;
+    uint64_t count;
+
+    if (!coord || !keys || !values || coord->hot_layout.tensor_bytes == 0)
+        return -1;
+
+    layout = &coord->hot_layout;
+    if (token_offset + (uint64_t)num_tokens > layout->tokens)
+        return -1;
+    count = (uint64_t)num_tokens * layout->heads * layout->head_dim;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+
+    /* Shared blocks are immutable; appending copies them first */
+    blk = block_lookup(coord, shard, block_id);
+    if (!blk || blk->ref_count > 1 ||
+        block_promote_locked(coord, shard, blk) < 0) {
+        block_shard_switch(coord, shard, 0);
+        return -1;
+    }
+
+    kv_quant_write(layout, blk->key_data, token_offset, num_tokens,
+                   token_offset, keys);
+    kv_quant_write(layout, blk->value_data, token_offset, num_tokens,
+                   token_offset, values);
+
+    /* Accuracy drift: read back what was stored and compare */
+    if (coord->config.max_quant_error > 0.0f) {
+        float *scratch = shard->quant_scratch;
+
+        kv_quant_read(layout, blk->key_data, token_offset, num_tokens, scratch);
+        kv_quant_read(layout, blk->value_data, token_offset, num_tokens,
+                      scratch + count);
+        if (kv_quant_relative_error(keys, scratch, (uint32_t)count) >
+            coord->config.max_quant_error ||
+            kv_quant_relative_error(values, scratch + count, (uint32_t)count) >
+            coord->config.max_quant_error)
+            shard->stats.quant_drift_events++;
+    }
+
+    if (blk->num_tokens < token_offset + num_tokens)
+        blk->num_tokens = token_offset + num_tokens;
+    notified = coh_write_locked(coord, blk);
+    blk->state = KV_BLOCK_MODIFIED;
+    blk->dirty = true;
+    blk->last_access_time_ns = kv_cache_get_time_ns();
+    block_touch_locked(coord, shard, blk);
+    repl_dirty_locked(coord, blk);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    if (notified && coord->config.coherency_protocol == KV_COHERENCY_STRONG)
+        return coh_flush(coord, true, KV_CACHE_COHERENCY_TIMEOUT_MS);
+
+    return 0;
+}
+
+/* Dequantize tokens of a block into fp32 keys and values */
+int kv_cache_read_kv(struct kv_cache_coordinator *coord,
+                    uint64_t block_id,
+                    uint32_t token_offset,
+                    uint32_t num_tokens,
+                    float *keys,
+                    float *values)
+{
+    const struct kv_quant_layout *layout;
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+
+    if (!coord || !keys || !values || coord->hot_layout.tensor_bytes == 0)
+        return -1;
+
+    layout = &coord->hot_layout;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+
+    blk = block_lookup(coord, shard, block_id);
+    if (!kv_cache_block_is_cached(blk) ||
+        block_promote_locked(coord, shard, blk) != 0 ||
+        token_offset + (uint64_t)num_tokens > blk->num_tokens) {
+        block_shard_switch(coord, shard, 0);
+        return -1;
+    }
+
+    kv_quant_read(layout, blk->key_data, token_offset, num_tokens, keys);
+    kv_quant_read(layout, blk->value_data, token_offset, num_tokens, values);
+    blk->last_access_time_ns = kv_cache_get_time_ns();
+    block_touch_locked(coord, shard, blk);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/* Spill a block's data to @tier (KV_TIER_NONE drops it for recompute) */
+int kv_cache_demote_block(struct kv_cache_coordinator *coord,
+                         uint64_t block_id,
+                         enum kv_block_tier tier)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+    int ret = -1;
+
+    if (!coord || tier == KV_TIER_HOT)
+        return -1;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+    blk = block_lookup(coord, shard, block_id);
+    if (kv_cache_block_is_cached(blk))
+        ret = block_demote_locked(coord, shard, blk, tier);
+    block_shard_switch(coord, shard, 0);
+
+    return ret;
+}
+
+/* Spill every resident block of a paused sequence. Returns blocks moved. */
+int kv_cache_demote_sequence(struct kv_cache_coordinator *coord,
+                            uint64_t sequence_id,
+                            enum kv_block_tier tier)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    int moved = 0;
+
+    if (!coord || tier == KV_TIER_HOT)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        struct kv_cache_block *blk;
+        uint64_t id = seq_block_id(coord, seq, i);
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (kv_cache_block_is_cached(blk) &&
+            block_demote_locked(coord, held, blk, tier) == 0)
+            moved++;
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return moved;
+}
+
+/*
+ * Make a block resident. Returns 0 if its data is valid, 1 if it had
+ * been dropped and the caller must recompute it, -1 on failure.
+ */
+int kv_cache_promote_block(struct kv_cache_coordinator *coord,
+                          uint64_t block_id)
+{
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+    int ret = -1;
+
+    if (!coord)
+        return -1;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+    blk = block_lookup(coord, shard, block_id);
+    if (blk)
+        ret = block_promote_locked(coord, shard, blk);
+    block_shard_switch(coord, shard, 0);
+
+    return ret;
+}
+
+/* Queue spilled blocks from @first_block onwards for background promotion */
+int kv_cache_prefetch_sequence(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              uint32_t first_block)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    uint32_t distance;
+
+    if (!coord)
+        return -1;
+
+    distance = coord->config.prefetch_distance ?
+               coord->config.prefetch_distance : KV_CACHE_DEFAULT_PREFETCH_DISTANCE;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    prefetch_sequence_locked(coord, seq, first_block, distance);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return 0;
+}
+
+/*
+ * Longest cached prefix of @tokens, in tokens (a multiple of the block
+ * size). @matching_seq (optional) receives the sequence that published
+ * the deepest matched block if it is still live, else NULL.
+ */
+int kv_cache_find_prefix(struct kv_cache_coordinator *coord,
+                        const uint32_t *tokens,
+                        uint32_t num_tokens,
+                        struct kv_sequence **matching_seq)
+{
+    struct kv_block_shard *held = NULL;
+    uint32_t matched, max_blocks, i;
+    uint64_t *block_ids;
+    uint64_t owner = 0;
+
+    if (matching_seq)
+        *matching_seq = NULL;
+    if (!coord || !tokens)
+        return -1;
+
+    max_blocks = num_tokens / coord->config.block_size_tokens;
+    block_ids = malloc(((size_t)max_blocks + 1) * sizeof(uint64_t));
+    if (!block_ids)
+        return -1;
+
+    pthread_mutex_lock(&coord->prefix_lock);
+
+    matched = kv_prefix_tree_match(&coord->prefix_tree, tokens, num_tokens,
+                                   block_ids, max_blocks, &owner,
+                                   kv_cache_get_time_ns());
+    matched = snapshot_load_locked(coord, tokens, block_ids, matched, max_blocks);
+
+    /* Stop at the first block whose data is no longer resident */
+    for (i = 0; i < matched; i++) {
+        held = block_shard_switch(coord, held, block_ids[i]);
+        if (!kv_cache_block_is_cached(block_lookup(coord, held, block_ids[i])))
+            break;
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_unlock(&coord->prefix_lock);
+    free(block_ids);
+
+    if (i > 0 && matching_seq) {
+        struct kv_sequence_shard *shard = seq_shard(coord, owner);
+
+        pthread_mutex_lock(&shard->lock);
+        *matching_seq = seq_lookup(shard, owner);
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return (int)(i * coord->config.block_size_tokens);
+}
+
+/*
+ * Publish the full blocks of a sequence's first @num_tokens tokens so
+ * later requests can reuse them. Least recently used prefix leaves are
+ * evicted to make room. Returns the number of newly published blocks.
+ */
+int kv_cache_insert_prefix(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const uint32_t *tokens,
+                           uint32_t num_tokens)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    uint32_t num_blocks, first_new, created, tokens_per_block;
+    uint64_t *block_ids;
+
+    if (!coord || !tokens)
+        return -1;
+
+    tokens_per_block = coord->config.block_size_tokens;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    if (num_tokens > seq->sequence_length)
+        num_tokens = seq->sequence_length;
+    num_blocks = num_tokens / tokens_per_block;
+    if (num_blocks > seq->num_blocks)
+        num_blocks = seq->num_blocks;
+
+    /* The tree takes ids; the table holds slots */
+    block_ids = malloc(((size_t)num_blocks + 1) * sizeof(uint64_t));
+    if (!block_ids) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        block_ids[i] = seq_block_id(coord, seq, i);
+        if (!block_ids[i]) {
+            num_blocks = i;         /* Dropped by retention */
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&coord->prefix_lock);
+
+    if (kv_prefix_tree_free_nodes(&coord->prefix_tree) < num_blocks)
+        prefix_evict_locked(coord, num_blocks -
+                            kv_prefix_tree_free_nodes(&coord->prefix_tree), false);
+
+    created = kv_prefix_tree_insert(&coord->prefix_tree, tokens, num_blocks,
+                                    block_ids, sequence_id, &first_new,
+                                    kv_cache_get_time_ns());
+
+    for (uint32_t i = first_new; i < first_new + created; i++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, block_ids[i]);
+        blk = block_lookup(coord, held, block_ids[i]);
+        if (blk) {
+            block_get_locked(coord, blk, 1);
+            blk->prefix_ref = true;
+            blk->state = KV_BLOCK_SHARED;
+        }
+    }
+    block_shard_switch(coord, held, 0);
+
+    /* New nodes go to the summary and the snapshot, by the prefix hash
+     * that keys them */
+    if (created) {
+        bool snapshot = kv_snapshot_enabled(&coord->snapshot);
+        uint64_t hash = 0;
+
+        if (snapshot)
+            pthread_mutex_lock(&coord->snapshot_lock);
+        for (uint32_t i = 0; i < first_new + created; i++) {
+            hash = kv_prefix_hash_block(hash, &tokens[(size_t)i * tokens_per_block],
+                                        tokens_per_block);
+            if (i < first_new)
+                continue;
+            kv_summary_add(&coord->summary, hash);
+            if (snapshot)
+                kv_snapshot_note(&coord->snapshot, KV_SNAP_STORE, hash);
+        }
+        if (snapshot)
+            pthread_mutex_unlock(&coord->snapshot_lock);
+    }
+
+    pthread_mutex_unlock(&coord->prefix_lock);
+
+    if (num_blocks > 0) {
+        seq->prefix_cached = true;
+        if (num_blocks * tokens_per_block > seq->prefix_length)
+            seq->prefix_length = num_blocks * tokens_per_block;
+    }
+
+    pthread_mutex_unlock(&shard->lock);
+
+    free(block_ids);
+    return (int)created;
+}
+
+/*
+ * Start an empty sequence from the longest cached prefix of @tokens by
+ * referencing the shared blocks instead of recomputing them. Returns the
+ * number of tokens covered; the caller prefills only the remainder.
+ */
+int kv_cache_attach_prefix(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const uint32_t *tokens,
+                           uint32_t num_tokens)
+{
+    uint32_t matched, attached, max_blocks, tokens_per_block;
+    struct kv_sequence_shard *shard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    uint64_t *block_ids;
+    uint64_t hash = 0;
+
+    if (!coord || !tokens)
+        return -1;
+
+    tokens_per_block = coord->config.block_size_tokens;
+    max_blocks = num_tokens / tokens_per_block;
+    block_ids = malloc(((size_t)max_blocks + 1) * sizeof(uint64_t));
+    if (!block_ids)
+        return -1;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+
+    seq = seq_lookup(shard, sequence_id);
+    if (!seq || seq->num_blocks != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        free(block_ids);
+        return -1;
+    }
+
+    pthread_mutex_lock(&coord->prefix_lock);
+
+    matched = kv_prefix_tree_match(&coord->prefix_tree, tokens, num_tokens,
+                                   block_ids, max_blocks, NULL,
+                                   kv_cache_get_time_ns());
+    matched = snapshot_load_locked(coord, tokens, block_ids, matched, max_blocks);
+    if (kv_block_table_reserve(&seq->blocks, matched) != 0)
+        matched = 0;
+
+    for (attached = 0; attached < matched; attached++) {
+        struct kv_cache_block *blk;
+
+        held = block_shard_switch(coord, held, block_ids[attached]);
+        blk = block_lookup(coord, held, block_ids[attached]);
+        if (!kv_cache_block_is_cached(blk))
+            break;
+
+        block_get_locked(coord, blk, 1);
+        blk->access_count++;
+        blk->last_access_time_ns = kv_cache_get_time_ns();
+        block_touch_locked(coord, held, blk);
+        kv_block_table_set(&seq->blocks, attached, (uint32_t)blk->block_id);
+        hash = kv_prefix_hash_block(hash, &tokens[(size_t)attached * tokens_per_block],
+                                    tokens_per_block);
+    }
+
+    /* Count the lookup against the sequence's home shard */
+    held = block_shard_switch(coord, held, 0);
+    held = &coord->block_shards[block_home_shard(coord, sequence_id)];
+    pthread_mutex_lock(&held->lock);
+    held->stats.requests++;
+    if (attached > 0)
+        held->stats.hits++;
+    else
+        held->stats.misses++;
+    pthread_mutex_unlock(&held->lock);
+
+    /* The first lookups after a restore measure how warm it was */
+    if (coord->snapshot.restored &&
+        atomic_load_explicit(&coord->warm_lookups, memory_order_relaxed) <
+        KV_CACHE_SNAPSHOT_WARM_LOOKUPS) {
+        if (atomic_fetch_add_explicit(&coord->warm_lookups, 1, memory_order_relaxed) <
+            KV_CACHE_SNAPSHOT_WARM_LOOKUPS && attached > 0)
+            atomic_fetch_add_explicit(&coord->warm_hits, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&coord->prefix_lock);
+
+    seq->num_blocks = attached;
+    seq_fill_reserved(coord, seq, attached);
+    seq->sequence_length = attached * tokens_per_block;
+    seq->prefix_hash = hash;
+    seq->prefix_length = seq->sequence_length;
+    seq->prefix_cached = attached > 0;
+    seq_touch_locked(coord, seq, kv_cache_get_time_ns());
+
+    /* Prefill attends over the whole prefix: start bringing it in now */
+    if (coord->config.enable_prefetch)
+        prefetch_sequence_locked(coord, seq, 0, attached);
+
+    pthread_mutex_unlock(&shard->lock);
+
+    free(block_ids);
+    return (int)seq->prefix_length;
+}
+
+/* Shrink the prefix cache by up to @max_nodes blocks */
+uint32_t kv_cache_evict_prefixes(struct kv_cache_coordinator *coord,
+                                 uint32_t max_nodes)
+{
+    uint32_t evicted;
+
+    if (!coord)
+        return 0;
+
+    pthread_mutex_lock(&coord->prefix_lock);
+    evicted = prefix_evict_locked(coord, max_nodes, false);
+    pthread_mutex_unlock(&coord->prefix_lock);
+
+    return evicted;
+}
+
+/*
+ * Evict @policy's victims until @num_bytes_needed of hot memory is
+ * released, one block per shard per round so no shard is drained
+ * first. Returns the number of blocks evicted.
+ */
+static int evict_bytes(struct kv_cache_coordinator *coord,
+                       uint64_t num_bytes_needed,
+                       enum kv_eviction_policy policy)
+{
+    uint64_t freed = 0;
+    int evicted = 0;
+    bool progress = true;
+
+    while (freed < num_bytes_needed && progress) {
+        progress = false;
+
+        for (uint32_t i = 0; i < coord->num_block_shards && freed < num_bytes_needed; i++) {
+            uint32_t s = atomic_fetch_add_explicit(&coord->evict_cursor, 1,
+                                                   memory_order_relaxed) %
+                         coord->num_block_shards;
+            struct kv_block_shard *shard = &coord->block_shards[s];
+            struct kv_cache_block *victim;
+
+            pthread_mutex_lock(&shard->lock);
+            victim = evict_pick_locked(coord, shard, policy);
+            if (victim &&
+                block_demote_locked(coord, shard, victim,
+                                    evict_tier(coord, shard, policy, victim)) == 0) {
+                shard->stats.evictions++;
+                freed += coord->block_bytes;
+                evicted++;
+                progress = true;
+            }
+            pthread_mutex_unlock(&shard->lock);
+        }
+    }
+
+    return evicted;
+}
+
+/* Evict least recently used blocks to release @num_bytes_needed */
+int kv_cache_evict_lru(struct kv_cache_coordinator *coord,
+                      uint64_t num_bytes_needed)
+{
+    if (!coord)
+        return -1;
+
+    return evict_bytes(coord, num_bytes_needed, KV_EVICT_LRU);
+}
+
+/* Evict the blocks cheapest to lose per byte to release @num_bytes_needed */
+int kv_cache_evict_cost_aware(struct kv_cache_coordinator *coord,
+                             uint64_t num_bytes_needed)
+{
+    if (!coord)
+        return -1;
+
+    return evict_bytes(coord, num_bytes_needed, KV_EVICT_COST_AWARE);
+}
+
+/*
+ * Next victim under the configured policy, taking shards round robin.
+ * The block is not removed; it may be gone by the time the caller acts.
+ */
+struct kv_cache_block *kv_cache_select_victim(struct kv_cache_coordinator *coord)
+{
+    if (!coord)
+        return NULL;
+
+    for (uint32_t i = 0; i < coord->num_block_shards; i++) {
+        uint32_t s = atomic_fetch_add_explicit(&coord->evict_cursor, 1,
+                                               memory_order_relaxed) %
+                     coord->num_block_shards;
+        struct kv_block_shard *shard = &coord->block_shards[s];
+        struct kv_cache_block *victim;
+
+        pthread_mutex_lock(&shard->lock);
+        victim = evict_pick_locked(coord, shard, coord->config.eviction_policy);
+        pthread_mutex_unlock(&shard->lock);
+
+        if (victim)
+            return victim;
+    }
+
+    return NULL;
+}
+
+/*
+ * Accept sequences from peer coordinators on @host:@port (port 0 picks
+ * one). Returns the bound port, which peers register for this node.
+ */
+int kv_cache_listen(struct kv_cache_coordinator *coord,
+                   const char *host,
+                   uint32_t port)
+{
+    int bound;
+
+    if (!coord)
+        return -1;
+
+    bound = kv_transport_listen(&coord->transport, host, port);
+    if (bound > 0)
+        printf("KV cache node %u listening on %s:%d\n",
+               coord->config.local_node_id, host ? host : "*", bound);
+
+    return bound;
+}
+
+/*
+ * Send a copy of a sequence to @target_node_id in the background. Only
+ * queues it: the blocks are pinned, read and streamed by the transport
+ * thread, so the caller's decode loop is not held up. The local copy
+ * is untouched. Returns a ticket for kv_cache_transfer_wait(), or -1.
+ */
+int64_t kv_cache_transfer_sequence(struct kv_cache_coordinator *coord,
+                                   uint64_t sequence_id,
+                                   uint32_t target_node_id)
+{
+    char host[sizeof(coord->nodes[0].hostname)];
+    uint32_t port;
+
+    if (!coord || target_node_id == coord->config.local_node_id ||
+        !node_address(coord, target_node_id, host, &port))
+        return -1;
+
+    return kv_transport_submit(&coord->transport, sequence_id, target_node_id,
+                               host, port);
+}
+
+/* Wait for a transfer: 0 delivered, -1 failed, 1 still running */
+int kv_cache_transfer_wait(struct kv_cache_coordinator *coord,
+                          uint64_t ticket,
+                          uint32_t timeout_ms)
+{
+    if (!coord)
+        return -1;
+
+    return kv_transport_wait(&coord->transport, ticket, timeout_ms);
+}
+
+/*
+ * Node serving @sequence_id. A live sequence keeps the node it was
+ * routed to until that node leaves; an unknown id is answered without
+ * being counted against any node.
+ */
+uint32_t kv_cache_route_sequence(struct kv_cache_coordinator *coord,
+                                uint64_t sequence_id)
+{
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    uint32_t node;
+
+    if (!coord)
+        return 0;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+    seq = seq_lookup(shard, sequence_id);
+    if (seq) {
+        node = route_sequence_locked(coord, seq);
+        pthread_mutex_unlock(&shard->lock);
+        return node;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    node = route_pick_locked(coord, sequence_id, 0, false);
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    return node;
+}
+
+/*
+ * Node to serve a request for @tokens: the one whose published prefix
+ * summary matches the most leading blocks, among nodes under the
+ * bounded-load cap (fewer sequences break ties), or the ring's choice
+ * when no node under the cap has the first block. @cached_tokens
+ * (optional) receives the tokens expected to be cached there; a false
+ * positive can overstate it by a block. A live @sequence_id is routed
+ * there, so call this before prefilling it; an unknown id is answered
+ * without being counted against any node.
+ */
+uint32_t kv_cache_route_prompt(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              const uint32_t *tokens,
+                              uint32_t num_tokens,
+                              uint32_t *cached_tokens)
+{
+    uint32_t depth[KV_CACHE_MAX_NODES] = { 0 };
+    uint32_t bs, num_blocks, node = 0, best = KV_CACHE_MAX_NODES;
+    struct kv_sequence_shard *shard;
+    struct kv_sequence *seq;
+    uint64_t alive = 0, hash = 0;
+    bool routed = false;
+
+    if (cached_tokens)
+        *cached_tokens = 0;
+    if (!coord || (!tokens && num_tokens))
+        return 0;
+
+    bs = coord->config.block_size_tokens;
+    num_blocks = num_tokens / bs;
+
+    /* Follow the rolling block hashes through every summary at once,
+     * dropping each node at its first miss */
+    pthread_rwlock_rdlock(&coord->summary_lock);
+    for (uint32_t i = 0; i < KV_CACHE_MAX_NODES; i++) {
+        if (coord->node_summary[i].num_bits)
+            alive |= kv_repl_node_bit(i);
+    }
+    for (uint32_t b = 0; b < num_blocks && alive; b++) {
+        hash = kv_prefix_hash_block(hash, &tokens[(size_t)b * bs], bs);
+        for (uint64_t m = alive; m; m &= m - 1) {
+            uint32_t i = (uint32_t)__builtin_ctzll(m);
+
+            if (kv_summary_view_test(&coord->node_summary[i], hash))
+                depth[i] = b + 1;
+            else
+                alive &= ~kv_repl_node_bit(i);
+        }
+    }
+    pthread_rwlock_unlock(&coord->summary_lock);
+
+    pthread_rwlock_rdlock(&coord->routing_lock);
+    if (coord->ring.num_nodes > 0) {
+        uint32_t cap = route_cap_locked(coord), best_load = 0;
+
+        for (uint32_t i = 0; i < KV_CACHE_MAX_NODES; i++) {
+            uint32_t load;
+
+            if (!depth[i] || !kv_ring_contains(&coord->ring, i))
+                continue;
+            load = atomic_load_explicit(&coord->route_load[i], memory_order_relaxed);
+            if (load >= cap)
+                continue;
+            if (best == KV_CACHE_MAX_NODES || depth[i] > depth[best] ||
+                (depth[i] == depth[best] && load < best_load)) {
+                best = i;
+                best_load = load;
+            }
+        }
+        node = best < KV_CACHE_MAX_NODES ? best :
+               route_pick_locked(coord, sequence_id, 0, false);
+        routed = true;
+    }
+    pthread_rwlock_unlock(&coord->routing_lock);
+
+    if (best < KV_CACHE_MAX_NODES) {
+        atomic_fetch_add_explicit(&coord->prefix_routes, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&coord->prefix_route_tokens, depth[best] * bs,
+                                  memory_order_relaxed);
+    }
+    if (cached_tokens)
+        *cached_tokens = depth[node] * bs;
+    if (!routed)
+        return node;
+
+    shard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&shard->lock);
+    seq = seq_lookup(shard, sequence_id);
+    if (seq && (!route_valid(coord, seq) || seq->preferred_node_id != node))
+        route_pin_locked(coord, seq, node);
+    pthread_mutex_unlock(&shard->lock);
+
+    return node;
+}
+
+/*
+ * Move a sequence to @target_node_id. With peers connected and a remote
+ * target, its blocks are shipped there and the local copy is dropped
+ * once the peer has them. Otherwise the move is bookkeeping: the route
+ * is pinned to the target and the sequence's private blocks are
+ * accounted to it (shared blocks stay with their first owner).
+ */
+int kv_cache_migrate_sequence(struct kv_cache_coordinator *coord,
+                             uint64_t sequence_id,
+                             uint32_t target_node_id)
+{
+    struct kv_sequence_shard *sshard;
+    struct kv_block_shard *held = NULL;
+    struct kv_sequence *seq;
+    bool online;
+
+    if (!coord)
+        return -1;
+
+    pthread_mutex_lock(&coord->node_lock);
+    online = target_node_id < coord->num_nodes && coord->nodes[target_node_id].online;
+    pthread_mutex_unlock(&coord->node_lock);
+    if (!online)
+        return -1;
+
+    if (coord->transport.listen_fd >= 0 &&
+        target_node_id != coord->config.local_node_id) {
+        int64_t ticket = kv_cache_transfer_sequence(coord, sequence_id,
+                                                    target_node_id);
+
+        if (ticket < 0 ||
+            kv_cache_transfer_wait(coord, (uint64_t)ticket,
+                                   KV_CACHE_MIGRATE_TIMEOUT_MS) != 0)
+            return -1;
+        return kv_cache_free_sequence(coord, sequence_id);
+    }
+
+    sshard = seq_shard(coord, sequence_id);
+    pthread_mutex_lock(&sshard->lock);
+
+    seq = seq_lookup(sshard, sequence_id);
+    if (!seq) {
+        pthread_mutex_unlock(&sshard->lock);
+        return -1;
+    }
+
+    route_pin_locked(coord, seq, target_node_id);
+
+    for (uint32_t i = 0; i < seq->num_blocks; i++) {
+        struct kv_cache_block *blk;
+        uint64_t id = seq_block_id(coord, seq, i);
+
+        held = block_shard_switch(coord, held, id);
+        blk = block_lookup(coord, held, id);
+        if (!blk || blk->ref_count > 1 || blk->node_id == target_node_id)
+            continue;
+
+        /* Resident bytes follow the block; spilled ones are not on a node */
+        if (blk->page != KV_PAGE_NONE) {
+            node_account(coord, blk->node_id, -(int64_t)coord->block_bytes, -1);
+            node_account(coord, target_node_id, coord->block_bytes, 1);
+        } else {
+            node_account(coord, blk->node_id, 0, -1);
+            node_account(coord, target_node_id, 0, 1);
+        }
+        blk->node_id = target_node_id;
+    }
+    block_shard_switch(coord, held, 0);
+
+    pthread_mutex_unlock(&sshard->lock);
+
+    return 0;
+}
+
+/*
+ * Send every queued coherency notice now and wait up to @timeout_ms for
+ * the peers to apply them. Returns 0 once no peer holds a copy older
+ * than this node's writes, -1 otherwise.
+ */
+int kv_cache_coherency_flush(struct kv_cache_coordinator *coord,
+                            uint32_t timeout_ms)
+{
+    if (!coord)
+        return -1;
+    if (coord->config.coherency_protocol == KV_COHERENCY_NONE)
+        return 0;
+
+    return coh_flush(coord, true, timeout_ms);
+}
+
+/*
+ * Keep a replica of @block_id on @target_node_id from now on; its
+ * current data goes out with the next replication batch. Returns -1 for
+ * an unknown block, a replica, or a node that is this one or offline.
+ */
+int kv_cache_replicate_block(struct kv_cache_coordinator *coord,
+                            uint64_t block_id,
+                            uint32_t target_node_id)
+{
+    char host[sizeof(coord->nodes[0].hostname)];
+    struct kv_block_shard *shard;
+    struct kv_cache_block *blk;
+    uint32_t port;
+
+    if (!coord || target_node_id >= KV_CACHE_MAX_NODES ||
+        target_node_id == coord->config.local_node_id ||
+        !node_address(coord, target_node_id, host, &port))
+        return -1;
+
+    shard = block_shard_switch(coord, NULL, block_id);
+    blk = block_lookup(coord, shard, block_id);
+    if (!blk || blk->replica_of) {
+        block_shard_switch(coord, shard, 0);
+        return -1;
+    }
+
+    blk->replicas |= kv_repl_node_bit(target_node_id);
+    repl_dirty_locked(coord, blk);
+    pthread_mutex_unlock(&shard->lock);
+
+    /* The coordinator thread may be asleep with nothing else to do */
+    pthread_mutex_lock(&coord->prefetch_lock);
+    pthread_cond_signal(&coord->prefetch_cond);
+    pthread_mutex_unlock(&coord->prefetch_lock);
+
+    return 0;
+}
+
+/*
+ * Sync-on-commit: send every queued replica update now and wait until
+ * the nodes replicating @block_id (every node, for block 0) have applied
+ * all updates sent to them so far. Writes made before the call are then
+ * durable on those replicas. Returns -1 if one failed or timed out.
+ */
+int kv_cache_sync_replicas(struct kv_cache_coordinator *coord,
+                          uint64_t block_id)
+{
+    uint64_t nodes = ~0ULL;
+
+    if (!coord)
+        return -1;
+
+    if (block_id) {
+        struct kv_block_shard *shard = block_shard_switch(coord, NULL, block_id);
+        struct kv_cache_block *blk = block_lookup(coord, shard, block_id);
+
+        if (!blk) {
+            block_shard_switch(coord, shard, 0);
+            return -1;
+        }
+        nodes = blk->replicas;
+        pthread_mutex_unlock(&shard->lock);
+    }
+
+    return repl_flush(coord, nodes, KV_CACHE_REPLICATION_TIMEOUT_MS);
+}
+
+/* Get statistics, summed over the shards */
+void kv_cache_get_statistics(struct kv_cache_coordinator *coord,
+                            struct kv_cache_config *stats)
+{
+    struct kv_shard_stats sum;
+    uint64_t total;
+
+    if (!coord || !stats)
+        return;
+
+    shard_stats_sum(coord, &sum);
+
+    memcpy(stats, &coord->config, sizeof(*stats));
+    stats->total_requests = sum.requests;
+    stats->cache_hits = sum.hits;
+    stats->cache_misses = sum.misses;
+    stats->total_evictions = sum.evictions;
+    stats->total_swap_outs = sum.swap_outs;
+    stats->total_swap_ins = sum.swap_ins;
+    stats->total_recompute_drops = sum.recompute_drops;
+    stats->total_retention_drops = sum.retention_drops;
+    stats->admission_rejects = atomic_load_explicit(&coord->admission_rejects,
+                                                    memory_order_relaxed);
+    stats->preempt_swaps = atomic_load_explicit(&coord->preempt_swaps,
+                                                memory_order_relaxed);
+    stats->preempt_recomputes = atomic_load_explicit(&coord->preempt_recomputes,
+                                                     memory_order_relaxed);
+    stats->total_prefetches = sum.prefetches;
+    stats->quant_drift_events = sum.quant_drift_events;
+
+    pthread_mutex_lock(&coord->coherency_lock);
+    stats->coherency_invalidations = coord->outbox.queued[KV_COH_INVALIDATE];
+    stats->coherency_upgrades = coord->outbox.queued[KV_COH_UPGRADE];
+    stats->coherency_writebacks = coord->outbox.queued[KV_COH_WRITEBACK];
+    stats->coherency_messages = coord->outbox.messages;
+    pthread_mutex_unlock(&coord->coherency_lock);
+
+    pthread_mutex_lock(&coord->replication_lock);
+    stats->replication_updates = coord->repl_outbox.queued[KV_REPL_UPDATE];
+    stats->replication_drops = coord->repl_outbox.queued[KV_REPL_DROP];
+    stats->replicas_stored = kv_index_count(&coord->replica_index);
+    pthread_mutex_unlock(&coord->replication_lock);
+
+    pthread_mutex_lock(&coord->replication_flush_lock);
+    stats->replication_messages = coord->repl_batch.messages;
+    pthread_mutex_unlock(&coord->replication_flush_lock);
+
+    stats->node_failures = atomic_load_explicit(&coord->node_failures,
+                                                memory_order_relaxed);
+    stats->failover_sequences = atomic_load_explicit(&coord->failover_sequences,
+                                                     memory_order_relaxed);
+    stats->rereplicated_blocks = atomic_load_explicit(&coord->rereplicated_blocks,
+                                                      memory_order_relaxed);
+
+    pthread_mutex_lock(&coord->snapshot_lock);
+    stats->snapshot_restored = coord->snapshot.restored;
+    stats->snapshot_loaded = coord->snapshot.claimed;
+    stats->snapshot_written = coord->snapshot.written;
+    pthread_mutex_unlock(&coord->snapshot_lock);
+    stats->snapshot_restore_ms = (float)coord->snapshot_restore_ns / 1e6f;
+
+    total = atomic_load_explicit(&coord->warm_lookups, memory_order_relaxed);
+    if (total > KV_CACHE_SNAPSHOT_WARM_LOOKUPS)
+        total = KV_CACHE_SNAPSHOT_WARM_LOOKUPS;
+    stats->warm_hit_rate_percent = total ?
+        (float)atomic_load_explicit(&coord->warm_hits, memory_order_relaxed) /
+        (float)total * 100.0f : 0.0f;
+
+    stats->prefix_routes = atomic_load_explicit(&coord->prefix_routes,
+                                                memory_order_relaxed);
+    stats->prefix_route_tokens = atomic_load_explicit(&coord->prefix_route_tokens,
+                                                      memory_order_relaxed);
+    stats->summaries_received = atomic_load_explicit(&coord->summaries_received,
+                                                     memory_order_relaxed);
+
+    total = sum.hits + sum.misses;
+    stats->hit_rate_percent = total ? (float)sum.hits / (float)total * 100.0f : 0.0f;
+}
+
+/* Hit rate in percent over all lookups */
+float kv_cache_calculate_hit_rate(struct kv_cache_coordinator *coord)
+{
+    struct kv_cache_config stats;
+
+    if (!coord)
+        return 0.0f;
+
+    kv_cache_get_statistics(coord, &stats);
+    return stats.hit_rate_percent;
+}
+
+/* Bytes of KV data currently allocated */
+uint64_t kv_cache_get_total_usage(struct kv_cache_coordinator *coord)
+{
+    if (!coord)
+        return 0;
+
+    return atomic_load_explicit(&coord->used_capacity_bytes, memory_order_relaxed);
+}
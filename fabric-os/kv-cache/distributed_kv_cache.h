@@ -4,7 +4,23 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <pthread.h>
+#include <time.h>
+#include "kv_block_table.h"
+#include "kv_coherency.h"
+#include "kv_evict.h"
+#include "kv_index.h"
+#include "kv_page_pool.h"
+#include "kv_phi.h"
+#include "kv_prefix_tree.h"
+#include "kv_quant.h"
+#include "kv_replication.h"
+#include "kv_ring.h"
+#include "kv_snapshot.h"
+#include "kv_summary.h"
+#include "kv_tier.h"
+#include "kv_transport.h"
 
 /*
  * Distributed KV Cache for LLM Inference
@@ -16,13 +32,33 @@
 #define KV_CACHE_MAX_NODES 64
 #define KV_CACHE_PAGE_SIZE 4096        /* Bytes */
 #define KV_CACHE_MAX_SEQUENCES 10000
-#define KV_CACHE_MAX_BLOCKS_PER_SEQ 2048
+#define KV_CACHE_SEQUENCE_CHUNK 64     /* Sequence slots allocated at a time */
+#define KV_CACHE_DEFAULT_BLOCK_TOKENS 16
+#define KV_CACHE_DEFAULT_PREFETCH_DISTANCE 4
+#define KV_CACHE_PREFETCH_QUEUE 1024
+#define KV_CACHE_DEFAULT_SHARDS 16
+#define KV_CACHE_MAX_SHARDS 64
+#define KV_CACHE_LINE_BYTES 64
+#define KV_CACHE_LFU_SAMPLE 8          /* LRU-end candidates compared by LFU */
+#define KV_CACHE_HEAP_SKIP 32          /* Pinned heap tops passed over */
+#define KV_CACHE_RECOMPUTE_MS_PER_TOKEN 0.02f /* Default recompute estimate */
+#define KV_CACHE_ROUTE_EPSILON 0.25f   /* Default bounded-load slack */
+#define KV_CACHE_MIGRATE_TIMEOUT_MS 5000
+#define KV_CACHE_COHERENCY_FLUSH_MS 1  /* MESI: longest a notice waits */
+#define KV_CACHE_COHERENCY_TIMEOUT_MS 1000 /* STRONG: wait for sharers */
+#define KV_CACHE_REPLICATION_FLUSH_MS 5 /* Longest a replica update waits */
+#define KV_CACHE_REPLICATION_TIMEOUT_MS 1000 /* Sync: wait for replicas */
+#define KV_CACHE_REPLICATION_WINDOW 16 /* Batches in flight per peer */
+#define KV_CACHE_SNAPSHOT_INTERVAL_MS 1000 /* Default snapshot flush period */
+#define KV_CACHE_SUMMARY_INTERVAL_MS 250 /* Default prefix summary period */
+#define KV_CACHE_SNAPSHOT_WARM_LOOKUPS 1000 /* Prefix lookups counted as warm */
+#define KV_CACHE_PREEMPT_MAX 8         /* Victims one block allocation may take */
 
 /* Cache eviction policies */
 enum kv_eviction_policy {
     KV_EVICT_LRU = 0,              /* Least Recently Used */
-    KV_EVICT_LFU = 1,              /* Least Frequently Used */
-    KV_EVICT_COST_AWARE = 2,       /* Consider recomputation cost */
+    KV_EVICT_LFU = 1,              /* Least Frequently Used (TinyLFU) */
+    KV_EVICT_COST_AWARE = 2,       /* Recompute cost x reuse / bytes */
     KV_EVICT_FIFO = 3,             /* First In First Out */
 };
 
@@ -33,7 +69,7 @@ enum kv_coherency_protocol {
     KV_COHERENCY_STRONG = 2,       /* Strong consistency */
 };
 
-/* Block state (MESI-like) */
+/* Block state (MESI; see the coherency directory in the coordinator) */
 enum kv_block_state {
     KV_BLOCK_INVALID = 0,
     KV_BLOCK_SHARED = 1,
@@ -49,27 +85,68 @@ struct kv_cache_block {
     enum kv_block_state state;
     uint64_t last_access_time_ns;
     uint64_t access_count;
-    uint32_t ref_count;            /* Reference count */
+    uint32_t ref_count;            /* Reference count, freed at zero */
     uint32_t node_id;              /* Node storing this block */
+    uint32_t num_tokens;           /* Tokens written into this block */
 
-    /* Data */
+    /* Data: one pool page, keys then values */
+    uint32_t page;                 /* Page pool handle (hot tier only) */
+    enum kv_block_tier tier;       /* Where the data currently lives */
+    uint32_t tier_slot;            /* Slot in a lower tier */
     void *key_data;                /* Key tensor */
     void *value_data;              /* Value tensor */
     uint32_t key_size_bytes;
     uint32_t value_size_bytes;
+    enum kv_precision precision;   /* Encoding of the data where it lives */
 
     /* Metadata */
     float recompute_cost_ms;       /* Cost to recompute if evicted */
+    float attention_score;         /* Accumulated attention, for retention */
     bool dirty;                    /* Modified since last sync */
     bool locked;                   /* Locked for computation */
+    bool prefix_ref;               /* One reference is the prefix tree's */
+    uint32_t send_pins;            /* Transfers reading the page */
+    struct kv_evict_link evict;    /* Shard eviction set (hot tier only) */
+
+    /* Coherency directory */
+    uint64_t sharers;              /* Peer nodes holding a copy */
+    uint32_t home_node;            /* Node tracking the block, if received */
+    uint64_t home_block_id;        /* Its id there, 0 = this node is home */
+
+    /* Replication */
+    uint64_t replicas;             /* Peer nodes keeping a copy */
+    uint64_t replica_pending;      /* Of those, queued for an update */
+    uint32_t replica_src;          /* Source node, if this is a replica */
+    uint64_t replica_of;           /* Its id there, 0 = not a replica */
+};
+
+/* How a sequence was preempted */
+enum kv_preemption {
+    KV_PREEMPT_NONE = 0,
+    KV_PREEMPT_SWAP = 1,           /* Blocks moved to a spill tier */
+    KV_PREEMPT_RECOMPUTE = 2,      /* Blocks dropped, prefill again */
+};
+
+/*
+ * Which blocks a sequence keeps as it grows. With a window, a block is
+ * dropped as soon as all of its tokens are older than the last
+ * window_tokens, unless it holds one of the first sink_tokens (attention
+ * sinks) or is among the heavy_blocks older blocks with the highest
+ * accumulated attention (heavy hitters, scored by the engine through
+ * kv_cache_update_attention()). window_tokens 0 keeps everything.
+ */
+struct kv_retention_policy {
+    uint32_t sink_tokens;
+    uint32_t window_tokens;
+    uint32_t heavy_blocks;
 };
 
 /* Sequence metadata */
 struct kv_sequence {
     uint64_t sequence_id;
     uint32_t num_blocks;
-    uint64_t block_ids[KV_CACHE_MAX_BLOCKS_PER_SEQ];
     uint32_t sequence_length;
+    struct kv_block_table blocks;  /* Block slot at each position */
     uint64_t created_time_ns;
     uint64_t last_access_time_ns;
 
@@ -80,7 +157,25 @@ struct kv_sequence {
 
     /* Routing hints */
     uint32_t preferred_node_id;    /* Node with most cached blocks */
+    uint32_t route_epoch;          /* Node epoch the route was taken in */
     float cache_hit_rate;          /* Historical hit rate */
+
+    uint64_t replica_nodes;        /* Peers its new blocks replicate to */
+
+    /* Retention */
+    struct kv_retention_policy retention;
+    uint32_t retain_next;          /* First block not yet behind the window */
+    uint32_t *retained;            /* Heavy blocks kept behind it */
+    uint32_t num_retained;
+    uint32_t retained_capacity;
+
+    /* Admission and preemption */
+    uint32_t reserved_blocks;      /* Admitted for, not yet filled */
+    enum kv_preemption preempted;
+    uint32_t recompute_tokens;     /* Dropped by preemption */
+    struct kv_sequence *lru_prev;  /* Shard's preemption list */
+    struct kv_sequence *lru_next;
+    bool on_lru;
 };
 
 /* Cache node information */
@@ -119,11 +214,48 @@ struct kv_cache_config {
     uint64_t total_capacity_bytes;
     uint32_t page_size_bytes;
     uint32_t block_size_tokens;    /* Tokens per block */
+    uint32_t numa_nodes;           /* Page arenas, 0 = one per NUMA node */
+    uint32_t num_shards;           /* Table lock shards, 0 = default */
+
+    /* KV precision: RAW leaves page layout to the caller, otherwise
+     * page_size_bytes is derived from the model shape */
+    enum kv_precision kv_precision;
+    enum kv_precision cold_precision; /* Spill tiers, RAW = as hot */
+    uint32_t num_kv_heads;
+    uint32_t head_dim;
+    float max_quant_error;         /* Drift check on write, 0 = off */
+
+    /* Cluster */
+    uint32_t local_node_id;        /* This coordinator in peers' node tables */
+    float route_load_epsilon;      /* Node load cap is (1 + eps) x average,
+                                    * 0 = default */
+    uint32_t summary_interval_ms;  /* Prefix summary publish period,
+                                    * 0 = default */
 
     /* Replication */
     uint32_t replication_factor;   /* Number of replicas */
     bool enable_replication;
 
+    /* Failure detection (phi accrual over node heartbeats) */
+    uint32_t heartbeat_interval_ms; /* Expected period, 0 = detection off */
+    float failure_phi_threshold;   /* Phi declaring a node dead, 0 = default */
+
+    /* Tiered storage (0 bytes disables a tier) */
+    uint64_t host_tier_bytes;
+    uint64_t file_tier_bytes;
+    char file_tier_path[256];
+
+    /* Prefix cache snapshot for warm restarts (empty path disables it) */
+    char snapshot_path[256];
+    uint64_t snapshot_bytes;       /* 0 = as many blocks as the hot tier */
+    uint32_t snapshot_interval_ms; /* Background flush period, 0 = default */
+
+    /* Admission control: reserve estimated_length on create, and
+     * preempt the least recently used sequence when a block cannot be
+     * allocated */
+    bool enable_admission_control;
+    bool enable_preemption;
+
     /* Prefetching */
     bool enable_prefetch;
     uint32_t prefetch_distance;    /* Blocks to prefetch ahead */
@@ -134,41 +266,306 @@ struct kv_cache_config {
     uint64_t cache_misses;
     float hit_rate_percent;
     uint64_t total_evictions;
+    uint64_t total_swap_outs;
+    uint64_t total_swap_ins;
+    uint64_t total_recompute_drops;
+    uint64_t total_retention_drops; /* Blocks a retention policy dropped */
+    uint64_t admission_rejects;    /* Sequences refused for capacity */
+    uint64_t preempt_swaps;        /* Sequences preempted to a spill tier */
+    uint64_t preempt_recomputes;   /* ... or dropped to be recomputed */
+    uint64_t total_prefetches;
+    uint64_t quant_drift_events;   /* Writes over max_quant_error */
+    uint64_t coherency_invalidations; /* Invalidations sent */
+    uint64_t coherency_upgrades;   /* Ownership requests sent */
+    uint64_t coherency_writebacks; /* Modified copies written back */
+    uint64_t coherency_messages;   /* Batches sent */
+    uint64_t replication_updates;  /* Block updates queued for replicas */
+    uint64_t replication_drops;    /* Replica drops queued */
+    uint64_t replication_messages; /* Batches sent */
+    uint64_t replicas_stored;      /* Replicas held for peers */
+    uint64_t node_failures;        /* Nodes declared dead */
+    uint64_t failover_sequences;   /* Taken over from their replicas */
+    uint64_t rereplicated_blocks;  /* Copies queued to restore replicas */
+    uint64_t snapshot_restored;    /* Prefix blocks found in the snapshot */
+    float snapshot_restore_ms;     /* Time to map and index them */
+    uint64_t snapshot_loaded;      /* Restored blocks a lookup brought back */
+    uint64_t snapshot_written;     /* Block records written */
+    float warm_hit_rate_percent;   /* Prefix hit rate of the first
+                                    * lookups after a restore */
+    uint64_t prefix_routes;        /* Prompts routed to a cached prefix */
+    uint64_t prefix_route_tokens;  /* Prompt tokens they found cached */
+    uint64_t summaries_received;   /* Peer prefix summaries applied */
+};
+
+/* Per-shard counters, summed by kv_cache_get_statistics() */
+struct kv_shard_stats {
+    uint64_t requests;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t swap_outs;
+    uint64_t swap_ins;
+    uint64_t recompute_drops;
+    uint64_t retention_drops;
+    uint64_t prefetches;
+    uint64_t quant_drift_events;
 };
 
+/*
+ * A contiguous range of block slots with its own lock, free slot stack
+ * and eviction set. Blocks are allocated in their sequence's home shard
+ * and spill to the others only when it is full.
+ */
+struct kv_block_shard {
+    pthread_mutex_t lock;
+    uint32_t first_slot;
+    uint32_t num_slots;
+    uint32_t *free_slots;
+    uint32_t free_count;
+    uint32_t next_generation;       /* High half of the next block id */
+    struct kv_evict_set evict;      /* Resident blocks: LRU list + cost heap */
+    struct kv_freq_sketch sketch;   /* TinyLFU access frequencies */
+    uint64_t num_blocks;            /* Live blocks */
+    void *swap_buffer;              /* One block, for tier exchanges */
+    float *quant_scratch;           /* Two tensors of fp32 */
+    struct kv_shard_stats stats;
+} __attribute__((aligned(KV_CACHE_LINE_BYTES)));
+
+/* Sequences whose id hashes to this shard */
+struct kv_sequence_shard {
+    pthread_mutex_t lock;
+    struct kv_sequence **chunks;    /* KV_CACHE_SEQUENCE_CHUNK slots each */
+    uint32_t num_chunks;
+    uint32_t dir_capacity;
+    uint32_t *free_slots;           /* Sized to the allocated slots */
+    uint32_t free_count;
+    struct kv_index index;          /* sequence_id -> slot */
+
+    /* Sequences holding blocks and not preempted, least recently
+     * used first */
+    struct kv_sequence *lru_head;
+    struct kv_sequence *lru_tail;
+} __attribute__((aligned(KV_CACHE_LINE_BYTES)));
+
 /* Global cache coordinator */
 struct kv_cache_coordinator {
     struct kv_cache_config config;
 
-    /* Node pool */
+    /* Node pool. Block accounting goes to the atomics on the hot path
+     * and is folded into nodes[] under node_lock when it is read. */
     struct kv_cache_node nodes[KV_CACHE_MAX_NODES];
     uint32_t num_nodes;
     pthread_mutex_t node_lock;
-
-    /* Block table (global view) */
+    _Atomic int64_t node_used_bytes[KV_CACHE_MAX_NODES];
+    _Atomic int32_t node_num_blocks[KV_CACHE_MAX_NODES];
+    _Atomic uint64_t node_transfer_bytes[KV_CACHE_MAX_NODES];
+
+    /*
+     * Block table: one slot array split into shards. A block id is
+     * (generation << 32 | slot), so lookup is a bounds check and an id
+     * compare under the owning shard's lock, and stale ids never match.
+     */
     struct kv_cache_block *blocks;
-    uint64_t num_blocks;
-    pthread_mutex_t block_lock;
-
-    /* Sequence table */
-    struct kv_sequence *sequences;
-    uint32_t num_sequences;
-    pthread_mutex_t sequence_lock;
-
-    /* Eviction queue (LRU) */
-    struct kv_cache_block **eviction_queue;
-    uint32_t eviction_queue_size;
-    pthread_mutex_t eviction_lock;
-
-    /* Routing table */
-    uint32_t *sequence_to_node_map; /* Sequence ID -> preferred node */
-    pthread_mutex_t routing_lock;
+    uint32_t block_capacity;        /* Slots */
+    struct kv_block_shard *block_shards;
+    uint32_t num_block_shards;
+    uint32_t block_shard_slots;     /* Slots per shard, last may be short */
+    uint32_t block_bytes;           /* Key + value bytes per block */
+    _Atomic uint64_t used_capacity_bytes;
+    struct kv_page_pool page_pool;  /* Backing pages, one per block */
+    struct kv_tier_store tiers;     /* Host/file spill */
+    struct kv_quant_layout hot_layout;  /* Per tensor, if quantized */
+    struct kv_quant_layout cold_layout; /* Spill encoding, if different */
+
+    /* Global pressure signal: while free hot pages are below the low
+     * watermark, every shard demotes one of its own cold blocks on
+     * allocation, so reclaim stays shard-local */
+    uint32_t low_watermark_pages;
+    _Atomic bool page_pressure;
+    _Atomic uint32_t evict_cursor;  /* Next shard for explicit eviction */
+
+    /* Sequence table, sharded by hash of sequence_id */
+    struct kv_sequence_shard *sequence_shards;
+    uint32_t num_sequence_shards;   /* Power of two */
+    _Atomic uint32_t num_sequences;
+    _Atomic uint64_t reserved_blocks; /* Admitted sequences' unfilled blocks */
+    _Atomic uint64_t admission_rejects;
+    _Atomic uint64_t preempt_swaps;
+    _Atomic uint64_t preempt_recomputes;
+
+    /* Shared token prefixes; each node holds one block reference */
+    struct kv_prefix_tree prefix_tree;
+    pthread_mutex_t prefix_lock;
+    _Atomic uint64_t prefix_only_blocks; /* Referenced by the tree alone */
+
+    /*
+     * Routing: consistent hash ring over online nodes, with bounded
+     * loads. A sequence's route is cached in the sequence itself and
+     * kept until it is freed or its node leaves, which bumps the node's
+     * epoch and so invalidates exactly the routes it held.
+     */
+    struct kv_ring ring;
+    pthread_rwlock_t routing_lock;  /* Ring membership; loads under rdlock */
+    _Atomic uint32_t route_load[KV_CACHE_MAX_NODES]; /* Sequences routed */
+    _Atomic uint32_t route_epoch[KV_CACHE_MAX_NODES];
+    _Atomic uint32_t route_total;
+
+    /*
+     * Prefix summaries. Each node publishes a counting Bloom filter of
+     * its prefix tree's block hashes every summary_interval_ms it
+     * changed; kv_cache_route_prompt() checks a prompt against all of
+     * them, this node's own included, to find where it is cached.
+     */
+    struct kv_summary summary;      /* This node's, under prefix_lock */
+    pthread_rwlock_t summary_lock;
+    struct kv_summary_view node_summary[KV_CACHE_MAX_NODES];
+    uint64_t summary_sent_version;  /* Coordinator thread only */
+    uint64_t summary_sent_nodes;    /* Peers holding that version */
+    _Atomic uint64_t prefix_routes;
+    _Atomic uint64_t prefix_route_tokens;
+    _Atomic uint64_t summaries_received;
+
+    /* Block transfer to and from peer coordinators */
+    struct kv_transport transport;
+
+    /*
+     * Coherency directory. Blocks this node sent away list the peers
+     * holding copies in their sharer mask; received copies name their
+     * home block, and home_index finds them again by it. Notices are
+     * batched per destination and go out when a batch fills, from the
+     * coordinator thread within KV_CACHE_COHERENCY_FLUSH_MS, or at once
+     * (waiting for the acks) under KV_COHERENCY_STRONG.
+     */
+    pthread_mutex_t coherency_lock;
+    struct kv_coh_outbox outbox;
+    struct kv_index home_index;     /* (home node, home block) -> slot */
+    uint64_t coherency_tickets[KV_CACHE_MAX_NODES]; /* Last batch sent */
+    _Atomic bool coherency_pending;
+
+    /*
+     * Replication. A written block is queued once for each of its
+     * replica nodes not already owed an update; the coordinator thread
+     * copies the queued blocks' current data into batches within
+     * KV_CACHE_REPLICATION_FLUSH_MS. One flush runs at a time
+     * (replication_flush_lock), so a peer never gets older data after
+     * newer. Replicas held for peers are found in replica_index by
+     * (source node, source block).
+     */
+    pthread_mutex_t replication_lock;
+    pthread_mutex_t replication_flush_lock;
+    struct kv_repl_outbox repl_outbox;
+    struct kv_index replica_index;  /* (source node, source block) -> slot */
+    struct kv_repl_queue repl_spare; /* Flusher's, under the flush lock */
+    struct kv_repl_batch repl_batch; /* Flusher's, under the flush lock */
+    uint64_t replication_tickets[KV_CACHE_MAX_NODES]; /* Last batch sent */
+    _Atomic uint64_t replication_due_ns; /* Flush by then, 0 = idle */
+
+    /*
+     * Failure detection. The coordinator thread scores each node's
+     * heartbeat silence; a node past the phi threshold is taken offline,
+     * the sequences it replicated to us and that now route here are
+     * rebuilt from their replicas, and every block left short of replicas
+     * is copied again, most expensive to recompute first.
+     */
+    struct kv_phi_detector node_phi[KV_CACHE_MAX_NODES]; /* Under node_lock */
+    _Atomic uint64_t node_failures;
+    _Atomic uint64_t failover_sequences;
+    _Atomic uint64_t rereplicated_blocks;
+
+    /*
+     * Prefix cache snapshot. Publishing and evicting a prefix block
+     * queues a store or drop; the coordinator thread applies them every
+     * snapshot_interval_ms, copying each new block into the mapped file.
+     * After a restart, a lookup that runs past the live tree continues
+     * into the snapshot's records and loads the blocks it finds.
+     */
+    pthread_mutex_t snapshot_lock;
+    struct kv_snapshot snapshot;
+    struct kv_snap_item *snapshot_items; /* Flusher's, swapped with pending */
+    uint32_t snapshot_items_capacity;
+    uint32_t *snapshot_tokens;      /* Flusher's copy of one chunk */
+    void *snapshot_buffer;          /* ... and of one block */
+    uint64_t snapshot_restore_ns;   /* Mapping and indexing it on init */
+    _Atomic uint64_t warm_lookups;
+    _Atomic uint64_t warm_hits;
+
+    /* Prefetch queue, drained by the coordinator thread */
+    uint64_t prefetch_queue[KV_CACHE_PREFETCH_QUEUE];
+    uint32_t prefetch_head;
+    uint32_t prefetch_count;
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_cond;
 
     /* Coordinator state */
     bool running;
     pthread_t coordinator_thread;
 };
 
+/*
+ * Locking: sequence shard -> prefix_lock -> snapshot_lock -> block shard ->
+ * coherency_lock / replication_lock -> node_lock.
+ * At most one sequence shard is held. A second block shard is either
+ * taken with trylock (to reclaim or exchange pages across shards) or,
+ * for copy-on-write, both are locked in index order. prefetch_lock is
+ * taken alone; routing_lock is taken under at most a sequence shard and
+ * nothing is taken under it, and summary_lock is taken alone;
+ * replication_flush_lock is taken before any other lock. Block pointers
+ * returned by the API stay valid until the block's last reference is
+ * dropped; a block's data pointers are only valid while it is resident
+ * (KV_TIER_HOT).
+ *
+ * Blocks referenced more than once (forked sequences, published
+ * prefixes) are immutable: kv_cache_write_kv() refuses them, and
+ * kv_cache_append_tokens() first gives the sequence its own copy of a
+ * shared last block. Look blocks up again after appending. A sequence
+ * being sent to a peer holds one extra reference on each block until
+ * the peer acknowledges it, so its blocks are immutable and stay hot
+ * for that long.
+ *
+ * With a coherency protocol on, a sent block stays coherent with the
+ * peer's copy afterwards: writing either one invalidates the other
+ * (MESI). Under KV_COHERENCY_STRONG, writes return only once every
+ * stale copy is gone; kv_cache_coherency_flush() gives MESI callers the
+ * same point on demand.
+ *
+ * With replication on, each sequence picks replication_factor peers when it
+ * is created and its blocks are copied to them in the background as
+ * they are written (asynchronous durability). A caller that needs the
+ * replicas current at a commit point calls kv_cache_sync_replicas(),
+ * which returns once the peers have applied every update queued so far.
+ *
+ * With heartbeat_interval_ms set, a node that stops calling in through
+ * kv_cache_node_heartbeat() is declared dead (phi accrual); a heartbeat
+ * brings it back.
+ *
+ * With snapshot_path set, the prefix cache is mirrored into that file in
+ * the background and survives a restart: the file is mapped again on
+ * init, and restored prefixes are loaded as lookups first reach them.
+ *
+ * kv_cache_route_prompt() places a new request where its prompt's
+ * prefix is already cached: it follows the prompt's block hashes
+ * through every node's published summary and takes the longest match
+ * among nodes under the bounded-load cap, falling back to the ring.
+ *
+ * A sequence with a retention policy (kv_cache_set_retention()) drops
+ * blocks behind its window as it grows, so a streaming session holds a
+ * bounded number of blocks. Positions keep their indices; a dropped one
+ * reads as missing (kv_cache_get_sequence_block() fails on it), forks
+ * and transfers carry the gaps, and prefix publishing stops at the
+ * first one. The policy itself stays with the sequence it was set on.
+ *
+ * With enable_admission_control, kv_cache_create_sequence() reserves
+ * blocks for estimated_length and refuses a sequence the cache could
+ * not hold next to every reservation already made (blocks only the
+ * prefix cache holds count as free). With enable_preemption, an append
+ * that finds no block left preempts the least recently used other
+ * sequence (kept in per-shard LRU lists) instead of failing: it is
+ * swapped to a spill tier when there is room and that is cheaper than
+ * recomputing it, and dropped otherwise. A preempted sequence refuses
+ * appends until kv_cache_resume_sequence(), which says how many tokens
+ * must be prefilled again.
+ */
+
 /* Function prototypes */
 
 /* Initialization */
@@ -191,6 +588,10 @@ int kv_cache_allocate_block(struct kv_cache_coordinator *coord,
 int kv_cache_get_block(struct kv_cache_coordinator *coord,
                       uint64_t block_id,
                       struct kv_cache_block **block);
+int kv_cache_get_sequence_block(struct kv_cache_coordinator *coord,
+                               uint64_t sequence_id,
+                               uint32_t block_index,
+                               struct kv_cache_block **block);
 int kv_cache_free_block(struct kv_cache_coordinator *coord,
                        uint64_t block_id);
 
@@ -203,12 +604,72 @@ int kv_cache_append_tokens(struct kv_cache_coordinator *coord,
                           uint32_t num_tokens);
 int kv_cache_free_sequence(struct kv_cache_coordinator *coord,
                           uint64_t sequence_id);
+int kv_cache_fork_sequence(struct kv_cache_coordinator *coord,
+                           uint64_t parent_id,
+                           uint64_t child_id);
+int kv_cache_fork_beams(struct kv_cache_coordinator *coord,
+                        uint64_t parent_id,
+                        const uint64_t *child_ids,
+                        uint32_t num_children);
+
+/* Admission and preemption */
+int kv_cache_preempt_sequence(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id);
+int kv_cache_resume_sequence(struct kv_cache_coordinator *coord,
+                             uint64_t sequence_id);
+
+/* Retention */
+int kv_cache_set_retention(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const struct kv_retention_policy *policy);
+int kv_cache_update_attention(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              uint32_t first_block,
+                              const float *scores,
+                              uint32_t num_blocks);
+
+/* Quantized KV data (fp32 in [token][head][head_dim] order) */
+int kv_cache_write_kv(struct kv_cache_coordinator *coord,
+                     uint64_t block_id,
+                     uint32_t token_offset,
+                     uint32_t num_tokens,
+                     const float *keys,
+                     const float *values);
+int kv_cache_read_kv(struct kv_cache_coordinator *coord,
+                    uint64_t block_id,
+                    uint32_t token_offset,
+                    uint32_t num_tokens,
+                    float *keys,
+                    float *values);
+
+/* Tiered storage */
+int kv_cache_demote_block(struct kv_cache_coordinator *coord,
+                         uint64_t block_id,
+                         enum kv_block_tier tier);
+int kv_cache_demote_sequence(struct kv_cache_coordinator *coord,
+                            uint64_t sequence_id,
+                            enum kv_block_tier tier);
+int kv_cache_promote_block(struct kv_cache_coordinator *coord,
+                          uint64_t block_id);
+int kv_cache_prefetch_sequence(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              uint32_t first_block);
 
 /* Prefix caching */
 int kv_cache_find_prefix(struct kv_cache_coordinator *coord,
                         const uint32_t *tokens,
                         uint32_t num_tokens,
                         struct kv_sequence **matching_seq);
+int kv_cache_insert_prefix(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const uint32_t *tokens,
+                           uint32_t num_tokens);
+int kv_cache_attach_prefix(struct kv_cache_coordinator *coord,
+                           uint64_t sequence_id,
+                           const uint32_t *tokens,
+                           uint32_t num_tokens);
+uint32_t kv_cache_evict_prefixes(struct kv_cache_coordinator *coord,
+                                 uint32_t max_nodes);
 int kv_cache_share_prefix(struct kv_cache_coordinator *coord,
                          uint64_t seq_id_1,
                          uint64_t seq_id_2);
@@ -220,13 +681,33 @@ int kv_cache_evict_cost_aware(struct kv_cache_coordinator *coord,
                              uint64_t num_bytes_needed);
 struct kv_cache_block *kv_cache_select_victim(struct kv_cache_coordinator *coord);
 
+/* Transfer */
+int kv_cache_listen(struct kv_cache_coordinator *coord,
+                   const char *host,
+                   uint32_t port);
+int64_t kv_cache_transfer_sequence(struct kv_cache_coordinator *coord,
+                                   uint64_t sequence_id,
+                                   uint32_t target_node_id);
+int kv_cache_transfer_wait(struct kv_cache_coordinator *coord,
+                          uint64_t ticket,
+                          uint32_t timeout_ms);
+
 /* Routing */
 uint32_t kv_cache_route_sequence(struct kv_cache_coordinator *coord,
                                 uint64_t sequence_id);
+uint32_t kv_cache_route_prompt(struct kv_cache_coordinator *coord,
+                              uint64_t sequence_id,
+                              const uint32_t *tokens,
+                              uint32_t num_tokens,
+                              uint32_t *cached_tokens);
 int kv_cache_migrate_sequence(struct kv_cache_coordinator *coord,
                              uint64_t sequence_id,
                              uint32_t target_node_id);
 
+/* Coherency */
+int kv_cache_coherency_flush(struct kv_cache_coordinator *coord,
+                            uint32_t timeout_ms);
+
 /* Replication */
 int kv_cache_replicate_block(struct kv_cache_coordinator *coord,
                             uint64_t block_id,
@@ -241,11 +722,23 @@ float kv_cache_calculate_hit_rate(struct kv_cache_coordinator *coord);
 uint64_t kv_cache_get_total_usage(struct kv_cache_coordinator *coord);
 
 /* Utility functions */
+static inline uint64_t kv_cache_get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 static inline bool kv_cache_block_is_cached(struct kv_cache_block *block)
 {
     return block && block->state != KV_BLOCK_INVALID;
 }
 
+static inline bool kv_cache_block_is_resident(struct kv_cache_block *block)
+{
+    return kv_cache_block_is_cached(block) && block->tier == KV_TIER_HOT;
+}
+
 static inline float kv_cache_node_utilization(struct kv_cache_node *node)
 {
     if (node->total_capacity_bytes == 0)
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_block_table.h"
+
+/*
+ * Chunked Block Table Implementation
+ *
+ * Only the directory is ever reallocated, and it holds one pointer per
+ * 64 blocks, so growth copies a few bytes per thousand tokens. Freed
+ * sequences keep their first chunk for the next sequence in the slot.
+ */
+
+static uint32_t chunks_for(uint32_t num_slots)
+{
+    return (uint32_t)(((uint64_t)num_slots + KV_BLOCK_TABLE_CHUNK - 1) >>
+                      KV_BLOCK_TABLE_SHIFT);
+}
+
+static int dir_resize(struct kv_block_table *table, uint32_t capacity)
+{
+    uint32_t **dir = realloc(table->chunks, (size_t)capacity * sizeof(*dir));
+
+    if (!dir)
+        return -1;
+    table->chunks = dir;
+    table->dir_capacity = capacity;
+    return 0;
+}
+
+/* Make room for entries [0, @num_slots); existing entries stay put */
+int kv_block_table_reserve(struct kv_block_table *table, uint32_t num_slots)
+{
+    uint32_t need = chunks_for(num_slots);
+
+    if (!table)
+        return -1;
+    if (need <= table->num_chunks)
+        return 0;
+
+    if (need > table->dir_capacity) {
+        uint32_t cap = table->dir_capacity ? table->dir_capacity : KV_BLOCK_TABLE_MIN_DIR;
+
+        while (cap < need)
+            cap = cap > UINT32_MAX / 2 ? need : cap * 2;
+        if (dir_resize(table, cap) != 0)
+            return -1;
+    }
+
+    while (table->num_chunks < need) {
+        uint32_t *chunk = malloc(KV_BLOCK_TABLE_CHUNK * sizeof(uint32_t));
+
+        if (!chunk)
+            return -1;
+        table->chunks[table->num_chunks++] = chunk;
+    }
+
+    return 0;
+}
+
+/* Release chunks past the first @num_slots entries */
+void kv_block_table_trim(struct kv_block_table *table, uint32_t num_slots)
+{
+    uint32_t keep = chunks_for(num_slots);
+
+    if (!table)
+        return;
+
+    while (table->num_chunks > keep)
+        free(table->chunks[--table->num_chunks]);
+
+    if (keep == 0) {
+        free(table->chunks);
+        table->chunks = NULL;
+        table->dir_capacity = 0;
+    } else if (table->dir_capacity > 4 * keep &&
+               table->dir_capacity > KV_BLOCK_TABLE_MIN_DIR) {
+        /* A long sequence ended: give the directory back too */
+        dir_resize(table, keep > KV_BLOCK_TABLE_MIN_DIR ? keep : KV_BLOCK_TABLE_MIN_DIR);
+    }
+}
+
+void kv_block_table_destroy(struct kv_block_table *table)
+{
+    kv_block_table_trim(table, 0);
+}
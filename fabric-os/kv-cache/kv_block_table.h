@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_BLOCK_TABLE_H
+#define _KV_BLOCK_TABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Per-sequence block table: position -> block slot.
+ *
+ * Slots are 32-bit indices into the coordinator's block array, stored in
+ * fixed-size chunks hung off a directory that doubles as the sequence
+ * grows. Appending never moves existing entries, a lookup is two loads,
+ * and a short sequence costs one 256-byte chunk instead of a table
+ * sized for the longest context. Not thread-safe; the owning sequence
+ * shard's lock covers it.
+ */
+
+#define KV_BLOCK_TABLE_SHIFT 6
+#define KV_BLOCK_TABLE_CHUNK (1U << KV_BLOCK_TABLE_SHIFT) /* Slots per chunk */
+#define KV_BLOCK_TABLE_MIN_DIR 4
+#define KV_BLOCK_TABLE_NONE UINT32_MAX /* Position whose block was dropped */
+
+struct kv_block_table {
+    uint32_t **chunks;              /* Directory */
+    uint32_t num_chunks;            /* Chunks allocated */
+    uint32_t dir_capacity;
+};
+
+/* Function prototypes */
+int kv_block_table_reserve(struct kv_block_table *table, uint32_t num_slots);
+void kv_block_table_trim(struct kv_block_table *table, uint32_t num_slots);
+void kv_block_table_destroy(struct kv_block_table *table);
+
+/* Utility functions */
+
+/* Entry @index, which must be below the reserved size */
+static inline uint32_t kv_block_table_get(const struct kv_block_table *table,
+                                          uint32_t index)
+{
+    return table->chunks[index >> KV_BLOCK_TABLE_SHIFT]
+                        [index & (KV_BLOCK_TABLE_CHUNK - 1)];
+}
+
+static inline void kv_block_table_set(struct kv_block_table *table,
+                                      uint32_t index, uint32_t slot)
+{
+    table->chunks[index >> KV_BLOCK_TABLE_SHIFT]
+                 [index & (KV_BLOCK_TABLE_CHUNK - 1)] = slot;
+}
+
+static inline uint32_t kv_block_table_capacity(const struct kv_block_table *table)
+{
+    return table->num_chunks << KV_BLOCK_TABLE_SHIFT;
+}
+
+#endif /* _KV_BLOCK_TABLE_H */
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_coherency.h"
+
+/*
+ * Coherency Message Batch Implementation
+ *
+ * Entry arrays are allocated the first time a node is sent anything and
+ * then reused for every batch; writeback data grows by doubling. Taking
+ * a batch copies it into one contiguous payload that the transport owns.
+ */
+
+int kv_coh_outbox_init(struct kv_coh_outbox *outbox, uint32_t block_bytes)
+{
+    if (!outbox || block_bytes == 0)
+        return -1;
+
+    memset(outbox, 0, sizeof(*outbox));
+    outbox->block_bytes = block_bytes;
+    return 0;
+}
+
+void kv_coh_outbox_destroy(struct kv_coh_outbox *outbox)
+{
+    if (!outbox)
+        return;
+
+    for (uint32_t i = 0; i < KV_COH_MAX_NODES; i++) {
+        free(outbox->batches[i].entries);
+        free(outbox->batches[i].data);
+    }
+    memset(outbox, 0, sizeof(*outbox));
+}
+
+/*
+ * Queue @op on @block_id for @node. WRITEBACK copies @data (block_bytes).
+ * Callers send the batch once kv_coh_batch_full(); a full batch refuses
+ * more entries.
+ */
+int kv_coh_queue(struct kv_coh_outbox *outbox, uint32_t node, enum kv_coh_op op,
+                 uint64_t block_id, uint32_t num_tokens, const void *data)
+{
+    struct kv_coh_batch *batch;
+    struct kv_coh_entry *entry;
+
+    if (node >= KV_COH_MAX_NODES || op == 0 || op >= KV_COH_NUM_OPS ||
+        (op == KV_COH_WRITEBACK && !data))
+        return -1;
+
+    batch = &outbox->batches[node];
+    if (!batch->entries) {
+        batch->entries = calloc(KV_COH_BATCH_ENTRIES, sizeof(struct kv_coh_entry));
+        if (!batch->entries)
+            return -1;
+    }
+    if (batch->count >= KV_COH_BATCH_ENTRIES)
+        return -1;
+
+    if (op == KV_COH_WRITEBACK) {
+        if (batch->num_data == batch->data_capacity) {
+            uint32_t cap = batch->data_capacity ? batch->data_capacity * 2 : 4;
+            uint8_t *buf = realloc(batch->data, (size_t)cap * outbox->block_bytes);
+
+            if (!buf)
+                return -1;
+            batch->data = buf;
+            batch->data_capacity = cap;
+        }
+        memcpy(batch->data + (size_t)batch->num_data * outbox->block_bytes, data,
+               outbox->block_bytes);
+        batch->num_data++;
+    }
+
+    entry = &batch->entries[batch->count++];
+    entry->block_id = block_id;
+    entry->op = op;
+    entry->num_tokens = num_tokens;
+
+    outbox->pending |= kv_coh_node_bit(node);
+    outbox->queued[op]++;
+    return 0;
+}
+
+/*
+ * Detach @node's batch as one malloc()ed payload (the caller frees it),
+ * or NULL if nothing is queued or memory ran out (the batch is kept).
+ */
+void *kv_coh_take(struct kv_coh_outbox *outbox, uint32_t node,
+                  uint32_t *count, uint32_t *bytes)
+{
+    struct kv_coh_batch *batch;
+    size_t head, len;
+    uint8_t *payload;
+
+    if (node >= KV_COH_MAX_NODES)
+        return NULL;
+
+    batch = &outbox->batches[node];
+    if (batch->count == 0)
+        return NULL;
+
+    head = (size_t)batch->count * sizeof(struct kv_coh_entry);
+    len = head + (size_t)batch->num_data * outbox->block_bytes;
+    payload = malloc(len);
+    if (!payload)
+        return NULL;
+
+    memcpy(payload, batch->entries, head);
+    if (batch->num_data)
+        memcpy(payload + head, batch->data,
+               (size_t)batch->num_data * outbox->block_bytes);
+
+    *count = batch->count;
+    *bytes = (uint32_t)len;
+
+    batch->count = 0;
+    batch->num_data = 0;
+    outbox->pending &= ~kv_coh_node_bit(node);
+    outbox->messages++;
+    return payload;
+}
+
+/* Check a received payload and locate its entries and writeback data */
+int kv_coh_parse(const void *payload, uint32_t count, uint32_t bytes,
+                 uint32_t block_bytes, const struct kv_coh_entry **entries,
+                 const uint8_t **data)
+{
+    const struct kv_coh_entry *e = payload;
+    uint64_t head = (uint64_t)count * sizeof(struct kv_coh_entry);
+    uint64_t writebacks = 0;
+
+    if (!payload || head > bytes)
+        return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (e[i].op == 0 || e[i].op >= KV_COH_NUM_OPS)
+            return -1;
+        if (e[i].op == KV_COH_WRITEBACK)
+            writebacks++;
+    }
+    if (head + writebacks * block_bytes != bytes)
+        return -1;
+
+    *entries = e;
+    *data = (const uint8_t *)payload + head;
+    return 0;
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_COHERENCY_H
+#define _KV_COHERENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Coherency message batches.
+ *
+ * The coordinator's directory decides which nodes must hear about a
+ * block; the outbox collects those notices per destination node and
+ * hands each node's batch over as one message payload, so a write burst
+ * over many shared blocks costs one message per peer rather than one
+ * per block.
+ *
+ * A payload is @count entries followed by the data of each WRITEBACK
+ * entry, in entry order. Not thread-safe; the coordinator holds
+ * coherency_lock.
+ */
+
+#define KV_COH_MAX_NODES 64            /* Sharer sets are 64-bit masks */
+#define KV_COH_BATCH_ENTRIES 256       /* Entries per message */
+
+enum kv_coh_op {
+    KV_COH_INVALIDATE = 1,          /* Home -> sharer: drop your copy */
+    KV_COH_UPGRADE = 2,             /* Sharer -> home: I am writing my copy */
+    KV_COH_WRITEBACK = 3,           /* Owner -> home: modified data */
+    KV_COH_NUM_OPS,
+};
+
+struct kv_coh_entry {
+    uint64_t block_id;              /* Id at the home node */
+    uint32_t op;
+    uint32_t num_tokens;            /* WRITEBACK: tokens in the data */
+};
+
+/* Notices queued for one destination */
+struct kv_coh_batch {
+    struct kv_coh_entry *entries;
+    uint32_t count;
+    uint8_t *data;                  /* WRITEBACK payloads, grown on demand */
+    uint32_t num_data;
+    uint32_t data_capacity;         /* Payloads */
+};
+
+struct kv_coh_outbox {
+    struct kv_coh_batch batches[KV_COH_MAX_NODES];
+    uint32_t block_bytes;           /* WRITEBACK payload size */
+    uint64_t pending;               /* Nodes with queued entries */
+
+    /* Statistics */
+    uint64_t queued[KV_COH_NUM_OPS];
+    uint64_t messages;
+};
+
+/* Function prototypes */
+int kv_coh_outbox_init(struct kv_coh_outbox *outbox, uint32_t block_bytes);
+void kv_coh_outbox_destroy(struct kv_coh_outbox *outbox);
+int kv_coh_queue(struct kv_coh_outbox *outbox, uint32_t node, enum kv_coh_op op,
+                 uint64_t block_id, uint32_t num_tokens, const void *data);
+void *kv_coh_take(struct kv_coh_outbox *outbox, uint32_t node,
+                  uint32_t *count, uint32_t *bytes);
+int kv_coh_parse(const void *payload, uint32_t count, uint32_t bytes,
+                 uint32_t block_bytes, const struct kv_coh_entry **entries,
+                 const uint8_t **data);
+
+/* Utility functions */
+
+static inline uint64_t kv_coh_node_bit(uint32_t node)
+{
+    return node < KV_COH_MAX_NODES ? 1ULL << node : 0;
+}
+
+static inline bool kv_coh_batch_full(const struct kv_coh_outbox *outbox,
+                                     uint32_t node)
+{
+    return outbox->batches[node].count >= KV_COH_BATCH_ENTRIES;
+}
+
+#endif /* _KV_COHERENCY_H */
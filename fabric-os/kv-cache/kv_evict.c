@@ -0,0 +1,318 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_evict.h"
+#include "kv_index.h"
+
+/*
+ * KV Eviction Structures Implementation
+ *
+ * Heap entries are object indices; each sift writes the moved object's
+ * new position back into its link so that remove and rescore can start
+ * from the right place. The heap has room for every object, so inserts
+ * never allocate.
+ */
+
+#define HEAP_PARENT(i) (((i) - 1) / 2)
+
+static float heap_score(const struct kv_evict_set *set, uint32_t pos)
+{
+    return kv_evict_link_of(set, set->heap[pos])->score;
+}
+
+static void heap_place(struct kv_evict_set *set, uint32_t pos, uint32_t idx)
+{
+    set->heap[pos] = idx;
+    kv_evict_link_of(set, idx)->heap_pos = pos;
+}
+
+static void heap_sift_up(struct kv_evict_set *set, uint32_t pos)
+{
+    uint32_t idx = set->heap[pos];
+    float score = kv_evict_link_of(set, idx)->score;
+
+    while (pos > 0 && heap_score(set, HEAP_PARENT(pos)) > score) {
+        heap_place(set, pos, set->heap[HEAP_PARENT(pos)]);
+        pos = HEAP_PARENT(pos);
+    }
+    heap_place(set, pos, idx);
+}
+
+static void heap_sift_down(struct kv_evict_set *set, uint32_t pos, uint32_t size)
+{
+    uint32_t idx = set->heap[pos];
+    float score = kv_evict_link_of(set, idx)->score;
+
+    for (;;) {
+        uint32_t child = 2 * pos + 1;
+
+        if (child >= size)
+            break;
+        if (child + 1 < size && heap_score(set, child + 1) < heap_score(set, child))
+            child++;
+        if (heap_score(set, child) >= score)
+            break;
+
+        heap_place(set, pos, set->heap[child]);
+        pos = child;
+    }
+    heap_place(set, pos, idx);
+}
+
+static void heap_remove(struct kv_evict_set *set, uint32_t idx)
+{
+    struct kv_evict_link *link = kv_evict_link_of(set, idx);
+    uint32_t pos = link->heap_pos;
+    uint32_t moved;
+
+    if (pos == KV_EVICT_END)
+        return;
+
+    link->heap_pos = KV_EVICT_END;
+    if (pos == --set->heap_size)
+        return;
+
+    /* Fill the hole with the last entry, which may need to go either way */
+    moved = set->heap[set->heap_size];
+    heap_place(set, pos, moved);
+    heap_sift_down(set, pos, set->heap_size);
+    heap_sift_up(set, kv_evict_link_of(set, moved)->heap_pos);
+}
+
+/*
+ * Track up to @capacity objects of @stride bytes starting at @base, each
+ * with a struct kv_evict_link at @link_offset.
+ */
+int kv_evict_init(struct kv_evict_set *set, void *base, size_t stride,
+                  size_t link_offset, uint32_t capacity)
+{
+    if (!set || !base || capacity == 0 || capacity == KV_EVICT_END)
+        return -1;
+
+    memset(set, 0, sizeof(*set));
+
+    set->heap = calloc(capacity, sizeof(uint32_t));
+    if (!set->heap)
+        return -1;
+
+    set->base = base;
+    set->stride = stride;
+    set->link_offset = link_offset;
+    set->capacity = capacity;
+    set->lru_head = KV_EVICT_END;
+    set->lru_tail = KV_EVICT_END;
+
+    return 0;
+}
+
+void kv_evict_destroy(struct kv_evict_set *set)
+{
+    if (!set)
+        return;
+
+    free(set->heap);
+    memset(set, 0, sizeof(*set));
+}
+
+/* Add @idx as most recently used with heap key @score */
+void kv_evict_insert(struct kv_evict_set *set, uint32_t idx, float score)
+{
+    struct kv_evict_link *link;
+
+    if (idx >= set->capacity)
+        return;
+
+    link = kv_evict_link_of(set, idx);
+    if (link->queued)
+        return;
+
+    link->queued = true;
+    link->score = score;
+    link->heap_pos = KV_EVICT_END;
+    link->next = KV_EVICT_END;
+    link->prev = set->lru_tail;
+    if (set->lru_tail != KV_EVICT_END)
+        kv_evict_link_of(set, set->lru_tail)->next = idx;
+    else
+        set->lru_head = idx;
+    set->lru_tail = idx;
+    set->count++;
+
+    kv_evict_heap_push(set, idx);
+}
+
+void kv_evict_remove(struct kv_evict_set *set, uint32_t idx)
+{
+    struct kv_evict_link *link = kv_evict_link_of(set, idx);
+
+    if (!link->queued)
+        return;
+
+    heap_remove(set, idx);
+
+    if (link->prev != KV_EVICT_END)
+        kv_evict_link_of(set, link->prev)->next = link->next;
+    else
+        set->lru_head = link->next;
+    if (link->next != KV_EVICT_END)
+        kv_evict_link_of(set, link->next)->prev = link->prev;
+    else
+        set->lru_tail = link->prev;
+
+    link->queued = false;
+    link->prev = KV_EVICT_END;
+    link->next = KV_EVICT_END;
+    set->count--;
+}
+
+/* Move @idx to the most recently used end */
+void kv_evict_touch(struct kv_evict_set *set, uint32_t idx)
+{
+    struct kv_evict_link *link = kv_evict_link_of(set, idx);
+
+    if (!link->queued || set->lru_tail == idx)
+        return;
+
+    if (link->prev != KV_EVICT_END)
+        kv_evict_link_of(set, link->prev)->next = link->next;
+    else
+        set->lru_head = link->next;
+    kv_evict_link_of(set, link->next)->prev = link->prev;
+
+    link->prev = set->lru_tail;
+    link->next = KV_EVICT_END;
+    kv_evict_link_of(set, set->lru_tail)->next = idx;
+    set->lru_tail = idx;
+}
+
+/* Change @idx's heap key */
+void kv_evict_rescore(struct kv_evict_set *set, uint32_t idx, float score)
+{
+    struct kv_evict_link *link = kv_evict_link_of(set, idx);
+    float old = link->score;
+
+    link->score = score;
+    if (link->heap_pos == KV_EVICT_END)
+        return;
+
+    if (score < old)
+        heap_sift_up(set, link->heap_pos);
+    else
+        heap_sift_down(set, link->heap_pos, set->heap_size);
+}
+
+/*
+ * Take the lowest-scored member off the heap (it stays on the recency
+ * list). Callers that skip it must kv_evict_heap_push() it back.
+ */
+uint32_t kv_evict_heap_pop(struct kv_evict_set *set)
+{
+    uint32_t idx;
+
+    if (set->heap_size == 0)
+        return KV_EVICT_END;
+
+    idx = set->heap[0];
+    heap_remove(set, idx);
+    return idx;
+}
+
+void kv_evict_heap_push(struct kv_evict_set *set, uint32_t idx)
+{
+    struct kv_evict_link *link = kv_evict_link_of(set, idx);
+
+    if (!link->queued || link->heap_pos != KV_EVICT_END ||
+        set->heap_size >= set->capacity)
+        return;
+
+    heap_place(set, set->heap_size, idx);
+    heap_sift_up(set, set->heap_size++);
+}
+
+/* Size for about @capacity distinct hot keys */
+int kv_sketch_init(struct kv_freq_sketch *sketch, uint32_t capacity)
+{
+    uint32_t words = 8;
+
+    if (!sketch)
+        return -1;
+
+    memset(sketch, 0, sizeof(*sketch));
+
+    /* 16 counters per word, four per key: ~one word per four keys */
+    while (words < capacity / 4 && words < (1U << 26))
+        words <<= 1;
+
+    sketch->table = calloc(words, sizeof(uint64_t));
+    if (!sketch->table)
+        return -1;
+
+    sketch->mask = words - 1;
+    sketch->sample_size = capacity > 0 ? capacity * KV_SKETCH_SAMPLE_FACTOR :
+                          KV_SKETCH_SAMPLE_FACTOR;
+    return 0;
+}
+
+void kv_sketch_destroy(struct kv_freq_sketch *sketch)
+{
+    if (!sketch)
+        return;
+
+    free(sketch->table);
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+/* Word and nibble of @key's counter in row @row */
+static void sketch_slot(const struct kv_freq_sketch *sketch, uint64_t hash,
+                        uint32_t row, uint32_t *word, uint32_t *shift)
+{
+    uint64_t h = kv_hash64(hash + row * 0x9e3779b97f4a7c15ULL);
+
+    *word = (uint32_t)h & sketch->mask;
+    /* Each row uses its own quarter of the word's 16 counters */
+    *shift = (row * 4 + (uint32_t)(h >> 60) % 4) * 4;
+}
+
+/* Halve every counter: popularity decays once per sample period */
+static void sketch_age(struct kv_freq_sketch *sketch)
+{
+    for (uint32_t i = 0; i <= sketch->mask; i++)
+        sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ULL;
+    sketch->additions /= 2;
+}
+
+void kv_sketch_increment(struct kv_freq_sketch *sketch, uint64_t key)
+{
+    uint64_t hash = kv_hash64(key);
+    bool added = false;
+
+    for (uint32_t row = 0; row < 4; row++) {
+        uint32_t word, shift;
+
+        sketch_slot(sketch, hash, row, &word, &shift);
+        if (((sketch->table[word] >> shift) & 0xf) < KV_SKETCH_MAX_COUNT) {
+            sketch->table[word] += 1ULL << shift;
+            added = true;
+        }
+    }
+
+    if (added && ++sketch->additions >= sketch->sample_size)
+        sketch_age(sketch);
+}
+
+uint32_t kv_sketch_estimate(const struct kv_freq_sketch *sketch, uint64_t key)
+{
+    uint64_t hash = kv_hash64(key);
+    uint32_t min = KV_SKETCH_MAX_COUNT;
+
+    for (uint32_t row = 0; row < 4; row++) {
+        uint32_t word, shift, count;
+
+        sketch_slot(sketch, hash, row, &word, &shift);
+        count = (sketch->table[word] >> shift) & 0xf;
+        if (count < min)
+            min = count;
+    }
+
+    return min;
+}
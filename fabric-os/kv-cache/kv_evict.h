@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_EVICT_H
+#define _KV_EVICT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Eviction bookkeeping for KV blocks.
+ *
+ * An eviction set tracks objects in a caller-owned array through a link
+ * embedded in each object (intrusive, so nothing is allocated per
+ * insert). Objects are named by their index in the array. Every member
+ * is on a doubly linked recency list (LRU at the head) and in a binary
+ * min-heap ordered by a caller-supplied score; the link records the
+ * heap position, so removing or rescoring a member is O(log n).
+ *
+ * The frequency sketch is TinyLFU: a count-min sketch of 4-bit counters,
+ * four per key, that halves every counter after a sample period so old
+ * popularity fades. Items seen once stay at the bottom, which keeps
+ * one-hit wonders from outliving blocks that are actually reused.
+ *
+ * Not thread-safe; the coordinator keeps one set and one sketch per
+ * block shard under the shard lock.
+ */
+
+#define KV_EVICT_END UINT32_MAX
+#define KV_SKETCH_MAX_COUNT 15
+#define KV_SKETCH_SAMPLE_FACTOR 10     /* Reset after 10 x capacity adds */
+
+struct kv_evict_link {
+    uint32_t prev;                  /* Recency list */
+    uint32_t next;
+    uint32_t heap_pos;
+    float score;                    /* Heap key, lowest evicted first */
+    bool queued;                    /* Member of the set */
+};
+
+struct kv_evict_set {
+    uint8_t *base;                  /* Object 0 */
+    size_t stride;                  /* Bytes between objects */
+    size_t link_offset;             /* offsetof(object, link) */
+    uint32_t capacity;
+
+    uint32_t lru_head;              /* Least recently used */
+    uint32_t lru_tail;
+    uint32_t count;
+
+    uint32_t *heap;                 /* Object indices, capacity entries */
+    uint32_t heap_size;
+};
+
+struct kv_freq_sketch {
+    uint64_t *table;                /* 16 counters per word */
+    uint32_t mask;                  /* Words - 1 */
+    uint32_t additions;
+    uint32_t sample_size;
+};
+
+/* Function prototypes */
+int kv_evict_init(struct kv_evict_set *set, void *base, size_t stride,
+                  size_t link_offset, uint32_t capacity);
+void kv_evict_destroy(struct kv_evict_set *set);
+void kv_evict_insert(struct kv_evict_set *set, uint32_t idx, float score);
+void kv_evict_remove(struct kv_evict_set *set, uint32_t idx);
+void kv_evict_touch(struct kv_evict_set *set, uint32_t idx);
+void kv_evict_rescore(struct kv_evict_set *set, uint32_t idx, float score);
+uint32_t kv_evict_heap_pop(struct kv_evict_set *set);
+void kv_evict_heap_push(struct kv_evict_set *set, uint32_t idx);
+
+int kv_sketch_init(struct kv_freq_sketch *sketch, uint32_t capacity);
+void kv_sketch_destroy(struct kv_freq_sketch *sketch);
+void kv_sketch_increment(struct kv_freq_sketch *sketch, uint64_t key);
+uint32_t kv_sketch_estimate(const struct kv_freq_sketch *sketch, uint64_t key);
+
+/* Utility functions */
+
+static inline struct kv_evict_link *kv_evict_link_of(const struct kv_evict_set *set,
+                                                     uint32_t idx)
+{
+    return (struct kv_evict_link *)(set->base + (size_t)idx * set->stride +
+                                    set->link_offset);
+}
+
+static inline bool kv_evict_queued(const struct kv_evict_set *set, uint32_t idx)
+{
+    return kv_evict_link_of(set, idx)->queued;
+}
+
+/* Iterate from least to most recently used */
+static inline uint32_t kv_evict_lru_first(const struct kv_evict_set *set)
+{
+    return set->lru_head;
+}
+
+static inline uint32_t kv_evict_lru_next(const struct kv_evict_set *set,
+                                         uint32_t idx)
+{
+    return kv_evict_link_of(set, idx)->next;
+}
+
+#endif /* _KV_EVICT_H */
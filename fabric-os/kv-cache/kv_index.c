@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kv_index.h"
+
+/*
+ * Robin Hood Hash Index Implementation
+ *
+ * On insert, an entry that has probed further than the resident entry
+ * takes its place and the resident continues probing ("rob the rich").
+ * This keeps probe lengths short and nearly uniform, so a lookup is one
+ * or two cache lines even at high load, and a miss can stop as soon as
+ * it meets an entry closer to its home than the probe is.
+ */
+
+static uint32_t round_up_pow2(uint32_t n)
+{
+    uint32_t cap = KV_INDEX_MIN_CAPACITY;
+
+    while (cap < n && cap < (1U << 31))
+        cap <<= 1;
+    return cap;
+}
+
+static int index_alloc(struct kv_index *index, uint32_t capacity)
+{
+    index->entries = calloc(capacity, sizeof(struct kv_index_entry));
+    if (!index->entries)
+        return -1;
+
+    index->capacity = capacity;
+    index->mask = capacity - 1;
+    index->count = 0;
+    return 0;
+}
+
+/* Initialize, sized so @expected_entries fit without growing */
+int kv_index_init(struct kv_index *index, uint32_t expected_entries)
+{
+    uint64_t want;
+
+    if (!index)
+        return -1;
+
+    want = (uint64_t)expected_entries * KV_INDEX_MAX_LOAD_DEN /
+           KV_INDEX_MAX_LOAD_NUM + 1;
+    if (want > (1U << 31))
+        want = 1U << 31;
+
+    return index_alloc(index, round_up_pow2((uint32_t)want));
+}
+
+void kv_index_destroy(struct kv_index *index)
+{
+    if (!index)
+        return;
+
+    free(index->entries);
+    memset(index, 0, sizeof(*index));
+}
+
+void kv_index_clear(struct kv_index *index)
+{
+    if (!index || !index->entries)
+        return;
+
+    memset(index->entries, 0, (size_t)index->capacity * sizeof(*index->entries));
+    index->count = 0;
+}
+
+/* Insert without load check; key must not be present */
+static void index_place(struct kv_index *index, uint64_t key, uint32_t value)
+{
+    struct kv_index_entry cur = { key, value, 1 };
+    uint32_t pos = (uint32_t)kv_hash64(key) & index->mask;
+
+    for (;;) {
+        struct kv_index_entry *e = &index->entries[pos];
+
+        if (e->dist == 0) {
+            *e = cur;
+            index->count++;
+            return;
+        }
+
+        if (e->dist < cur.dist) {
+            struct kv_index_entry tmp = *e;
+            *e = cur;
+            cur = tmp;
+        }
+
+        pos = (pos + 1) & index->mask;
+        cur.dist++;
+    }
+}
+
+static int index_grow(struct kv_index *index)
+{
+    struct kv_index old = *index;
+
+    if (old.capacity >= (1U << 31))
+        return -1;
+
+    if (index_alloc(index, old.capacity << 1) != 0) {
+        *index = old;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < old.capacity; i++) {
+        if (old.entries[i].dist)
+            index_place(index, old.entries[i].key, old.entries[i].value);
+    }
+
+    free(old.entries);
+    return 0;
+}
+
+static struct kv_index_entry *index_find(const struct kv_index *index,
+                                         uint64_t key)
+{
+    uint32_t pos = (uint32_t)kv_hash64(key) & index->mask;
+    uint32_t dist = 1;
+
+    for (;;) {
+        struct kv_index_entry *e = &index->entries[pos];
+
+        /* Empty, or resident is closer to home than we are: absent */
+        if (e->dist < dist)
+            return NULL;
+        if (e->key == key)
+            return e;
+
+        pos = (pos + 1) & index->mask;
+        dist++;
+    }
+}
+
+/* Insert or update. Returns 0 on success, -1 if the table cannot grow. */
+int kv_index_insert(struct kv_index *index, uint64_t key, uint32_t value)
+{
+    struct kv_index_entry *e;
+
+    if (!index || !index->entries)
+        return -1;
+
+    e = index_find(index, key);
+    if (e) {
+        e->value = value;
+        return 0;
+    }
+
+    if ((uint64_t)(index->count + 1) * KV_INDEX_MAX_LOAD_DEN >
+        (uint64_t)index->capacity * KV_INDEX_MAX_LOAD_NUM) {
+        if (index_grow(index) != 0) {
+            fprintf(stderr, "kv_index: cannot grow beyond %u entries\n",
+                    index->capacity);
+            return -1;
+        }
+    }
+
+    index_place(index, key, value);
+    return 0;
+}
+
+bool kv_index_lookup(const struct kv_index *index, uint64_t key,
+                     uint32_t *value)
+{
+    struct kv_index_entry *e;
+
+    if (!index || !index->entries)
+        return false;
+
+    e = index_find(index, key);
+    if (!e)
+        return false;
+
+    if (value)
+        *value = e->value;
+    return true;
+}
+
+/* Remove with backward-shift deletion (no tombstones) */
+bool kv_index_remove(struct kv_index *index, uint64_t key, uint32_t *value)
+{
+    struct kv_index_entry *e;
+    uint32_t pos, next;
+
+    if (!index || !index->entries)
+        return false;
+
+    e = index_find(index, key);
+    if (!e)
+        return false;
+
+    if (value)
+        *value = e->value;
+
+    pos = (uint32_t)(e - index->entries);
+    for (;;) {
+        next = (pos + 1) & index->mask;
+        if (index->entries[next].dist <= 1)
+            break;
+
+        index->entries[pos] = index->entries[next];
+        index->entries[pos].dist--;
+        pos = next;
+    }
+
+    memset(&index->entries[pos], 0, sizeof(index->entries[pos]));
+    index->count--;
+    return true;
+}
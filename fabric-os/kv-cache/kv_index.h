@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_INDEX_H
+#define _KV_INDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Open-addressed Robin Hood hash index: 64-bit key -> 32-bit slot.
+ *
+ * Entries are 16 bytes (four per cache line) stored inline, probe
+ * distances are bounded by the Robin Hood invariant, and deletion uses
+ * backward shifting so there are no tombstones. Not thread-safe; the
+ * owner serializes access.
+ */
+
+#define KV_INDEX_MIN_CAPACITY 16
+#define KV_INDEX_MAX_LOAD_NUM 7         /* Grow above 7/8 full */
+#define KV_INDEX_MAX_LOAD_DEN 8
+
+struct kv_index_entry {
+    uint64_t key;
+    uint32_t value;
+    uint32_t dist;                      /* Probe distance + 1, 0 = empty */
+};
+
+struct kv_index {
+    struct kv_index_entry *entries;
+    uint32_t capacity;                  /* Power of two */
+    uint32_t mask;
+    uint32_t count;
+};
+
+/* Function prototypes */
+int kv_index_init(struct kv_index *index, uint32_t expected_entries);
+void kv_index_destroy(struct kv_index *index);
+int kv_index_insert(struct kv_index *index, uint64_t key, uint32_t value);
+bool kv_index_lookup(const struct kv_index *index, uint64_t key,
+                     uint32_t *value);
+bool kv_index_remove(struct kv_index *index, uint64_t key, uint32_t *value);
+void kv_index_clear(struct kv_index *index);
+
+/* Utility functions */
+
+/* 64-bit finalizer (MurmurHash3 fmix64); also used for sharding/routing */
+static inline uint64_t kv_hash64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint32_t kv_index_count(const struct kv_index *index)
+{
+    return index->count;
+}
+
+#endif /* _KV_INDEX_H */
@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "distributed_kv_cache.h"
+
+/*
+ * kv-loopback: run several coordinators in one process, connected over
+ * 127.0.0.1, and move sequences between them with the block transport.
+ *
+ * Node 0 creates the sequences, fills every block with a byte pattern
+ * derived from its sequence and position, and queues every transfer at
+ * once, round robin over the other nodes, so they are pipelined. Each
+ * copy is then checked block by block on its destination, and the bytes
+ * counted by the sender and by each receiver must agree. Exits non-zero
+ * on any failure.
+ */
+
+#define LOOPBACK_SLACK_BLOCKS 64        /* Per node, beyond the sequences */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n <n>         coordinators, node 0 sends (default 3)\n"
+            "  -s <n>         sequences to transfer (default 4)\n"
+            "  -b <n>         blocks per sequence (default 1024)\n"
+            "  -t <ms>        per-transfer timeout (default 5000)\n",
+            prog);
+}
+
+static uint8_t block_pattern(uint64_t sequence_id, uint32_t index)
+{
+    return (uint8_t)(sequence_id * 31 + index);
+}
+
+static uint32_t destination(uint64_t sequence_id, uint32_t num_nodes)
+{
+    return 1 + (uint32_t)((sequence_id - 1) % (num_nodes - 1));
+}
+
+/* Create sequence @sequence_id on @coord and fill its blocks */
+static int fill_sequence(struct kv_cache_coordinator *coord, uint64_t sequence_id,
+                         uint32_t num_blocks)
+{
+    if (kv_cache_create_sequence(coord, sequence_id, 0) != 0 ||
+        kv_cache_append_tokens(coord, sequence_id,
+                               num_blocks * coord->config.block_size_tokens) != 0)
+        return -1;
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        struct kv_cache_block *blk;
+
+        if (kv_cache_get_sequence_block(coord, sequence_id, i, &blk) != 0)
+            return -1;
+        memset(blk->key_data, block_pattern(sequence_id, i), coord->block_bytes);
+    }
+    return 0;
+}
+
+/* Number of blocks of @sequence_id on @coord that did not arrive intact */
+static uint32_t check_sequence(struct kv_cache_coordinator *coord, uint64_t sequence_id,
+                               uint32_t num_blocks)
+{
+    uint32_t bad = 0;
+
+    for (uint32_t i = 0; i < num_blocks; i++) {
+        struct kv_cache_block *blk;
+        const uint8_t *data;
+        uint8_t want = block_pattern(sequence_id, i);
+
+        if (kv_cache_get_sequence_block(coord, sequence_id, i, &blk) != 0) {
+            bad++;
+            continue;
+        }
+
+        data = blk->key_data;
+        for (uint32_t b = 0; b < coord->block_bytes; b++) {
+            if (data[b] != want) {
+                bad++;
+                break;
+            }
+        }
+    }
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    struct kv_cache_coordinator *nodes;
+    uint32_t num_nodes = 3, num_sequences = 4, num_blocks = 1024, timeout_ms = 5000;
+    uint64_t start_ns, queued_ns, done_ns, sent = 0, received = 0;
+    uint32_t initialized = 0, failures = 0;
+    int64_t *tickets = NULL;
+    int opt, ret = 1;
+
+    while ((opt = getopt(argc, argv, "n:s:b:t:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            num_nodes = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            num_sequences = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            num_blocks = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            timeout_ms = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (num_nodes < 2 || num_nodes > KV_CACHE_MAX_NODES ||
+        num_sequences == 0 || num_blocks == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    nodes = calloc(num_nodes, sizeof(*nodes));
+    tickets = calloc(num_sequences, sizeof(*tickets));
+    if (!nodes || !tickets) {
+        fprintf(stderr, "Out of memory\n");
+        goto out;
+    }
+
+    /* Every node can hold everything node 0 sends */
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        struct kv_cache_config config;
+
+        memset(&config, 0, sizeof(config));
+        config.total_capacity_bytes =
+            ((uint64_t)num_sequences * num_blocks + LOOPBACK_SLACK_BLOCKS) *
+            2 * KV_CACHE_PAGE_SIZE;
+        config.local_node_id = i;
+        if (kv_cache_init(&nodes[i], &config) != 0) {
+            fprintf(stderr, "Node %u: init failed\n", i);
+            goto out;
+        }
+        initialized++;
+    }
+
+    for (uint32_t i = 0; i < num_nodes; i++) {
+        int port = kv_cache_listen(&nodes[i], "127.0.0.1", 0);
+
+        if (port <= 0) {
+            fprintf(stderr, "Node %u: cannot listen\n", i);
+            goto out;
+        }
+
+        for (uint32_t j = 0; j < num_nodes; j++) {
+            struct kv_cache_node node;
+
+            memset(&node, 0, sizeof(node));
+            strcpy(node.hostname, "127.0.0.1");
+            node.port = (uint32_t)port;
+            node.total_capacity_bytes = nodes[i].config.total_capacity_bytes;
+            if (kv_cache_register_node(&nodes[j], &node) != (int)i) {
+                fprintf(stderr, "Node %u: cannot register node %u\n", j, i);
+                goto out;
+            }
+        }
+    }
+
+    for (uint64_t s = 1; s <= num_sequences; s++) {
+        if (fill_sequence(&nodes[0], s, num_blocks) != 0) {
+            fprintf(stderr, "Sequence %llu: cannot fill %u blocks\n",
+                    (unsigned long long)s, num_blocks);
+            goto out;
+        }
+    }
+
+    start_ns = kv_cache_get_time_ns();
+    for (uint64_t s = 1; s <= num_sequences; s++)
+        tickets[s - 1] = kv_cache_transfer_sequence(&nodes[0], s,
+                                                    destination(s, num_nodes));
+    queued_ns = kv_cache_get_time_ns();
+
+    for (uint64_t s = 1; s <= num_sequences; s++) {
+        if (tickets[s - 1] < 0 ||
+            kv_cache_transfer_wait(&nodes[0], (uint64_t)tickets[s - 1], timeout_ms) != 0) {
+            fprintf(stderr, "Sequence %llu: transfer to node %u failed\n",
+                    (unsigned long long)s, destination(s, num_nodes));
+            failures++;
+        }
+    }
+    done_ns = kv_cache_get_time_ns();
+
+    for (uint64_t s = 1; s <= num_sequences; s++) {
+        uint32_t bad = check_sequence(&nodes[destination(s, num_nodes)], s, num_blocks);
+
+        if (bad) {
+            fprintf(stderr, "Sequence %llu: %u of %u blocks wrong on node %u\n",
+                    (unsigned long long)s, bad, num_blocks, destination(s, num_nodes));
+            failures++;
+        }
+    }
+
+    for (uint32_t i = 1; i < num_nodes; i++) {
+        sent += atomic_load_explicit(&nodes[0].node_transfer_bytes[i],
+                                     memory_order_relaxed);
+        received += atomic_load_explicit(&nodes[i].node_transfer_bytes[0],
+                                         memory_order_relaxed);
+    }
+    if (sent != received) {
+        fprintf(stderr, "Byte counters disagree: sent %llu, received %llu\n",
+                (unsigned long long)sent, (unsigned long long)received);
+        failures++;
+    }
+
+    printf("\n%u x %u blocks (%.1f MB) to %u peers: queued in %.3f ms, "
+           "done in %.2f ms, %llu bytes on the wire\n",
+           num_sequences, num_blocks,
+           (double)num_sequences * num_blocks * nodes[0].block_bytes / 1e6,
+           num_nodes - 1, (double)(queued_ns - start_ns) / 1e6,
+           (double)(done_ns - start_ns) / 1e6, (unsigned long long)sent);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    ret = failures ? 1 : 0;
+
+out:
+    for (uint32_t i = 0; i < initialized; i++)
+        kv_cache_cleanup(&nodes[i]);
+    free(tickets);
+    free(nodes);
+    return ret;
+}
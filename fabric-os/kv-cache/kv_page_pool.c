@@ -0,0 +1,278 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "kv_page_pool.h"
+
+/*
+ * KV Page Pool Implementation
+ *
+ * Each arena is one anonymous mapping. We ask for explicit hugepages
+ * first (reserved up front, so a short pool fails here rather than with
+ * SIGBUS on first touch) and fall back to transparent hugepages
+ * (MADV_HUGEPAGE) when not enough are reserved. On multi-node systems
+ * the mapping is bound to its node with mbind() before it is touched,
+ * so first-touch places it locally.
+ *
+ * The free list is a Treiber stack of page indices. The head carries a
+ * tag that is bumped on every update, so a pop that raced with a
+ * pop/push of the same page fails its CAS instead of corrupting the list.
+ */
+
+#define MPOL_PREFERRED_MODE 1
+
+#define HEAD_INDEX(h) ((uint32_t)(h))
+#define HEAD_TAG(h) ((uint32_t)((h) >> 32))
+#define MAKE_HEAD(tag, idx) (((uint64_t)(tag) << 32) | (uint32_t)(idx))
+
+static void arena_bind(struct kv_page_arena *arena)
+{
+#ifdef SYS_mbind
+    unsigned long nodemask[(KV_PAGE_MAX_ARENAS + 63) / 64] = { 0 };
+
+    nodemask[arena->numa_node / 64] = 1UL << (arena->numa_node % 64);
+
+    /* Best effort: without a NUMA kernel the pages just land anywhere */
+    syscall(SYS_mbind, arena->base, arena->map_bytes, MPOL_PREFERRED_MODE,
+            nodemask, KV_PAGE_MAX_ARENAS + 1, 0);
+#else
+    (void)arena;
+#endif
+}
+
+static int arena_map(struct kv_page_arena *arena, uint64_t bytes)
+{
+    uint64_t huge_bytes = (bytes + KV_PAGE_HUGEPAGE_SIZE - 1) &
+                          ~(KV_PAGE_HUGEPAGE_SIZE - 1);
+    void *base = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    base = mmap(NULL, huge_bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+
+    if (base != MAP_FAILED) {
+        arena->hugepages = true;
+        arena->map_bytes = huge_bytes;
+    } else {
+        base = mmap(NULL, huge_bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED)
+            return -1;
+#ifdef MADV_HUGEPAGE
+        madvise(base, huge_bytes, MADV_HUGEPAGE);
+#endif
+        arena->hugepages = false;
+        arena->map_bytes = huge_bytes;
+    }
+
+    arena->base = base;
+    return 0;
+}
+
+static void arena_unmap(struct kv_page_arena *arena)
+{
+    if (arena->base)
+        munmap(arena->base, arena->map_bytes);
+    free((void *)arena->next);
+    memset(arena, 0, sizeof(*arena));
+}
+
+/*
+ * Create @total_pages pages of @page_bytes spread evenly over
+ * @num_numa_nodes arenas (0 = one per detected node).
+ */
+int kv_page_pool_init(struct kv_page_pool *pool, uint32_t page_bytes,
+                      uint32_t total_pages, uint32_t num_numa_nodes)
+{
+    uint32_t first = 0;
+
+    if (!pool || page_bytes == 0 || total_pages == 0 ||
+        total_pages == KV_PAGE_NONE)
+        return -1;
+
+    memset(pool, 0, sizeof(*pool));
+
+    if (num_numa_nodes == 0)
+        num_numa_nodes = kv_page_detect_numa_nodes();
+    if (num_numa_nodes > KV_PAGE_MAX_ARENAS)
+        num_numa_nodes = KV_PAGE_MAX_ARENAS;
+    if (num_numa_nodes > total_pages)
+        num_numa_nodes = total_pages;
+
+    pool->page_bytes = page_bytes;
+    pool->total_pages = total_pages;
+
+    for (uint32_t n = 0; n < num_numa_nodes; n++) {
+        struct kv_page_arena *arena = &pool->arenas[n];
+        uint32_t pages = total_pages / num_numa_nodes +
+                         (n < total_pages % num_numa_nodes ? 1 : 0);
+
+        arena->numa_node = (int)n;
+        arena->first_page = first;
+        arena->num_pages = pages;
+        arena->next = malloc(pages * sizeof(*arena->next));
+
+        if (!arena->next || arena_map(arena, (uint64_t)pages * page_bytes) != 0) {
+            fprintf(stderr, "kv_page_pool: cannot map %u pages on node %u\n",
+                    pages, n);
+            pool->num_arenas = n + 1;
+            kv_page_pool_destroy(pool);
+            return -1;
+        }
+
+        if (num_numa_nodes > 1)
+            arena_bind(arena);
+
+        /* Stack pops low pages first */
+        for (uint32_t i = 0; i < pages; i++)
+            atomic_store_explicit(&arena->next[i],
+                                  i + 1 < pages ? i + 1 : KV_PAGE_NONE,
+                                  memory_order_relaxed);
+        atomic_store(&arena->free_head, MAKE_HEAD(0, 0));
+        atomic_store(&arena->free_count, pages);
+
+        first += pages;
+    }
+
+    pool->num_arenas = num_numa_nodes;
+    return 0;
+}
+
+void kv_page_pool_destroy(struct kv_page_pool *pool)
+{
+    if (!pool)
+        return;
+
+    for (uint32_t i = 0; i < pool->num_arenas; i++)
+        arena_unmap(&pool->arenas[i]);
+    pool->num_arenas = 0;
+}
+
+static uint32_t arena_pop(struct kv_page_arena *arena)
+{
+    uint64_t head = atomic_load_explicit(&arena->free_head,
+                                         memory_order_acquire);
+    uint32_t idx, next;
+
+    do {
+        idx = HEAD_INDEX(head);
+        if (idx == KV_PAGE_NONE)
+            return KV_PAGE_NONE;
+        next = atomic_load_explicit(&arena->next[idx], memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(
+                 &arena->free_head, &head, MAKE_HEAD(HEAD_TAG(head) + 1, next),
+                 memory_order_acq_rel, memory_order_acquire));
+
+    atomic_fetch_sub_explicit(&arena->free_count, 1, memory_order_relaxed);
+    return idx;
+}
+
+static void arena_push(struct kv_page_arena *arena, uint32_t idx)
+{
+    uint64_t head = atomic_load_explicit(&arena->free_head,
+                                         memory_order_relaxed);
+
+    do {
+        atomic_store_explicit(&arena->next[idx], HEAD_INDEX(head),
+                              memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(
+                 &arena->free_head, &head, MAKE_HEAD(HEAD_TAG(head) + 1, idx),
+                 memory_order_release, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&arena->free_count, 1, memory_order_relaxed);
+}
+
+/*
+ * Take a page, preferring @numa_node's arena (-1 = caller's node) and
+ * falling back to the others. Returns KV_PAGE_NONE when all are empty.
+ */
+uint32_t kv_page_alloc(struct kv_page_pool *pool, int numa_node)
+{
+    uint32_t home, idx;
+
+    if (!pool || pool->num_arenas == 0)
+        return KV_PAGE_NONE;
+
+    if (numa_node < 0)
+        numa_node = kv_page_current_numa_node();
+    home = (uint32_t)numa_node % pool->num_arenas;
+
+    for (uint32_t i = 0; i < pool->num_arenas; i++) {
+        struct kv_page_arena *arena = &pool->arenas[(home + i) % pool->num_arenas];
+
+        idx = arena_pop(arena);
+        if (idx == KV_PAGE_NONE)
+            continue;
+
+        atomic_fetch_add_explicit(&pool->allocs, 1, memory_order_relaxed);
+        if (i > 0)
+            atomic_fetch_add_explicit(&pool->remote_allocs, 1,
+                                      memory_order_relaxed);
+        return arena->first_page + idx;
+    }
+
+    return KV_PAGE_NONE;
+}
+
+/* Return a page to the arena it came from */
+void kv_page_free(struct kv_page_pool *pool, uint32_t page)
+{
+    if (!pool || page == KV_PAGE_NONE)
+        return;
+
+    for (uint32_t i = 0; i < pool->num_arenas; i++) {
+        struct kv_page_arena *arena = &pool->arenas[i];
+
+        if (page - arena->first_page < arena->num_pages) {
+            arena_push(arena, page - arena->first_page);
+            atomic_fetch_add_explicit(&pool->frees, 1, memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+uint32_t kv_page_pool_free_pages(struct kv_page_pool *pool)
+{
+    uint32_t total = 0;
+
+    if (!pool)
+        return 0;
+
+    for (uint32_t i = 0; i < pool->num_arenas; i++)
+        total += atomic_load_explicit(&pool->arenas[i].free_count,
+                                      memory_order_relaxed);
+    return total;
+}
+
+/* Number of online NUMA nodes (1 if unknown) */
+uint32_t kv_page_detect_numa_nodes(void)
+{
+    uint32_t n = 0;
+    char path[64];
+
+    while (n < KV_PAGE_MAX_ARENAS) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u", n);
+        if (access(path, F_OK) != 0)
+            break;
+        n++;
+    }
+
+    return n ? n : 1;
+}
+
+/* NUMA node of the CPU the caller is running on (0 if unknown) */
+int kv_page_current_numa_node(void)
+{
+#ifdef SYS_getcpu
+    unsigned int cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return (int)node;
+#endif
+    return 0;
+}
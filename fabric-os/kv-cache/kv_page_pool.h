@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_PAGE_POOL_H
+#define _KV_PAGE_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/*
+ * Fixed-size KV page pool.
+ *
+ * A page holds one block's keys followed by its values, so every block is
+ * a single contiguous allocation. Pages are carved from one large arena
+ * per NUMA node (hugepage-backed when the system allows it) and recycled
+ * through a lock-free free list per arena, so allocation never touches
+ * malloc and the pool cannot fragment.
+ */
+
+#define KV_PAGE_MAX_ARENAS 8
+#define KV_PAGE_NONE UINT32_MAX
+#define KV_PAGE_HUGEPAGE_SIZE (2UL * 1024 * 1024)
+
+struct kv_page_arena {
+    uint8_t *base;
+    uint64_t map_bytes;
+    uint32_t first_page;            /* Pool-wide handle of page 0 */
+    uint32_t num_pages;
+    int numa_node;
+    bool hugepages;                 /* Backed by MAP_HUGETLB */
+
+    /* Treiber stack: low 32 bits page index, high 32 bits ABA tag */
+    _Atomic uint64_t free_head;
+    _Atomic uint32_t free_count;
+    _Atomic uint32_t *next;         /* Free list links */
+};
+
+struct kv_page_pool {
+    struct kv_page_arena arenas[KV_PAGE_MAX_ARENAS];
+    uint32_t num_arenas;
+    uint32_t page_bytes;            /* Key + value bytes per page */
+    uint32_t total_pages;
+
+    /* Statistics */
+    _Atomic uint64_t allocs;
+    _Atomic uint64_t frees;
+    _Atomic uint64_t remote_allocs; /* Served by another node's arena */
+};
+
+/* Function prototypes */
+int kv_page_pool_init(struct kv_page_pool *pool, uint32_t page_bytes,
+                      uint32_t total_pages, uint32_t num_numa_nodes);
+void kv_page_pool_destroy(struct kv_page_pool *pool);
+uint32_t kv_page_alloc(struct kv_page_pool *pool, int numa_node);
+void kv_page_free(struct kv_page_pool *pool, uint32_t page);
+uint32_t kv_page_pool_free_pages(struct kv_page_pool *pool);
+uint32_t kv_page_detect_numa_nodes(void);
+int kv_page_current_numa_node(void);
+
+/* Utility functions */
+
+/* Address of a page handle returned by kv_page_alloc() */
+static inline void *kv_page_addr(struct kv_page_pool *pool, uint32_t page)
+{
+    for (uint32_t i = 0; i < pool->num_arenas; i++) {
+        struct kv_page_arena *arena = &pool->arenas[i];
+
+        if (page - arena->first_page < arena->num_pages)
+            return arena->base + (uint64_t)(page - arena->first_page) *
+                                 pool->page_bytes;
+    }
+    return NULL;
+}
+
+#endif /* _KV_PAGE_POOL_H */
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <math.h>
+#include <string.h>
+#include "kv_phi.h"
+
+/*
+ * Phi-Accrual Failure Detector Implementation
+ *
+ * The window keeps a running sum and sum of squares, so a heartbeat and
+ * a phi query are both O(1). The normal tail uses the logistic
+ * approximation from Akka's detector, which stays finite far into the
+ * tail where 1 - erf() would round to zero.
+ */
+
+static void phi_add(struct kv_phi_detector *d, uint64_t interval)
+{
+    if (d->count == KV_PHI_WINDOW) {
+        double old = (double)d->intervals[d->next];
+
+        d->sum -= old;
+        d->sum_sq -= old * old;
+    } else {
+        d->count++;
+    }
+
+    d->intervals[d->next] = interval;
+    d->next = (d->next + 1) % KV_PHI_WINDOW;
+    d->sum += (double)interval;
+    d->sum_sq += (double)interval * (double)interval;
+}
+
+/* Start tracking a node heard from at @now_ns, beating every ~@expected_ns */
+void kv_phi_init(struct kv_phi_detector *d, uint64_t now_ns, uint64_t expected_ns)
+{
+    memset(d, 0, sizeof(*d));
+    d->expected_ns = expected_ns ? expected_ns : 1;
+    d->last_ns = now_ns;
+
+    /* Seed: mean = expected, stddev = expected / 4 */
+    phi_add(d, d->expected_ns - d->expected_ns / 4);
+    phi_add(d, d->expected_ns + d->expected_ns / 4);
+}
+
+void kv_phi_heartbeat(struct kv_phi_detector *d, uint64_t now_ns)
+{
+    if (now_ns > d->last_ns)
+        phi_add(d, now_ns - d->last_ns);
+    d->last_ns = now_ns;
+}
+
+/* Suspicion that the node is down, given silence until @now_ns */
+double kv_phi_value(const struct kv_phi_detector *d, uint64_t now_ns)
+{
+    double mean, var, stddev, floor, y, e;
+    double t = now_ns > d->last_ns ? (double)(now_ns - d->last_ns) : 0.0;
+
+    mean = d->sum / d->count;
+    var = d->sum_sq / d->count - mean * mean;
+    stddev = var > 0.0 ? sqrt(var) : 0.0;
+    floor = (double)d->expected_ns / 10.0;
+    if (stddev < floor)
+        stddev = floor;
+
+    /* One missed beat is a pause, not a failure */
+    mean += (double)d->expected_ns;
+
+    y = (t - mean) / stddev;
+    e = exp(-y * (1.5976 + 0.070566 * y * y));
+    if (t > mean)
+        return -log10(e / (1.0 + e));
+    return -log10(1.0 - 1.0 / (1.0 + e));
+}
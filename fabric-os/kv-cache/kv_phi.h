@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_PHI_H
+#define _KV_PHI_H
+
+#include <stdint.h>
+
+/*
+ * Phi-accrual failure detector.
+ *
+ * Instead of a fixed timeout, a node's recent heartbeat inter-arrival
+ * times are kept in a sliding window, and the silence since its last
+ * heartbeat is scored as phi = -log10(P(the next heartbeat is even
+ * later)) under a normal fit of that window. Phi 1 means a 10% chance
+ * the node is merely slow, phi 8 one in 10^8, so one threshold adapts to
+ * each node's own jitter (Hayashibara et al., 2004).
+ *
+ * The window starts out seeded with the expected interval, the standard
+ * deviation is kept above a floor so a perfectly regular sender is not
+ * declared dead on its first late beat, and one whole interval of pause
+ * is tolerated on top of the mean. Not thread-safe; the coordinator
+ * holds node_lock.
+ */
+
+#define KV_PHI_WINDOW 64               /* Intervals kept */
+#define KV_PHI_DEFAULT_THRESHOLD 8.0f
+
+struct kv_phi_detector {
+    uint64_t intervals[KV_PHI_WINDOW]; /* ns */
+    uint32_t count;
+    uint32_t next;
+    double sum;                     /* Of the window, ns */
+    double sum_sq;
+    uint64_t last_ns;               /* Last heartbeat */
+    uint64_t expected_ns;           /* Seed, pause allowance and stddev floor */
+};
+
+/* Function prototypes */
+void kv_phi_init(struct kv_phi_detector *d, uint64_t now_ns, uint64_t expected_ns);
+void kv_phi_heartbeat(struct kv_phi_detector *d, uint64_t now_ns);
+double kv_phi_value(const struct kv_phi_detector *d, uint64_t now_ns);
+
+#endif /* _KV_PHI_H */
@@ -0,0 +1,358 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kv_prefix_tree.h"
+
+/*
+ * Token Prefix Radix Tree Implementation
+ *
+ * Node slots and their token chunks live in flat arrays. Edges are not
+ * stored explicitly: the child of node P for chunk C is the node whose
+ * key is hash(P.prefix_hash, C), verified against the parent slot and
+ * the stored tokens to rule out hash collisions.
+ */
+
+static uint32_t *node_tokens(struct kv_prefix_tree *tree, uint32_t slot)
+{
+    return &tree->tokens[(size_t)slot * tree->tokens_per_block];
+}
+
+static void lru_unlink(struct kv_prefix_tree *tree, uint32_t slot)
+{
+    struct kv_prefix_node *node = &tree->nodes[slot];
+
+    if (node->lru_prev != KV_PREFIX_NONE)
+        tree->nodes[node->lru_prev].lru_next = node->lru_next;
+    else if (tree->lru_head == slot)
+        tree->lru_head = node->lru_next;
+    else
+        return;                     /* Not on the list */
+
+    if (node->lru_next != KV_PREFIX_NONE)
+        tree->nodes[node->lru_next].lru_prev = node->lru_prev;
+    else
+        tree->lru_tail = node->lru_prev;
+
+    node->lru_prev = KV_PREFIX_NONE;
+    node->lru_next = KV_PREFIX_NONE;
+}
+
+static void lru_push_tail(struct kv_prefix_tree *tree, uint32_t slot)
+{
+    struct kv_prefix_node *node = &tree->nodes[slot];
+
+    node->lru_prev = tree->lru_tail;
+    node->lru_next = KV_PREFIX_NONE;
+    if (tree->lru_tail != KV_PREFIX_NONE)
+        tree->nodes[tree->lru_tail].lru_next = slot;
+    else
+        tree->lru_head = slot;
+    tree->lru_tail = slot;
+}
+
+static void lru_push_head(struct kv_prefix_tree *tree, uint32_t slot)
+{
+    struct kv_prefix_node *node = &tree->nodes[slot];
+
+    node->lru_prev = KV_PREFIX_NONE;
+    node->lru_next = tree->lru_head;
+    if (tree->lru_head != KV_PREFIX_NONE)
+        tree->nodes[tree->lru_head].lru_prev = slot;
+    else
+        tree->lru_tail = slot;
+    tree->lru_head = slot;
+}
+
+int kv_prefix_tree_init(struct kv_prefix_tree *tree,
+                        uint32_t tokens_per_block,
+                        uint32_t capacity)
+{
+    if (!tree || tokens_per_block == 0 || capacity == 0 ||
+        capacity == KV_PREFIX_NONE)
+        return -1;
+
+    memset(tree, 0, sizeof(*tree));
+
+    tree->nodes = calloc(capacity, sizeof(struct kv_prefix_node));
+    tree->tokens = malloc((size_t)capacity * tokens_per_block * sizeof(uint32_t));
+    tree->free_slots = malloc(capacity * sizeof(uint32_t));
+
+    if (!tree->nodes || !tree->tokens || !tree->free_slots ||
+        kv_index_init(&tree->index, capacity) != 0) {
+        free(tree->nodes);
+        free(tree->tokens);
+        free(tree->free_slots);
+        memset(tree, 0, sizeof(*tree));
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < capacity; i++)
+        tree->free_slots[i] = capacity - 1 - i;
+
+    tree->capacity = capacity;
+    tree->free_count = capacity;
+    tree->tokens_per_block = tokens_per_block;
+    tree->lru_head = KV_PREFIX_NONE;
+    tree->lru_tail = KV_PREFIX_NONE;
+
+    return 0;
+}
+
+void kv_prefix_tree_destroy(struct kv_prefix_tree *tree)
+{
+    if (!tree)
+        return;
+
+    kv_index_destroy(&tree->index);
+    free(tree->nodes);
+    free(tree->tokens);
+    free(tree->free_slots);
+    memset(tree, 0, sizeof(*tree));
+}
+
+/* Child of @parent covering @chunk, or KV_PREFIX_NONE */
+static uint32_t find_child(struct kv_prefix_tree *tree, uint32_t parent,
+                           uint64_t child_hash, const uint32_t *chunk)
+{
+    uint32_t slot;
+
+    if (!kv_index_lookup(&tree->index, child_hash, &slot))
+        return KV_PREFIX_NONE;
+
+    if (tree->nodes[slot].parent != parent ||
+        memcmp(node_tokens(tree, slot), chunk,
+               tree->tokens_per_block * sizeof(uint32_t)) != 0)
+        return KV_PREFIX_NONE;      /* Hash collision */
+
+    return slot;
+}
+
+/*
+ * Longest cached prefix of @tokens in whole blocks.
+ * Writes up to @max_blocks matched block ids and returns how many blocks
+ * matched. @owner_sequence_id (optional) receives the publisher of the
+ * deepest matched node. Matched nodes are stamped with @now_ns.
+ */
+uint32_t kv_prefix_tree_match(struct kv_prefix_tree *tree,
+                              const uint32_t *tokens,
+                              uint32_t num_tokens,
+                              uint64_t *block_ids,
+                              uint32_t max_blocks,
+                              uint64_t *owner_sequence_id,
+                              uint64_t now_ns)
+{
+    uint32_t bs, parent = KV_PREFIX_NONE, matched = 0;
+    uint64_t hash = 0;
+
+    if (!tree || !tree->nodes || !tokens)
+        return 0;
+
+    bs = tree->tokens_per_block;
+    tree->lookups++;
+
+    while ((matched + 1) * (uint64_t)bs <= num_tokens &&
+           (!block_ids || matched < max_blocks)) {
+        const uint32_t *chunk = &tokens[(size_t)matched * bs];
+        uint64_t child_hash = kv_prefix_hash_block(hash, chunk, bs);
+        uint32_t slot = find_child(tree, parent, child_hash, chunk);
+
+        if (slot == KV_PREFIX_NONE)
+            break;
+
+        tree->nodes[slot].last_access_ns = now_ns;
+        if (block_ids)
+            block_ids[matched] = tree->nodes[slot].block_id;
+
+        parent = slot;
+        hash = child_hash;
+        matched++;
+    }
+
+    if (parent != KV_PREFIX_NONE) {
+        if (owner_sequence_id)
+            *owner_sequence_id = tree->nodes[parent].owner_sequence_id;
+
+        /* Refresh the deepest node's place in the leaf LRU */
+        if (tree->nodes[parent].num_children == 0) {
+            lru_unlink(tree, parent);
+            lru_push_tail(tree, parent);
+        }
+    }
+
+    tree->matched_blocks += matched;
+    return matched;
+}
+
+/*
+ * Publish @num_blocks full blocks of @tokens backed by @block_ids.
+ * Existing nodes are reused; new nodes are created for the remainder as
+ * long as free slots last, stamped with @now_ns. Returns the number of
+ * new nodes; the caller must take a reference on
+ * block_ids[*first_new .. *first_new + ret).
+ */
+uint32_t kv_prefix_tree_insert(struct kv_prefix_tree *tree,
+                               const uint32_t *tokens,
+                               uint32_t num_blocks,
+                               const uint64_t *block_ids,
+                               uint64_t owner_sequence_id,
+                               uint32_t *first_new,
+                               uint64_t now_ns)
+{
+    uint32_t bs, parent = KV_PREFIX_NONE, created = 0, i;
+    uint64_t hash = 0;
+
+    if (first_new)
+        *first_new = num_blocks;
+
+    if (!tree || !tree->nodes || !tokens || !block_ids)
+        return 0;
+
+    bs = tree->tokens_per_block;
+
+    for (i = 0; i < num_blocks; i++) {
+        const uint32_t *chunk = &tokens[(size_t)i * bs];
+        uint64_t child_hash = kv_prefix_hash_block(hash, chunk, bs);
+        uint32_t slot = find_child(tree, parent, child_hash, chunk);
+        struct kv_prefix_node *node;
+
+        if (slot == KV_PREFIX_NONE) {
+            /* Occupied by a colliding prefix, or out of slots: stop */
+            if (tree->free_count == 0 ||
+                kv_index_lookup(&tree->index, child_hash, NULL))
+                break;
+
+            slot = tree->free_slots[tree->free_count - 1];
+            if (kv_index_insert(&tree->index, child_hash, slot) != 0)
+                break;
+            tree->free_count--;
+            tree->num_nodes++;
+
+            node = &tree->nodes[slot];
+            memset(node, 0, sizeof(*node));
+            node->in_use = true;
+            node->prefix_hash = child_hash;
+            node->block_id = block_ids[i];
+            node->parent = parent;
+            node->lru_prev = KV_PREFIX_NONE;
+            node->lru_next = KV_PREFIX_NONE;
+            memcpy(node_tokens(tree, slot), chunk, bs * sizeof(uint32_t));
+
+            if (parent != KV_PREFIX_NONE) {
+                if (tree->nodes[parent].num_children++ == 0)
+                    lru_unlink(tree, parent);
+            }
+
+            if (created == 0 && first_new)
+                *first_new = i;
+            created++;
+        }
+
+        node = &tree->nodes[slot];
+        node->owner_sequence_id = owner_sequence_id;
+        node->last_access_ns = now_ns;
+
+        parent = slot;
+        hash = child_hash;
+    }
+
+    /* The deepest node is the freshest leaf */
+    if (parent != KV_PREFIX_NONE && tree->nodes[parent].num_children == 0) {
+        lru_unlink(tree, parent);
+        lru_push_tail(tree, parent);
+    }
+
+    tree->inserted_blocks += created;
+    return created;
+}
+
+/*
+ * Copy out the node keyed @prefix_hash: its block, publisher, parent's
+ * hash (0 at depth one) and, into @tokens, its chunk. Returns false if
+ * there is none. Does not count as an access.
+ */
+bool kv_prefix_tree_get(const struct kv_prefix_tree *tree, uint64_t prefix_hash,
+                        uint64_t *block_id, uint64_t *owner_sequence_id,
+                        uint64_t *parent_hash, uint32_t *tokens)
+{
+    const struct kv_prefix_node *node;
+    uint32_t slot;
+
+    if (!tree || !tree->nodes || !kv_index_lookup(&tree->index, prefix_hash, &slot))
+        return false;
+
+    node = &tree->nodes[slot];
+    if (block_id)
+        *block_id = node->block_id;
+    if (owner_sequence_id)
+        *owner_sequence_id = node->owner_sequence_id;
+    if (parent_hash)
+        *parent_hash = node->parent != KV_PREFIX_NONE ?
+                       tree->nodes[node->parent].prefix_hash : 0;
+    if (tokens)
+        memcpy(tokens, &tree->tokens[(size_t)slot * tree->tokens_per_block],
+               tree->tokens_per_block * sizeof(uint32_t));
+    return true;
+}
+
+/*
+ * Remove the least recently used leaf that @evictable (optional) accepts
+ * the block of. Leaves it refuses move to the recent end, and each leaf
+ * is offered once per call. The parent becomes a leaf in turn when it
+ * has no other children. Returns false if no leaf was removed; otherwise
+ * @block_id receives the block whose tree reference to drop and
+ * @prefix_hash (optional) the node's key.
+ */
+bool kv_prefix_tree_evict_leaf(struct kv_prefix_tree *tree,
+                               bool (*evictable)(void *ctx, uint64_t block_id),
+                               void *ctx,
+                               uint64_t *block_id,
+                               uint64_t *prefix_hash)
+{
+    uint32_t slot, parent, first_refused = KV_PREFIX_NONE;
+    struct kv_prefix_node *node;
+
+    if (!tree || !tree->nodes)
+        return false;
+
+    for (;;) {
+        slot = tree->lru_head;
+        if (slot == KV_PREFIX_NONE || slot == first_refused)
+            return false;
+        if (!evictable || evictable(ctx, tree->nodes[slot].block_id))
+            break;
+
+        if (first_refused == KV_PREFIX_NONE)
+            first_refused = slot;
+        lru_unlink(tree, slot);
+        lru_push_tail(tree, slot);
+    }
+
+    node = &tree->nodes[slot];
+    lru_unlink(tree, slot);
+
+    kv_index_remove(&tree->index, node->prefix_hash, NULL);
+    if (block_id)
+        *block_id = node->block_id;
+    if (prefix_hash)
+        *prefix_hash = node->prefix_hash;
+
+    parent = node->parent;
+    memset(node, 0, sizeof(*node));
+    tree->free_slots[tree->free_count++] = slot;
+    tree->num_nodes--;
+    tree->evicted_blocks++;
+
+    if (parent != KV_PREFIX_NONE && --tree->nodes[parent].num_children == 0) {
+        struct kv_prefix_node *p = &tree->nodes[parent];
+
+        /* Order the new leaf by recency relative to the current LRU end */
+        if (tree->lru_head == KV_PREFIX_NONE ||
+            p->last_access_ns <= tree->nodes[tree->lru_head].last_access_ns)
+            lru_push_head(tree, parent);
+        else
+            lru_push_tail(tree, parent);
+    }
+
+    return true;
+}
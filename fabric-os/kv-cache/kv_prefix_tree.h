@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_PREFIX_TREE_H
+#define _KV_PREFIX_TREE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kv_index.h"
+
+/*
+ * Radix tree of token prefixes at KV block granularity.
+ *
+ * Each node covers one full block of tokens and points at the shared KV
+ * block that holds their keys/values. A node is identified by the rolling
+ * hash of the whole prefix up to and including its block, so finding a
+ * child is one index probe and a longest-prefix match is O(prefix length).
+ * Leaves are kept on an LRU list for eviction. The tree stores block ids
+ * only; the coordinator owns the block references.
+ */
+
+#define KV_PREFIX_NONE UINT32_MAX
+#define KV_PREFIX_HASH_SEED 0x9e3779b97f4a7c15ULL
+
+struct kv_prefix_node {
+    uint64_t prefix_hash;           /* Rolling hash of the prefix so far */
+    uint64_t block_id;              /* Shared KV block for this chunk */
+    uint64_t owner_sequence_id;     /* Sequence that last published it */
+    uint64_t last_access_ns;
+    uint32_t parent;                /* Slot, KV_PREFIX_NONE for depth 1 */
+    uint32_t num_children;
+    uint32_t lru_prev;              /* Leaf LRU links (leaves only) */
+    uint32_t lru_next;
+    bool in_use;
+};
+
+struct kv_prefix_tree {
+    struct kv_prefix_node *nodes;
+    uint32_t *tokens;               /* capacity * tokens_per_block */
+    uint32_t capacity;
+    uint32_t tokens_per_block;
+    uint32_t num_nodes;
+
+    uint32_t *free_slots;
+    uint32_t free_count;
+
+    struct kv_index index;          /* prefix_hash -> slot */
+
+    uint32_t lru_head;              /* Least recently used leaf */
+    uint32_t lru_tail;
+
+    /* Statistics */
+    uint64_t lookups;
+    uint64_t matched_blocks;
+    uint64_t inserted_blocks;
+    uint64_t evicted_blocks;
+};
+
+/* Function prototypes */
+int kv_prefix_tree_init(struct kv_prefix_tree *tree,
+                        uint32_t tokens_per_block,
+                        uint32_t capacity);
+void kv_prefix_tree_destroy(struct kv_prefix_tree *tree);
+
+uint32_t kv_prefix_tree_match(struct kv_prefix_tree *tree,
+                              const uint32_t *tokens,
+                              uint32_t num_tokens,
+                              uint64_t *block_ids,
+                              uint32_t max_blocks,
+                              uint64_t *owner_sequence_id,
+                              uint64_t now_ns);
+uint32_t kv_prefix_tree_insert(struct kv_prefix_tree *tree,
+                               const uint32_t *tokens,
+                               uint32_t num_blocks,
+                               const uint64_t *block_ids,
+                               uint64_t owner_sequence_id,
+                               uint32_t *first_new,
+                               uint64_t now_ns);
+bool kv_prefix_tree_get(const struct kv_prefix_tree *tree, uint64_t prefix_hash,
+                        uint64_t *block_id, uint64_t *owner_sequence_id,
+                        uint64_t *parent_hash, uint32_t *tokens);
+bool kv_prefix_tree_evict_leaf(struct kv_prefix_tree *tree,
+                               bool (*evictable)(void *ctx, uint64_t block_id),
+                               void *ctx,
+                               uint64_t *block_id,
+                               uint64_t *prefix_hash);
+
+/* Utility functions */
+
+/* Extend a rolling prefix hash by one block of tokens */
+static inline uint64_t kv_prefix_hash_block(uint64_t prefix_hash,
+                                            const uint32_t *tokens,
+                                            uint32_t num_tokens)
+{
+    uint64_t h = prefix_hash ^ KV_PREFIX_HASH_SEED;
+
+    for (uint32_t i = 0; i < num_tokens; i++)
+        h = (h ^ tokens[i]) * 0x100000001b3ULL;   /* FNV-1a step */
+
+    return kv_hash64(h);
+}
+
+static inline uint32_t kv_prefix_tree_free_nodes(const struct kv_prefix_tree *tree)
+{
+    return tree->free_count;
+}
+
+#endif /* _KV_PREFIX_TREE_H */
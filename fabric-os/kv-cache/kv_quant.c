@@ -0,0 +1,390 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "kv_quant.h"
+
+/*
+ * KV Quantization Kernels
+ *
+ * Every kernel works on one contiguous row of head_dim elements with
+ * restrict-qualified pointers and branch-free clamping/rounding, so the
+ * integer paths auto-vectorize at -O2. FP8 and FP16 use bit-level
+ * conversions (round to nearest even, saturating) that do not depend on
+ * compiler support for narrow float types.
+ */
+
+static float quant_max(enum kv_precision precision)
+{
+    switch (precision) {
+    case KV_PRECISION_FP8:  return KV_QUANT_FP8_MAX;
+    case KV_PRECISION_INT8: return 127.0f;
+    case KV_PRECISION_INT4: return 7.0f;
+    default:                return 0.0f;
+    }
+}
+
+static inline float bits_to_float(uint32_t bits)
+{
+    float f;
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint32_t float_to_bits(float f)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+/* E4M3, input already scaled into [-448, 448] */
+static inline uint8_t fp8_encode(float v)
+{
+    uint32_t bits = float_to_bits(v);
+    uint32_t sign = (bits >> 24) & 0x80;
+    uint32_t code;
+    float a;
+
+    bits &= 0x7fffffff;
+    a = bits_to_float(bits);
+
+    if (a >= KV_QUANT_FP8_MAX)
+        return (uint8_t)(sign | 0x7e);
+
+    /* Subnormal range: multiples of 2^-9 (8 * 2^-9 is the smallest normal) */
+    if (a < 0.015625f)
+        return (uint8_t)(sign | (uint32_t)(a * 512.0f + 0.5f));
+
+    bits += 0x7ffff + ((bits >> 20) & 1);       /* Round to 3 mantissa bits */
+    code = ((((bits >> 23) & 0xff) - 127 + 7) << 3) | ((bits >> 20) & 7);
+    if (code > 0x7e)
+        code = 0x7e;
+
+    return (uint8_t)(sign | code);
+}
+
+static inline float fp8_decode(uint8_t c)
+{
+    uint32_t exp = (c >> 3) & 0xf, mant = c & 7;
+    float v;
+
+    if (exp == 0)
+        v = (float)mant * (1.0f / 512.0f);
+    else
+        v = bits_to_float(((exp - 7 + 127) << 23) | (mant << 20));
+
+    return (c & 0x80) ? -v : v;
+}
+
+/* IEEE binary16, saturating at 65504 */
+static inline uint16_t fp16_encode(float f)
+{
+    uint32_t bits = float_to_bits(f);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = bits & 0x7fffff;
+    uint32_t h, rem;
+
+    if ((bits & 0x7fffffff) > 0x7f800000)
+        return (uint16_t)(sign | 0x7e00);       /* NaN */
+
+    if (exp <= 0) {
+        uint32_t shift;
+
+        if (exp < -10)
+            return (uint16_t)sign;
+        mant |= 0x800000;
+        shift = (uint32_t)(14 - exp);
+        h = mant >> shift;
+        h += (mant >> (shift - 1)) & 1;
+        return (uint16_t)(sign | h);
+    }
+
+    h = ((uint32_t)exp << 10) | (mant >> 13);
+    rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    if (h >= 0x7c00)
+        h = 0x7bff;
+
+    return (uint16_t)(sign | h);
+}
+
+static inline float fp16_decode(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+    float v;
+
+    if (exp == 0) {
+        v = (float)mant * (1.0f / 16777216.0f);
+        return sign ? -v : v;
+    }
+    if (exp == 31)
+        return bits_to_float(sign | 0x7f800000 | (mant << 13));
+
+    return bits_to_float(sign | ((exp - 15 + 127) << 23) | (mant << 13));
+}
+
+/* Row kernels: @n elements, @inv = 1/scale for encode, @scale for decode */
+
+static void row_encode_int8(int8_t *restrict q, const float *restrict x,
+                            uint32_t n, float inv)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        float v = x[i] * inv;
+
+        v = v > 127.0f ? 127.0f : (v < -127.0f ? -127.0f : v);
+        q[i] = (int8_t)(v + (v >= 0.0f ? 0.5f : -0.5f));
+    }
+}
+
+static void row_decode_int8(float *restrict x, const int8_t *restrict q,
+                            uint32_t n, float scale)
+{
+    for (uint32_t i = 0; i < n; i++)
+        x[i] = (float)q[i] * scale;
+}
+
+static void row_encode_int4(uint8_t *restrict q, const float *restrict x,
+                            uint32_t n, float inv)
+{
+    for (uint32_t i = 0; i < n / 2; i++) {
+        float lo = x[2 * i] * inv, hi = x[2 * i + 1] * inv;
+        int32_t l, h;
+
+        lo = lo > 7.0f ? 7.0f : (lo < -7.0f ? -7.0f : lo);
+        hi = hi > 7.0f ? 7.0f : (hi < -7.0f ? -7.0f : hi);
+        l = (int32_t)(lo + (lo >= 0.0f ? 0.5f : -0.5f));
+        h = (int32_t)(hi + (hi >= 0.0f ? 0.5f : -0.5f));
+        q[i] = (uint8_t)((l & 0xf) | ((h & 0xf) << 4));
+    }
+}
+
+static void row_decode_int4(float *restrict x, const uint8_t *restrict q,
+                            uint32_t n, float scale)
+{
+    for (uint32_t i = 0; i < n / 2; i++) {
+        /* Sign-extend each nibble */
+        int32_t l = (int32_t)((uint32_t)q[i] << 28) >> 28;
+        int32_t h = (int32_t)((uint32_t)q[i] << 24) >> 28;
+
+        x[2 * i] = (float)l * scale;
+        x[2 * i + 1] = (float)h * scale;
+    }
+}
+
+static void row_encode_fp8(uint8_t *restrict q, const float *restrict x,
+                           uint32_t n, float inv)
+{
+    for (uint32_t i = 0; i < n; i++)
+        q[i] = fp8_encode(x[i] * inv);
+}
+
+static void row_decode_fp8(float *restrict x, const uint8_t *restrict q,
+                           uint32_t n, float scale)
+{
+    for (uint32_t i = 0; i < n; i++)
+        x[i] = fp8_decode(q[i]) * scale;
+}
+
+static void row_encode_fp16(uint16_t *restrict q, const float *restrict x,
+                            uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        q[i] = fp16_encode(x[i]);
+}
+
+static void row_decode_fp16(float *restrict x, const uint16_t *restrict q,
+                            uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        x[i] = fp16_decode(q[i]);
+}
+
+/* Byte address of row (head, token) */
+static uint8_t *row_addr(const struct kv_quant_layout *layout, void *tensor,
+                         uint32_t head, uint32_t token)
+{
+    uint64_t elem = ((uint64_t)head * layout->tokens + token) * layout->head_dim;
+
+    return (uint8_t *)tensor + layout->scale_bytes +
+           elem * kv_precision_bits(layout->precision) / 8;
+}
+
+static void row_encode(const struct kv_quant_layout *layout, uint8_t *row,
+                       const float *x, float scale)
+{
+    float inv = scale > 0.0f ? 1.0f / scale : 0.0f;
+    uint32_t n = layout->head_dim;
+
+    switch (layout->precision) {
+    case KV_PRECISION_FP16: row_encode_fp16((uint16_t *)row, x, n); break;
+    case KV_PRECISION_FP8:  row_encode_fp8(row, x, n, inv); break;
+    case KV_PRECISION_INT8: row_encode_int8((int8_t *)row, x, n, inv); break;
+    case KV_PRECISION_INT4: row_encode_int4(row, x, n, inv); break;
+    default: break;
+    }
+}
+
+static void row_decode(const struct kv_quant_layout *layout, const uint8_t *row,
+                       float *x, float scale)
+{
+    uint32_t n = layout->head_dim;
+
+    switch (layout->precision) {
+    case KV_PRECISION_FP16: row_decode_fp16(x, (const uint16_t *)row, n); break;
+    case KV_PRECISION_FP8:  row_decode_fp8(x, row, n, scale); break;
+    case KV_PRECISION_INT8: row_decode_int8(x, (const int8_t *)row, n, scale); break;
+    case KV_PRECISION_INT4: row_decode_int4(x, row, n, scale); break;
+    default: break;
+    }
+}
+
+/* Describe a block tensor; returns -1 for unsupported shapes */
+int kv_quant_layout_init(struct kv_quant_layout *layout,
+                         enum kv_precision precision, uint32_t tokens,
+                         uint32_t heads, uint32_t head_dim)
+{
+    uint64_t data_bytes;
+
+    if (!layout || precision == KV_PRECISION_RAW || precision > KV_PRECISION_INT4 ||
+        tokens == 0 || heads == 0 || head_dim == 0 ||
+        head_dim > KV_QUANT_MAX_HEAD_DIM)
+        return -1;
+
+    if (precision == KV_PRECISION_INT4 && (head_dim & 1))
+        return -1;
+
+    data_bytes = (uint64_t)tokens * heads * head_dim *
+                 kv_precision_bits(precision) / 8;
+
+    layout->precision = precision;
+    layout->tokens = tokens;
+    layout->heads = heads;
+    layout->head_dim = head_dim;
+    layout->scale_bytes = 0;
+    if (precision != KV_PRECISION_FP16)
+        layout->scale_bytes = (heads * (uint32_t)sizeof(float) +
+                               KV_QUANT_SCALE_ALIGN - 1) &
+                              ~(uint32_t)(KV_QUANT_SCALE_ALIGN - 1);
+
+    if (data_bytes + layout->scale_bytes > UINT32_MAX)
+        return -1;
+    layout->tensor_bytes = (uint32_t)(data_bytes + layout->scale_bytes);
+
+    return 0;
+}
+
+/*
+ * Quantize @num_tokens tokens from @src into @tensor at @token_offset.
+ * @filled_tokens is how many tokens the tensor already holds; with 0 the
+ * scales start fresh, otherwise they only ever widen.
+ */
+void kv_quant_write(const struct kv_quant_layout *layout, void *tensor,
+                    uint32_t token_offset, uint32_t num_tokens,
+                    uint32_t filled_tokens, const float *src)
+{
+    uint32_t stride = layout->heads * layout->head_dim;
+    float *scales = tensor;
+    float qmax = quant_max(layout->precision);
+    float row[KV_QUANT_MAX_HEAD_DIM];
+
+    if (token_offset + num_tokens > layout->tokens)
+        num_tokens = token_offset < layout->tokens ?
+                     layout->tokens - token_offset : 0;
+    if (filled_tokens > layout->tokens)
+        filled_tokens = layout->tokens;
+
+    for (uint32_t h = 0; h < layout->heads; h++) {
+        float scale = 0.0f;
+
+        if (qmax > 0.0f) {
+            float absmax = 0.0f, needed;
+
+            for (uint32_t t = 0; t < num_tokens; t++) {
+                const float *x = &src[(uint64_t)t * stride + h * layout->head_dim];
+
+                for (uint32_t d = 0; d < layout->head_dim; d++) {
+                    float a = fabsf(x[d]);
+
+                    absmax = a > absmax ? a : absmax;
+                }
+            }
+
+            scale = filled_tokens ? scales[h] : 0.0f;
+            needed = absmax / qmax;
+
+            /* Widen: re-encode what is already there at the new scale */
+            if (needed > scale) {
+                for (uint32_t t = 0; t < filled_tokens && scale > 0.0f; t++) {
+                    uint8_t *r = row_addr(layout, tensor, h, t);
+
+                    row_decode(layout, r, row, scale);
+                    row_encode(layout, r, row, needed);
+                }
+                scale = needed;
+            }
+            scales[h] = scale;
+        }
+
+        for (uint32_t t = 0; t < num_tokens; t++)
+            row_encode(layout, row_addr(layout, tensor, h, token_offset + t),
+                       &src[(uint64_t)t * stride + h * layout->head_dim], scale);
+    }
+}
+
+/* Dequantize tokens [token_offset, token_offset + num_tokens) into @dst */
+void kv_quant_read(const struct kv_quant_layout *layout, const void *tensor,
+                   uint32_t token_offset, uint32_t num_tokens, float *dst)
+{
+    uint32_t stride = layout->heads * layout->head_dim;
+    const float *scales = tensor;
+
+    if (token_offset + num_tokens > layout->tokens)
+        num_tokens = token_offset < layout->tokens ?
+                     layout->tokens - token_offset : 0;
+
+    for (uint32_t h = 0; h < layout->heads; h++) {
+        float scale = layout->scale_bytes ? scales[h] : 1.0f;
+
+        for (uint32_t t = 0; t < num_tokens; t++)
+            row_decode(layout, row_addr(layout, (void *)tensor, h, token_offset + t),
+                       &dst[(uint64_t)t * stride + h * layout->head_dim], scale);
+    }
+}
+
+/* Relative RMS error ||ref - approx|| / ||ref|| */
+float kv_quant_relative_error(const float *ref, const float *approx,
+                              uint32_t count)
+{
+    double num = 0.0, den = 0.0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        double d = (double)ref[i] - (double)approx[i];
+
+        num += d * d;
+        den += (double)ref[i] * (double)ref[i];
+    }
+
+    if (den == 0.0)
+        return num == 0.0 ? 0.0f : 1.0f;
+
+    return (float)sqrt(num / den);
+}
+
+const char *kv_precision_name(enum kv_precision precision)
+{
+    switch (precision) {
+    case KV_PRECISION_RAW:  return "raw";
+    case KV_PRECISION_FP16: return "fp16";
+    case KV_PRECISION_FP8:  return "fp8";
+    case KV_PRECISION_INT8: return "int8";
+    case KV_PRECISION_INT4: return "int4";
+    default:                return "unknown";
+    }
+}
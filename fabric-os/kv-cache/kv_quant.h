@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_QUANT_H
+#define _KV_QUANT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * KV block precision and quantization kernels.
+ *
+ * A quantized tensor (the keys or the values of one block) is laid out
+ * head-major: one float scale per head, padded to a cache line, followed
+ * by [head][token][head_dim] elements. Scales are symmetric absmax
+ * scales per head per block. When a write brings a larger magnitude than
+ * the current scale covers, the head's earlier tokens are requantized
+ * to the wider scale, so decode can fill a block one token at a time.
+ *
+ * Callers exchange data as fp32 in [token][head][head_dim] order.
+ */
+
+enum kv_precision {
+    KV_PRECISION_RAW = 0,          /* Opaque bytes, managed by the caller */
+    KV_PRECISION_FP16 = 1,
+    KV_PRECISION_FP8 = 2,          /* E4M3 with per-head scale */
+    KV_PRECISION_INT8 = 3,
+    KV_PRECISION_INT4 = 4,         /* Two per byte */
+};
+
+#define KV_QUANT_FP8_MAX 448.0f
+#define KV_QUANT_SCALE_ALIGN 64
+#define KV_QUANT_MAX_HEAD_DIM 1024
+
+struct kv_quant_layout {
+    enum kv_precision precision;
+    uint32_t tokens;               /* Tokens per block */
+    uint32_t heads;
+    uint32_t head_dim;
+    uint32_t scale_bytes;          /* Scale header, cache-line padded */
+    uint32_t tensor_bytes;         /* Scales + elements for K or V */
+};
+
+/* Function prototypes */
+int kv_quant_layout_init(struct kv_quant_layout *layout,
+                         enum kv_precision precision, uint32_t tokens,
+                         uint32_t heads, uint32_t head_dim);
+void kv_quant_write(const struct kv_quant_layout *layout, void *tensor,
+                    uint32_t token_offset, uint32_t num_tokens,
+                    uint32_t filled_tokens, const float *src);
+void kv_quant_read(const struct kv_quant_layout *layout, const void *tensor,
+                   uint32_t token_offset, uint32_t num_tokens, float *dst);
+float kv_quant_relative_error(const float *ref, const float *approx,
+                              uint32_t count);
+const char *kv_precision_name(enum kv_precision precision);
+
+/* Utility functions */
+
+static inline uint32_t kv_precision_bits(enum kv_precision precision)
+{
+    switch (precision) {
+    case KV_PRECISION_FP16: return 16;
+    case KV_PRECISION_FP8:  return 8;
+    case KV_PRECISION_INT8: return 8;
+    case KV_PRECISION_INT4: return 4;
+    default:                return 0;
+    }
+}
+
+static inline uint32_t kv_quant_elements(const struct kv_quant_layout *layout)
+{
+    return layout->tokens * layout->heads * layout->head_dim;
+}
+
+#endif /* _KV_QUANT_H */
@@ -0,0 +1,985 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include "distributed_kv_cache.h"
+
+/*
+ * kv-replay: drive the KV cache with an inference request trace and
+ * compare eviction policies on it.
+ *
+ * A trace is text, one request per line, ordered or not:
+ *
+ *   <arrival_ms> <output_tokens> <name>:<tokens>[,<name>:<tokens>...] [<reply>]
+ *
+ * The prompt is the concatenation of the named segments. A segment's
+ * token ids are a pure function of its name, so requests that start
+ * with the same segments share a prefix exactly as they would in
+ * production. If <reply> is given the output tokens are that segment's
+ * tokens and the whole sequence is published to the prefix cache when
+ * the request completes, which is how a chat's next turn finds its
+ * history. Lines starting with '#' are ignored.
+ *
+ * Without -r a trace is synthesized from a mix of system-prompt,
+ * multi-turn chat and RAG requests: system prompts and documents are
+ * picked with Zipf popularity, prompt and output lengths are lognormal,
+ * and new requests arrive as a Poisson process. -w saves it.
+ *
+ * Replay runs in trace time without sleeping. At its arrival a request
+ * attaches its longest cached prefix, prefills the rest, publishes its
+ * prompt and reserves its output tokens; it is freed output_tokens x
+ * the per-token decode time later. Each policy replays the same trace
+ * on a fresh cache.
+ */
+
+#define REPLAY_MAX_TOKENS 32768         /* Longest prompt + output */
+#define REPLAY_NAME_LEN 24
+
+enum replay_class {
+    REPLAY_SYSTEM,                  /* System prompt + one user message */
+    REPLAY_CHAT,                    /* Multi-turn conversation */
+    REPLAY_RAG,                     /* System prompt + retrieved documents */
+    REPLAY_NUM_CLASSES,
+};
+
+enum replay_op {
+    OP_ATTACH,
+    OP_PREFILL,
+    OP_PUBLISH,
+    OP_DECODE,
+    OP_FREE,
+    NUM_OPS,
+};
+
+static const char *const op_names[NUM_OPS] = {
+    "attach", "prefill", "publish", "decode", "free",
+};
+
+struct replay_segment {
+    char name[REPLAY_NAME_LEN];
+    uint64_t key;                   /* Seeds the segment's token ids */
+    uint32_t tokens;
+};
+
+struct replay_request {
+    double arrival_ms;
+    uint32_t output_tokens;
+    uint32_t first_segment;
+    uint32_t num_segments;
+    int32_t reply_segment;          /* -1: output is not published */
+};
+
+struct replay_trace {
+    struct replay_request *requests;
+    uint32_t num_requests;
+    uint32_t request_capacity;
+    struct replay_segment *segments;
+    uint32_t num_segments;
+    uint32_t segment_capacity;
+};
+
+/* Workload generator parameters */
+struct replay_workload {
+    uint32_t num_requests;
+    double rate;                    /* New requests (conversations) per second */
+    double mix[REPLAY_NUM_CLASSES];
+    double zipf_s;
+    uint32_t num_system_prompts;
+    uint32_t system_tokens;
+    uint32_t num_documents;
+    uint32_t document_tokens;
+    uint32_t documents_per_query;
+    double prompt_median;           /* User message tokens, lognormal */
+    double prompt_sigma;
+    double output_median;           /* Output tokens, lognormal */
+    double output_sigma;
+    double mean_turns;              /* Chat turns, geometric */
+    double think_ms;                /* Mean gap between chat turns */
+    uint64_t seed;
+};
+
+struct replay_stats {
+    uint64_t requests;
+    uint64_t rejected;              /* Could not be admitted or prefilled */
+    uint64_t prompt_tokens;
+    uint64_t cached_tokens;         /* Prompt tokens served from the cache */
+    uint64_t allocations;           /* Blocks allocated */
+    uint64_t peak_bytes;
+    double wall_s;
+    struct kv_cache_config cache;   /* Cache statistics at the end */
+
+    /* Per-operation latency samples in nanoseconds */
+    uint32_t *latency[NUM_OPS];
+    uint32_t num_latency[NUM_OPS];
+};
+
+/* Pending completion, min-heap on completion time */
+struct replay_completion {
+    double time_ms;
+    uint32_t request;
+};
+
+struct replay_heap {
+    struct replay_completion *items;
+    uint32_t count;
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "Trace:\n"
+            "  -r <file>      replay a trace file instead of generating one\n"
+            "  -w <file>      write the generated trace to a file\n"
+            "  -n <n>         requests to generate (default 5000)\n"
+            "  -q <rate>      new requests/conversations per second (default 20)\n"
+            "  -m <s,c,r>     system/chat/RAG mix weights (default 4,4,2)\n"
+            "  -S <n,len>     system prompts and their tokens (default 8,1024)\n"
+            "  -D <n,len,k>   documents, tokens each, per query (default 500,512,3)\n"
+            "  -l <med,sig>   user message tokens, lognormal (default 128,1.0)\n"
+            "  -o <med,sig>   output tokens, lognormal (default 128,0.8)\n"
+            "  -T <turns>     mean chat turns (default 4)\n"
+            "  -z <s>         Zipf exponent for prompt/document reuse (default 1.0)\n"
+            "  -s <seed>      generator seed (default 1)\n"
+            "Cache:\n"
+            "  -p <list>      policies to compare: lru,lfu,cost,fifo (default all)\n"
+            "  -C <MB>        hot tier capacity (default 256)\n"
+            "  -H <MB>        host spill tier (default 0)\n"
+            "  -b <tokens>    tokens per block (default 16)\n"
+            "  -t <ms>        decode time per output token (default 20)\n",
+            prog);
+}
+
+/* splitmix64: the generator and the segment token ids */
+static uint64_t mix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t rng_next(uint64_t *state)
+{
+    *state += 0x9e3779b97f4a7c15ULL;
+    return mix64(*state);
+}
+
+static double rng_uniform(uint64_t *state)
+{
+    return (double)(rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_exponential(uint64_t *state, double mean)
+{
+    return -mean * log(1.0 - rng_uniform(state));
+}
+
+static uint32_t rng_lognormal(uint64_t *state, double median, double sigma)
+{
+    double u1 = 1.0 - rng_uniform(state), u2 = rng_uniform(state);
+    double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+    double v = median * exp(sigma * z);
+
+    if (v < 1.0)
+        return 1;
+    if (v > REPLAY_MAX_TOKENS)
+        return REPLAY_MAX_TOKENS;
+    return (uint32_t)v;
+}
+
+/* Zipf(@s) over @n items as a cumulative table */
+static double *zipf_table(uint32_t n, double s)
+{
+    double *cdf = malloc((size_t)n * sizeof(double));
+    double sum = 0.0;
+
+    if (!cdf)
+        return NULL;
+
+    for (uint32_t i = 0; i < n; i++) {
+        sum += 1.0 / pow((double)(i + 1), s);
+        cdf[i] = sum;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        cdf[i] /= sum;
+    return cdf;
+}
+
+static uint32_t zipf_pick(const double *cdf, uint32_t n, uint64_t *state)
+{
+    double u = rng_uniform(state);
+    uint32_t lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static uint64_t segment_key(const char *name)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static int trace_add_segment(struct replay_trace *trace, const char *name,
+                             uint32_t tokens)
+{
+    struct replay_segment *seg;
+
+    if (trace->num_segments == trace->segment_capacity) {
+        uint32_t cap = trace->segment_capacity ? trace->segment_capacity * 2 : 1024;
+        struct replay_segment *p = realloc(trace->segments, (size_t)cap * sizeof(*p));
+
+        if (!p)
+            return -1;
+        trace->segments = p;
+        trace->segment_capacity = cap;
+    }
+
+    seg = &trace->segments[trace->num_segments];
+    snprintf(seg->name, sizeof(seg->name), "%s", name);
+    seg->key = segment_key(seg->name);
+    seg->tokens = tokens;
+    return (int)trace->num_segments++;
+}
+
+static struct replay_request *trace_add_request(struct replay_trace *trace,
+                                                double arrival_ms,
+                                                uint32_t output_tokens)
+{
+    struct replay_request *req;
+
+    if (trace->num_requests == trace->request_capacity) {
+        uint32_t cap = trace->request_capacity ? trace->request_capacity * 2 : 1024;
+        struct replay_request *p = realloc(trace->requests, (size_t)cap * sizeof(*p));
+
+        if (!p)
+            return NULL;
+        trace->requests = p;
+        trace->request_capacity = cap;
+    }
+
+    req = &trace->requests[trace->num_requests++];
+    req->arrival_ms = arrival_ms;
+    req->output_tokens = output_tokens;
+    req->first_segment = trace->num_segments;
+    req->num_segments = 0;
+    req->reply_segment = -1;
+    return req;
+}
+
+/* Copy segment @index onto the end of the newest request */
+static int trace_push_segment(struct replay_trace *trace, struct replay_request *req,
+                              uint32_t index)
+{
+    struct replay_segment seg = trace->segments[index];
+
+    if (trace_add_segment(trace, seg.name, seg.tokens) < 0)
+        return -1;
+    req->num_segments++;
+    return 0;
+}
+
+static int compare_arrival(const void *a, const void *b)
+{
+    const struct replay_request *x = a, *y = b;
+
+    if (x->arrival_ms != y->arrival_ms)
+        return x->arrival_ms < y->arrival_ms ? -1 : 1;
+    return x->first_segment < y->first_segment ? -1 : 1;
+}
+
+static int generate_trace(struct replay_trace *trace,
+                          const struct replay_workload *w, double tpot_ms)
+{
+    double *sys_cdf = zipf_table(w->num_system_prompts, w->zipf_s);
+    double *doc_cdf = zipf_table(w->num_documents, w->zipf_s);
+    double mix_total = w->mix[REPLAY_SYSTEM] + w->mix[REPLAY_CHAT] + w->mix[REPLAY_RAG];
+    uint64_t rng = w->seed;
+    double now = 0.0;
+    char name[REPLAY_NAME_LEN];
+    int ret = -1;
+
+    if (!sys_cdf || !doc_cdf || mix_total <= 0.0)
+        goto out;
+
+    for (uint32_t id = 0; trace->num_requests < w->num_requests; id++) {
+        double pick = rng_uniform(&rng) * mix_total;
+        uint32_t sys = zipf_pick(sys_cdf, w->num_system_prompts, &rng);
+        struct replay_request *req;
+        uint32_t history;
+
+        now += rng_exponential(&rng, 1000.0 / w->rate);
+
+        /* Every request opens with a system prompt */
+        snprintf(name, sizeof(name), "sys%u", sys);
+        history = trace->num_segments;
+        if (trace_add_segment(trace, name, w->system_tokens) < 0)
+            goto out;
+
+        if (pick < w->mix[REPLAY_SYSTEM]) {
+            req = trace_add_request(trace, now,
+                                    rng_lognormal(&rng, w->output_median,
+                                                  w->output_sigma));
+            if (!req || trace_push_segment(trace, req, history) != 0)
+                goto out;
+            snprintf(name, sizeof(name), "u%u", id);
+            if (trace_add_segment(trace, name, rng_lognormal(&rng, w->prompt_median,
+                                                              w->prompt_sigma)) < 0)
+                goto out;
+            req->num_segments++;
+        } else if (pick < w->mix[REPLAY_SYSTEM] + w->mix[REPLAY_CHAT]) {
+            /* Turn k's prompt is the system prompt and turns 0..k-1 with
+             * their replies; the next turn follows the reply */
+            double at = now, p_more = 1.0 - 1.0 / (w->mean_turns > 1.0 ?
+                                                   w->mean_turns : 1.0);
+            uint32_t num_history = 1;
+
+            for (uint32_t turn = 0; trace->num_requests < w->num_requests; turn++) {
+                uint32_t out = rng_lognormal(&rng, w->output_median, w->output_sigma);
+
+                req = trace_add_request(trace, at, out);
+                if (!req)
+                    goto out;
+                for (uint32_t i = 0; i < num_history; i++)
+                    if (trace_push_segment(trace, req, history + i) != 0)
+                        goto out;
+                history = req->first_segment;
+
+                snprintf(name, sizeof(name), "c%uu%u", id, turn);
+                if (trace_add_segment(trace, name,
+                                      rng_lognormal(&rng, w->prompt_median,
+                                                    w->prompt_sigma)) < 0)
+                    goto out;
+                req->num_segments++;
+
+                snprintf(name, sizeof(name), "c%ua%u", id, turn);
+                req->reply_segment = trace_add_segment(trace, name, out);
+                if (req->reply_segment < 0)
+                    goto out;
+
+                /* History for the next turn: this prompt plus the reply */
+                num_history = req->num_segments + 1;
+                if (rng_uniform(&rng) >= p_more)
+                    break;
+                at += out * tpot_ms + rng_exponential(&rng, w->think_ms);
+            }
+        } else {
+            req = trace_add_request(trace, now,
+                                    rng_lognormal(&rng, w->output_median,
+                                                  w->output_sigma));
+            if (!req || trace_push_segment(trace, req, history) != 0)
+                goto out;
+            for (uint32_t k = 0; k < w->documents_per_query; k++) {
+                snprintf(name, sizeof(name), "doc%u",
+                         zipf_pick(doc_cdf, w->num_documents, &rng));
+                if (trace_add_segment(trace, name, w->document_tokens) < 0)
+                    goto out;
+                req->num_segments++;
+            }
+            snprintf(name, sizeof(name), "q%u", id);
+            if (trace_add_segment(trace, name, rng_lognormal(&rng, w->prompt_median,
+                                                              w->prompt_sigma)) < 0)
+                goto out;
+            req->num_segments++;
+        }
+    }
+
+    qsort(trace->requests, trace->num_requests, sizeof(*trace->requests),
+          compare_arrival);
+    ret = 0;
+out:
+    free(sys_cdf);
+    free(doc_cdf);
+    return ret;
+}
+
+static int parse_segment(struct replay_trace *trace, char *spec)
+{
+    char *colon = strrchr(spec, ':');
+    char *end;
+    unsigned long tokens;
+
+    if (!colon || colon == spec || colon - spec >= REPLAY_NAME_LEN)
+        return -1;
+    *colon = '\0';
+    tokens = strtoul(colon + 1, &end, 10);
+    if (*end != '\0' || tokens == 0 || tokens > REPLAY_MAX_TOKENS)
+        return -1;
+    return trace_add_segment(trace, spec, (uint32_t)tokens);
+}
+
+static int read_trace(struct replay_trace *trace, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char *line = NULL;
+    size_t len = 0;
+    uint64_t lineno = 0, bad = 0;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while (getline(&line, &len, f) != -1) {
+        char *save = NULL, *arrival, *output, *segs, *reply, *seg;
+        struct replay_request *req;
+        bool ok = true;
+
+        lineno++;
+        arrival = strtok_r(line, " \t\r\n", &save);
+        if (!arrival || arrival[0] == '#')
+            continue;
+        output = strtok_r(NULL, " \t\r\n", &save);
+        segs = strtok_r(NULL, " \t\r\n", &save);
+        reply = strtok_r(NULL, " \t\r\n", &save);
+        if (!output || !segs) {
+            bad++;
+            continue;
+        }
+
+        req = trace_add_request(trace, strtod(arrival, NULL),
+                                (uint32_t)strtoul(output, NULL, 10));
+        if (!req)
+            break;
+
+        for (char *s2 = NULL, *p = segs; (seg = strtok_r(p, ",", &s2)); p = NULL) {
+            if (parse_segment(trace, seg) < 0) {
+                ok = false;
+                break;
+            }
+            req->num_segments++;
+        }
+        if (ok && reply) {
+            char spec[REPLAY_NAME_LEN + 16];
+
+            snprintf(spec, sizeof(spec), "%s:%u", reply, req->output_tokens);
+            req->reply_segment = parse_segment(trace, spec);
+            ok = req->reply_segment >= 0;
+        }
+        if (!ok || req->num_segments == 0) {
+            trace->num_segments = req->first_segment;
+            trace->num_requests--;
+            bad++;
+        }
+    }
+
+    free(line);
+    fclose(f);
+
+    if (bad)
+        fprintf(stderr, "%s: skipped %llu malformed lines of %llu\n", path,
+                (unsigned long long)bad, (unsigned long long)lineno);
+
+    qsort(trace->requests, trace->num_requests, sizeof(*trace->requests),
+          compare_arrival);
+    return trace->num_requests ? 0 : -1;
+}
+
+static int write_trace(const struct replay_trace *trace, const char *path)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    fprintf(f, "# arrival_ms output_tokens segment:tokens,... [reply]\n");
+    for (uint32_t i = 0; i < trace->num_requests; i++) {
+        const struct replay_request *req = &trace->requests[i];
+
+        fprintf(f, "%.3f %u ", req->arrival_ms, req->output_tokens);
+        for (uint32_t s = 0; s < req->num_segments; s++) {
+            const struct replay_segment *seg = &trace->segments[req->first_segment + s];
+
+            fprintf(f, "%s%s:%u", s ? "," : "", seg->name, seg->tokens);
+        }
+        if (req->reply_segment >= 0)
+            fprintf(f, " %s", trace->segments[req->reply_segment].name);
+        fputc('\n', f);
+    }
+
+    return fclose(f);
+}
+
+/* Fill @tokens with the request's prompt (and reply); returns the count */
+static uint32_t build_tokens(const struct replay_trace *trace,
+                             const struct replay_request *req,
+                             bool with_reply, uint32_t *tokens, uint32_t max)
+{
+    uint32_t n = 0;
+
+    for (uint32_t s = 0; s <= req->num_segments && n < max; s++) {
+        const struct replay_segment *seg;
+
+        if (s == req->num_segments) {
+            if (!with_reply || req->reply_segment < 0)
+                break;
+            seg = &trace->segments[req->reply_segment];
+        } else
+            seg = &trace->segments[req->first_segment + s];
+
+        for (uint32_t i = 0; i < seg->tokens && n < max; i++)
+            tokens[n++] = (uint32_t)mix64(seg->key + i);
+    }
+
+    return n;
+}
+
+static void heap_push(struct replay_heap *heap, double time_ms, uint32_t request)
+{
+    uint32_t i = heap->count++;
+
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+
+        if (heap->items[parent].time_ms <= time_ms)
+            break;
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i].time_ms = time_ms;
+    heap->items[i].request = request;
+}
+
+static struct replay_completion heap_pop(struct replay_heap *heap)
+{
+    struct replay_completion top = heap->items[0];
+    struct replay_completion last = heap->items[--heap->count];
+    uint32_t i = 0;
+
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count &&
+            heap->items[child + 1].time_ms < heap->items[child].time_ms)
+            child++;
+        if (last.time_ms <= heap->items[child].time_ms)
+            break;
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->count > 0)
+        heap->items[i] = last;
+    return top;
+}
+
+static void record(struct replay_stats *stats, enum replay_op op, uint64_t start_ns)
+{
+    uint64_t ns = kv_cache_get_time_ns() - start_ns;
+
+    stats->latency[op][stats->num_latency[op]++] =
+        ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+/* The request finished decoding: publish its reply for the next turn */
+static void complete_request(struct kv_cache_coordinator *coord,
+                             const struct replay_trace *trace, uint32_t index,
+                             uint32_t *tokens, uint32_t max_tokens,
+                             struct replay_stats *stats)
+{
+    const struct replay_request *req = &trace->requests[index];
+    uint64_t start;
+
+    if (req->reply_segment >= 0) {
+        uint32_t n = build_tokens(trace, req, true, tokens, max_tokens);
+
+        start = kv_cache_get_time_ns();
+        kv_cache_insert_prefix(coord, index + 1, tokens, n);
+        record(stats, OP_PUBLISH, start);
+    }
+
+    start = kv_cache_get_time_ns();
+    kv_cache_free_sequence(coord, index + 1);
+    record(stats, OP_FREE, start);
+}
+
+static void admit_request(struct kv_cache_coordinator *coord,
+                          const struct replay_trace *trace, uint32_t index,
+                          uint32_t *tokens, uint32_t max_tokens,
+                          struct replay_heap *pending, double tpot_ms,
+                          struct replay_stats *stats)
+{
+    const struct replay_request *req = &trace->requests[index];
+    uint32_t tokens_per_block = coord->config.block_size_tokens;
+    uint32_t output = req->output_tokens, prompt;
+    uint64_t seq_id = index + 1, start;
+    int cached;
+
+    if (output >= max_tokens)
+        output = max_tokens - 1;
+    prompt = build_tokens(trace, req, false, tokens, max_tokens - output);
+
+    stats->requests++;
+    stats->prompt_tokens += prompt;
+
+    if (kv_cache_create_sequence(coord, seq_id, prompt + output) != 0) {
+        stats->rejected++;
+        return;
+    }
+
+    start = kv_cache_get_time_ns();
+    cached = kv_cache_attach_prefix(coord, seq_id, tokens, prompt);
+    record(stats, OP_ATTACH, start);
+    if (cached < 0)
+        cached = 0;
+    stats->cached_tokens += (uint32_t)cached;
+
+    start = kv_cache_get_time_ns();
+    if (kv_cache_append_tokens(coord, seq_id, prompt - (uint32_t)cached) != 0) {
+        record(stats, OP_PREFILL, start);
+        kv_cache_free_sequence(coord, seq_id);
+        stats->rejected++;
+        return;
+    }
+    record(stats, OP_PREFILL, start);
+
+    start = kv_cache_get_time_ns();
+    kv_cache_insert_prefix(coord, seq_id, tokens, prompt);
+    record(stats, OP_PUBLISH, start);
+
+    /* Reserve the output now so the request holds its full footprint
+     * for its whole lifetime */
+    start = kv_cache_get_time_ns();
+    if (kv_cache_append_tokens(coord, seq_id, output) != 0) {
+        record(stats, OP_DECODE, start);
+        kv_cache_free_sequence(coord, seq_id);
+        stats->rejected++;
+        return;
+    }
+    record(stats, OP_DECODE, start);
+
+    stats->allocations += (prompt + output + tokens_per_block - 1) / tokens_per_block -
+                          (uint32_t)cached / tokens_per_block;
+    heap_push(pending, req->arrival_ms + output * tpot_ms, index);
+}
+
+static int replay(const struct replay_trace *trace,
+                  struct kv_cache_config *config, double tpot_ms,
+                  struct replay_stats *stats)
+{
+    struct kv_cache_coordinator *coord = calloc(1, sizeof(*coord));
+    uint32_t max_tokens = REPLAY_MAX_TOKENS;
+    uint32_t *tokens = malloc((size_t)max_tokens * sizeof(uint32_t));
+    struct replay_heap pending = {
+        .items = calloc(trace->num_requests, sizeof(struct replay_completion)),
+    };
+    uint64_t start;
+    int ret = -1;
+
+    for (int op = 0; op < NUM_OPS; op++) {
+        /* Every request publishes at most twice */
+        stats->latency[op] = malloc((size_t)trace->num_requests * 2 * sizeof(uint32_t));
+        if (!stats->latency[op])
+            goto out;
+    }
+    if (!coord || !tokens || !pending.items || kv_cache_init(coord, config) != 0)
+        goto out;
+
+    start = kv_cache_get_time_ns();
+    for (uint32_t i = 0; i < trace->num_requests; i++) {
+        const struct replay_request *req = &trace->requests[i];
+        uint64_t used;
+
+        while (pending.count && pending.items[0].time_ms <= req->arrival_ms)
+            complete_request(coord, trace, heap_pop(&pending).request,
+                             tokens, max_tokens, stats);
+
+        admit_request(coord, trace, i, tokens, max_tokens, &pending, tpot_ms, stats);
+
+        used = kv_cache_get_total_usage(coord);
+        if (used > stats->peak_bytes)
+            stats->peak_bytes = used;
+    }
+    while (pending.count)
+        complete_request(coord, trace, heap_pop(&pending).request,
+                         tokens, max_tokens, stats);
+    stats->wall_s = (double)(kv_cache_get_time_ns() - start) / 1e9;
+
+    kv_cache_get_statistics(coord, &stats->cache);
+    kv_cache_cleanup(coord);
+    ret = 0;
+out:
+    free(pending.items);
+    free(tokens);
+    free(coord);
+    return ret;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* @p-th percentile in microseconds (sorts the samples) */
+static double percentile_us(uint32_t *samples, uint32_t n, double p)
+{
+    if (n == 0)
+        return 0.0;
+    qsort(samples, n, sizeof(*samples), compare_u32);
+    return samples[(uint32_t)((n - 1) * p / 100.0 + 0.5)] / 1000.0;
+}
+
+static void print_workload(const struct replay_trace *trace,
+                           const struct kv_cache_config *config)
+{
+    uint64_t segment_tokens = 0;
+
+    for (uint32_t i = 0; i < trace->num_requests; i++) {
+        const struct replay_request *req = &trace->requests[i];
+
+        for (uint32_t s = 0; s < req->num_segments; s++)
+            segment_tokens += trace->segments[req->first_segment + s].tokens;
+    }
+
+    printf("\nWorkload: %u requests over %.1fs, mean prompt %.0f tokens\n",
+           trace->num_requests,
+           trace->num_requests ?
+           trace->requests[trace->num_requests - 1].arrival_ms / 1000.0 : 0.0,
+           trace->num_requests ? (double)segment_tokens / trace->num_requests : 0.0);
+    printf("Cache:    %lluMB hot, %lluMB host, %u tokens/block\n",
+           (unsigned long long)(config->total_capacity_bytes >> 20),
+           (unsigned long long)(config->host_tier_bytes >> 20),
+           config->block_size_tokens);
+}
+
+static void print_report(const char *const *names,
+                         struct replay_stats *stats, uint32_t num_policies,
+                         uint32_t block_bytes, uint32_t tokens_per_block)
+{
+    printf("\n  %-6s %8s %8s %10s %11s %9s %9s %9s %9s %9s\n", "Policy",
+           "Hit%", "Req hit%", "Saved MB", "Allocs/s", "Peak MB", "Evicted",
+           "Swapped", "Dropped", "Rejected");
+    for (uint32_t p = 0; p < num_policies; p++) {
+        const struct replay_stats *s = &stats[p];
+        double saved = (double)(s->cached_tokens / tokens_per_block) * block_bytes;
+
+        printf("  %-6s %8.2f %8.2f %10.1f %11.0f %9.1f %9llu %9llu %9llu %9llu\n",
+               names[p],
+               s->prompt_tokens ?
+               100.0 * (double)s->cached_tokens / (double)s->prompt_tokens : 0.0,
+               s->cache.hit_rate_percent, saved / (1024.0 * 1024.0),
+               s->wall_s > 0.0 ? (double)s->allocations / s->wall_s : 0.0,
+               (double)s->peak_bytes / (1024.0 * 1024.0),
+               (unsigned long long)s->cache.total_evictions,
+               (unsigned long long)s->cache.total_swap_outs,
+               (unsigned long long)s->cache.total_recompute_drops,
+               (unsigned long long)s->rejected);
+    }
+
+    printf("\n  Latency us p50/p99\n  %-6s", "Policy");
+    for (int op = 0; op < NUM_OPS; op++)
+        printf(" %17s", op_names[op]);
+    printf("\n");
+    for (uint32_t p = 0; p < num_policies; p++) {
+        struct replay_stats *s = &stats[p];
+
+        printf("  %-6s", names[p]);
+        for (int op = 0; op < NUM_OPS; op++) {
+            char cell[32];
+
+            snprintf(cell, sizeof(cell), "%.1f/%.1f",
+                     percentile_us(s->latency[op], s->num_latency[op], 50.0),
+                     percentile_us(s->latency[op], s->num_latency[op], 99.0));
+            printf(" %17s", cell);
+        }
+        printf("\n");
+    }
+}
+
+static int parse_policies(char *list, enum kv_eviction_policy *policies,
+                          const char **names)
+{
+    static const struct {
+        const char *name;
+        enum kv_eviction_policy policy;
+    } known[] = {
+        { "lru", KV_EVICT_LRU },
+        { "lfu", KV_EVICT_LFU },
+        { "cost", KV_EVICT_COST_AWARE },
+        { "fifo", KV_EVICT_FIFO },
+    };
+    uint32_t n = 0;
+    char *save = NULL;
+
+    for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        uint32_t k;
+
+        for (k = 0; k < sizeof(known) / sizeof(known[0]); k++)
+            if (strcmp(tok, known[k].name) == 0)
+                break;
+        if (k == sizeof(known) / sizeof(known[0]) || n == 4) {
+            fprintf(stderr, "Unknown policy: %s\n", tok);
+            return -1;
+        }
+        policies[n] = known[k].policy;
+        names[n++] = known[k].name;
+    }
+    return (int)n;
+}
+
+int main(int argc, char **argv)
+{
+    struct replay_workload w = {
+        .num_requests = 5000,
+        .rate = 20.0,
+        .mix = { 4.0, 4.0, 2.0 },
+        .zipf_s = 1.0,
+        .num_system_prompts = 8,
+        .system_tokens = 1024,
+        .num_documents = 500,
+        .document_tokens = 512,
+        .documents_per_query = 3,
+        .prompt_median = 128.0,
+        .prompt_sigma = 1.0,
+        .output_median = 128.0,
+        .output_sigma = 0.8,
+        .mean_turns = 4.0,
+        .think_ms = 10000.0,
+        .seed = 1,
+    };
+    struct kv_cache_config config;
+    struct replay_trace trace = { 0 };
+    struct replay_stats stats[4];
+    enum kv_eviction_policy policies[4];
+    const char *names[4];
+    char default_policies[] = "lru,lfu,cost,fifo";
+    char *policy_list = default_policies;
+    const char *read_path = NULL, *write_path = NULL;
+    double tpot_ms = 20.0;
+    int num_policies, opt, ret = 1;
+
+    memset(stats, 0, sizeof(stats));
+    memset(&config, 0, sizeof(config));
+    config.total_capacity_bytes = 256ULL << 20;
+    config.block_size_tokens = KV_CACHE_DEFAULT_BLOCK_TOKENS;
+
+    while ((opt = getopt(argc, argv, "r:w:n:q:m:S:D:l:o:T:z:s:p:C:H:b:t:h")) != -1) {
+        bool ok = true;
+
+        switch (opt) {
+        case 'r':
+            read_path = optarg;
+            break;
+        case 'w':
+            write_path = optarg;
+            break;
+        case 'n':
+            w.num_requests = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            w.rate = strtod(optarg, NULL);
+            ok = w.rate > 0.0;
+            break;
+        case 'm':
+            ok = sscanf(optarg, "%lf,%lf,%lf", &w.mix[REPLAY_SYSTEM],
+                        &w.mix[REPLAY_CHAT], &w.mix[REPLAY_RAG]) == 3;
+            break;
+        case 'S':
+            ok = sscanf(optarg, "%u,%u", &w.num_system_prompts,
+                        &w.system_tokens) == 2 && w.num_system_prompts > 0;
+            break;
+        case 'D':
+            ok = sscanf(optarg, "%u,%u,%u", &w.num_documents, &w.document_tokens,
+                        &w.documents_per_query) == 3 && w.num_documents > 0;
+            break;
+        case 'l':
+            ok = sscanf(optarg, "%lf,%lf", &w.prompt_median, &w.prompt_sigma) == 2;
+            break;
+        case 'o':
+            ok = sscanf(optarg, "%lf,%lf", &w.output_median, &w.output_sigma) == 2;
+            break;
+        case 'T':
+            w.mean_turns = strtod(optarg, NULL);
+            break;
+        case 'z':
+            w.zipf_s = strtod(optarg, NULL);
+            break;
+        case 's':
+            w.seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            policy_list = optarg;
+            break;
+        case 'C':
+            config.total_capacity_bytes = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'H':
+            config.host_tier_bytes = strtoull(optarg, NULL, 10) << 20;
+            break;
+        case 'b':
+            config.block_size_tokens = (uint32_t)strtoul(optarg, NULL, 10);
+            ok = config.block_size_tokens > 0;
+            break;
+        case 't':
+            tpot_ms = strtod(optarg, NULL);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Bad value for -%c: %s\n", opt, optarg);
+            return 1;
+        }
+    }
+
+    num_policies = parse_policies(policy_list, policies, names);
+    if (num_policies <= 0)
+        return 1;
+
+    if (read_path ? read_trace(&trace, read_path) != 0
+                  : generate_trace(&trace, &w, tpot_ms) != 0) {
+        fprintf(stderr, "Failed to load trace\n");
+        goto out;
+    }
+    if (write_path && write_trace(&trace, write_path) != 0)
+        goto out;
+
+    for (int p = 0; p < num_policies; p++) {
+        config.eviction_policy = policies[p];
+        if (replay(&trace, &config, tpot_ms, &stats[p]) != 0) {
+            fprintf(stderr, "Replay under %s failed\n", names[p]);
+            goto out;
+        }
+    }
+
+    print_workload(&trace, &config);
+    print_report(names, stats, (uint32_t)num_policies,
+                 2 * (config.page_size_bytes ? config.page_size_bytes
+                                             : KV_CACHE_PAGE_SIZE),
+                 config.block_size_tokens);
+    ret = 0;
+out:
+    for (int p = 0; p < num_policies; p++)
+        for (int op = 0; op < NUM_OPS; op++)
+            free(stats[p].latency[op]);
+    free(trace.requests);
+    free(trace.segments);
+    return ret;
+}
@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_replication.h"
+
+/*
+ * Replication Queue and Batch Implementation
+ *
+ * Queues are swapped out whole with an empty spare, so the flusher
+ * walks a node's blocks without holding the outbox, and both arrays are
+ * kept for reuse. Batch data grows by doubling; taking a batch copies it
+ * into one contiguous payload that the transport owns.
+ */
+
+void kv_repl_outbox_init(struct kv_repl_outbox *outbox)
+{
+    memset(outbox, 0, sizeof(*outbox));
+}
+
+void kv_repl_outbox_destroy(struct kv_repl_outbox *outbox)
+{
+    if (!outbox)
+        return;
+
+    for (uint32_t i = 0; i < KV_REPL_MAX_NODES; i++)
+        kv_repl_queue_destroy(&outbox->queues[i]);
+    memset(outbox, 0, sizeof(*outbox));
+}
+
+void kv_repl_queue_destroy(struct kv_repl_queue *queue)
+{
+    free(queue->items);
+    memset(queue, 0, sizeof(*queue));
+}
+
+/* Queue @op on @block_id for @node */
+int kv_repl_queue(struct kv_repl_outbox *outbox, uint32_t node,
+                  enum kv_repl_op op, uint64_t block_id)
+{
+    struct kv_repl_queue *queue;
+    struct kv_repl_item *item;
+
+    if (node >= KV_REPL_MAX_NODES || op == 0 || op >= KV_REPL_NUM_OPS)
+        return -1;
+
+    queue = &outbox->queues[node];
+    if (queue->count == queue->capacity) {
+        uint32_t cap = queue->capacity ? queue->capacity * 2 : 64;
+        struct kv_repl_item *items = realloc(queue->items, cap * sizeof(*items));
+
+        if (!items)
+            return -1;
+        queue->items = items;
+        queue->capacity = cap;
+    }
+
+    item = &queue->items[queue->count++];
+    item->block_id = block_id;
+    item->op = op;
+    item->reserved = 0;
+
+    outbox->pending |= kv_repl_node_bit(node);
+    outbox->queued[op]++;
+    return 0;
+}
+
+/* Exchange @node's queue for @spare, which must be empty */
+void kv_repl_detach(struct kv_repl_outbox *outbox, uint32_t node,
+                    struct kv_repl_queue *spare)
+{
+    struct kv_repl_queue tmp;
+
+    if (node >= KV_REPL_MAX_NODES)
+        return;
+
+    tmp = outbox->queues[node];
+    outbox->queues[node] = *spare;
+    outbox->queues[node].count = 0;
+    *spare = tmp;
+    outbox->pending &= ~kv_repl_node_bit(node);
+}
+
+int kv_repl_batch_init(struct kv_repl_batch *batch, uint32_t block_bytes)
+{
+    if (!batch || block_bytes == 0)
+        return -1;
+
+    memset(batch, 0, sizeof(*batch));
+    batch->entries = calloc(KV_REPL_BATCH_BLOCKS, sizeof(struct kv_repl_entry));
+    if (!batch->entries)
+        return -1;
+    batch->block_bytes = block_bytes;
+    return 0;
+}
+
+void kv_repl_batch_destroy(struct kv_repl_batch *batch)
+{
+    if (!batch)
+        return;
+
+    free(batch->entries);
+    free(batch->data);
+    memset(batch, 0, sizeof(*batch));
+}
+
+/*
+ * Add @entry, copying @data (block_bytes) for an UPDATE; an UPDATE
+ * without data is sent as KV_REPL_NO_DATA. A full batch refuses more.
+ */
+int kv_repl_batch_add(struct kv_repl_batch *batch,
+                      const struct kv_repl_entry *entry, const void *data)
+{
+    struct kv_repl_entry *e;
+
+    if (kv_repl_batch_full(batch) || entry->op == 0 ||
+        entry->op >= KV_REPL_NUM_OPS)
+        return -1;
+
+    if (entry->op == KV_REPL_UPDATE && data) {
+        if (batch->num_data == batch->data_capacity) {
+            uint32_t cap = batch->data_capacity ? batch->data_capacity * 2 : 4;
+            uint8_t *buf = realloc(batch->data, (size_t)cap * batch->block_bytes);
+
+            if (!buf)
+                return -1;
+            batch->data = buf;
+            batch->data_capacity = cap;
+        }
+        memcpy(batch->data + (size_t)batch->num_data * batch->block_bytes, data,
+               batch->block_bytes);
+        batch->num_data++;
+    }
+
+    e = &batch->entries[batch->count++];
+    *e = *entry;
+    e->flags &= ~KV_REPL_NO_DATA;
+    if (entry->op == KV_REPL_UPDATE && !data)
+        e->flags |= KV_REPL_NO_DATA;
+    e->reserved = 0;
+    return 0;
+}
+
+/*
+ * Detach the batch as one malloc()ed payload (the caller frees it), or
+ * NULL if it is empty or memory ran out. The batch is empty afterwards
+ * either way: the flusher moves on rather than retry.
+ */
+void *kv_repl_batch_take(struct kv_repl_batch *batch, uint32_t *count,
+                         uint32_t *bytes)
+{
+    size_t head, len;
+    uint8_t *payload;
+
+    if (batch->count == 0)
+        return NULL;
+
+    head = (size_t)batch->count * sizeof(struct kv_repl_entry);
+    len = head + (size_t)batch->num_data * batch->block_bytes;
+    payload = malloc(len);
+    if (payload) {
+        memcpy(payload, batch->entries, head);
+        if (batch->num_data)
+            memcpy(payload + head, batch->data,
+                   (size_t)batch->num_data * batch->block_bytes);
+
+        *count = batch->count;
+        *bytes = (uint32_t)len;
+        batch->messages++;
+    }
+
+    batch->count = 0;
+    batch->num_data = 0;
+    return payload;
+}
+
+/* Check a received payload and locate its entries and block data */
+int kv_repl_parse(const void *payload, uint32_t count, uint32_t bytes,
+                  uint32_t block_bytes, const struct kv_repl_entry **entries,
+                  const uint8_t **data)
+{
+    const struct kv_repl_entry *e = payload;
+    uint64_t head = (uint64_t)count * sizeof(struct kv_repl_entry);
+    uint64_t updates = 0;
+
+    if (!payload || head > bytes)
+        return -1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (e[i].op == 0 || e[i].op >= KV_REPL_NUM_OPS)
+            return -1;
+        if (kv_repl_entry_has_data(&e[i]))
+            updates++;
+    }
+    if (head + updates * block_bytes != bytes)
+        return -1;
+
+    *entries = e;
+    *data = (const uint8_t *)payload + head;
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_REPLICATION_H
+#define _KV_REPLICATION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Replication queues and batches.
+ *
+ * A written block owes its replica nodes a copy. The outbox records
+ * only which blocks each node is owed, once per block however often it
+ * is written before the next flush; the data is copied into a batch
+ * when the flush gets to the block, so a decode burst on one block costs
+ * one copy per replica, and none on the decode path.
+ *
+ * A payload is @count entries followed by the data of each UPDATE entry
+ * without KV_REPL_NO_DATA, in entry order. Not thread-safe; the
+ * coordinator holds replication_lock for the outbox, and a batch belongs
+ * to whoever is flushing.
+ */
+
+#define KV_REPL_MAX_NODES 64           /* Replica sets are 64-bit masks */
+#define KV_REPL_BATCH_BLOCKS 128       /* Entries per message */
+
+enum kv_repl_op {
+    KV_REPL_UPDATE = 1,             /* Store or refresh a replica */
+    KV_REPL_DROP = 2,               /* The source block was freed */
+    KV_REPL_NUM_OPS,
+};
+
+/* Entry flags */
+#define KV_REPL_NO_DATA 0x1            /* Not resident at the source */
+
+struct kv_repl_entry {
+    uint64_t block_id;              /* Id at the source node */
+    uint64_t sequence_id;
+    uint32_t op;
+    uint32_t flags;
+    uint32_t position;
+    uint32_t num_tokens;
+    float recompute_cost_ms;
+    uint32_t reserved;
+};
+
+/* A block owed to one node */
+struct kv_repl_item {
+    uint64_t block_id;
+    uint32_t op;
+    uint32_t reserved;
+};
+
+/* Blocks owed to one node, grown by doubling and reused */
+struct kv_repl_queue {
+    struct kv_repl_item *items;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct kv_repl_outbox {
+    struct kv_repl_queue queues[KV_REPL_MAX_NODES];
+    uint64_t pending;               /* Nodes with queued blocks */
+
+    /* Statistics */
+    uint64_t queued[KV_REPL_NUM_OPS];
+};
+
+/* One message being assembled */
+struct kv_repl_batch {
+    struct kv_repl_entry *entries;  /* KV_REPL_BATCH_BLOCKS */
+    uint32_t count;
+    uint8_t *data;                  /* Payloads, grown on demand */
+    uint32_t num_data;
+    uint32_t data_capacity;         /* Payloads */
+    uint32_t block_bytes;
+
+    /* Statistics */
+    uint64_t messages;
+};
+
+/* Function prototypes */
+void kv_repl_outbox_init(struct kv_repl_outbox *outbox);
+void kv_repl_outbox_destroy(struct kv_repl_outbox *outbox);
+int kv_repl_queue(struct kv_repl_outbox *outbox, uint32_t node,
+                  enum kv_repl_op op, uint64_t block_id);
+void kv_repl_detach(struct kv_repl_outbox *outbox, uint32_t node,
+                    struct kv_repl_queue *spare);
+void kv_repl_queue_destroy(struct kv_repl_queue *queue);
+
+int kv_repl_batch_init(struct kv_repl_batch *batch, uint32_t block_bytes);
+void kv_repl_batch_destroy(struct kv_repl_batch *batch);
+int kv_repl_batch_add(struct kv_repl_batch *batch,
+                      const struct kv_repl_entry *entry, const void *data);
+void *kv_repl_batch_take(struct kv_repl_batch *batch, uint32_t *count,
+                         uint32_t *bytes);
+int kv_repl_parse(const void *payload, uint32_t count, uint32_t bytes,
+                  uint32_t block_bytes, const struct kv_repl_entry **entries,
+                  const uint8_t **data);
+
+/* Utility functions */
+
+static inline uint64_t kv_repl_node_bit(uint32_t node)
+{
+    return node < KV_REPL_MAX_NODES ? 1ULL << node : 0;
+}
+
+static inline bool kv_repl_batch_full(const struct kv_repl_batch *batch)
+{
+    return batch->count >= KV_REPL_BATCH_BLOCKS;
+}
+
+static inline bool kv_repl_entry_has_data(const struct kv_repl_entry *entry)
+{
+    return entry->op == KV_REPL_UPDATE && !(entry->flags & KV_REPL_NO_DATA);
+}
+
+#endif /* _KV_REPLICATION_H */
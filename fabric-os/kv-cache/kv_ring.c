@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_index.h"
+#include "kv_ring.h"
+
+/*
+ * Consistent Hash Ring Implementation
+ *
+ * A node's points are hashes of (node, replica), so every coordinator
+ * that knows the same members builds the same ring and routes a key to
+ * the same node without talking to the others.
+ */
+
+static int point_cmp(const void *a, const void *b)
+{
+    const struct kv_ring_point *x = a, *y = b;
+
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return x->node < y->node ? -1 : x->node > y->node;
+}
+
+static uint64_t point_hash(uint32_t node, uint32_t replica)
+{
+    return kv_hash64(((uint64_t)node << 32 | replica) ^ 0x5bd1e9955bd1e995ULL);
+}
+
+int kv_ring_init(struct kv_ring *ring, uint32_t max_nodes, uint32_t vnodes)
+{
+    if (!ring || max_nodes == 0)
+        return -1;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->vnodes = vnodes ? vnodes : KV_RING_DEFAULT_VNODES;
+    ring->max_nodes = max_nodes;
+    ring->capacity = max_nodes * ring->vnodes;
+
+    ring->points = calloc(ring->capacity, sizeof(struct kv_ring_point));
+    ring->member = calloc(max_nodes, sizeof(bool));
+    if (!ring->points || !ring->member) {
+        kv_ring_destroy(ring);
+        return -1;
+    }
+
+    return 0;
+}
+
+void kv_ring_destroy(struct kv_ring *ring)
+{
+    if (!ring)
+        return;
+
+    free(ring->points);
+    free(ring->member);
+    memset(ring, 0, sizeof(*ring));
+}
+
+int kv_ring_add(struct kv_ring *ring, uint32_t node)
+{
+    if (!ring || node >= ring->max_nodes)
+        return -1;
+    if (ring->member[node])
+        return 0;
+
+    for (uint32_t r = 0; r < ring->vnodes; r++) {
+        struct kv_ring_point *p = &ring->points[ring->num_points++];
+
+        p->hash = point_hash(node, r);
+        p->node = node;
+    }
+    qsort(ring->points, ring->num_points, sizeof(struct kv_ring_point), point_cmp);
+
+    ring->member[node] = true;
+    ring->num_nodes++;
+    return 0;
+}
+
+void kv_ring_remove(struct kv_ring *ring, uint32_t node)
+{
+    uint32_t kept = 0;
+
+    if (!ring || !kv_ring_contains(ring, node))
+        return;
+
+    /* Filtering keeps the remaining points sorted */
+    for (uint32_t i = 0; i < ring->num_points; i++) {
+        if (ring->points[i].node != node)
+            ring->points[kept++] = ring->points[i];
+    }
+    ring->num_points = kept;
+
+    ring->member[node] = false;
+    ring->num_nodes--;
+}
+
+/* First point at or after @hash, wrapping; 0 on an empty ring */
+uint32_t kv_ring_successor(const struct kv_ring *ring, uint64_t hash)
+{
+    uint32_t lo = 0, hi = ring->num_points;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (ring->points[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo < ring->num_points ? lo : 0;
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_RING_H
+#define _KV_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Consistent hash ring with virtual nodes.
+ *
+ * Each member node owns @vnodes points on a 64-bit ring; a key belongs
+ * to the first point at or after its hash. Adding or removing a node
+ * only moves the keys on the arcs its points cover, about 1/n of them,
+ * and many points per node keep the arcs even. Callers that bound load
+ * walk on from the successor with kv_ring_next() until a node has room.
+ *
+ * Membership changes rebuild the sorted point array (rare); lookups are
+ * a binary search. Not thread-safe; the coordinator holds routing_lock.
+ */
+
+#define KV_RING_DEFAULT_VNODES 160
+
+struct kv_ring_point {
+    uint64_t hash;
+    uint32_t node;
+};
+
+struct kv_ring {
+    struct kv_ring_point *points;   /* Sorted by hash */
+    uint32_t num_points;
+    uint32_t capacity;
+    uint32_t num_nodes;             /* Members */
+    uint32_t max_nodes;
+    uint32_t vnodes;                /* Points per node */
+    bool *member;                   /* By node id */
+};
+
+/* Function prototypes */
+int kv_ring_init(struct kv_ring *ring, uint32_t max_nodes, uint32_t vnodes);
+void kv_ring_destroy(struct kv_ring *ring);
+int kv_ring_add(struct kv_ring *ring, uint32_t node);
+void kv_ring_remove(struct kv_ring *ring, uint32_t node);
+uint32_t kv_ring_successor(const struct kv_ring *ring, uint64_t hash);
+
+/* Utility functions */
+
+static inline bool kv_ring_contains(const struct kv_ring *ring, uint32_t node)
+{
+    return node < ring->max_nodes && ring->member[node];
+}
+
+/* Point after @pos, wrapping around */
+static inline uint32_t kv_ring_next(const struct kv_ring *ring, uint32_t pos)
+{
+    return pos + 1 < ring->num_points ? pos + 1 : 0;
+}
+
+#endif /* _KV_RING_H */
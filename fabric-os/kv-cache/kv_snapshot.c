@@ -0,0 +1,396 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "kv_snapshot.h"
+
+/*
+ * Prefix Cache Snapshot Implementation
+ *
+ * The file is sized for its capacity up front and mapped whole, like the
+ * file spill tier. Opening a file written with the same geometry keeps
+ * its records; anything else is truncated and starts empty. Record
+ * writes are plain stores into the mapping; kv_snapshot_sync() only
+ * asks the kernel to start writing back, or waits for it at shutdown.
+ */
+
+static uint64_t snap_align(uint64_t bytes)
+{
+    return (bytes + KV_SNAP_ALIGN - 1) & ~(uint64_t)(KV_SNAP_ALIGN - 1);
+}
+
+static uint32_t *record_tokens(const struct kv_snapshot *snap, uint32_t slot)
+{
+    return &snap->tokens[(size_t)slot * snap->tokens_per_block];
+}
+
+static uint8_t *record_data(const struct kv_snapshot *snap, uint32_t slot)
+{
+    return snap->data + (uint64_t)slot * snap->block_bytes;
+}
+
+/* FNV-1a over 64-bit words, then the tail bytes */
+static uint64_t snap_checksum(const uint32_t *tokens, uint32_t num_tokens,
+                              const uint8_t *data, uint32_t bytes)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint32_t i = 0;
+
+    for (uint32_t t = 0; t < num_tokens; t++)
+        h = (h ^ tokens[t]) * 0x100000001b3ULL;
+
+    for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t w;
+
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < bytes; i++)
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+
+    return kv_hash64(h);
+}
+
+static bool header_matches(const struct kv_snap_header *h, uint32_t capacity,
+                           uint32_t block_bytes, uint32_t tokens_per_block,
+                           uint32_t format)
+{
+    return h->magic == KV_SNAP_MAGIC && h->version == KV_SNAP_VERSION &&
+           h->format == format && h->block_bytes == block_bytes &&
+           h->tokens_per_block == tokens_per_block && h->capacity == capacity &&
+           h->epoch != 0;
+}
+
+/* Index the valid records of a reopened file as cold */
+static int snap_restore(struct kv_snapshot *snap)
+{
+    for (uint32_t slot = snap->capacity; slot-- > 0;) {
+        struct kv_snap_record *rec = &snap->records[slot];
+
+        if (rec->epoch == 0 || kv_index_lookup(&snap->index, rec->prefix_hash, NULL)) {
+            rec->epoch = 0;
+            snap->free_slots[snap->free_count++] = slot;
+            continue;
+        }
+        if (kv_index_insert(&snap->index, rec->prefix_hash, slot) != 0)
+            return -1;
+
+        snap->state[slot] = KV_SNAP_COLD;
+        snap->cold_slots[snap->cold_count++] = slot;
+    }
+
+    snap->num_cold = snap->cold_count;
+    snap->restored = snap->cold_count;
+    return 0;
+}
+
+/*
+ * Map the snapshot at @path for @capacity blocks of @block_bytes, keeping
+ * the records of a file written with the same geometry and @format.
+ * Returns the number of records restored, or -1.
+ */
+int kv_snapshot_open(struct kv_snapshot *snap, const char *path,
+                     uint32_t capacity, uint32_t block_bytes,
+                     uint32_t tokens_per_block, uint32_t format)
+{
+    uint64_t records_off, tokens_off, data_off;
+    struct stat st;
+    bool keep;
+
+    if (!snap || !path || !path[0] || capacity == 0 || capacity == KV_SNAP_NONE ||
+        block_bytes == 0 || tokens_per_block == 0)
+        return -1;
+
+    memset(snap, 0, sizeof(*snap));
+    snap->fd = -1;
+
+    records_off = KV_SNAP_ALIGN;
+    tokens_off = records_off + snap_align((uint64_t)capacity * sizeof(struct kv_snap_record));
+    data_off = tokens_off + snap_align((uint64_t)capacity * tokens_per_block *
+                                       sizeof(uint32_t));
+    snap->map_bytes = data_off + (uint64_t)capacity * block_bytes;
+
+    snap->state = calloc(capacity, sizeof(uint8_t));
+    snap->free_slots = malloc(capacity * sizeof(uint32_t));
+    snap->cold_slots = malloc(capacity * sizeof(uint32_t));
+    if (!snap->state || !snap->free_slots || !snap->cold_slots ||
+        kv_index_init(&snap->index, capacity) != 0)
+        goto fail;
+
+    snap->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (snap->fd < 0 || fstat(snap->fd, &st) != 0) {
+        fprintf(stderr, "kv_snapshot: cannot open %s\n", path);
+        goto fail;
+    }
+
+    /* A file of another size is rebuilt from scratch */
+    keep = (uint64_t)st.st_size == snap->map_bytes;
+    if (!keep && (ftruncate(snap->fd, 0) != 0 ||
+                  ftruncate(snap->fd, (off_t)snap->map_bytes) != 0)) {
+        fprintf(stderr, "kv_snapshot: cannot size %s\n", path);
+        goto fail;
+    }
+
+    snap->base = mmap(NULL, snap->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      snap->fd, 0);
+    if (snap->base == MAP_FAILED) {
+        snap->base = NULL;
+        fprintf(stderr, "kv_snapshot: cannot map %s\n", path);
+        goto fail;
+    }
+
+    snap->header = (struct kv_snap_header *)snap->base;
+    snap->records = (struct kv_snap_record *)(snap->base + records_off);
+    snap->tokens = (uint32_t *)(snap->base + tokens_off);
+    snap->data = snap->base + data_off;
+    snap->capacity = capacity;
+    snap->block_bytes = block_bytes;
+    snap->tokens_per_block = tokens_per_block;
+
+    if (keep && header_matches(snap->header, capacity, block_bytes,
+                               tokens_per_block, format)) {
+        if (snap_restore(snap) != 0)
+            goto fail;
+        return (int)snap->restored;
+    }
+
+    /* Start empty: clear the record table, then claim the file */
+    memset(snap->records, 0, (size_t)capacity * sizeof(struct kv_snap_record));
+    memset(snap->header, 0, sizeof(*snap->header));
+    snap->header->version = KV_SNAP_VERSION;
+    snap->header->format = format;
+    snap->header->block_bytes = block_bytes;
+    snap->header->tokens_per_block = tokens_per_block;
+    snap->header->capacity = capacity;
+    snap->header->epoch = 1;
+    atomic_thread_fence(memory_order_release);
+    snap->header->magic = KV_SNAP_MAGIC;
+
+    for (uint32_t i = 0; i < capacity; i++)
+        snap->free_slots[i] = capacity - 1 - i;
+    snap->free_count = capacity;
+
+    return 0;
+
+fail:
+    kv_snapshot_close(snap);
+    return -1;
+}
+
+void kv_snapshot_close(struct kv_snapshot *snap)
+{
+    if (!snap)
+        return;
+
+    if (snap->base)
+        munmap(snap->base, snap->map_bytes);
+    if (snap->fd >= 0)
+        close(snap->fd);
+    free(snap->state);
+    free(snap->free_slots);
+    free(snap->cold_slots);
+    free(snap->pending);
+    kv_index_destroy(&snap->index);
+
+    memset(snap, 0, sizeof(*snap));
+    snap->fd = -1;
+}
+
+/* Queue @op on @prefix_hash for the next flush */
+int kv_snapshot_note(struct kv_snapshot *snap, enum kv_snap_op op,
+                     uint64_t prefix_hash)
+{
+    struct kv_snap_item *item;
+
+    if (snap->num_pending == snap->pending_capacity) {
+        uint32_t cap = snap->pending_capacity ? snap->pending_capacity * 2 : 64;
+        struct kv_snap_item *items = realloc(snap->pending, cap * sizeof(*items));
+
+        if (!items)
+            return -1;
+        snap->pending = items;
+        snap->pending_capacity = cap;
+    }
+
+    item = &snap->pending[snap->num_pending++];
+    item->prefix_hash = prefix_hash;
+    item->op = op;
+    item->reserved = 0;
+    return 0;
+}
+
+/*
+ * Exchange the pending items for the caller's empty array *@items of
+ * *@capacity. Returns how many the caller now holds.
+ */
+uint32_t kv_snapshot_take_pending(struct kv_snapshot *snap,
+                                  struct kv_snap_item **items,
+                                  uint32_t *capacity)
+{
+    struct kv_snap_item *taken = snap->pending;
+    uint32_t cap = snap->pending_capacity;
+    uint32_t count = snap->num_pending;
+
+    snap->pending = *items;
+    snap->pending_capacity = *capacity;
+    snap->num_pending = 0;
+
+    *items = taken;
+    *capacity = cap;
+    return count;
+}
+
+static void record_clear(struct kv_snapshot *snap, uint32_t slot)
+{
+    snap->records[slot].epoch = 0;
+    if (snap->state[slot] == KV_SNAP_COLD)
+        snap->num_cold--;
+    snap->state[slot] = KV_SNAP_FREE;
+}
+
+/* A free record, else the oldest cold one still unclaimed */
+static uint32_t record_alloc(struct kv_snapshot *snap)
+{
+    if (snap->free_count)
+        return snap->free_slots[--snap->free_count];
+
+    while (snap->cold_count) {
+        uint32_t slot = snap->cold_slots[--snap->cold_count];
+
+        if (snap->state[slot] != KV_SNAP_COLD)
+            continue;
+        kv_index_remove(&snap->index, snap->records[slot].prefix_hash, NULL);
+        record_clear(snap, slot);
+        return slot;
+    }
+
+    return KV_SNAP_NONE;
+}
+
+/*
+ * Write the record of a published prefix block. A live record for the
+ * same prefix is left alone (published blocks are immutable); a cold
+ * one is overwritten. Returns the record, or KV_SNAP_NONE when the file
+ * is full of live records.
+ */
+uint32_t kv_snapshot_store(struct kv_snapshot *snap, uint64_t prefix_hash,
+                           uint64_t parent_hash, uint64_t owner_sequence_id,
+                           float recompute_cost_ms, const uint32_t *tokens,
+                           const void *data)
+{
+    struct kv_snap_record *rec;
+    uint32_t slot;
+
+    if (kv_index_lookup(&snap->index, prefix_hash, &slot)) {
+        if (snap->state[slot] == KV_SNAP_LIVE)
+            return slot;
+        record_clear(snap, slot);
+    } else {
+        slot = record_alloc(snap);
+        if (slot == KV_SNAP_NONE) {
+            snap->full++;
+            return KV_SNAP_NONE;
+        }
+        if (kv_index_insert(&snap->index, prefix_hash, slot) != 0) {
+            snap->free_slots[snap->free_count++] = slot;
+            return KV_SNAP_NONE;
+        }
+    }
+
+    rec = &snap->records[slot];
+    atomic_thread_fence(memory_order_release);
+
+    memcpy(record_tokens(snap, slot), tokens, snap->tokens_per_block * sizeof(uint32_t));
+    memcpy(record_data(snap, slot), data, snap->block_bytes);
+    rec->prefix_hash = prefix_hash;
+    rec->parent_hash = parent_hash;
+    rec->owner_sequence_id = owner_sequence_id;
+    rec->recompute_cost_ms = recompute_cost_ms;
+    rec->reserved = 0;
+    rec->checksum = snap_checksum(tokens, snap->tokens_per_block, data,
+                                  snap->block_bytes);
+
+    atomic_thread_fence(memory_order_release);
+    rec->epoch = snap->header->epoch;
+
+    snap->state[slot] = KV_SNAP_LIVE;
+    snap->written++;
+    return slot;
+}
+
+/* Forget @prefix_hash's record, if any */
+void kv_snapshot_drop(struct kv_snapshot *snap, uint64_t prefix_hash)
+{
+    uint32_t slot;
+
+    if (!kv_index_remove(&snap->index, prefix_hash, &slot))
+        return;
+
+    record_clear(snap, slot);
+    snap->free_slots[snap->free_count++] = slot;
+}
+
+/*
+ * Take the cold record continuing @parent_hash with @tokens, checking
+ * its checksum. Returns the record, now live, or KV_SNAP_NONE; a
+ * corrupt record is dropped.
+ */
+uint32_t kv_snapshot_claim(struct kv_snapshot *snap, uint64_t prefix_hash,
+                           uint64_t parent_hash, const uint32_t *tokens)
+{
+    const struct kv_snap_record *rec;
+    uint32_t slot;
+
+    if (!snap->num_cold || !kv_index_lookup(&snap->index, prefix_hash, &slot) ||
+        snap->state[slot] != KV_SNAP_COLD)
+        return KV_SNAP_NONE;
+
+    rec = &snap->records[slot];
+    if (rec->parent_hash != parent_hash ||
+        memcmp(record_tokens(snap, slot), tokens,
+               snap->tokens_per_block * sizeof(uint32_t)) != 0)
+        return KV_SNAP_NONE;       /* Hash collision */
+
+    if (rec->checksum != snap_checksum(tokens, snap->tokens_per_block,
+                                       record_data(snap, slot), snap->block_bytes)) {
+        snap->corrupt++;
+        kv_snapshot_drop(snap, prefix_hash);
+        return KV_SNAP_NONE;
+    }
+
+    snap->state[slot] = KV_SNAP_LIVE;
+    snap->num_cold--;
+    snap->claimed++;
+    return slot;
+}
+
+/* Return a claimed record to the cold set (it was not used after all) */
+void kv_snapshot_unclaim(struct kv_snapshot *snap, uint32_t slot)
+{
+    if (slot >= snap->capacity || snap->state[slot] != KV_SNAP_LIVE)
+        return;
+
+    snap->state[slot] = KV_SNAP_COLD;
+    snap->num_cold++;
+    snap->claimed--;
+    if (snap->cold_count < snap->capacity)
+        snap->cold_slots[snap->cold_count++] = slot;
+}
+
+/*
+ * Start writing the mapping back, or with @wait finish doing so. Records
+ * written from now on carry the next epoch.
+ */
+int kv_snapshot_sync(struct kv_snapshot *snap, bool wait)
+{
+    if (!kv_snapshot_enabled(snap))
+        return 0;
+
+    snap->header->epoch++;
+    return msync(snap->base, snap->map_bytes, wait ? MS_SYNC : MS_ASYNC);
+}
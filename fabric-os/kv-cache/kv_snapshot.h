@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_SNAPSHOT_H
+#define _KV_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kv_index.h"
+
+/*
+ * Prefix cache snapshot file.
+ *
+ * The published prefix blocks are mirrored into a file mapped
+ * MAP_SHARED: a header, a table of fixed-size records, then each
+ * record's token chunk and block data in their own arrays. A record is
+ * written in place when its prefix is published and cleared when it is
+ * evicted, so a snapshot costs one block copy per new prefix block and
+ * the kernel writes the pages back in the background.
+ *
+ * Reopening a compatible file reads only the record table; the records
+ * come back "cold" and are found by prefix hash. A cold record's tokens,
+ * parent and checksum are checked, and its data copied out, only when a
+ * lookup first reaches it (kv_snapshot_claim()). A record is valid once
+ * its epoch is non-zero; the epoch is cleared before the record is
+ * rewritten and set last, so a record torn by a crash is either skipped
+ * or caught by its checksum. Not thread-safe; the coordinator holds
+ * snapshot_lock.
+ */
+
+#define KV_SNAP_MAGIC 0x3150414e53564b00ULL /* "\0KVSNAP1" */
+#define KV_SNAP_VERSION 1
+#define KV_SNAP_NONE UINT32_MAX
+#define KV_SNAP_ALIGN 4096             /* Sections start page-aligned */
+
+enum kv_snap_op {
+    KV_SNAP_STORE = 1,              /* Prefix published: write its record */
+    KV_SNAP_DROP = 2,               /* Prefix evicted: clear it */
+};
+
+struct kv_snap_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t format;                /* Caller's data encoding */
+    uint32_t block_bytes;
+    uint32_t tokens_per_block;
+    uint32_t capacity;              /* Records */
+    uint32_t reserved;
+    uint64_t epoch;                 /* Bumped on every sync */
+};
+
+struct kv_snap_record {
+    uint64_t prefix_hash;           /* Rolling hash through this block */
+    uint64_t parent_hash;           /* 0 at depth one */
+    uint64_t owner_sequence_id;     /* Sequence that published it */
+    uint64_t checksum;              /* Of the tokens and data */
+    uint64_t epoch;                 /* Written in, 0 = free */
+    float recompute_cost_ms;
+    uint32_t reserved;
+};
+
+/* Record state, in memory only */
+enum kv_snap_state {
+    KV_SNAP_FREE = 0,
+    KV_SNAP_COLD = 1,               /* Restored, not yet claimed */
+    KV_SNAP_LIVE = 2,               /* Mirrors a prefix tree node */
+};
+
+/* A pending store or drop */
+struct kv_snap_item {
+    uint64_t prefix_hash;
+    uint32_t op;
+    uint32_t reserved;
+};
+
+struct kv_snapshot {
+    int fd;
+    uint8_t *base;
+    uint64_t map_bytes;
+    struct kv_snap_header *header;
+    struct kv_snap_record *records;
+    uint32_t *tokens;               /* capacity * tokens_per_block */
+    uint8_t *data;                  /* capacity * block_bytes */
+    uint32_t capacity;
+    uint32_t block_bytes;
+    uint32_t tokens_per_block;
+
+    uint8_t *state;                 /* enum kv_snap_state per record */
+    uint32_t *free_slots;
+    uint32_t free_count;
+    uint32_t *cold_slots;           /* Restored records, reused last */
+    uint32_t cold_count;            /* Stack depth, may hold claimed ones */
+    uint32_t num_cold;
+    struct kv_index index;          /* prefix_hash -> record */
+
+    /* Stores and drops not yet applied, grown by doubling */
+    struct kv_snap_item *pending;
+    uint32_t num_pending;
+    uint32_t pending_capacity;
+
+    /* Statistics */
+    uint32_t restored;              /* Valid records found on open */
+    uint64_t written;
+    uint64_t claimed;
+    uint64_t corrupt;               /* Failed their checksum */
+    uint64_t full;                  /* Stores with no record to spare */
+};
+
+/* Function prototypes */
+int kv_snapshot_open(struct kv_snapshot *snap, const char *path,
+                     uint32_t capacity, uint32_t block_bytes,
+                     uint32_t tokens_per_block, uint32_t format);
+void kv_snapshot_close(struct kv_snapshot *snap);
+int kv_snapshot_note(struct kv_snapshot *snap, enum kv_snap_op op,
+                     uint64_t prefix_hash);
+uint32_t kv_snapshot_take_pending(struct kv_snapshot *snap,
+                                  struct kv_snap_item **items,
+                                  uint32_t *capacity);
+uint32_t kv_snapshot_store(struct kv_snapshot *snap, uint64_t prefix_hash,
+                           uint64_t parent_hash, uint64_t owner_sequence_id,
+                           float recompute_cost_ms, const uint32_t *tokens,
+                           const void *data);
+void kv_snapshot_drop(struct kv_snapshot *snap, uint64_t prefix_hash);
+uint32_t kv_snapshot_claim(struct kv_snapshot *snap, uint64_t prefix_hash,
+                           uint64_t parent_hash, const uint32_t *tokens);
+void kv_snapshot_unclaim(struct kv_snapshot *snap, uint32_t slot);
+int kv_snapshot_sync(struct kv_snapshot *snap, bool wait);
+
+/* Utility functions */
+
+static inline bool kv_snapshot_enabled(const struct kv_snapshot *snap)
+{
+    return snap->base != NULL;
+}
+
+static inline const void *kv_snapshot_data(const struct kv_snapshot *snap,
+                                           uint32_t slot)
+{
+    return snap->data + (uint64_t)slot * snap->block_bytes;
+}
+
+#endif /* _KV_SNAPSHOT_H */
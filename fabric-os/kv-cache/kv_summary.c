@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdlib.h>
+#include <string.h>
+#include "kv_summary.h"
+
+/*
+ * Prefix Summary Implementation
+ *
+ * One byte-wide counter per bit. Encoding walks the counters once and
+ * packs the non-zero ones into words; a view keeps its bit array and
+ * reallocates only when a peer's filter changes size.
+ */
+
+int kv_summary_init(struct kv_summary *summary, uint32_t expected_keys)
+{
+    uint64_t want = (uint64_t)expected_keys * KV_SUMMARY_BITS_PER_KEY;
+    uint32_t bits = KV_SUMMARY_MIN_BITS;
+
+    if (!summary)
+        return -1;
+
+    while (bits < want && bits < KV_SUMMARY_MAX_BITS)
+        bits <<= 1;
+
+    memset(summary, 0, sizeof(*summary));
+    summary->counts = calloc(bits, sizeof(uint8_t));
+    if (!summary->counts)
+        return -1;
+    summary->num_bits = bits;
+    return 0;
+}
+
+void kv_summary_destroy(struct kv_summary *summary)
+{
+    if (!summary)
+        return;
+
+    free(summary->counts);
+    memset(summary, 0, sizeof(*summary));
+}
+
+void kv_summary_add(struct kv_summary *summary, uint64_t hash)
+{
+    uint32_t mask = summary->num_bits - 1;
+
+    for (uint32_t i = 0; i < KV_SUMMARY_HASHES; i++) {
+        uint8_t *count = &summary->counts[kv_summary_probe(hash, i, mask)];
+
+        if (*count == UINT8_MAX)
+            continue;
+        if ((*count)++ == 0)
+            summary->version++;
+    }
+    summary->num_keys++;
+}
+
+/* Take back one kv_summary_add() of @hash */
+void kv_summary_remove(struct kv_summary *summary, uint64_t hash)
+{
+    uint32_t mask = summary->num_bits - 1;
+
+    for (uint32_t i = 0; i < KV_SUMMARY_HASHES; i++) {
+        uint8_t *count = &summary->counts[kv_summary_probe(hash, i, mask)];
+
+        if (*count == 0 || *count == UINT8_MAX)
+            continue;
+        if (--(*count) == 0)
+            summary->version++;
+    }
+    if (summary->num_keys)
+        summary->num_keys--;
+}
+
+/* The bit view as one malloc()ed message, or NULL */
+void *kv_summary_encode(const struct kv_summary *summary, uint32_t *bytes)
+{
+    struct kv_summary_msg *msg;
+    uint64_t *bits;
+    size_t len = sizeof(*msg) + summary->num_bits / 8;
+
+    msg = calloc(1, len);
+    if (!msg)
+        return NULL;
+
+    msg->num_bits = summary->num_bits;
+    msg->num_hashes = KV_SUMMARY_HASHES;
+    msg->version = summary->version;
+
+    bits = (uint64_t *)(msg + 1);
+    for (uint32_t i = 0; i < summary->num_bits; i++) {
+        if (summary->counts[i])
+            bits[i / 64] |= 1ULL << (i % 64);
+    }
+
+    *bytes = (uint32_t)len;
+    return msg;
+}
+
+/* Replace @view with a received message. Returns -1 if it is malformed. */
+int kv_summary_view_decode(struct kv_summary_view *view, const void *payload,
+                           uint32_t bytes)
+{
+    const struct kv_summary_msg *msg = payload;
+    uint32_t num_bits;
+
+    if (!payload || bytes < sizeof(*msg))
+        return -1;
+
+    num_bits = msg->num_bits;
+    if (msg->num_hashes != KV_SUMMARY_HASHES || num_bits < KV_SUMMARY_MIN_BITS ||
+        num_bits > KV_SUMMARY_MAX_BITS || (num_bits & (num_bits - 1)) ||
+        bytes != sizeof(*msg) + num_bits / 8)
+        return -1;
+
+    if (view->num_bits != num_bits) {
+        uint64_t *bits = malloc(num_bits / 8);
+
+        if (!bits)
+            return -1;
+        free(view->bits);
+        view->bits = bits;
+        view->num_bits = num_bits;
+    }
+
+    memcpy(view->bits, msg + 1, num_bits / 8);
+    view->version = msg->version;
+    return 0;
+}
+
+void kv_summary_view_destroy(struct kv_summary_view *view)
+{
+    if (!view)
+        return;
+
+    free(view->bits);
+    memset(view, 0, sizeof(*view));
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_SUMMARY_H
+#define _KV_SUMMARY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Prefix summaries: what a node's prefix cache holds, in a few bits per
+ * block.
+ *
+ * A node counts the rolling prefix hashes of its published blocks in a
+ * counting Bloom filter, so evictions can be taken back out, and ships
+ * peers only the bit view (counter != 0). A router tests a prompt's
+ * rolling block hashes against each node's view in order; the first
+ * miss ends that node's match. False positives overstate a match by a
+ * block now and then (about 2.4% per block at the sizing below); there
+ * are no false negatives short of a saturated counter.
+ *
+ * A message is a struct kv_summary_msg followed by num_bits / 8 bytes
+ * of bits. Not thread-safe; the coordinator holds prefix_lock for its
+ * own filter and summary_lock for the views.
+ */
+
+#define KV_SUMMARY_HASHES 4            /* Probes per key */
+#define KV_SUMMARY_BITS_PER_KEY 8
+#define KV_SUMMARY_MIN_BITS 1024
+#define KV_SUMMARY_MAX_BITS (1U << 26) /* 8 MiB on the wire */
+
+/* Counting filter of this node's prefix hashes */
+struct kv_summary {
+    uint8_t *counts;                /* Saturate at UINT8_MAX and stay */
+    uint32_t num_bits;              /* Power of two */
+    uint32_t num_keys;
+    uint64_t version;               /* Bumped whenever a bit flips */
+};
+
+/* A node's summary as peers see it */
+struct kv_summary_view {
+    uint64_t *bits;
+    uint32_t num_bits;              /* 0 = none received */
+    uint64_t version;
+};
+
+struct kv_summary_msg {
+    uint32_t num_bits;
+    uint32_t num_hashes;
+    uint64_t version;
+};
+
+/* Function prototypes */
+int kv_summary_init(struct kv_summary *summary, uint32_t expected_keys);
+void kv_summary_destroy(struct kv_summary *summary);
+void kv_summary_add(struct kv_summary *summary, uint64_t hash);
+void kv_summary_remove(struct kv_summary *summary, uint64_t hash);
+void *kv_summary_encode(const struct kv_summary *summary, uint32_t *bytes);
+int kv_summary_view_decode(struct kv_summary_view *view, const void *payload,
+                           uint32_t bytes);
+void kv_summary_view_destroy(struct kv_summary_view *view);
+
+/* Utility functions */
+
+/* Double hashing off the already mixed 64-bit key */
+static inline uint32_t kv_summary_probe(uint64_t hash, uint32_t i, uint32_t mask)
+{
+    return ((uint32_t)hash + i * ((uint32_t)(hash >> 32) | 1)) & mask;
+}
+
+static inline bool kv_summary_view_test(const struct kv_summary_view *view,
+                                        uint64_t hash)
+{
+    uint32_t mask = view->num_bits - 1;
+
+    if (!view->num_bits)
+        return false;
+
+    for (uint32_t i = 0; i < KV_SUMMARY_HASHES; i++) {
+        uint32_t bit = kv_summary_probe(hash, i, mask);
+
+        if (!(view->bits[bit / 64] & (1ULL << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+#endif /* _KV_SUMMARY_H */
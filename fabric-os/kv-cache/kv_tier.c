@@ -0,0 +1,188 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "kv_tier.h"
+
+/*
+ * KV Tier Store Implementation
+ *
+ * The host tier reuses the page pool on a single arena. The file tier
+ * maps the whole spill file MAP_SHARED and hands out block-sized slots
+ * from a free stack; demotion and promotion are plain memcpy()s and the
+ * kernel writes dirty pages back in the background.
+ */
+
+static int file_tier_open(struct kv_tier_store *store, const char *path,
+                          uint64_t bytes)
+{
+    uint32_t slots = (uint32_t)(bytes / store->slot_bytes);
+
+    if (slots == 0)
+        return 0;
+
+    store->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (store->fd < 0) {
+        fprintf(stderr, "kv_tier: cannot open %s\n", path);
+        return -1;
+    }
+
+    store->file_bytes = (uint64_t)slots * store->slot_bytes;
+    if (ftruncate(store->fd, (off_t)store->file_bytes) != 0) {
+        fprintf(stderr, "kv_tier: cannot size %s\n", path);
+        return -1;
+    }
+
+    store->file_base = mmap(NULL, store->file_bytes, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, store->fd, 0);
+    if (store->file_base == MAP_FAILED) {
+        store->file_base = NULL;
+        fprintf(stderr, "kv_tier: cannot map %s\n", path);
+        return -1;
+    }
+
+    store->file_free_slots = malloc(slots * sizeof(uint32_t));
+    if (!store->file_free_slots)
+        return -1;
+
+    for (uint32_t i = 0; i < slots; i++)
+        store->file_free_slots[i] = slots - 1 - i;
+    store->file_slots = slots;
+    store->file_free_count = slots;
+
+    return 0;
+}
+
+/*
+ * Set up the tiers that have a non-zero size. @file_path may be NULL or
+ * empty to disable the file tier.
+ */
+int kv_tier_store_init(struct kv_tier_store *store, uint32_t slot_bytes,
+                       uint64_t host_bytes, const char *file_path,
+                       uint64_t file_bytes)
+{
+    uint64_t host_slots;
+
+    if (!store || slot_bytes == 0)
+        return -1;
+
+    memset(store, 0, sizeof(*store));
+    store->fd = -1;
+    store->slot_bytes = slot_bytes;
+    pthread_mutex_init(&store->file_lock, NULL);
+
+    host_slots = host_bytes / slot_bytes;
+    if (host_slots > KV_PAGE_NONE - 1)
+        host_slots = KV_PAGE_NONE - 1;
+    if (host_slots > 0) {
+        if (kv_page_pool_init(&store->host, slot_bytes, (uint32_t)host_slots, 1) != 0)
+            return -1;
+        store->host_enabled = true;
+    }
+
+    if (file_path && file_path[0] && file_bytes > 0 &&
+        file_tier_open(store, file_path, file_bytes) != 0) {
+        kv_tier_store_destroy(store);
+        return -1;
+    }
+
+    return 0;
+}
+
+void kv_tier_store_destroy(struct kv_tier_store *store)
+{
+    if (!store)
+        return;
+
+    if (store->host_enabled)
+        kv_page_pool_destroy(&store->host);
+    if (store->file_base)
+        munmap(store->file_base, store->file_bytes);
+    if (store->fd >= 0)
+        close(store->fd);
+    free(store->file_free_slots);
+    pthread_mutex_destroy(&store->file_lock);
+
+    memset(store, 0, sizeof(*store));
+    store->fd = -1;
+}
+
+/* Take a slot in @tier, KV_PAGE_NONE if it is full or disabled */
+uint32_t kv_tier_alloc(struct kv_tier_store *store, enum kv_block_tier tier)
+{
+    uint32_t slot = KV_PAGE_NONE;
+
+    switch (tier) {
+    case KV_TIER_HOST:
+        if (!store->host_enabled)
+            return KV_PAGE_NONE;
+        return kv_page_alloc(&store->host, 0);
+    case KV_TIER_FILE:
+        pthread_mutex_lock(&store->file_lock);
+        if (store->file_free_count > 0)
+            slot = store->file_free_slots[--store->file_free_count];
+        pthread_mutex_unlock(&store->file_lock);
+        return slot;
+    default:
+        return KV_PAGE_NONE;
+    }
+}
+
+void kv_tier_free(struct kv_tier_store *store, enum kv_block_tier tier,
+                  uint32_t slot)
+{
+    if (slot == KV_PAGE_NONE)
+        return;
+
+    switch (tier) {
+    case KV_TIER_HOST:
+        if (store->host_enabled)
+            kv_page_free(&store->host, slot);
+        break;
+    case KV_TIER_FILE:
+        if (slot >= store->file_slots)
+            break;
+        pthread_mutex_lock(&store->file_lock);
+        store->file_free_slots[store->file_free_count++] = slot;
+        pthread_mutex_unlock(&store->file_lock);
+        break;
+    default:
+        break;
+    }
+}
+
+void *kv_tier_addr(struct kv_tier_store *store, enum kv_block_tier tier,
+                   uint32_t slot)
+{
+    switch (tier) {
+    case KV_TIER_HOST:
+        return store->host_enabled ? kv_page_addr(&store->host, slot) : NULL;
+    case KV_TIER_FILE:
+        if (slot >= store->file_slots)
+            return NULL;
+        return store->file_base + (uint64_t)slot * store->slot_bytes;
+    default:
+        return NULL;
+    }
+}
+
+uint32_t kv_tier_free_slots(struct kv_tier_store *store,
+                            enum kv_block_tier tier)
+{
+    uint32_t count;
+
+    switch (tier) {
+    case KV_TIER_HOST:
+        return store->host_enabled ? kv_page_pool_free_pages(&store->host) : 0;
+    case KV_TIER_FILE:
+        pthread_mutex_lock(&store->file_lock);
+        count = store->file_free_count;
+        pthread_mutex_unlock(&store->file_lock);
+        return count;
+    default:
+        return 0;
+    }
+}
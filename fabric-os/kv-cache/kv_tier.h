@@ -0,0 +1,93 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_TIER_H
+#define _KV_TIER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "kv_page_pool.h"
+
+/*
+ * Lower storage tiers for KV blocks.
+ *
+ * Blocks live in the hot page pool while in use. Cold blocks are demoted
+ * to a host-memory tier (a second page pool) or a file tier (a shared
+ * file mapping, so the page cache does the I/O), and promoted back on
+ * access or ahead of it by the prefetcher. Slots in both tiers are the
+ * size of one block. Safe to call from several coordinator shards at
+ * once: the host tier is a lock-free page pool and the file tier's free
+ * stack has its own lock. Callers own the contents of the slots they hold.
+ */
+
+enum kv_block_tier {
+    KV_TIER_HOT = 0,               /* Resident in the page pool */
+    KV_TIER_HOST = 1,              /* Host-memory spill */
+    KV_TIER_FILE = 2,              /* File-backed spill */
+    KV_TIER_NONE = 3,              /* Dropped, must be recomputed */
+};
+
+/* Cost model for bringing a block back (rough per-tier constants) */
+#define KV_TIER_HOST_LATENCY_US 5.0f
+#define KV_TIER_HOST_BANDWIDTH_GBPS 10.0f
+#define KV_TIER_FILE_LATENCY_US 80.0f
+#define KV_TIER_FILE_BANDWIDTH_GBPS 1.5f
+
+struct kv_tier_store {
+    uint32_t slot_bytes;
+
+    /* Host tier */
+    struct kv_page_pool host;
+    bool host_enabled;
+
+    /* File tier */
+    int fd;
+    uint8_t *file_base;
+    uint64_t file_bytes;
+    uint32_t file_slots;
+    uint32_t *file_free_slots;
+    uint32_t file_free_count;
+    pthread_mutex_t file_lock;     /* Protects the file free stack */
+};
+
+/* Function prototypes */
+int kv_tier_store_init(struct kv_tier_store *store, uint32_t slot_bytes,
+                       uint64_t host_bytes, const char *file_path,
+                       uint64_t file_bytes);
+void kv_tier_store_destroy(struct kv_tier_store *store);
+uint32_t kv_tier_alloc(struct kv_tier_store *store, enum kv_block_tier tier);
+void kv_tier_free(struct kv_tier_store *store, enum kv_block_tier tier,
+                  uint32_t slot);
+void *kv_tier_addr(struct kv_tier_store *store, enum kv_block_tier tier,
+                   uint32_t slot);
+uint32_t kv_tier_free_slots(struct kv_tier_store *store,
+                            enum kv_block_tier tier);
+
+/* Utility functions */
+
+/* Estimated time to bring @bytes back from @tier, in ms */
+static inline float kv_tier_swap_in_cost_ms(enum kv_block_tier tier,
+                                            uint64_t bytes)
+{
+    switch (tier) {
+    case KV_TIER_HOST:
+        return (KV_TIER_HOST_LATENCY_US +
+                (float)bytes / (KV_TIER_HOST_BANDWIDTH_GBPS * 1000.0f)) / 1000.0f;
+    case KV_TIER_FILE:
+        return (KV_TIER_FILE_LATENCY_US +
+                (float)bytes / (KV_TIER_FILE_BANDWIDTH_GBPS * 1000.0f)) / 1000.0f;
+    default:
+        return 0.0f;
+    }
+}
+
+static inline bool kv_tier_enabled(const struct kv_tier_store *store,
+                                   enum kv_block_tier tier)
+{
+    if (tier == KV_TIER_HOST)
+        return store->host_enabled;
+    if (tier == KV_TIER_FILE)
+        return store->file_base != NULL;
+    return tier == KV_TIER_HOT;
+}
+
+#endif /* _KV_TIER_H */
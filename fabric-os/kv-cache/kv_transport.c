@@ -0,0 +1,1052 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/errqueue.h>
+#include "kv_transport.h"
+
+/*
+ * KV Transport Implementation
+ *
+ * One sender thread owns every outgoing connection: it sends queued
+ * transfers back to back and polls the sockets for acks and zero-copy
+ * completions (which arrive on the socket error queue). Each incoming
+ * connection gets a receive thread, so a long sequence arriving from
+ * one peer does not hold up another's.
+ */
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+static uint64_t xfer_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int xfer_read_full(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/* Step @iov past @n consumed bytes, returning the first unfinished entry */
+static struct iovec *iov_advance(struct iovec *iov, int *cnt, size_t n)
+{
+    while (*cnt > 0 && n >= iov->iov_len) {
+        n -= iov->iov_len;
+        iov++;
+        (*cnt)--;
+    }
+    if (*cnt > 0) {
+        iov->iov_base = (uint8_t *)iov->iov_base + n;
+        iov->iov_len -= n;
+    }
+
+    return iov;
+}
+
+static int xfer_readv_full(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0) {
+        ssize_t n = readv(fd, iov, cnt);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        iov = iov_advance(iov, &cnt, (size_t)n);
+    }
+
+    return 0;
+}
+
+static int xfer_send_full(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+
+    return 0;
+}
+
+/* Fail sends (and, if @recv, reads) on @fd that stall past the I/O timeout */
+static void xfer_set_timeouts(int fd, bool recv)
+{
+    struct timeval timeout = {
+        .tv_sec = KV_XFER_IO_TIMEOUT_MS / 1000,
+        .tv_usec = (KV_XFER_IO_TIMEOUT_MS % 1000) * 1000,
+    };
+
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (recv)
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+/*
+ * Connect with a bounded wait. One sender thread serves every peer, so
+ * later sends and ack reads are bounded too: a peer that stops reading,
+ * or stalls halfway through an ack, fails with EAGAIN and is dropped
+ * rather than stalling the others.
+ */
+static int xfer_connect(const char *host, uint32_t port)
+{
+    struct addrinfo hints, *res, *ai;
+    char service[16];
+    int fd = -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &res) != 0)
+        return -1;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        struct pollfd pfd;
+        int err = 0, flags;
+        socklen_t len = sizeof(err);
+
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            if (errno != EINPROGRESS ||
+                poll(&pfd, 1, KV_XFER_CONNECT_TIMEOUT_MS) != 1 ||
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+                close(fd);
+                fd = -1;
+                continue;
+            }
+        }
+
+        fcntl(fd, F_SETFL, flags);
+        break;
+    }
+    freeaddrinfo(res);
+
+    if (fd >= 0) {
+        int one = 1;
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        xfer_set_timeouts(fd, true);
+    }
+
+    return fd;
+}
+
+/* Final status for @job: unpin, publish, free (no transport lock held) */
+static void job_finish(struct kv_transport *t, struct kv_xfer_job *job, int status)
+{
+    struct kv_xfer_slot *slot;
+
+    job->status = status;
+    if (job->prepared)
+        t->ops.complete(t->ops.ctx, job);
+
+    pthread_mutex_lock(&t->lock);
+    slot = &t->slots[job->ticket % KV_XFER_QUEUE_DEPTH];
+    if (slot->ticket == job->ticket) {
+        slot->status = status;
+        slot->done = true;
+    }
+    t->outstanding--;
+    pthread_cond_broadcast(&t->done_cond);
+    pthread_mutex_unlock(&t->lock);
+
+    free(job->descs);
+    free(job->data);
+    free(job->handles);
+    free(job->msgs);
+    free(job->payload);
+    free(job);
+}
+
+/* Drop a peer connection and fail what it still owed us */
+static void peer_close(struct kv_transport *t, struct kv_xfer_peer *peer)
+{
+    struct kv_xfer_job *job = peer->inflight;
+
+    if (peer->fd >= 0)
+        close(peer->fd);
+    peer->fd = -1;
+    peer->inflight = NULL;
+    peer->inflight_tail = NULL;
+
+    while (job) {
+        struct kv_xfer_job *next = job->next;
+
+        job_finish(t, job, -1);
+        job = next;
+    }
+}
+
+static int peer_open(struct kv_xfer_peer *peer, const char *host, uint32_t port)
+{
+    int one = 1;
+
+    if (peer->fd >= 0)
+        return 0;
+
+    peer->fd = xfer_connect(host, port);
+    if (peer->fd < 0)
+        return -1;
+
+    peer->zerocopy = setsockopt(peer->fd, SOL_SOCKET, SO_ZEROCOPY,
+                                &one, sizeof(one)) == 0;
+    peer->zc_sent = 0;
+    peer->zc_done = 0;
+    return 0;
+}
+
+/* Acked transfers whose zero-copy sends have all completed are done */
+static void peer_retire(struct kv_transport *t, struct kv_xfer_peer *peer)
+{
+    while (peer->inflight && peer->inflight->acked &&
+           peer->zc_done >= peer->inflight->zc_last) {
+        struct kv_xfer_job *job = peer->inflight;
+
+        peer->inflight = job->next;
+        if (!peer->inflight)
+            peer->inflight_tail = NULL;
+        job_finish(t, job, job->status);
+    }
+}
+
+/* Collect zero-copy completion ranges from the error queue; returns
+ * how many notifications there were */
+static int peer_drain_errqueue(struct kv_xfer_peer *peer)
+{
+    char control[128];
+    int count = 0;
+
+    for (;;) {
+        struct msghdr msg;
+        struct cmsghdr *cm;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(peer->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            return count;
+        count++;
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *ee = (struct sock_extended_err *)CMSG_DATA(cm);
+            uint64_t next;
+
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) ||
+                ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY || ee->ee_errno != 0)
+                continue;
+
+            /* ee_data is the last completed send, a wrapping 32-bit count */
+            next = ((peer->zc_done & ~0xffffffffULL) | ee->ee_data) + 1;
+            if (next < peer->zc_done)
+                next += 1ULL << 32;
+            peer->zc_done = next;
+        }
+    }
+}
+
+/*
+ * Send all of @iov, zero-copy if @zerocopy. A send the kernel refuses to
+ * pin (ENOBUFS, optmem exhausted) is retried as a copy. Fails once the
+ * peer has taken longer than the I/O timeout to accept the message,
+ * rather than granting each partial send its own timeout.
+ */
+static int peer_sendmsg(struct kv_xfer_peer *peer, struct iovec *iov, int cnt,
+                        bool zerocopy)
+{
+    uint64_t deadline_ms = xfer_now_ms() + KV_XFER_IO_TIMEOUT_MS;
+
+    while (cnt > 0) {
+        struct msghdr msg;
+        ssize_t n;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t)cnt;
+
+        n = sendmsg(peer->fd, &msg, MSG_NOSIGNAL | (zerocopy ? MSG_ZEROCOPY : 0));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && zerocopy && errno == ENOBUFS) {
+            zerocopy = false;
+            continue;
+        }
+        if (n <= 0)
+            return -1;
+
+        if (zerocopy)
+            peer->zc_sent++;
+        iov = iov_advance(iov, &cnt, (size_t)n);
+        if (cnt > 0 && xfer_now_ms() >= deadline_ms)
+            return -1;
+    }
+
+    return 0;
+}
+
+/* @job was sent in full: await its ack */
+static void peer_track(struct kv_xfer_peer *peer, struct kv_xfer_job *job)
+{
+    job->zc_last = peer->zc_sent;
+    job->next = NULL;
+    if (peer->inflight_tail)
+        peer->inflight_tail->next = job;
+    else
+        peer->inflight = job;
+    peer->inflight_tail = job;
+}
+
+/* Send a control message (copied: payloads are small) */
+static void send_control(struct kv_transport *t, struct kv_xfer_job *job)
+{
+    struct kv_xfer_peer *peer = &t->peers[job->node_id];
+    struct iovec iov[2];
+
+    job->msgs = calloc(1, sizeof(struct kv_xfer_msg));
+    if (!job->msgs || peer_open(peer, job->host, job->port) != 0) {
+        job_finish(t, job, -1);
+        return;
+    }
+
+    job->msgs->magic = KV_XFER_MAGIC;
+    job->msgs->version = KV_XFER_VERSION;
+    job->msgs->type = KV_XFER_MSG_CONTROL;
+    job->msgs->flags = job->payload_kind;
+    job->msgs->ticket = job->ticket;
+    job->msgs->src_node = t->local_node;
+    job->msgs->payload_bytes = job->payload_bytes;
+    job->msgs->payload_count = job->payload_count;
+
+    iov[0].iov_base = job->msgs;
+    iov[0].iov_len = sizeof(struct kv_xfer_msg);
+    iov[1].iov_base = job->payload;
+    iov[1].iov_len = job->payload_bytes;
+
+    if (peer_sendmsg(peer, iov, job->payload_bytes ? 2 : 1, false) != 0) {
+        peer_close(t, peer);
+        job_finish(t, job, -1);
+        return;
+    }
+
+    peer_track(peer, job);
+}
+
+/* Pin, describe and stream one transfer without waiting for its ack */
+static void send_job(struct kv_transport *t, struct kv_xfer_job *job)
+{
+    struct iovec iov[KV_XFER_BATCH_BLOCKS + 2];
+    struct kv_xfer_peer *peer;
+    uint32_t chunks;
+
+    if (job->node_id >= KV_XFER_MAX_CONNS) {
+        job_finish(t, job, -1);
+        return;
+    }
+    if (job->payload) {
+        send_control(t, job);
+        return;
+    }
+    if (t->ops.prepare(t->ops.ctx, job) != 0) {
+        job_finish(t, job, -1);
+        return;
+    }
+    job->prepared = true;
+
+    peer = &t->peers[job->node_id];
+    chunks = job->num_blocks ? (job->num_blocks + KV_XFER_BATCH_BLOCKS - 1) /
+                               KV_XFER_BATCH_BLOCKS : 1;
+    job->msgs = calloc(chunks, sizeof(struct kv_xfer_msg));
+    if (!job->msgs || peer_open(peer, job->host, job->port) != 0) {
+        job_finish(t, job, -1);
+        return;
+    }
+
+    for (uint32_t c = 0; c < chunks; c++) {
+        struct kv_xfer_msg *msg = &job->msgs[c];
+        uint32_t first = c * KV_XFER_BATCH_BLOCKS;
+        uint32_t count = job->num_blocks - first;
+        size_t payload = 0;
+        int n = 0;
+
+        if (count > KV_XFER_BATCH_BLOCKS)
+            count = KV_XFER_BATCH_BLOCKS;
+
+        msg->magic = KV_XFER_MAGIC;
+        msg->version = KV_XFER_VERSION;
+        msg->type = KV_XFER_MSG_CHUNK;
+        msg->flags = (c == 0 ? KV_XFER_FIRST : 0) |
+                     (c + 1 == chunks ? KV_XFER_LAST : 0);
+        msg->sequence_id = job->sequence_id;
+        msg->ticket = job->ticket;
+        msg->src_node = t->local_node;
+        msg->first_block = first;
+        msg->num_blocks = count;
+        msg->block_bytes = job->block_bytes;
+        msg->sequence_length = job->sequence_length;
+        msg->precision = job->precision;
+
+        iov[n].iov_base = msg;
+        iov[n++].iov_len = sizeof(*msg);
+        if (count) {
+            iov[n].iov_base = &job->descs[first];
+            iov[n++].iov_len = count * sizeof(struct kv_xfer_desc);
+        }
+        for (uint32_t i = first; i < first + count; i++) {
+            if (!job->data[i])
+                continue;
+            iov[n].iov_base = job->data[i];
+            iov[n++].iov_len = job->block_bytes;
+            payload += job->block_bytes;
+        }
+
+        if (peer_sendmsg(peer, iov, n,
+                         peer->zerocopy && payload >= KV_XFER_ZEROCOPY_MIN) != 0) {
+            peer_close(t, peer);
+            job_finish(t, job, -1);
+            return;
+        }
+    }
+
+    peer_track(peer, job);
+}
+
+/* An ack is due for the oldest transfer in flight on @peer */
+static void peer_read_ack(struct kv_transport *t, struct kv_xfer_peer *peer)
+{
+    struct kv_xfer_msg ack;
+    struct kv_xfer_job *job = peer->inflight;
+
+    if (xfer_read_full(peer->fd, &ack, sizeof(ack)) != 0 ||
+        ack.magic != KV_XFER_MAGIC || ack.type != KV_XFER_MSG_ACK ||
+        !job || job->acked || ack.ticket != job->ticket) {
+        peer_close(t, peer);
+        return;
+    }
+
+    job->acked = true;
+    job->status = ack.status;
+}
+
+static void *sender_thread_fn(void *arg)
+{
+    struct kv_transport *t = arg;
+    struct pollfd pfds[1 + KV_XFER_MAX_CONNS];
+    uint32_t ids[1 + KV_XFER_MAX_CONNS];
+
+    for (;;) {
+        struct kv_xfer_job *job;
+        uint64_t value;
+        nfds_t n = 1;
+        bool running;
+
+        pfds[0].fd = t->wake_fd;
+        pfds[0].events = POLLIN;
+        for (uint32_t i = 0; i < KV_XFER_MAX_CONNS; i++) {
+            if (t->peers[i].fd < 0 || !t->peers[i].inflight)
+                continue;
+            pfds[n].fd = t->peers[i].fd;
+            pfds[n].events = POLLIN;
+            ids[n++] = i;
+        }
+
+        if (poll(pfds, n, -1) < 0 && errno != EINTR)
+            break;
+
+        if (pfds[0].revents & POLLIN) {
+            if (read(t->wake_fd, &value, sizeof(value)) < 0)
+                (void)value;
+        }
+
+        pthread_mutex_lock(&t->lock);
+        running = t->running;
+        job = t->queue_head;
+        t->queue_head = NULL;
+        t->queue_tail = NULL;
+        pthread_mutex_unlock(&t->lock);
+
+        while (job) {
+            struct kv_xfer_job *next = job->next;
+
+            if (running)
+                send_job(t, job);
+            else
+                job_finish(t, job, -1);
+            job = next;
+        }
+
+        for (nfds_t i = 1; i < n; i++) {
+            struct kv_xfer_peer *peer = &t->peers[ids[i]];
+
+            if (peer->fd != pfds[i].fd)
+                continue;
+            if ((pfds[i].revents & POLLERR) && peer_drain_errqueue(peer) == 0) {
+                /* Not a completion: the connection itself failed */
+                peer_close(t, peer);
+                continue;
+            }
+            if (pfds[i].revents & (POLLIN | POLLHUP))
+                peer_read_ack(t, peer);
+            if (peer->fd >= 0)
+                peer_retire(t, peer);
+        }
+
+        if (!running)
+            break;
+    }
+
+    for (uint32_t i = 0; i < KV_XFER_MAX_CONNS; i++)
+        peer_close(t, &t->peers[i]);
+
+    return NULL;
+}
+
+static int conn_send_ack(struct kv_transport *t, int fd,
+                         const struct kv_xfer_msg *msg, int status)
+{
+    struct kv_xfer_msg ack;
+
+    memset(&ack, 0, sizeof(ack));
+    ack.magic = KV_XFER_MAGIC;
+    ack.version = KV_XFER_VERSION;
+    ack.type = KV_XFER_MSG_ACK;
+    ack.status = status;
+    ack.sequence_id = msg->sequence_id;
+    ack.ticket = msg->ticket;
+    ack.src_node = t->local_node;
+
+    return xfer_send_full(fd, &ack, sizeof(ack));
+}
+
+/* Read and hand over one control message, returning the status to ack
+ * or -2 if the connection is unusable */
+static int conn_recv_control(struct kv_transport *t, int fd,
+                             const struct kv_xfer_msg *msg)
+{
+    void *payload;
+    int status = -1;
+
+    if (msg->payload_bytes > KV_XFER_CONTROL_MAX)
+        return -2;
+
+    payload = malloc(msg->payload_bytes ? msg->payload_bytes : 1);
+    if (!payload)
+        return -2;
+
+    if (xfer_read_full(fd, payload, msg->payload_bytes) != 0) {
+        free(payload);
+        return -2;
+    }
+
+    if (t->ops.recv_control)
+        status = t->ops.recv_control(t->ops.ctx, msg, payload);
+
+    free(payload);
+    return status;
+}
+
+/* Receive whole sequences and control messages from one peer, acking each */
+static void *conn_thread_fn(void *arg)
+{
+    struct kv_xfer_conn *conn = arg;
+    struct kv_transport *t = conn->transport;
+    struct kv_xfer_desc descs[KV_XFER_BATCH_BLOCKS];
+    struct iovec iov[KV_XFER_BATCH_BLOCKS];
+    struct kv_xfer_rx rx;
+    struct kv_xfer_msg msg;
+    void *scratch = NULL;
+    uint32_t scratch_bytes = 0;
+    bool open = false;
+
+    memset(&rx, 0, sizeof(rx));
+
+    while (xfer_read_full(conn->fd, &msg, sizeof(msg)) == 0) {
+        int n = 0, status;
+
+        if (msg.magic != KV_XFER_MAGIC || msg.version != KV_XFER_VERSION)
+            break;
+
+        /* Senders never interleave a control message with a sequence */
+        if (msg.type == KV_XFER_MSG_CONTROL && !open) {
+            status = conn_recv_control(t, conn->fd, &msg);
+            if (status == -2 || conn_send_ack(t, conn->fd, &msg, status) != 0)
+                break;
+            continue;
+        }
+
+        if (msg.type != KV_XFER_MSG_CHUNK || msg.num_blocks > KV_XFER_BATCH_BLOCKS)
+            break;
+
+        if (msg.flags & KV_XFER_FIRST) {
+            if (open) {
+                rx.status = -1;
+                t->ops.recv_end(t->ops.ctx, &rx, &msg);
+            }
+            rx.sequence_id = msg.sequence_id;
+            rx.count = 0;
+            rx.status = 0;
+            open = true;
+        }
+        if (!open || msg.sequence_id != rx.sequence_id ||
+            xfer_read_full(conn->fd, descs, msg.num_blocks * sizeof(descs[0])) != 0)
+            break;
+
+        memset(iov, 0, msg.num_blocks * sizeof(iov[0]));
+        if (rx.status == 0)
+            t->ops.recv_chunk(t->ops.ctx, &rx, &msg, descs, iov);
+
+        /* Payloads the coordinator could not place are read and dropped */
+        for (uint32_t i = 0; i < msg.num_blocks; i++) {
+            if (descs[i].flags & KV_XFER_NO_DATA)
+                continue;
+            if (!iov[i].iov_base) {
+                if (scratch_bytes < msg.block_bytes) {
+                    free(scratch);
+                    scratch = malloc(msg.block_bytes);
+                    scratch_bytes = scratch ? msg.block_bytes : 0;
+                }
+                iov[i].iov_base = scratch;
+            }
+            iov[i].iov_len = msg.block_bytes;
+            iov[n++] = iov[i];
+        }
+        if ((n > 0 && !scratch && rx.status != 0) ||
+            xfer_readv_full(conn->fd, iov, n) != 0)
+            break;
+
+        if (!(msg.flags & KV_XFER_LAST))
+            continue;
+
+        status = t->ops.recv_end(t->ops.ctx, &rx, &msg);
+        open = false;
+
+        if (conn_send_ack(t, conn->fd, &msg, status) != 0)
+            break;
+    }
+
+    if (open) {
+        rx.status = -1;
+        t->ops.recv_end(t->ops.ctx, &rx, &msg);
+    }
+
+    free(rx.handles);
+    free(scratch);
+
+    pthread_mutex_lock(&t->conn_lock);
+    close(conn->fd);
+    conn->fd = -1;
+    pthread_mutex_unlock(&t->conn_lock);
+
+    return NULL;
+}
+
+static void *accept_thread_fn(void *arg)
+{
+    struct kv_transport *t = arg;
+
+    for (;;) {
+        struct kv_xfer_conn *conn = NULL;
+        bool accepted = false;
+        int fd, one = 1;
+
+        fd = accept4(t->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        /* Idle between messages is normal; a peer not reading acks is not */
+        xfer_set_timeouts(fd, false);
+
+        /* Reuse a slot whose connection has closed */
+        pthread_mutex_lock(&t->conn_lock);
+        for (uint32_t i = 0; i < KV_XFER_MAX_CONNS && !conn; i++) {
+            struct kv_xfer_conn *c = &t->conns[i];
+
+            if (c->active && c->fd < 0) {
+                pthread_mutex_unlock(&t->conn_lock);
+                pthread_join(c->thread, NULL);
+                pthread_mutex_lock(&t->conn_lock);
+                c->active = false;
+            }
+            if (!c->active)
+                conn = c;
+        }
+        if (conn && t->running) {
+            conn->fd = fd;
+            conn->transport = t;
+            accepted = pthread_create(&conn->thread, NULL, conn_thread_fn,
+                                      conn) == 0;
+            conn->active = accepted;
+            if (!accepted)
+                conn->fd = -1;
+        }
+        pthread_mutex_unlock(&t->conn_lock);
+
+        if (!accepted)
+            close(fd);
+    }
+
+    return NULL;
+}
+
+/* Set up the transport; threads start on first listen or submit */
+int kv_transport_init(struct kv_transport *t, const struct kv_xfer_ops *ops,
+                      uint32_t local_node)
+{
+    if (!t || !ops || !ops->prepare || !ops->complete ||
+        !ops->recv_chunk || !ops->recv_end)
+        return -1;
+
+    memset(t, 0, sizeof(*t));
+    t->ops = *ops;
+    t->local_node = local_node;
+    t->listen_fd = -1;
+    for (uint32_t i = 0; i < KV_XFER_MAX_CONNS; i++) {
+        t->peers[i].fd = -1;
+        t->conns[i].fd = -1;
+    }
+
+    t->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (t->wake_fd < 0)
+        return -1;
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_mutex_init(&t->conn_lock, NULL);
+    pthread_cond_init(&t->done_cond, NULL);
+    t->running = true;
+
+    return 0;
+}
+
+/* Stop both directions; queued and unacked transfers fail */
+void kv_transport_shutdown(struct kv_transport *t)
+{
+    uint64_t one = 1;
+
+    if (!t || t->wake_fd < 0)
+        return;
+
+    pthread_mutex_lock(&t->lock);
+    t->running = false;
+    pthread_mutex_unlock(&t->lock);
+
+    if (t->sender_started) {
+        if (write(t->wake_fd, &one, sizeof(one)) < 0)
+            (void)one;
+        pthread_join(t->sender_thread, NULL);
+    }
+
+    if (t->listen_fd >= 0) {
+        shutdown(t->listen_fd, SHUT_RDWR);
+        pthread_join(t->accept_thread, NULL);
+        close(t->listen_fd);
+        t->listen_fd = -1;
+    }
+
+    pthread_mutex_lock(&t->conn_lock);
+    for (uint32_t i = 0; i < KV_XFER_MAX_CONNS; i++) {
+        if (t->conns[i].active && t->conns[i].fd >= 0)
+            shutdown(t->conns[i].fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&t->conn_lock);
+
+    for (uint32_t i = 0; i < KV_XFER_MAX_CONNS; i++) {
+        if (t->conns[i].active)
+            pthread_join(t->conns[i].thread, NULL);
+        t->conns[i].active = false;
+    }
+
+    close(t->wake_fd);
+    t->wake_fd = -1;
+    pthread_cond_destroy(&t->done_cond);
+    pthread_mutex_destroy(&t->conn_lock);
+    pthread_mutex_destroy(&t->lock);
+}
+
+/*
+ * Accept transfers on @host:@port (NULL host = any address, port 0 = an
+ * ephemeral port). Returns the bound port or -1.
+ */
+int kv_transport_listen(struct kv_transport *t, const char *host, uint32_t port)
+{
+    struct addrinfo hints, *res;
+    struct sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    char service[16];
+    int fd, one = 1;
+
+    if (!t || !t->running || t->listen_fd >= 0 || port > 65535)
+        return -1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    snprintf(service, sizeof(service), "%u", port);
+
+    if (getaddrinfo(host, service, &hints, &res) != 0)
+        return -1;
+
+    fd = socket(res->ai_family, res->ai_socktype | SOCK_CLOEXEC, res->ai_protocol);
+    if (fd >= 0 &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+         bind(fd, res->ai_addr, res->ai_addrlen) != 0 ||
+         listen(fd, KV_XFER_MAX_CONNS) != 0 ||
+         getsockname(fd, (struct sockaddr *)&addr, &len) != 0)) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0) {
+        fprintf(stderr, "kv_transport: cannot listen on %s:%u\n",
+                host ? host : "*", port);
+        return -1;
+    }
+
+    t->listen_fd = fd;
+    t->listen_port = ntohs(addr.ss_family == AF_INET6 ?
+                           ((struct sockaddr_in6 *)&addr)->sin6_port :
+                           ((struct sockaddr_in *)&addr)->sin_port);
+
+    if (pthread_create(&t->accept_thread, NULL, accept_thread_fn, t) != 0) {
+        close(fd);
+        t->listen_fd = -1;
+        return -1;
+    }
+
+    return (int)t->listen_port;
+}
+
+/* Queue @job and wake the sender; frees @job on failure */
+static int64_t job_enqueue(struct kv_transport *t, struct kv_xfer_job *job)
+{
+    struct kv_xfer_slot *slot;
+    uint64_t ticket, one = 1;
+
+    pthread_mutex_lock(&t->lock);
+
+    if (!t->running || t->outstanding >= KV_XFER_QUEUE_DEPTH) {
+        pthread_mutex_unlock(&t->lock);
+        free(job->payload);
+        free(job);
+        return -1;
+    }
+
+    if (!t->sender_started) {
+        if (pthread_create(&t->sender_thread, NULL, sender_thread_fn, t) != 0) {
+            pthread_mutex_unlock(&t->lock);
+            free(job->payload);
+            free(job);
+            return -1;
+        }
+        t->sender_started = true;
+    }
+
+    ticket = ++t->next_ticket;
+    job->ticket = ticket;
+    slot = &t->slots[ticket % KV_XFER_QUEUE_DEPTH];
+    slot->ticket = ticket;
+    slot->status = 0;
+    slot->done = false;
+
+    if (t->queue_tail)
+        t->queue_tail->next = job;
+    else
+        t->queue_head = job;
+    t->queue_tail = job;
+    t->outstanding++;
+
+    pthread_mutex_unlock(&t->lock);
+
+    if (write(t->wake_fd, &one, sizeof(one)) < 0)
+        (void)one;
+
+    /* The sender thread owns (and may already have freed) the job */
+    return (int64_t)ticket;
+}
+
+/*
+ * Queue sequence @sequence_id for @node_id at @host:@port. Returns a
+ * ticket for kv_transport_wait(), or -1 if the queue is full.
+ */
+int64_t kv_transport_submit(struct kv_transport *t, uint64_t sequence_id,
+                            uint32_t node_id, const char *host, uint32_t port)
+{
+    struct kv_xfer_job *job;
+
+    if (!t || !host)
+        return -1;
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return -1;
+
+    job->sequence_id = sequence_id;
+    job->node_id = node_id;
+    snprintf(job->host, sizeof(job->host), "%s", host);
+    job->port = port;
+
+    return job_enqueue(t, job);
+}
+
+/*
+ * Queue a control message of @kind with @count records in @bytes of
+ * @payload for @node_id. The transport takes @payload (malloc()ed) and frees it once
+ * sent, even on failure. Returns a ticket, or -1.
+ */
+int64_t kv_transport_send(struct kv_transport *t, uint32_t node_id,
+                          const char *host, uint32_t port, uint32_t kind,
+                          void *payload, uint32_t bytes, uint32_t count)
+{
+    struct kv_xfer_job *job;
+
+    if (!t || !host || !payload || bytes > KV_XFER_CONTROL_MAX) {
+        free(payload);
+        return -1;
+    }
+
+    job = calloc(1, sizeof(*job));
+    if (!job) {
+        free(payload);
+        return -1;
+    }
+
+    job->node_id = node_id;
+    snprintf(job->host, sizeof(job->host), "%s", host);
+    job->port = port;
+    job->payload = payload;
+    job->payload_kind = kind;
+    job->payload_bytes = bytes;
+    job->payload_count = count;
+
+    return job_enqueue(t, job);
+}
+
+/*
+ * Wait up to @timeout_ms for transfer @ticket. Returns its status (0 or
+ * -1), or 1 on timeout. Only the last KV_XFER_QUEUE_DEPTH statuses are
+ * kept; older tickets read as done.
+ */
+int kv_transport_wait(struct kv_transport *t, uint64_t ticket,
+                      uint32_t timeout_ms)
+{
+    struct kv_xfer_slot *slot;
+    struct timespec deadline;
+    int ret = 0;
+
+    if (!t)
+        return -1;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&t->lock);
+
+    if (ticket == 0 || ticket > t->next_ticket) {
+        pthread_mutex_unlock(&t->lock);
+        return -1;
+    }
+
+    slot = &t->slots[ticket % KV_XFER_QUEUE_DEPTH];
+    while (slot->ticket == ticket && !slot->done) {
+        if (pthread_cond_timedwait(&t->done_cond, &t->lock, &deadline) == ETIMEDOUT) {
+            ret = 1;
+            break;
+        }
+    }
+    if (ret == 0 && slot->ticket == ticket)
+        ret = slot->status;
+
+    pthread_mutex_unlock(&t->lock);
+
+    return ret;
+}
+
+/* Size @job's block arrays for prepare() */
+int kv_xfer_job_reserve(struct kv_xfer_job *job, uint32_t num_blocks)
+{
+    size_t n = num_blocks ? num_blocks : 1;
+
+    job->descs = calloc(n, sizeof(struct kv_xfer_desc));
+    job->data = calloc(n, sizeof(void *));
+    job->handles = calloc(n, sizeof(uint64_t));
+    if (!job->descs || !job->data || !job->handles)
+        return -1;
+
+    job->num_blocks = num_blocks;
+    return 0;
+}
+
+/* Remember a block received for the current sequence */
+int kv_xfer_rx_add(struct kv_xfer_rx *rx, uint64_t handle)
+{
+    if (rx->count == rx->capacity) {
+        uint32_t cap = rx->capacity ? rx->capacity * 2 : KV_XFER_BATCH_BLOCKS;
+        uint64_t *handles = realloc(rx->handles, cap * sizeof(uint64_t));
+
+        if (!handles)
+            return -1;
+        rx->handles = handles;
+        rx->capacity = cap;
+    }
+
+    rx->handles[rx->count++] = handle;
+    return 0;
+}
@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _KV_TRANSPORT_H
+#define _KV_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+/*
+ * Block transfer between KV cache coordinators over TCP.
+ *
+ * A transfer moves one sequence's blocks to a peer. The sender thread
+ * streams it as chunks of up to KV_XFER_BATCH_BLOCKS blocks, each one
+ * sendmsg() of a header, a descriptor table and the blocks' pages
+ * straight from the page pool (scatter-gather, MSG_ZEROCOPY where the
+ * socket supports it). It does not wait for a peer's ack before sending
+ * the next transfer, so sequences to the same or different peers are
+ * pipelined. The receiver reads each chunk's descriptors, asks its
+ * coordinator for destination pages and readv()s the payload directly
+ * into them.
+ *
+ * Source pages are pinned by the coordinator until the transfer is
+ * acknowledged and the kernel has reported every zero-copy send of it
+ * complete. Messages are in host byte order: peers share an ABI.
+ *
+ * Control messages carry an opaque payload (coherency or replication
+ * batches, told apart by their kind) over the same connections, in
+ * order with the transfers, and are acknowledged the same way.
+ *
+ * The coordinator supplies policy through kv_xfer_ops; callbacks run
+ * on the transport threads with no transport lock held.
+ */
+
+#define KV_XFER_MAGIC 0x4b565846U      /* "KVXF" */
+#define KV_XFER_VERSION 3
+#define KV_XFER_BATCH_BLOCKS 64        /* Blocks per sendmsg() */
+#define KV_XFER_QUEUE_DEPTH 256        /* Transfers queued or in flight */
+#define KV_XFER_MAX_CONNS 64           /* Connections per direction */
+#define KV_XFER_ZEROCOPY_MIN (64 * 1024) /* Smaller chunks are copied */
+#define KV_XFER_CONNECT_TIMEOUT_MS 1000
+#define KV_XFER_IO_TIMEOUT_MS 5000     /* Longest a peer may stall a send */
+#define KV_XFER_CONTROL_MAX (16U << 20) /* Largest control payload */
+
+enum kv_xfer_msg_type {
+    KV_XFER_MSG_CHUNK = 1,
+    KV_XFER_MSG_ACK = 2,
+    KV_XFER_MSG_CONTROL = 3,
+};
+
+/* Control message kinds, carried in the header's flags */
+enum kv_xfer_control_kind {
+    KV_XFER_CONTROL_COHERENCY = 0,
+    KV_XFER_CONTROL_REPLICATION = 1,
+    KV_XFER_CONTROL_SUMMARY = 2,
+};
+
+/* Chunk flags */
+#define KV_XFER_FIRST 0x1               /* First chunk of a sequence */
+#define KV_XFER_LAST 0x2                /* Last chunk, ack expected */
+
+/* Descriptor flags */
+#define KV_XFER_NO_DATA 0x1             /* Dropped at the source, no payload */
+#define KV_XFER_HOLE 0x2                /* Not kept at the source, no block */
+
+/* Wire header, followed by num_blocks descriptors and their payloads */
+struct kv_xfer_msg {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    uint32_t flags;
+    int32_t status;                 /* Acks: 0 or -1 */
+    uint64_t sequence_id;
+    uint64_t ticket;                /* Sender's, echoed in the ack */
+    uint32_t src_node;              /* Sender's node id */
+    uint32_t first_block;           /* Sequence index of descriptor 0 */
+    uint32_t num_blocks;
+    uint32_t block_bytes;           /* Payload per block */
+    uint32_t sequence_length;       /* Tokens */
+    uint32_t precision;             /* Encoding of the payloads */
+    uint32_t payload_bytes;         /* Control: bytes after the header */
+    uint32_t payload_count;         /* Control: records in the payload */
+};
+
+struct kv_xfer_desc {
+    uint32_t position;
+    uint32_t num_tokens;
+    uint32_t state;
+    uint32_t flags;
+    float recompute_cost_ms;
+    uint32_t reserved;
+    uint64_t block_id;              /* Sender's id for the block */
+};
+
+/*
+ * One queued sequence transfer. The transport fills in the request; the
+ * coordinator's prepare callback fills in the blocks.
+ */
+struct kv_xfer_job {
+    uint64_t ticket;
+    uint64_t sequence_id;
+    uint32_t node_id;               /* Destination */
+    char host[256];
+    uint32_t port;
+
+    /* Filled in by prepare() */
+    uint32_t num_blocks;
+    uint32_t sequence_length;
+    uint32_t block_bytes;
+    uint32_t precision;
+    struct kv_xfer_desc *descs;
+    void **data;                    /* Pinned pages, NULL for NO_DATA */
+    uint64_t *handles;              /* Coordinator's, for unpinning */
+
+    /* Control message instead of a sequence (owned, freed when done) */
+    void *payload;
+    uint32_t payload_kind;
+    uint32_t payload_bytes;
+    uint32_t payload_count;
+
+    /* Transport state */
+    struct kv_xfer_msg *msgs;       /* One header per chunk */
+    uint64_t zc_last;               /* Zero-copy sends to wait for */
+    bool prepared;                  /* Pinned: complete() will be called */
+    bool acked;
+    int status;
+    struct kv_xfer_job *next;
+};
+
+/* Receive state of the sequence arriving on one connection */
+struct kv_xfer_rx {
+    uint64_t sequence_id;
+    uint64_t *handles;              /* Coordinator's, one per block */
+    uint32_t count;
+    uint32_t capacity;
+    int status;                     /* -1 once anything failed */
+};
+
+struct kv_xfer_ops {
+    void *ctx;
+    /* Sender: pin the sequence and describe it, 0 on success */
+    int (*prepare)(void *ctx, struct kv_xfer_job *job);
+    /* Sender: job->status is final; unpin */
+    void (*complete)(void *ctx, struct kv_xfer_job *job);
+    /* Receiver: point iov[i] at a page for descs[i]; a NULL base
+     * discards that payload */
+    void (*recv_chunk)(void *ctx, struct kv_xfer_rx *rx,
+                       const struct kv_xfer_msg *msg,
+                       const struct kv_xfer_desc *descs, struct iovec *iov);
+    /* Receiver: the last chunk arrived (rx->status 0) or the connection
+     * dropped; install or release. Returns the status to ack. */
+    int (*recv_end)(void *ctx, struct kv_xfer_rx *rx,
+                    const struct kv_xfer_msg *msg);
+    /* Receiver: a control message (optional). Returns the status to ack. */
+    int (*recv_control)(void *ctx, const struct kv_xfer_msg *msg,
+                        const void *payload);
+};
+
+/* Per-peer outgoing connection */
+struct kv_xfer_peer {
+    int fd;
+    bool zerocopy;                  /* SO_ZEROCOPY accepted */
+    uint64_t zc_sent;               /* Zero-copy sendmsg() calls */
+    uint64_t zc_done;               /* Completions reported */
+    struct kv_xfer_job *inflight;   /* Sent, awaiting ack, oldest first */
+    struct kv_xfer_job *inflight_tail;
+};
+
+/* Incoming connection */
+struct kv_xfer_conn {
+    int fd;
+    pthread_t thread;
+    bool active;
+    struct kv_transport *transport;
+};
+
+struct kv_xfer_slot {
+    uint64_t ticket;
+    int status;
+    bool done;
+};
+
+struct kv_transport {
+    struct kv_xfer_ops ops;
+    uint32_t local_node;
+
+    /* Submission queue and ticket status */
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    struct kv_xfer_job *queue_head;
+    struct kv_xfer_job *queue_tail;
+    uint32_t outstanding;           /* Queued + in flight */
+    uint64_t next_ticket;
+    struct kv_xfer_slot slots[KV_XFER_QUEUE_DEPTH];
+
+    /* Sender */
+    int wake_fd;                    /* eventfd */
+    bool sender_started;
+    pthread_t sender_thread;
+    struct kv_xfer_peer peers[KV_XFER_MAX_CONNS]; /* By node id */
+
+    /* Receiver */
+    int listen_fd;
+    uint32_t listen_port;
+    pthread_t accept_thread;
+    struct kv_xfer_conn conns[KV_XFER_MAX_CONNS];
+    pthread_mutex_t conn_lock;
+
+    _Atomic bool running;
+};
+
+/* Function prototypes */
+int kv_transport_init(struct kv_transport *t, const struct kv_xfer_ops *ops,
+                      uint32_t local_node);
+void kv_transport_shutdown(struct kv_transport *t);
+int kv_transport_listen(struct kv_transport *t, const char *host, uint32_t port);
+int64_t kv_transport_submit(struct kv_transport *t, uint64_t sequence_id,
+                            uint32_t node_id, const char *host, uint32_t port);
+int64_t kv_transport_send(struct kv_transport *t, uint32_t node_id,
+                          const char *host, uint32_t port, uint32_t kind,
+                          void *payload, uint32_t bytes, uint32_t count);
+int kv_transport_wait(struct kv_transport *t, uint64_t ticket,
+                      uint32_t timeout_ms);
+
+int kv_xfer_job_reserve(struct kv_xfer_job *job, uint32_t num_blocks);
+int kv_xfer_rx_add(struct kv_xfer_rx *rx, uint64_t handle);
+
+#endif /* _KV_TRANSPORT_H */
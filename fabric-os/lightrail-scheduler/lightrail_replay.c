@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "lightrail_scheduler.h"
+#include "lightrail_trace.h"
+
+/*
+ * lightrail-replay: re-run a binary decision log through any
+ * algorithm/config and diff the decisions and modeled outcomes.
+ *
+ * Devices are seeded from the header's device table, which holds their
+ * state as of the oldest record in the ring, and the ring's device
+ * records are applied in log order on top. Every logged decision is re-made synchronously
+ * on the replay scheduler, and completions release the device the
+ * replay chose. Both the logged and the replayed choice are costed
+ * against the replay's device state so the comparison is like-for-like.
+ */
+
+#define REPLAY_TASK_SLOTS (1U << 16)
+
+struct replay_task {
+    bool valid;
+    struct task_descriptor task;    /* As assigned by the replay */
+};
+
+struct replay_stats {
+    uint64_t records;
+    uint64_t unreadable;
+    uint64_t submissions;
+    uint64_t shed;
+    uint64_t decisions;
+    uint64_t matched;
+    uint64_t differed;
+    uint64_t logged_failures;
+    uint64_t replay_failures;
+    uint64_t completions;
+
+    /* Modeled outcomes (estimated duration on the chosen device) */
+    uint64_t logged_duration_us;
+    uint64_t replay_duration_us;
+    uint64_t logged_deadline_misses;
+    uint64_t replay_deadline_misses;
+
+    /* Estimator accuracy from logged completions */
+    double abs_error_us_sum;
+    uint64_t logged_per_device[LIGHTRAIL_MAX_DEVICES];
+    uint64_t replay_per_device[LIGHTRAIL_MAX_DEVICES];
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <trace-file>\n"
+            "  -a <n>        scheduling algorithm (enum scheduling_algorithm)\n"
+            "  -o <n>        optimization objective (enum optimization_objective)\n"
+            "  -w <l,p,c>    objective weights latency,power,cost\n"
+            "  -c <value>    cache hit value\n"
+            "  -v            print every differing decision\n",
+            prog);
+}
+
+static uint32_t modeled_duration(struct lightrail_scheduler *sched,
+                                 struct task_descriptor *task,
+                                 uint32_t device_id)
+{
+    uint32_t estimate;
+
+    if (device_id >= sched->num_devices)
+        return 0;
+
+    pthread_mutex_lock(&sched->device_lock);
+    estimate = lightrail_estimate_calibrated_duration(sched, task, device_id);
+    pthread_mutex_unlock(&sched->device_lock);
+
+    return estimate;
+}
+
+static void replay_decision(struct lightrail_scheduler *sched,
+                            struct replay_task *tasks,
+                            const struct lightrail_trace_decision *logged,
+                            struct replay_stats *stats,
+                            bool verbose)
+{
+    struct lightrail_trace_decision replayed;
+    struct task_descriptor task;
+    uint32_t logged_us = 0, replay_us = 0;
+    int ret;
+
+    stats->decisions++;
+
+    memcpy(&task, &logged->task, sizeof(task));
+    ret = lightrail_schedule_decide(sched, &task, &replayed);
+
+    if (logged->result != 0)
+        stats->logged_failures++;
+    if (ret != 0)
+        stats->replay_failures++;
+
+    if (logged->result == 0 && logged->assigned_device_id < LIGHTRAIL_MAX_DEVICES) {
+        stats->logged_per_device[logged->assigned_device_id]++;
+        logged_us = modeled_duration(sched, &task, logged->assigned_device_id);
+        stats->logged_duration_us += logged_us;
+        if (task.deadline_ms && logged_us > (uint64_t)task.deadline_ms * 1000)
+            stats->logged_deadline_misses++;
+    }
+
+    if (ret == 0) {
+        stats->replay_per_device[task.assigned_device_id]++;
+        replay_us = task.estimated_duration_us;
+        stats->replay_duration_us += replay_us;
+        if (task.deadline_ms && replay_us > (uint64_t)task.deadline_ms * 1000)
+            stats->replay_deadline_misses++;
+    }
+
+    if (logged->result == ret &&
+        (ret != 0 || logged->assigned_device_id == task.assigned_device_id)) {
+        stats->matched++;
+    } else {
+        stats->differed++;
+        if (verbose) {
+            printf("task %u: logged device %d (%uus) -> replay device %d (%uus)",
+                   task.task_id,
+                   logged->result == 0 ? (int)logged->assigned_device_id : -1,
+                   logged_us,
+                   ret == 0 ? (int)task.assigned_device_id : -1,
+                   replay_us);
+            if (replayed.num_alternatives > 0)
+                printf(" [best score %.2f]", replayed.alternatives[0].score);
+            printf("\n");
+        }
+    }
+
+    if (ret == 0) {
+        lightrail_commit_assignment(sched, &task);
+        tasks[task.task_id % REPLAY_TASK_SLOTS].valid = true;
+        memcpy(&tasks[task.task_id % REPLAY_TASK_SLOTS].task, &task,
+               sizeof(task));
+    }
+}
+
+static void replay_completion(struct lightrail_scheduler *sched,
+                              struct replay_task *tasks,
+                              const struct lightrail_trace_record *rec,
+                              struct replay_stats *stats)
+{
+    const struct lightrail_trace_completion *done = &rec->data.completion;
+    struct replay_task *slot = &tasks[done->task_id % REPLAY_TASK_SLOTS];
+    double err;
+
+    stats->completions++;
+
+    err = (double)done->actual_duration_us -
+          (double)done->estimated_duration_us;
+    stats->abs_error_us_sum += err < 0 ? -err : err;
+
+    if (!slot->valid || slot->task.task_id != done->task_id)
+        return;
+
+    /* Deadlines were set on the recording's clock, as was the record */
+    lightrail_complete_task_at(sched, &slot->task, done->actual_duration_us,
+                               rec->timestamp_ns);
+    slot->valid = false;
+}
+
+static void print_report(struct lightrail_scheduler *sched,
+                         const struct replay_stats *stats)
+{
+    printf("\nReplay summary:\n");
+    printf("  Records:        %llu (%llu unreadable)\n",
+           (unsigned long long)stats->records,
+           (unsigned long long)stats->unreadable);
+    printf("  Submissions:    %llu (%llu shed at dispatch)\n",
+           (unsigned long long)stats->submissions,
+           (unsigned long long)stats->shed);
+    printf("  Decisions:      %llu (matched %llu, differed %llu)\n",
+           (unsigned long long)stats->decisions,
+           (unsigned long long)stats->matched,
+           (unsigned long long)stats->differed);
+    printf("  Unschedulable:  logged %llu, replay %llu\n",
+           (unsigned long long)stats->logged_failures,
+           (unsigned long long)stats->replay_failures);
+    printf("  Modeled time:   logged %.3fms, replay %.3fms\n",
+           (double)stats->logged_duration_us / 1000.0,
+           (double)stats->replay_duration_us / 1000.0);
+    printf("  Deadline miss:  logged %llu, replay %llu\n",
+           (unsigned long long)stats->logged_deadline_misses,
+           (unsigned long long)stats->replay_deadline_misses);
+    if (stats->completions > 0)
+        printf("  Completions:    %llu (mean |actual - estimate| %.3fms)\n",
+               (unsigned long long)stats->completions,
+               stats->abs_error_us_sum / 1000.0 / (double)stats->completions);
+
+    printf("\n  %-8s %-24s %10s %10s\n", "Device", "Name", "Logged", "Replay");
+    for (uint32_t i = 0; i < sched->num_devices; i++) {
+        if (!stats->logged_per_device[i] && !stats->replay_per_device[i])
+            continue;
+        printf("  %-8u %-24.24s %10llu %10llu\n", i, sched->devices[i].name,
+               (unsigned long long)stats->logged_per_device[i],
+               (unsigned long long)stats->replay_per_device[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct lightrail_scheduler sched;
+    struct scheduler_config config;
+    struct lightrail_trace trace;
+    struct lightrail_trace_record rec;
+    struct replay_stats *stats;
+    struct replay_task *tasks;
+    int algorithm = -1, objective = -1;
+    float weights[3], cache_hit_value = 0.0f;
+    bool set_weights = false, set_cache_value = false;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:o:w:c:vh")) != -1) {
+        switch (opt) {
+        case 'a':
+            algorithm = atoi(optarg);
+            break;
+        case 'o':
+            objective = atoi(optarg);
+            break;
+        case 'w':
+            if (sscanf(optarg, "%f,%f,%f", &weights[0], &weights[1],
+                       &weights[2]) != 3) {
+                fprintf(stderr, "Bad weights: %s\n", optarg);
+                return 1;
+            }
+            set_weights = true;
+            break;
+        case 'c':
+            cache_hit_value = strtof(optarg, NULL);
+            set_cache_value = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (lightrail_trace_open(&trace, argv[optind]) != 0)
+        return 1;
+
+    /* Start from the recorded config, then apply overrides */
+    memcpy(&config, &trace.header->config, sizeof(config));
+    if (algorithm >= 0)
+        config.algorithm = (enum scheduling_algorithm)algorithm;
+    if (objective >= 0)
+        config.objective = (enum optimization_objective)objective;
+    if (set_weights) {
+        config.weight_latency = weights[0];
+        config.weight_power = weights[1];
+        config.weight_cost = weights[2];
+    }
+    if (set_cache_value)
+        config.cache_hit_value = cache_hit_value;
+
+    /* Statistics start from zero regardless of the recorded snapshot */
+    config.total_tasks_scheduled = 0;
+    config.total_tasks_completed = 0;
+    config.total_scheduling_decisions = 0;
+    config.cache_aware_decisions = 0;
+
+    stats = calloc(1, sizeof(*stats));
+    tasks = calloc(REPLAY_TASK_SLOTS, sizeof(*tasks));
+    if (!stats || !tasks || lightrail_scheduler_init(&sched, &config) != 0) {
+        fprintf(stderr, "Failed to set up replay\n");
+        free(stats);
+        free(tasks);
+        lightrail_trace_close(&trace);
+        return 1;
+    }
+
+    /* Devices as of the first surviving record */
+    for (uint32_t i = 0; i < trace.header->num_devices &&
+                         i < LIGHTRAIL_MAX_DEVICES; i++) {
+        struct device_info device;
+
+        memcpy(&device, &trace.header->devices[i], sizeof(device));
+        lightrail_register_device(&sched, &device);
+    }
+
+    for (uint64_t n = lightrail_trace_first(&trace);
+         n < lightrail_trace_end(&trace); n++) {
+        stats->records++;
+
+        if (lightrail_trace_read(&trace, n, &rec) != 0) {
+            stats->unreadable++;
+            continue;
+        }
+
+        switch (rec.event) {
+        case TRACE_EVENT_DEVICE_REGISTER:
+            /* Unless the header table already had it */
+            if (rec.data.device.device_id >= sched.num_devices)
+                lightrail_register_device(&sched, &rec.data.device);
+            break;
+        case TRACE_EVENT_DEVICE_UPDATE:
+            lightrail_update_device_state(&sched, rec.data.device.device_id,
+                                          &rec.data.device);
+            break;
+        case TRACE_EVENT_SUBMIT:
+            stats->submissions++;
+            break;
+        case TRACE_EVENT_SHED:
+            stats->shed++;
+            break;
+        case TRACE_EVENT_DECISION:
+            replay_decision(&sched, tasks, &rec.data.decision, stats, verbose);
+            break;
+        case TRACE_EVENT_COMPLETE:
+            replay_completion(&sched, tasks, &rec, stats);
+            break;
+        default:
+            stats->unreadable++;
+            break;
+        }
+    }
+
+    print_report(&sched, stats);
+
+    lightrail_scheduler_cleanup(&sched);
+    lightrail_trace_close(&trace);
+    free(tasks);
+    free(stats);
+
+    return 0;
+}
@@ -9,6 +9,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include "lightrail_scheduler.h"
+#include "lightrail_trace.h"
 
 /*
  * LightRail AI Mathematical Scheduler Implementation
@@ -22,11 +23,31 @@ struct pq_node {
     float cost;
 };
 
+/*
+ * Default roofline profiles, [device type][precision], used until a
+ * calibration run replaces them. Compute efficiency is relative to the
+ * device's FP16 peak, so reduced precisions can exceed 1.0.
+ */
+static const struct device_perf_profile
+default_profiles[LIGHTRAIL_NUM_DEVICE_TYPES][LIGHTRAIL_NUM_PRECISIONS] = {
+    /*                 FP16                FP32                FP8                 INT8 */
+    [DEVICE_TYPE_CPU] = {
+        { 0.60f, 0.70f, 5 },  { 0.60f, 0.70f, 5 },  { 0.60f, 0.70f, 5 },  { 1.20f, 0.70f, 5 } },
+    [DEVICE_TYPE_GPU] = {
+        { 0.75f, 0.85f, 10 }, { 0.40f, 0.85f, 10 }, { 1.50f, 0.85f, 10 }, { 1.50f, 0.85f, 10 } },
+    [DEVICE_TYPE_TPU] = {
+        { 0.80f, 0.85f, 20 }, { 0.25f, 0.85f, 20 }, { 0.80f, 0.85f, 20 }, { 1.60f, 0.85f, 20 } },
+    [DEVICE_TYPE_NPU] = {
+        { 0.60f, 0.70f, 15 }, { 0.20f, 0.70f, 15 }, { 1.20f, 0.70f, 15 }, { 1.80f, 0.70f, 15 } },
+    [DEVICE_TYPE_PHOTONIC] = {
+        { 0.90f, 0.60f, 2 },  { 0.10f, 0.60f, 2 },  { 1.00f, 0.60f, 2 },  { 1.00f, 0.60f, 2 } },
+};
+
 /* Initialize scheduler */
 int lightrail_scheduler_init(struct lightrail_scheduler *sched,
                             struct scheduler_config *config)
 {
-    int ret;
+    pthread_mutexattr_t attr;
 
     if (!sched || !config)
         return -1;
@@ -36,7 +57,12 @@ int lightrail_scheduler_init(struct lightrail_scheduler *sched,
 
     /* Initialize device pool */
     sched->num_devices = 0;
-    pthread_mutex_init(&sched->device_lock, NULL);
+
+    /* Recursive: cache-affinity scoring runs Dijkstra under the lock */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sched->device_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
 
     /* Allocate task queue */
     sched->task_queue_size = LIGHTRAIL_MAX_TASKS;
@@ -47,8 +73,7 @@ int lightrail_scheduler_init(struct lightrail_scheduler *sched,
         return -1;
     }
 
-    sched->task_queue_head = 0;
-    sched->task_queue_tail = 0;
+    sched->task_queue_count = 0;
     pthread_mutex_init(&sched->task_lock, NULL);
     pthread_cond_init(&sched->task_available, NULL);
 
@@ -76,6 +101,11 @@ int lightrail_scheduler_init(struct lightrail_scheduler *sched,
 
     pthread_mutex_init(&sched->route_lock, NULL);
 
+    memcpy(sched->profiles, default_profiles, sizeof(sched->profiles));
+
+    for (uint32_t i = 0; i < LIGHTRAIL_MAX_DEVICES; i++)
+        sched->duration_calibration[i] = 1.0f;
+
     sched->running = false;
 
     printf("LightRail Scheduler initialized: algorithm=%d, objective=%d\n",
@@ -130,6 +160,9 @@ int lightrail_register_device(struct lightrail_scheduler *sched,
     sched->devices[device_id].device_id = device_id;
     sched->num_devices++;
 
+    lightrail_trace_emit_device(sched->trace, TRACE_EVENT_DEVICE_REGISTER,
+                                &sched->devices[device_id]);
+
     pthread_mutex_unlock(&sched->device_lock);
 
     printf("Registered device %d: %s (%d)\n", device_id, device->name,
@@ -138,11 +171,413 @@ int lightrail_register_device(struct lightrail_scheduler *sched,
     return device_id;
 }
 
-/* Submit a task for scheduling */
+/* Update a device's live state (utilization, memory, power, links) */
+int lightrail_update_device_state(struct lightrail_scheduler *sched,
+                                 uint32_t device_id,
+                                 struct device_info *state)
+{
+    if (!sched || !state)
+        return -1;
+
+    pthread_mutex_lock(&sched->device_lock);
+
+    if (device_id >= sched->num_devices) {
+        pthread_mutex_unlock(&sched->device_lock);
+        return -1;
+    }
+
+    memcpy(&sched->devices[device_id], state, sizeof(*state));
+    sched->devices[device_id].device_id = device_id;
+
+    lightrail_trace_emit_device(sched->trace, TRACE_EVENT_DEVICE_UPDATE,
+                                &sched->devices[device_id]);
+
+    pthread_mutex_unlock(&sched->device_lock);
+
+    return 0;
+}
+
+/* Restore heap order upwards from @pos */
+static void task_heap_sift_up(struct task_descriptor *heap, uint32_t pos)
+{
+    struct task_descriptor tmp;
+
+    while (pos > 0) {
+        uint32_t parent = (pos - 1) / 2;
+
+        if (!lightrail_task_before(&heap[pos], &heap[parent]))
+            break;
+
+        memcpy(&tmp, &heap[parent], sizeof(tmp));
+        memcpy(&heap[parent], &heap[pos], sizeof(tmp));
+        memcpy(&heap[pos], &tmp, sizeof(tmp));
+        pos = parent;
+    }
+}
+
+/* Restore heap order downwards from @pos */
+static void task_heap_sift_down(struct task_descriptor *heap, uint32_t count,
+                                uint32_t pos)
+{
+    struct task_descriptor tmp;
+
+    for (;;) {
+        uint32_t left = 2 * pos + 1;
+        uint32_t right = left + 1;
+        uint32_t first = pos;
+
+        if (left < count && lightrail_task_before(&heap[left], &heap[first]))
+            first = left;
+        if (right < count && lightrail_task_before(&heap[right], &heap[first]))
+            first = right;
+        if (first == pos)
+            break;
+
+        memcpy(&tmp, &heap[first], sizeof(tmp));
+        memcpy(&heap[first], &heap[pos], sizeof(tmp));
+        memcpy(&heap[pos], &tmp, sizeof(tmp));
+        pos = first;
+    }
+}
+
+/* Roofline profile for a device type and precision */
+const struct device_perf_profile *lightrail_get_profile(struct lightrail_scheduler *sched,
+                                                        enum device_type type,
+                                                        enum task_precision precision)
+{
+    if (!sched || (uint32_t)type >= LIGHTRAIL_NUM_DEVICE_TYPES ||
+        (uint32_t)precision >= LIGHTRAIL_NUM_PRECISIONS)
+        return NULL;
+
+    return &sched->profiles[type][precision];
+}
+
+/* Install a measured or hand-tuned profile */
+int lightrail_set_profile(struct lightrail_scheduler *sched,
+                         enum device_type type,
+                         enum task_precision precision,
+                         const struct device_perf_profile *profile)
+{
+    if (!sched || !profile || (uint32_t)type >= LIGHTRAIL_NUM_DEVICE_TYPES ||
+        (uint32_t)precision >= LIGHTRAIL_NUM_PRECISIONS ||
+        profile->compute_efficiency <= 0.0f ||
+        profile->bandwidth_efficiency <= 0.0f)
+        return -1;
+
+    pthread_mutex_lock(&sched->device_lock);
+    memcpy(&sched->profiles[type][precision], profile, sizeof(*profile));
+    pthread_mutex_unlock(&sched->device_lock);
+
+    return 0;
+}
+
+/* Least-squares fit y = slope * x + intercept */
+static bool fit_line(const double *x, const double *y, uint32_t n,
+                     double *slope, double *intercept)
+{
+    double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, denom;
+
+    if (n < 2)
+        return false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+
+    denom = (double)n * sxx - sx * sx;
+    if (fabs(denom) < 1e-12)
+        return false;
+
+    *slope = ((double)n * sxy - sx * sy) / denom;
+    *intercept = (sy - *slope * sx) / (double)n;
+
+    return *slope > 0.0;
+}
+
+static float clamp_efficiency(double eff)
+{
+    if (eff < 0.01)
+        return 0.01f;
+    if (eff > 4.0)
+        return 4.0f;
+    return (float)eff;
+}
+
+/*
+ * Fit a roofline profile from a calibration run.
+ *
+ * Each sample is classified as compute- or memory-bound by where its
+ * intensity falls relative to its device's peak ridge point. Within each
+ * class measured time is regressed on time-at-peak: the slope gives
+ * 1/efficiency and the intercept the fixed overhead.
+ */
+int lightrail_calibrate_profile(struct lightrail_scheduler *sched,
+                               enum device_type type,
+                               enum task_precision precision,
+                               const struct perf_calibration_sample *samples,
+                               uint32_t num_samples)
+{
+    struct device_perf_profile profile;
+    double *cx, *cy, *mx, *my;
+    uint32_t nc = 0, nm = 0;
+    double slope, intercept, overhead = 0.0;
+    double compute_eff = 0.0, bandwidth_eff = 0.0;
+    uint32_t fits = 0;
+    int ret = -1;
+
+    if (!sched || !samples || num_samples == 0 ||
+        (uint32_t)type >= LIGHTRAIL_NUM_DEVICE_TYPES ||
+        (uint32_t)precision >= LIGHTRAIL_NUM_PRECISIONS)
+        return -1;
+
+    cx = calloc(num_samples, sizeof(double));
+    cy = calloc(num_samples, sizeof(double));
+    mx = calloc(num_samples, sizeof(double));
+    my = calloc(num_samples, sizeof(double));
+    if (!cx || !cy || !mx || !my)
+        goto out;
+
+    pthread_mutex_lock(&sched->device_lock);
+
+    memcpy(&profile, &sched->profiles[type][precision], sizeof(profile));
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        const struct perf_calibration_sample *smp = &samples[i];
+        struct device_info *dev;
+        double compute_us, memory_us;
+
+        if (smp->device_id >= sched->num_devices || smp->measured_us == 0)
+            continue;
+
+        dev = &sched->devices[smp->device_id];
+        if (dev->type != type || dev->peak_performance_tflops <= 0.0f)
+            continue;
+
+        compute_us = (double)smp->compute_ops /
+                     ((double)dev->peak_performance_tflops * 1e6);
+        memory_us = dev->memory_bandwidth_gbps ?
+                    (double)smp->bytes_moved /
+                    ((double)dev->memory_bandwidth_gbps * 1e3) : 0.0;
+
+        if (compute_us >= memory_us) {
+            cx[nc] = compute_us;
+            cy[nc++] = smp->measured_us;
+        } else {
+            mx[nm] = memory_us;
+            my[nm++] = smp->measured_us;
+        }
+    }
+
+    pthread_mutex_unlock(&sched->device_lock);
+
+    if (nc + nm == 0) {
+        fprintf(stderr, "No usable calibration samples for type %d\n", type);
+        goto out;
+    }
+
+    if (fit_line(cx, cy, nc, &slope, &intercept)) {
+        compute_eff = 1.0 / slope;
+        overhead += intercept;
+        fits++;
+    }
+    if (fit_line(mx, my, nm, &slope, &intercept)) {
+        bandwidth_eff = 1.0 / slope;
+        overhead += intercept;
+        fits++;
+    }
+
+    overhead = fits ? overhead / fits : (double)profile.fixed_overhead_us;
+    if (overhead < 0.0)
+        overhead = 0.0;
+
+    /* Classes too small to regress: ratio of ideal to net measured time */
+    if (compute_eff == 0.0 && nc > 0) {
+        double ideal = 0.0, net = 0.0;
+        for (uint32_t i = 0; i < nc; i++) {
+            ideal += cx[i];
+            net += fmax(cy[i] - overhead, 1.0);
+        }
+        compute_eff = ideal / net;
+    }
+    if (bandwidth_eff == 0.0 && nm > 0) {
+        double ideal = 0.0, net = 0.0;
+        for (uint32_t i = 0; i < nm; i++) {
+            ideal += mx[i];
+            net += fmax(my[i] - overhead, 1.0);
+        }
+        bandwidth_eff = ideal / net;
+    }
+
+    if (compute_eff > 0.0)
+        profile.compute_efficiency = clamp_efficiency(compute_eff);
+    if (bandwidth_eff > 0.0)
+        profile.bandwidth_efficiency = clamp_efficiency(bandwidth_eff);
+    profile.fixed_overhead_us = (uint32_t)lround(overhead);
+    profile.calibrated = true;
+
+    ret = lightrail_set_profile(sched, type, precision, &profile);
+
+    printf("Calibrated profile type=%d precision=%d: compute=%.2f "
+           "bandwidth=%.2f overhead=%uus (%u samples)\n",
+           type, precision, profile.compute_efficiency,
+           profile.bandwidth_efficiency, profile.fixed_overhead_us, nc + nm);
+
+out:
+    free(cx);
+    free(cy);
+    free(mx);
+    free(my);
+    return ret;
+}
+
+/*
+ * Roofline estimate (us) scaled by what completions on this device
+ * observed. Called with device_lock held.
+ */
+uint32_t lightrail_estimate_calibrated_duration(struct lightrail_scheduler *sched,
+                                                struct task_descriptor *task,
+                                                uint32_t device_id)
+{
+    struct device_info *dev;
+    uint32_t estimate;
+    float scaled;
+
+    if (!sched || !task || device_id >= sched->num_devices)
+        return UINT32_MAX;
+
+    dev = &sched->devices[device_id];
+    estimate = lightrail_estimate_task_duration(task, dev,
+        lightrail_get_profile(sched, dev->type, lightrail_task_precision(task)));
+    if (estimate == UINT32_MAX)
+        return estimate;
+
+    scaled = ceilf((float)estimate * sched->duration_calibration[device_id]);
+    return scaled < (float)(UINT32_MAX - 1) ? (uint32_t)scaled : UINT32_MAX - 1;
+}
+
+/*
+ * Fastest calibrated duration (us) over all devices able to run @task.
+ * @finish_us receives the soonest that any of them could finish it
+ * behind the work already assigned to it (UINT64_MAX if none can).
+ */
+static uint32_t best_case_duration(struct lightrail_scheduler *sched,
+                                   struct task_descriptor *task,
+                                   uint64_t *finish_us)
+{
+    uint32_t best = UINT32_MAX;
+
+    *finish_us = UINT64_MAX;
+
+    pthread_mutex_lock(&sched->device_lock);
+    for (uint32_t i = 0; i < sched->num_devices; i++) {
+        uint32_t estimate;
+
+        if (!lightrail_device_can_run_task(&sched->devices[i], task))
+            continue;
+
+        estimate = lightrail_estimate_calibrated_duration(sched, task, i);
+        if (estimate == UINT32_MAX)
+            continue;
+
+        if (estimate < best)
+            best = estimate;
+        if (sched->device_backlog_us[i] + estimate < *finish_us)
+            *finish_us = sched->device_backlog_us[i] + estimate;
+    }
+    pthread_mutex_unlock(&sched->device_lock);
+
+    return best;
+}
+
+/* Admission accounting class of a task */
+static inline uint32_t queued_class(const struct task_descriptor *task)
+{
+    return task->priority < LIGHTRAIL_PRIORITY_CLASSES ?
+           task->priority : LIGHTRAIL_PRIORITY_CLASSES - 1;
+}
+
+/*
+ * Can @task still finish by its deadline? It first waits for the queued
+ * work the heap dispatches ahead of it, spread across the fleet: all of
+ * the higher classes, plus the deadline work in its own class from now
+ * to its deadline slot. Work already late is shed, not run, and a
+ * deadline beyond the slot window counts the whole class. Then it waits
+ * for its best device's backlog. All of these are running sums, so this
+ * is O(slots) whatever the queue length. Called with task_lock held.
+ */
+static bool deadline_feasible(struct lightrail_scheduler *sched,
+                              struct task_descriptor *task,
+                              uint64_t finish_us,
+                              uint64_t now_ns)
+{
+    uint32_t class = queued_class(task);
+    uint64_t first = now_ns >> LIGHTRAIL_DEADLINE_SLOT_SHIFT;
+    uint64_t last = task->absolute_deadline_ns >> LIGHTRAIL_DEADLINE_SLOT_SHIFT;
+    uint64_t slots = last >= first ? last - first + 1 : 0;
+    uint64_t ahead_us = 0;
+    uint64_t finish_ns;
+
+    if (finish_us == UINT64_MAX)
+        return false;
+
+    for (uint32_t c = class + 1; c < LIGHTRAIL_PRIORITY_CLASSES; c++)
+        ahead_us += sched->queued_class_work_us[c];
+
+    if (slots > LIGHTRAIL_DEADLINE_SLOTS)
+        slots = LIGHTRAIL_DEADLINE_SLOTS;
+    for (uint64_t i = 0; i < slots; i++)
+        ahead_us += sched->queued_deadline_work_us[class]
+                        [(last - i) % LIGHTRAIL_DEADLINE_SLOTS];
+
+    if (sched->num_devices > 1)
+        ahead_us /= sched->num_devices;
+
+    finish_ns = now_ns + (ahead_us + finish_us) * 1000ULL;
+    return finish_ns <= task->absolute_deadline_ns;
+}
+
+/* Add or remove a queued task's estimate from the queued work (task_lock) */
+static void queued_work_account(struct lightrail_scheduler *sched,
+                                const struct task_descriptor *task,
+                                bool add)
+{
+    uint32_t class = queued_class(task);
+    uint64_t work = task->estimated_duration_us == UINT32_MAX ? 0 :
+                    task->estimated_duration_us;
+    uint64_t *total = &sched->queued_class_work_us[class];
+    uint64_t *slot = NULL;
+
+    if (task->absolute_deadline_ns)
+        slot = &sched->queued_deadline_work_us[class]
+                   [(task->absolute_deadline_ns >> LIGHTRAIL_DEADLINE_SLOT_SHIFT) %
+                    LIGHTRAIL_DEADLINE_SLOTS];
+
+    if (add) {
+        *total += work;
+        if (slot)
+            *slot += work;
+    } else {
+        *total -= work < *total ? work : *total;
+        if (slot)
+            *slot -= work < *slot ? work : *slot;
+    }
+}
+
+/*
+ * Submit a task for scheduling.
+ * Returns 0 if queued, -1 if the queue is full or admission control
+ * rejected a task that cannot meet its deadline.
+ */
 int lightrail_submit_task(struct lightrail_scheduler *sched,
                          struct task_descriptor *task)
 {
-    uint32_t next_tail;
+    struct task_descriptor *queued;
+    uint32_t deadline_ms;
+    uint64_t finish_us;
+    uint64_t now;
 
     if (!sched || !task)
         return -1;
@@ -150,20 +585,55 @@ int lightrail_submit_task(struct lightrail_scheduler *sched,
     pthread_mutex_lock(&sched->task_lock);
 
     /* Check if queue is full */
-    next_tail = (sched->task_queue_tail + 1) % sched->task_queue_size;
-    if (next_tail == sched->task_queue_head) {
+    if (sched->task_queue_count == sched->task_queue_size) {
         pthread_mutex_unlock(&sched->task_lock);
         fprintf(stderr, "Task queue full\n");
         return -1;
     }
 
-    /* Add task to queue */
-    memcpy(&sched->task_queue[sched->task_queue_tail], task, sizeof(*task));
-    sched->task_queue[sched->task_queue_tail].task_id =
-        sched->config.total_tasks_scheduled++;
-    sched->task_queue[sched->task_queue_tail].state = TASK_STATE_PENDING;
+    /* Stage the task in the first free heap slot */
+    queued = &sched->task_queue[sched->task_queue_count];
+    memcpy(queued, task, sizeof(*task));
+    queued->task_id = sched->config.total_tasks_scheduled++;
+    queued->state = TASK_STATE_PENDING;
+    queued->downgraded = false;
+
+    now = lightrail_get_time_ns();
+    deadline_ms = task->deadline_ms ? task->deadline_ms
+                                    : sched->config.max_latency_ms;
+    queued->submit_time_ns = now;
+    queued->absolute_deadline_ns = deadline_ms ?
+        now + (uint64_t)deadline_ms * 1000000ULL : 0;
+
+    /* Every queued task counts its own estimate, never the caller's */
+    queued->estimated_duration_us = best_case_duration(sched, queued, &finish_us);
+
+    /* Admission control */
+    if (queued->absolute_deadline_ns &&
+        sched->config.admission_policy != ADMISSION_ADMIT_ALL) {
+        if (!deadline_feasible(sched, queued, finish_us, now)) {
+            if (sched->config.admission_policy == ADMISSION_REJECT) {
+                queued->state = TASK_STATE_FAILED;
+                sched->config.tasks_rejected++;
+                lightrail_trace_emit(sched->trace, TRACE_EVENT_SUBMIT,
+                                     queued, sizeof(*queued));
+                pthread_mutex_unlock(&sched->task_lock);
+                return -1;
+            }
+
+            /* Run it as best-effort in the lowest class */
+            queued->priority = 0;
+            queued->absolute_deadline_ns = 0;
+            queued->downgraded = true;
+            sched->config.tasks_downgraded++;
+        }
+    }
+
+    lightrail_trace_emit(sched->trace, TRACE_EVENT_SUBMIT,
+                         queued, sizeof(*queued));
 
-    sched->task_queue_tail = next_tail;
+    queued_work_account(sched, queued, true);
+    task_heap_sift_up(sched->task_queue, sched->task_queue_count++);
 
     /* Signal scheduler thread */
     pthread_cond_signal(&sched->task_available);
@@ -173,6 +643,23 @@ int lightrail_submit_task(struct lightrail_scheduler *sched,
     return 0;
 }
 
+/* Fraction of deadline tasks that met their SLO (1.0 if none yet) */
+float lightrail_slo_attainment(struct lightrail_scheduler *sched)
+{
+    uint64_t total;
+
+    if (!sched)
+        return 0.0f;
+
+    total = sched->config.deadlines_met + sched->config.deadlines_missed +
+            sched->config.tasks_rejected + sched->config.tasks_downgraded +
+            sched->config.tasks_shed;
+    if (total == 0)
+        return 1.0f;
+
+    return (float)sched->config.deadlines_met / (float)total;
+}
+
 /* Dijkstra's algorithm for optimal route finding */
 int lightrail_schedule_dijkstra(struct lightrail_scheduler *sched,
                                uint32_t source_id, uint32_t dest_id,
@@ -313,9 +800,41 @@ int lightrail_schedule_dijkstra(struct lightrail_scheduler *sched,
     return 0;
 }
 
-/* Cache-aware scheduling */
-int lightrail_schedule_with_cache_affinity(struct lightrail_scheduler *sched,
-                                          struct task_descriptor *task)
+/* Keep the best-scored candidates, sorted by descending score */
+static void decision_add_alternative(struct lightrail_trace_decision *decision,
+                                     uint32_t device_id, float score,
+                                     uint32_t duration_us)
+{
+    struct lightrail_trace_alternative *alts;
+    uint32_t n, pos;
+
+    if (!decision)
+        return;
+
+    alts = decision->alternatives;
+    n = decision->num_alternatives;
+
+    pos = n;
+    while (pos > 0 && alts[pos - 1].score < score)
+        pos--;
+
+    if (pos >= LIGHTRAIL_TRACE_MAX_ALTERNATIVES)
+        return;
+
+    if (n == LIGHTRAIL_TRACE_MAX_ALTERNATIVES)
+        n--;                        /* Drop the worst */
+
+    memmove(&alts[pos + 1], &alts[pos], (n - pos) * sizeof(*alts));
+    alts[pos].device_id = device_id;
+    alts[pos].score = score;
+    alts[pos].estimated_duration_us = duration_us;
+    decision->num_alternatives = n + 1;
+}
+
+/* Cache-aware device selection, recording scored alternatives */
+static int schedule_cache_affinity(struct lightrail_scheduler *sched,
+                                   struct task_descriptor *task,
+                                   struct lightrail_trace_decision *decision)
 {
     float best_score = -FLT_MAX;
     uint32_t best_device = UINT32_MAX;
@@ -338,7 +857,8 @@ int lightrail_schedule_with_cache_affinity(struct lightrail_scheduler *sched,
         float cache_benefit = lightrail_calculate_cache_benefit(sched, task, i);
 
         /* Estimate execution time */
-        uint32_t exec_time_ms = lightrail_estimate_task_duration(task, dev);
+        uint32_t exec_time_us = lightrail_estimate_calibrated_duration(sched,
+                                                                       task, i);
 
         /* Calculate data transfer cost if cache miss */
         float transfer_cost_ms = 0.0f;
@@ -356,10 +876,12 @@ int lightrail_schedule_with_cache_affinity(struct lightrail_scheduler *sched,
 
         /* Calculate overall score (higher is better) */
         float score = cache_benefit -
-                     (float)exec_time_ms -
+                     (float)exec_time_us / 1000.0f -
                      transfer_cost_ms -
                      (dev->utilization_percent / 10.0f);
 
+        decision_add_alternative(decision, i, score, exec_time_us);
+
         if (score > best_score) {
             best_score = score;
             best_device = i;
@@ -377,11 +899,20 @@ int lightrail_schedule_with_cache_affinity(struct lightrail_scheduler *sched,
     task->assigned_device_id = best_device;
     task->state = TASK_STATE_SCHEDULED;
 
+    pthread_mutex_lock(&sched->task_lock);
     sched->config.cache_aware_decisions++;
+    pthread_mutex_unlock(&sched->task_lock);
 
     return 0;
 }
 
+/* Cache-aware scheduling */
+int lightrail_schedule_with_cache_affinity(struct lightrail_scheduler *sched,
+                                          struct task_descriptor *task)
+{
+    return schedule_cache_affinity(sched, task, NULL);
+}
+
 /* Calculate cache benefit for a device */
 float lightrail_calculate_cache_benefit(struct lightrail_scheduler *sched,
                                        struct task_descriptor *task,
@@ -399,21 +930,31 @@ float lightrail_calculate_cache_benefit(struct lightrail_scheduler *sched,
     return 0.0f;
 }
 
-/* Schedule a task (main scheduling function) */
-int lightrail_schedule_optimal(struct lightrail_scheduler *sched,
-                              struct task_descriptor *task)
+/*
+ * Make a scheduling decision without side effects beyond the task itself.
+ * If @decision is non-NULL it receives the input task, the outcome and the
+ * best-scored alternatives. Used by the scheduler thread and by replay.
+ */
+int lightrail_schedule_decide(struct lightrail_scheduler *sched,
+                             struct task_descriptor *task,
+                             struct lightrail_trace_decision *decision)
 {
     int ret;
 
     if (!sched || !task)
         return -1;
 
+    if (decision) {
+        memset(decision, 0, sizeof(*decision));
+        memcpy(&decision->task, task, sizeof(*task));
+    }
+
     /* Use appropriate algorithm */
     switch (sched->config.algorithm) {
     case SCHED_OPTIMAL_DIJKSTRA:
     case SCHED_OPTIMAL_ASTAR:
         /* Cache-aware scheduling with optimal routing */
-        ret = lightrail_schedule_with_cache_affinity(sched, task);
+        ret = schedule_cache_affinity(sched, task, decision);
         break;
 
     case SCHED_GREEDY_OPTIMAL:
@@ -424,8 +965,14 @@ int lightrail_schedule_optimal(struct lightrail_scheduler *sched,
 
             pthread_mutex_lock(&sched->device_lock);
             for (uint32_t i = 0; i < sched->num_devices; i++) {
-                if (sched->devices[i].utilization_percent < min_util &&
-                    lightrail_device_can_run_task(&sched->devices[i], task)) {
+                if (!lightrail_device_can_run_task(&sched->devices[i], task))
+                    continue;
+
+                decision_add_alternative(decision, i,
+                    -sched->devices[i].utilization_percent,
+                    lightrail_estimate_calibrated_duration(sched, task, i));
+
+                if (sched->devices[i].utilization_percent < min_util) {
                     min_util = sched->devices[i].utilization_percent;
                     best_device = i;
                 }
@@ -445,12 +992,140 @@ int lightrail_schedule_optimal(struct lightrail_scheduler *sched,
     }
 
     if (ret == 0) {
+        pthread_mutex_lock(&sched->device_lock);
+        task->estimated_duration_us = lightrail_estimate_calibrated_duration(
+            sched, task, task->assigned_device_id);
+        pthread_mutex_unlock(&sched->device_lock);
+
+        pthread_mutex_lock(&sched->task_lock);
         sched->config.total_scheduling_decisions++;
+        pthread_mutex_unlock(&sched->task_lock);
     }
 
+    if (decision) {
+        decision->result = ret;
+        decision->assigned_device_id = ret == 0 ? task->assigned_device_id
+                                                : UINT32_MAX;
+    }
+
+    return ret;
+}
+
+/* Schedule a task (main scheduling function) */
+int lightrail_schedule_optimal(struct lightrail_scheduler *sched,
+                              struct task_descriptor *task)
+{
+    struct lightrail_trace_decision decision;
+    int ret;
+
+    if (!sched || !task)
+        return -1;
+
+    if (!lightrail_trace_enabled(sched->trace))
+        return lightrail_schedule_decide(sched, task, NULL);
+
+    ret = lightrail_schedule_decide(sched, task, &decision);
+    lightrail_trace_emit(sched->trace, TRACE_EVENT_DECISION,
+                         &decision, sizeof(decision));
+
     return ret;
 }
 
+/* Account a scheduled task against its device */
+void lightrail_commit_assignment(struct lightrail_scheduler *sched,
+                                struct task_descriptor *task)
+{
+    if (!sched || !task || task->assigned_device_id >= sched->num_devices)
+        return;
+
+    pthread_mutex_lock(&sched->device_lock);
+    sched->devices[task->assigned_device_id].utilization_percent +=
+        (float)task->compute_ops / 1e12f;  /* Mock calculation */
+    if (task->estimated_duration_us != UINT32_MAX)
+        sched->device_backlog_us[task->assigned_device_id] +=
+            task->estimated_duration_us;
+    pthread_mutex_unlock(&sched->device_lock);
+}
+
+/* Report that a scheduled task finished on its device just now */
+int lightrail_complete_task(struct lightrail_scheduler *sched,
+                           struct task_descriptor *task,
+                           uint32_t actual_duration_us)
+{
+    return lightrail_complete_task_at(sched, task, actual_duration_us,
+                                      lightrail_get_time_ns());
+}
+
+/*
+ * Report that a scheduled task finished at @completed_ns, on the clock
+ * its absolute deadline was set against (replay passes the logged time).
+ */
+int lightrail_complete_task_at(struct lightrail_scheduler *sched,
+                              struct task_descriptor *task,
+                              uint32_t actual_duration_us,
+                              uint64_t completed_ns)
+{
+    struct lightrail_trace_completion completion;
+    struct device_info *dev;
+    uint64_t *backlog;
+
+    if (!sched || !task || task->assigned_device_id >= sched->num_devices)
+        return -1;
+
+    pthread_mutex_lock(&sched->device_lock);
+    dev = &sched->devices[task->assigned_device_id];
+    dev->utilization_percent -= (float)task->compute_ops / 1e12f;
+    if (dev->utilization_percent < 0.0f)
+        dev->utilization_percent = 0.0f;
+
+    backlog = &sched->device_backlog_us[task->assigned_device_id];
+    if (task->estimated_duration_us != UINT32_MAX)
+        *backlog -= task->estimated_duration_us < *backlog ?
+                    task->estimated_duration_us : *backlog;
+
+    /* Learn how far off the estimates are for this device */
+    if (task->estimated_duration_us > 0 &&
+        task->estimated_duration_us != UINT32_MAX) {
+        float *factor = &sched->duration_calibration[task->assigned_device_id];
+        float ratio = (float)actual_duration_us /
+                      (float)task->estimated_duration_us;
+
+        *factor *= 1.0f + 0.1f * (ratio - 1.0f);
+        if (*factor < 0.1f)
+            *factor = 0.1f;
+        else if (*factor > 10.0f)
+            *factor = 10.0f;
+    }
+    pthread_mutex_unlock(&sched->device_lock);
+
+    task->state = TASK_STATE_COMPLETED;
+
+    pthread_mutex_lock(&sched->task_lock);
+    sched->config.total_tasks_completed++;
+    sched->total_execution_time_us += actual_duration_us;
+
+    if (task->absolute_deadline_ns) {
+        if (completed_ns <= task->absolute_deadline_ns)
+            sched->config.deadlines_met++;
+        else
+            sched->config.deadlines_missed++;
+        sched->config.slo_attainment = lightrail_slo_attainment(sched);
+    }
+    pthread_mutex_unlock(&sched->task_lock);
+
+    if (lightrail_trace_enabled(sched->trace)) {
+        completion.task_id = task->task_id;
+        completion.device_id = task->assigned_device_id;
+        completion.estimated_duration_us = task->estimated_duration_us;
+        completion.actual_duration_us = actual_duration_us;
+        completion.compute_ops = task->compute_ops;
+        lightrail_trace_emit(sched->trace, TRACE_EVENT_COMPLETE,
+                             &completion, sizeof(completion));
+    }
+
+    return 0;
+}
+
 /* Scheduler thread */
 void *lightrail_scheduler_thread(void *arg)
 {
@@ -463,8 +1138,7 @@ void *lightrail_scheduler_thread(void *arg)
         pthread_mutex_lock(&sched->task_lock);
 
         /* Wait for tasks */
-        while (sched->task_queue_head == sched->task_queue_tail &&
-               sched->running) {
+        while (sched->task_queue_count == 0 && sched->running) {
             pthread_cond_wait(&sched->task_available, &sched->task_lock);
         }
 
@@ -473,24 +1147,45 @@ void *lightrail_scheduler_thread(void *arg)
             break;
         }
 
-        /* Get next task */
-        memcpy(&task, &sched->task_queue[sched->task_queue_head],
-               sizeof(task));
-        sched->task_queue_head = (sched->task_queue_head + 1) %
-                                sched->task_queue_size;
+        /* Pop the most urgent task */
+        memcpy(&task, &sched->task_queue[0], sizeof(task));
+        sched->task_queue_count--;
+        if (sched->task_queue_count > 0) {
+            memcpy(&sched->task_queue[0],
+                   &sched->task_queue[sched->task_queue_count], sizeof(task));
+            task_heap_sift_down(sched->task_queue, sched->task_queue_count, 0);
+        }
+        queued_work_account(sched, &task, false);
+
+        /* Tasks that can no longer make their deadline get the same
+         * treatment they would have had at admission */
+        if (task.absolute_deadline_ns &&
+            sched->config.admission_policy != ADMISSION_ADMIT_ALL &&
+            (task.estimated_duration_us == UINT32_MAX ||
+             lightrail_get_time_ns() +
+             (uint64_t)task.estimated_duration_us * 1000ULL >
+             task.absolute_deadline_ns)) {
+            if (sched->config.admission_policy == ADMISSION_REJECT) {
+                task.state = TASK_STATE_FAILED;
+                sched->config.tasks_shed++;
+                sched->config.slo_attainment = lightrail_slo_attainment(sched);
+                lightrail_trace_emit(sched->trace, TRACE_EVENT_SHED,
+                                     &task, sizeof(task));
+                pthread_mutex_unlock(&sched->task_lock);
+                continue;
+            }
+
+            task.priority = 0;
+            task.absolute_deadline_ns = 0;
+            task.downgraded = true;
+            sched->config.tasks_downgraded++;
+        }
 
         pthread_mutex_unlock(&sched->task_lock);
 
-        /* Schedule the task */
+        /* Schedule the task (decision is recorded in the trace, if any) */
         if (lightrail_schedule_optimal(sched, &task) == 0) {
-            printf("Task %d scheduled to device %d\n",
-                   task.task_id, task.assigned_device_id);
-
-            /* Update device utilization */
-            pthread_mutex_lock(&sched->device_lock);
-            sched->devices[task.assigned_device_id].utilization_percent +=
-                (float)task.compute_ops / 1e12f;  /* Mock calculation */
-            pthread_mutex_unlock(&sched->device_lock);
+            lightrail_commit_assignment(sched, &task);
         } else {
             fprintf(stderr, "Failed to schedule task %d\n", task.task_id);
         }
@@ -543,5 +1238,18 @@ void lightrail_get_statistics(struct lightrail_scheduler *sched,
     if (!sched || !stats)
         return;
 
+    pthread_mutex_lock(&sched->task_lock);
+    sched->config.slo_attainment = lightrail_slo_attainment(sched);
     memcpy(stats, &sched->config, sizeof(*stats));
+    pthread_mutex_unlock(&sched->task_lock);
+}
+
+/* Attach a binary decision log (NULL detaches) */
+void lightrail_attach_trace(struct lightrail_scheduler *sched,
+                           struct lightrail_trace *trace)
+{
+    if (!sched)
+        return;
+
+    sched->trace = trace;
 }
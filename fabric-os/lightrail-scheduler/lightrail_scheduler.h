@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
+#include <math.h>
 
 /*
  * LightRail AI Mathematical Scheduler
@@ -17,6 +19,14 @@
 #define LIGHTRAIL_MAX_TASKS 4096
 #define LIGHTRAIL_MAX_ROUTES 16
 
+/* Admission control's view of the queue: priorities above the last
+ * class share it, deadlines are bucketed into ~4.2ms slots (~1.07s) */
+#define LIGHTRAIL_PRIORITY_CLASSES 8
+#define LIGHTRAIL_DEADLINE_SLOTS 256
+#define LIGHTRAIL_DEADLINE_SLOT_SHIFT 22
+
+struct lightrail_trace;
+
 /* Optimization objectives */
 enum optimization_objective {
     OPT_MINIMIZE_LATENCY = 0,       /* Minimize end-to-end latency */
@@ -45,6 +55,41 @@ enum device_type {
     DEVICE_TYPE_PHOTONIC = 4,
 };
 
+#define LIGHTRAIL_NUM_DEVICE_TYPES 5
+
+/* Kernel precision (peak_performance_tflops is quoted at FP16) */
+enum task_precision {
+    PRECISION_FP16 = 0,             /* FP16/BF16 */
+    PRECISION_FP32 = 1,
+    PRECISION_FP8 = 2,
+    PRECISION_INT8 = 3,
+};
+
+#define LIGHTRAIL_NUM_PRECISIONS 4
+
+/* Achievable performance of a device type at one precision */
+struct device_perf_profile {
+    float compute_efficiency;       /* Achievable / peak FP16 FLOPs */
+    float bandwidth_efficiency;     /* Achievable / peak memory bandwidth */
+    uint32_t fixed_overhead_us;     /* Launch/dispatch cost per task */
+    bool calibrated;                /* Measured rather than default */
+};
+
+/* One kernel measurement from a calibration run */
+struct perf_calibration_sample {
+    uint32_t device_id;             /* Registered device it ran on */
+    uint64_t compute_ops;           /* FLOPs executed */
+    uint64_t bytes_moved;           /* Memory traffic */
+    uint32_t measured_us;           /* Wall time on an idle device */
+};
+
+/* Admission control for deadline tasks */
+enum admission_policy {
+    ADMISSION_ADMIT_ALL = 0,        /* Queue everything, even if late */
+    ADMISSION_REJECT = 1,           /* Reject tasks that cannot meet deadline */
+    ADMISSION_DOWNGRADE = 2,        /* Demote them to best-effort instead */
+};
+
 /* Task states */
 enum task_state {
     TASK_STATE_PENDING = 0,
@@ -64,7 +109,7 @@ struct device_info {
     /* Capabilities */
     uint64_t compute_capacity_gflops;
     uint64_t memory_capacity_bytes;
-    uint64_t memory_bandwidth_gbps;
+    uint64_t memory_bandwidth_gbps; /* GB/s */
     uint32_t num_cores;
 
     /* Current state */
@@ -99,18 +144,20 @@ struct task_descriptor {
     uint64_t memory_required_bytes;
     uint64_t memory_bandwidth_required_gbps;
     uint32_t batch_size;
+    float arithmetic_intensity;     /* FLOPs per byte moved, 0 = unknown */
+    enum task_precision precision;
 
     /* Constraints */
     uint32_t deadline_ms;           /* SLA deadline */
     enum device_type preferred_device_type;
     uint32_t min_memory_bytes;
     uint32_t max_power_watts;
-    bool requires_high_precision;   /* FP32 vs FP16 */
+    bool requires_high_precision;   /* Forces FP32 */
 
     /* Scheduling decisions */
     uint32_t assigned_device_id;
     uint32_t scheduled_time_ms;
-    uint32_t estimated_duration_ms;
+    uint32_t estimated_duration_us; /* UINT32_MAX = cannot run */
     uint32_t estimated_power_mw;
     float estimated_cost;
 
@@ -125,6 +172,11 @@ struct task_descriptor {
 
     /* Priority */
     uint32_t priority;              /* Higher = more important */
+
+    /* Deadline tracking (set by the scheduler on submit) */
+    uint64_t submit_time_ns;
+    uint64_t absolute_deadline_ns;  /* 0 = no deadline (best-effort) */
+    bool downgraded;                /* Demoted by admission control */
 };
 
 /* Route between devices */
@@ -150,7 +202,7 @@ struct scheduler_config {
     float weight_cost;              /* γ */
 
     /* Constraints */
-    uint32_t max_latency_ms;
+    uint32_t max_latency_ms;        /* Default deadline if task has none */
     uint32_t max_power_watts;
     float max_cost_per_task;
 
@@ -170,6 +222,9 @@ struct scheduler_config {
     bool enable_prefetching;
     bool enable_workload_prediction;
 
+    /* Deadline scheduling */
+    enum admission_policy admission_policy;
+
     /* Statistics */
     uint64_t total_tasks_scheduled;
     uint64_t total_tasks_completed;
@@ -177,6 +232,14 @@ struct scheduler_config {
     uint64_t cache_aware_decisions;
     float average_scheduling_time_us;
     float optimization_quality;     /* 0-1, how close to optimal */
+
+    /* SLO statistics */
+    uint64_t tasks_rejected;        /* Refused at admission */
+    uint64_t tasks_downgraded;      /* Admitted as best-effort */
+    uint64_t tasks_shed;            /* Failed at dispatch, already late */
+    uint64_t deadlines_met;
+    uint64_t deadlines_missed;
+    float slo_attainment;           /* 0-1, met / all deadline tasks */
 };
 
 /* Scheduler state */
@@ -188,11 +251,10 @@ struct lightrail_scheduler {
     uint32_t num_devices;
     pthread_mutex_t device_lock;
 
-    /* Task queue */
+    /* Task queue: binary heap, priority class then EDF then FIFO */
     struct task_descriptor *task_queue;
     uint32_t task_queue_size;
-    uint32_t task_queue_head;
-    uint32_t task_queue_tail;
+    uint32_t task_queue_count;
     pthread_mutex_t task_lock;
     pthread_cond_t task_available;
 
@@ -204,6 +266,23 @@ struct lightrail_scheduler {
     pthread_t scheduler_thread;
     bool running;
 
+    /* Roofline profiles per device type and precision */
+    struct device_perf_profile profiles[LIGHTRAIL_NUM_DEVICE_TYPES][LIGHTRAIL_NUM_PRECISIONS];
+
+    /* Observed/estimated duration ratio per device (EWMA, 1.0 = exact) */
+    float duration_calibration[LIGHTRAIL_MAX_DEVICES];
+
+    /* Estimated work assigned but not completed, per device (device_lock) */
+    uint64_t device_backlog_us[LIGHTRAIL_MAX_DEVICES];
+
+    /* Estimated work of queued tasks per priority class, and of the
+     * deadline tasks among them per deadline slot (task_lock) */
+    uint64_t queued_class_work_us[LIGHTRAIL_PRIORITY_CLASSES];
+    uint64_t queued_deadline_work_us[LIGHTRAIL_PRIORITY_CLASSES][LIGHTRAIL_DEADLINE_SLOTS];
+
+    /* Binary decision log (NULL = disabled) */
+    struct lightrail_trace *trace;
+
     /* Performance metrics */
     uint64_t total_execution_time_us;
     uint64_t total_data_movement_bytes;
@@ -234,6 +313,37 @@ int lightrail_submit_batch(struct lightrail_scheduler *sched,
                           struct task_descriptor *tasks,
                           uint32_t count);
 
+/* Task lifecycle */
+void lightrail_commit_assignment(struct lightrail_scheduler *sched,
+                                struct task_descriptor *task);
+int lightrail_complete_task(struct lightrail_scheduler *sched,
+                           struct task_descriptor *task,
+                           uint32_t actual_duration_us);
+int lightrail_complete_task_at(struct lightrail_scheduler *sched,
+                              struct task_descriptor *task,
+                              uint32_t actual_duration_us,
+                              uint64_t completed_ns);
+
+/* Deadline scheduling */
+uint32_t lightrail_estimate_calibrated_duration(struct lightrail_scheduler *sched,
+                                                struct task_descriptor *task,
+                                                uint32_t device_id);
+float lightrail_slo_attainment(struct lightrail_scheduler *sched);
+
+/* Performance profiles */
+const struct device_perf_profile *lightrail_get_profile(struct lightrail_scheduler *sched,
+                                                        enum device_type type,
+                                                        enum task_precision precision);
+int lightrail_set_profile(struct lightrail_scheduler *sched,
+                         enum device_type type,
+                         enum task_precision precision,
+                         const struct device_perf_profile *profile);
+int lightrail_calibrate_profile(struct lightrail_scheduler *sched,
+                               enum device_type type,
+                               enum task_precision precision,
+                               const struct perf_calibration_sample *samples,
+                               uint32_t num_samples);
+
 /* Scheduling algorithms */
 int lightrail_schedule_optimal(struct lightrail_scheduler *sched,
                               struct task_descriptor *task);
@@ -281,7 +391,32 @@ void lightrail_get_statistics(struct lightrail_scheduler *sched,
                              struct scheduler_config *stats);
 void lightrail_reset_statistics(struct lightrail_scheduler *sched);
 
+/* Decision logging */
+void lightrail_attach_trace(struct lightrail_scheduler *sched,
+                           struct lightrail_trace *trace);
+
 /* Utility functions */
+static inline uint64_t lightrail_get_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* EDF order within a priority class, FIFO (task_id) among equals */
+static inline bool lightrail_task_before(const struct task_descriptor *a,
+                                         const struct task_descriptor *b)
+{
+    uint64_t da = a->absolute_deadline_ns ? a->absolute_deadline_ns : UINT64_MAX;
+    uint64_t db = b->absolute_deadline_ns ? b->absolute_deadline_ns : UINT64_MAX;
+
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+    if (da != db)
+        return da < db;
+    return a->task_id < b->task_id;
+}
+
 static inline float lightrail_compute_objective(struct lightrail_scheduler *sched,
                                                uint32_t latency_ms,
                                                uint32_t power_mw,
@@ -301,18 +436,49 @@ static inline bool lightrail_device_can_run_task(struct device_info *device,
            (device->utilization_percent < 95.0f);
 }
 
+static inline enum task_precision lightrail_task_precision(const struct task_descriptor *task)
+{
+    return task->requires_high_precision ? PRECISION_FP32 : task->precision;
+}
+
+/*
+ * Roofline estimate in microseconds: fixed overhead plus the slower of
+ * compute time at the achievable FLOP rate and transfer time at the
+ * achievable bandwidth, both derated by current utilization. Rounded up,
+ * so any task costs at least 1us. A NULL @profile means peak rates.
+ */
 static inline uint32_t lightrail_estimate_task_duration(struct task_descriptor *task,
-                                                        struct device_info *device)
+                                                        struct device_info *device,
+                                                        const struct device_perf_profile *profile)
 {
-    if (device->peak_performance_tflops == 0.0f)
+    float compute_eff = profile ? profile->compute_efficiency : 1.0f;
+    float bandwidth_eff = profile ? profile->bandwidth_efficiency : 1.0f;
+    float available = 1.0f - device->utilization_percent / 100.0f;
+    float compute_s, memory_s = 0.0f;
+    double duration_us;
+
+    if (device->peak_performance_tflops == 0.0f || compute_eff <= 0.0f ||
+        available <= 0.0f)
         return UINT32_MAX;
 
-    /* Duration = ops / (performance * utilization) */
-    float performance_tflops = device->peak_performance_tflops *
-                              (1.0f - device->utilization_percent / 100.0f);
-    float duration_s = (float)task->compute_ops / (performance_tflops * 1e12f);
+    compute_s = (float)task->compute_ops /
+                (device->peak_performance_tflops * compute_eff * available * 1e12f);
+
+    if (task->arithmetic_intensity > 0.0f) {
+        float bytes = (float)task->compute_ops / task->arithmetic_intensity;
+
+        if (device->memory_bandwidth_gbps == 0 || bandwidth_eff <= 0.0f)
+            return UINT32_MAX;
+
+        memory_s = bytes / ((float)device->memory_bandwidth_gbps *
+                            bandwidth_eff * available * 1e9f);
+    }
 
-    return (uint32_t)(duration_s * 1000.0f);  /* Convert to ms */
+    duration_us = ceil((double)(compute_s > memory_s ? compute_s : memory_s) * 1e6 +
+                       (profile ? (double)profile->fixed_overhead_us : 0.0));
+    if (duration_us < 1.0)
+        return 1;
+    return duration_us < (double)(UINT32_MAX - 1) ? (uint32_t)duration_us : UINT32_MAX - 1;
 }
 
 #endif /* _LIGHTRAIL_SCHEDULER_H */
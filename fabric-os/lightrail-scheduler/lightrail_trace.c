@@ -0,0 +1,323 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lightrail_trace.h"
+
+/*
+ * LightRail Binary Decision Log Implementation
+ *
+ * Ring layout: [header pages][capacity * record]. Record n lives in slot
+ * n & (capacity - 1); its seq word is a seqlock so readers can detect a
+ * slot that is being overwritten while they copy it.
+ */
+
+#define TRACE_PAGE_BYTES 4096
+#define TRACE_HEADER_BYTES \
+    ((sizeof(struct lightrail_trace_header) + TRACE_PAGE_BYTES - 1) & \
+     ~(size_t)(TRACE_PAGE_BYTES - 1))
+#define TRACE_PAYLOAD_OFFSET offsetof(struct lightrail_trace_record, timestamp_ns)
+
+static size_t trace_map_size(uint32_t capacity)
+{
+    return TRACE_HEADER_BYTES +
+           (size_t)capacity * sizeof(struct lightrail_trace_record);
+}
+
+/* Create a new trace file, truncating any existing one */
+int lightrail_trace_create(struct lightrail_trace *trace,
+                          const char *path,
+                          uint32_t capacity,
+                          const struct scheduler_config *config)
+{
+    struct lightrail_trace_header *hdr;
+    void *map;
+    int fd;
+
+    if (!trace || !path)
+        return -1;
+
+    if (capacity == 0)
+        capacity = LIGHTRAIL_TRACE_DEFAULT_CAPACITY;
+
+    if (capacity & (capacity - 1)) {
+        fprintf(stderr, "Trace capacity must be a power of two: %u\n",
+                capacity);
+        return -1;
+    }
+
+    memset(trace, 0, sizeof(*trace));
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("lightrail_trace_create: open");
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t)trace_map_size(capacity)) != 0) {
+        perror("lightrail_trace_create: ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, trace_map_size(capacity), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("lightrail_trace_create: mmap");
+        close(fd);
+        return -1;
+    }
+
+    hdr = map;
+    hdr->magic = LIGHTRAIL_TRACE_MAGIC;
+    hdr->version = LIGHTRAIL_TRACE_VERSION;
+    hdr->record_size = sizeof(struct lightrail_trace_record);
+    hdr->capacity = capacity;
+    hdr->device_info_size = sizeof(struct device_info);
+    hdr->task_descriptor_size = sizeof(struct task_descriptor);
+    hdr->config_size = sizeof(struct scheduler_config);
+    hdr->start_time_ns = lightrail_get_time_ns();
+    atomic_init(&hdr->head, 0);
+    if (config)
+        memcpy(&hdr->config, config, sizeof(*config));
+
+    trace->header = hdr;
+    trace->records = (struct lightrail_trace_record *)
+                     ((char *)map + TRACE_HEADER_BYTES);
+    trace->map_size = trace_map_size(capacity);
+    trace->fd = fd;
+    trace->writable = true;
+    pthread_mutex_init(&trace->fold_lock, NULL);
+
+    return 0;
+}
+
+/* Open an existing trace file read-only (for replay) */
+int lightrail_trace_open(struct lightrail_trace *trace, const char *path)
+{
+    struct lightrail_trace_header hdr;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (!trace || !path)
+        return -1;
+
+    memset(trace, 0, sizeof(*trace));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("lightrail_trace_open: open");
+        return -1;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < TRACE_HEADER_BYTES ||
+        pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        fprintf(stderr, "%s: not a LightRail trace\n", path);
+        close(fd);
+        return -1;
+    }
+
+    if (hdr.magic != LIGHTRAIL_TRACE_MAGIC ||
+        hdr.version != LIGHTRAIL_TRACE_VERSION) {
+        fprintf(stderr, "%s: bad trace magic/version\n", path);
+        close(fd);
+        return -1;
+    }
+
+    if (hdr.record_size != sizeof(struct lightrail_trace_record) ||
+        hdr.device_info_size != sizeof(struct device_info) ||
+        hdr.task_descriptor_size != sizeof(struct task_descriptor) ||
+        hdr.config_size != sizeof(struct scheduler_config)) {
+        fprintf(stderr, "%s: trace recorded by an incompatible build\n", path);
+        close(fd);
+        return -1;
+    }
+
+    if (hdr.capacity == 0 || (hdr.capacity & (hdr.capacity - 1)) ||
+        (size_t)st.st_size < trace_map_size(hdr.capacity)) {
+        fprintf(stderr, "%s: truncated trace\n", path);
+        close(fd);
+        return -1;
+    }
+
+    map = mmap(NULL, trace_map_size(hdr.capacity), PROT_READ, MAP_SHARED,
+               fd, 0);
+    if (map == MAP_FAILED) {
+        perror("lightrail_trace_open: mmap");
+        close(fd);
+        return -1;
+    }
+
+    trace->header = map;
+    trace->records = (struct lightrail_trace_record *)
+                     ((char *)map + TRACE_HEADER_BYTES);
+    trace->map_size = trace_map_size(hdr.capacity);
+    trace->fd = fd;
+    trace->writable = false;
+
+    return 0;
+}
+
+/* Close a trace, flushing a writable mapping to disk */
+void lightrail_trace_close(struct lightrail_trace *trace)
+{
+    if (!trace || !trace->header)
+        return;
+
+    if (trace->writable) {
+        msync(trace->header, trace->map_size, MS_SYNC);
+        pthread_mutex_destroy(&trace->fold_lock);
+    }
+
+    munmap(trace->header, trace->map_size);
+    close(trace->fd);
+
+    memset(trace, 0, sizeof(*trace));
+}
+
+/*
+ * Record @old, in @rec, is about to be overwritten: if it is a device
+ * record, fold it into the header table. Writers overwriting device
+ * records of one device may race, so the newest record wins.
+ */
+static void trace_fold_device(struct lightrail_trace *trace,
+                              const struct lightrail_trace_record *rec,
+                              uint64_t old)
+{
+    struct lightrail_trace_header *hdr = trace->header;
+    uint32_t id;
+
+    if (atomic_load_explicit(&rec->seq, memory_order_acquire) != 2 * old + 2 ||
+        (rec->event != TRACE_EVENT_DEVICE_REGISTER &&
+         rec->event != TRACE_EVENT_DEVICE_UPDATE))
+        return;
+
+    id = rec->data.device.device_id;
+    if (id >= LIGHTRAIL_MAX_DEVICES)
+        return;
+
+    pthread_mutex_lock(&trace->fold_lock);
+    if (old + 1 > hdr->device_records[id]) {
+        memcpy(&hdr->devices[id], &rec->data.device, sizeof(hdr->devices[id]));
+        hdr->device_records[id] = old + 1;
+        if (id >= hdr->num_devices)
+            hdr->num_devices = id + 1;
+    }
+    pthread_mutex_unlock(&trace->fold_lock);
+}
+
+/*
+ * Append one event. Never blocks, except to fold an overwritten device
+ * record into the header; the oldest records are overwritten.
+ */
+void lightrail_trace_emit(struct lightrail_trace *trace,
+                         enum lightrail_trace_event event,
+                         const void *payload,
+                         size_t payload_size)
+{
+    struct lightrail_trace_header *hdr;
+    struct lightrail_trace_record *rec;
+    uint64_t n;
+
+    if (!lightrail_trace_enabled(trace))
+        return;
+
+    hdr = trace->header;
+    if (payload_size > sizeof(rec->data))
+        payload_size = sizeof(rec->data);
+
+    n = atomic_fetch_add_explicit(&hdr->head, 1, memory_order_relaxed);
+    rec = &trace->records[n & (hdr->capacity - 1)];
+    if (n >= hdr->capacity)
+        trace_fold_device(trace, rec, n - hdr->capacity);
+
+    atomic_store_explicit(&rec->seq, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    rec->timestamp_ns = lightrail_get_time_ns();
+    rec->event = event;
+    rec->reserved = 0;
+    if (payload && payload_size)
+        memcpy(&rec->data, payload, payload_size);
+
+    atomic_store_explicit(&rec->seq, 2 * n + 2, memory_order_release);
+}
+
+/*
+ * Record a device registration or state update. Called with the
+ * scheduler's device_lock held, so one device's records are logged in
+ * the order they were applied.
+ */
+void lightrail_trace_emit_device(struct lightrail_trace *trace,
+                                enum lightrail_trace_event event,
+                                const struct device_info *device)
+{
+    if (!device || device->device_id >= LIGHTRAIL_MAX_DEVICES)
+        return;
+
+    lightrail_trace_emit(trace, event, device, sizeof(*device));
+}
+
+/* Oldest record number still present in the ring */
+uint64_t lightrail_trace_first(const struct lightrail_trace *trace)
+{
+    uint64_t head;
+
+    if (!trace || !trace->header)
+        return 0;
+
+    head = atomic_load_explicit(&trace->header->head, memory_order_acquire);
+    return head > trace->header->capacity ? head - trace->header->capacity : 0;
+}
+
+/* One past the newest claimed record number */
+uint64_t lightrail_trace_end(const struct lightrail_trace *trace)
+{
+    if (!trace || !trace->header)
+        return 0;
+
+    return atomic_load_explicit(&trace->header->head, memory_order_acquire);
+}
+
+/*
+ * Copy record @index out of the ring.
+ * Returns 0 on success, -1 if the record is unpublished or was
+ * overwritten while being read.
+ */
+int lightrail_trace_read(const struct lightrail_trace *trace,
+                        uint64_t index,
+                        struct lightrail_trace_record *record)
+{
+    const struct lightrail_trace_record *rec;
+    uint64_t expected = 2 * index + 2;
+    uint64_t before, after;
+
+    if (!trace || !trace->header || !record)
+        return -1;
+
+    rec = &trace->records[index & (trace->header->capacity - 1)];
+
+    before = atomic_load_explicit(&rec->seq, memory_order_acquire);
+    if (before != expected)
+        return -1;
+
+    memcpy((char *)record + TRACE_PAYLOAD_OFFSET,
+           (const char *)rec + TRACE_PAYLOAD_OFFSET,
+           sizeof(*record) - TRACE_PAYLOAD_OFFSET);
+
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+    if (after != expected)
+        return -1;
+
+    atomic_store_explicit(&record->seq, expected, memory_order_relaxed);
+    return 0;
+}
@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LIGHTRAIL_TRACE_H
+#define _LIGHTRAIL_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "lightrail_scheduler.h"
+
+/*
+ * LightRail Binary Decision Log
+ *
+ * Fixed-size binary event records written to an mmap'd ring file.
+ * Writers claim a slot with a single atomic increment and publish it
+ * with a per-record sequence word, so the scheduling hot path never
+ * takes a lock or makes a syscall. The log can later be replayed
+ * through any algorithm/config by lightrail-replay.
+ *
+ * A device registration or update that the ring is about to overwrite
+ * is first folded into a table in the header. The table therefore holds
+ * each device's state as of the oldest record still in the ring, so a
+ * replay of a wrapped log starts from it and applies the ring's device
+ * records in order on top.
+ */
+
+#define LIGHTRAIL_TRACE_MAGIC 0x5254524cU   /* "LRTR" */
+#define LIGHTRAIL_TRACE_VERSION 4
+#define LIGHTRAIL_TRACE_MAX_ALTERNATIVES 8
+#define LIGHTRAIL_TRACE_DEFAULT_CAPACITY (1U << 16)
+
+/* Event types */
+enum lightrail_trace_event {
+    TRACE_EVENT_NONE = 0,
+    TRACE_EVENT_DEVICE_REGISTER = 1,
+    TRACE_EVENT_DEVICE_UPDATE = 2,
+    TRACE_EVENT_SUBMIT = 3,
+    TRACE_EVENT_DECISION = 4,
+    TRACE_EVENT_COMPLETE = 5,
+    TRACE_EVENT_SHED = 6,           /* Task failed at dispatch, already late */
+};
+
+/* A scored candidate device considered for a decision */
+struct lightrail_trace_alternative {
+    uint32_t device_id;
+    uint32_t estimated_duration_us;
+    float score;                    /* Higher is better */
+};
+
+/* Scheduling decision with the best-scored alternatives */
+struct lightrail_trace_decision {
+    struct task_descriptor task;    /* Task as it entered the scheduler */
+    int32_t result;                 /* 0 on success, -1 if unschedulable */
+    uint32_t assigned_device_id;
+    uint32_t num_alternatives;
+    struct lightrail_trace_alternative alternatives[LIGHTRAIL_TRACE_MAX_ALTERNATIVES];
+};
+
+/* Task completion as reported by the executor */
+struct lightrail_trace_completion {
+    uint32_t task_id;
+    uint32_t device_id;
+    uint32_t estimated_duration_us;
+    uint32_t actual_duration_us;
+    uint64_t compute_ops;
+};
+
+/* One ring slot */
+struct lightrail_trace_record {
+    _Atomic uint64_t seq;           /* 2n+1 while writing, 2n+2 once published */
+    uint64_t timestamp_ns;
+    uint32_t event;
+    uint32_t reserved;
+    union {
+        struct device_info device;
+        struct task_descriptor task;
+        struct lightrail_trace_decision decision;
+        struct lightrail_trace_completion completion;
+    } data;
+};
+
+/* File header (first pages of the mapping) */
+struct lightrail_trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;              /* Records, power of two */
+
+    /* Layout checks so a replay never misreads a foreign build */
+    uint32_t device_info_size;
+    uint32_t task_descriptor_size;
+    uint32_t config_size;
+    uint32_t reserved;
+
+    uint64_t start_time_ns;
+    _Atomic uint64_t head;          /* Next record number to claim */
+
+    struct scheduler_config config; /* Config the log was recorded under */
+
+    /* Device state from records the ring has overwritten, indexed by
+     * device_id; device_records[id] is the newest folded record + 1 */
+    uint32_t num_devices;
+    uint32_t reserved2;
+    uint64_t device_records[LIGHTRAIL_MAX_DEVICES];
+    struct device_info devices[LIGHTRAIL_MAX_DEVICES];
+};
+
+/* Open trace handle */
+struct lightrail_trace {
+    struct lightrail_trace_header *header;
+    struct lightrail_trace_record *records;
+    size_t map_size;
+    int fd;
+    bool writable;
+    pthread_mutex_t fold_lock;      /* Header device table (writers) */
+};
+
+/* Function prototypes */
+
+/* Lifecycle */
+int lightrail_trace_create(struct lightrail_trace *trace,
+                          const char *path,
+                          uint32_t capacity,
+                          const struct scheduler_config *config);
+int lightrail_trace_open(struct lightrail_trace *trace, const char *path);
+void lightrail_trace_close(struct lightrail_trace *trace);
+
+/* Recording (lock-free, safe from any thread) */
+void lightrail_trace_emit(struct lightrail_trace *trace,
+                         enum lightrail_trace_event event,
+                         const void *payload,
+                         size_t payload_size);
+void lightrail_trace_emit_device(struct lightrail_trace *trace,
+                                enum lightrail_trace_event event,
+                                const struct device_info *device);
+
+/* Reading */
+uint64_t lightrail_trace_first(const struct lightrail_trace *trace);
+uint64_t lightrail_trace_end(const struct lightrail_trace *trace);
+int lightrail_trace_read(const struct lightrail_trace *trace,
+                        uint64_t index,
+                        struct lightrail_trace_record *record);
+
+/* Scheduler integration */
+int lightrail_schedule_decide(struct lightrail_scheduler *sched,
+                             struct task_descriptor *task,
+                             struct lightrail_trace_decision *decision);
+
+/* Utility functions */
+static inline bool lightrail_trace_enabled(const struct lightrail_trace *trace)
+{
+    return trace && trace->header && trace->writable;
+}
+
+#endif /* _LIGHTRAIL_TRACE_H */
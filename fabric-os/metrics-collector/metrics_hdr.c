@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include "metrics_hdr.h"
+
+/*
+ * HDR Histogram Implementation
+ *
+ * Every field is updated with relaxed atomics: a reader racing with
+ * writers may see a value counted in the buckets but not yet in the
+ * sum, which only skews that one read. Percentiles walk the buckets
+ * rather than trusting count, so they stay consistent with themselves.
+ */
+
+static void store_min(_Atomic uint64_t *min, uint64_t value)
+{
+    uint64_t cur = atomic_load_explicit(min, memory_order_relaxed);
+
+    while (value < cur &&
+           !atomic_compare_exchange_weak_explicit(min, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void store_max(_Atomic uint64_t *max, uint64_t value)
+{
+    uint64_t cur = atomic_load_explicit(max, memory_order_relaxed);
+
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(max, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+void metrics_hdr_reset(struct metrics_hdr *hdr)
+{
+    atomic_store_explicit(&hdr->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&hdr->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&hdr->min, UINT64_MAX, memory_order_relaxed);
+    atomic_store_explicit(&hdr->max, 0, memory_order_relaxed);
+    atomic_store_explicit(&hdr->last, 0, memory_order_relaxed);
+
+    for (uint32_t i = 0; i < METRICS_HDR_BUCKETS; i++)
+        atomic_store_explicit(&hdr->buckets[i], 0, memory_order_relaxed);
+}
+
+void metrics_hdr_record(struct metrics_hdr *hdr, uint64_t value)
+{
+    atomic_fetch_add_explicit(&hdr->buckets[metrics_hdr_index(value)], 1,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&hdr->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hdr->sum, value, memory_order_relaxed);
+    atomic_store_explicit(&hdr->last, value, memory_order_relaxed);
+    store_min(&hdr->min, value);
+    store_max(&hdr->max, value);
+}
+
+/* Add @src into @dst; @dst's last becomes @src's if @src has any */
+void metrics_hdr_merge(struct metrics_hdr *dst, const struct metrics_hdr *src)
+{
+    uint64_t count = atomic_load_explicit(&src->count, memory_order_relaxed);
+
+    if (count == 0)
+        return;
+
+    for (uint32_t i = 0; i < METRICS_HDR_BUCKETS; i++) {
+        uint64_t n = atomic_load_explicit(&src->buckets[i], memory_order_relaxed);
+
+        if (n)
+            atomic_fetch_add_explicit(&dst->buckets[i], n, memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&dst->count, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->sum,
+                              atomic_load_explicit(&src->sum, memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_store_explicit(&dst->last,
+                          atomic_load_explicit(&src->last, memory_order_relaxed),
+                          memory_order_relaxed);
+    store_min(&dst->min, atomic_load_explicit(&src->min, memory_order_relaxed));
+    store_max(&dst->max, atomic_load_explicit(&src->max, memory_order_relaxed));
+}
+
+/*
+ * Value at @percentile (0-100): the top of the bucket holding that rank,
+ * capped at the largest value seen, so within 1/128 above the exact
+ * answer. 0 if empty.
+ */
+uint64_t metrics_hdr_value_at(const struct metrics_hdr *hdr, float percentile)
+{
+    uint64_t total = 0, rank, seen = 0, max;
+    double exact;
+
+    for (uint32_t i = 0; i < METRICS_HDR_BUCKETS; i++)
+        total += atomic_load_explicit(&hdr->buckets[i], memory_order_relaxed);
+
+    if (total == 0)
+        return 0;
+
+    if (percentile < 0.0f)
+        percentile = 0.0f;
+    if (percentile > 100.0f)
+        percentile = 100.0f;
+
+    /* Nearest rank: the smallest value with @percentile at or below it */
+    exact = (double)percentile / 100.0 * (double)total;
+    rank = (uint64_t)exact;
+    if ((double)rank < exact || rank == 0)
+        rank++;
+
+    max = atomic_load_explicit(&hdr->max, memory_order_relaxed);
+    for (uint32_t i = 0; i < METRICS_HDR_BUCKETS; i++) {
+        seen += atomic_load_explicit(&hdr->buckets[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = metrics_hdr_highest(i);
+
+            return value < max ? value : max;
+        }
+    }
+
+    return max;
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _METRICS_HDR_H
+#define _METRICS_HDR_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * HDR (high dynamic range) latency histogram.
+ *
+ * Log-linear buckets over nanoseconds: values below 2^SUB_BITS get a
+ * bucket each, and every further power of two is split into 2^(SUB_BITS
+ * - 1) equal buckets, so a bucket is never wider than 1/128 of its
+ * lowest value. Recording is a handful of relaxed atomic adds and safe
+ * from any thread; a percentile is one pass over the buckets.
+ *
+ * Histograms of the same layout merge by adding buckets, which is how
+ * per-thread histograms are combined on read.
+ */
+
+#define METRICS_HDR_SUB_BITS 8
+#define METRICS_HDR_MAX_BITS 40        /* ~18 min in ns; larger values clamp */
+#define METRICS_HDR_HALF (1U << (METRICS_HDR_SUB_BITS - 1))
+#define METRICS_HDR_BUCKETS \
+    ((METRICS_HDR_MAX_BITS - METRICS_HDR_SUB_BITS + 2) * METRICS_HDR_HALF)
+
+struct metrics_hdr {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;           /* ns */
+    _Atomic uint64_t min;           /* UINT64_MAX while empty */
+    _Atomic uint64_t max;
+    _Atomic uint64_t last;          /* Most recent value */
+    _Atomic uint64_t buckets[METRICS_HDR_BUCKETS];
+};
+
+/* Function prototypes */
+void metrics_hdr_reset(struct metrics_hdr *hdr);
+void metrics_hdr_record(struct metrics_hdr *hdr, uint64_t value);
+void metrics_hdr_merge(struct metrics_hdr *dst, const struct metrics_hdr *src);
+uint64_t metrics_hdr_value_at(const struct metrics_hdr *hdr, float percentile);
+
+/* Utility functions */
+
+static inline uint32_t metrics_hdr_index(uint64_t value)
+{
+    uint32_t msb, shift;
+
+    if (value < (1ULL << METRICS_HDR_SUB_BITS))
+        return (uint32_t)value;
+
+    if (value >= (1ULL << METRICS_HDR_MAX_BITS))
+        value = (1ULL << METRICS_HDR_MAX_BITS) - 1;
+
+    msb = 63 - (uint32_t)__builtin_clzll(value);
+    shift = msb - METRICS_HDR_SUB_BITS + 1;
+    return shift * METRICS_HDR_HALF + (uint32_t)(value >> shift);
+}
+
+/* Largest value that lands in bucket @index */
+static inline uint64_t metrics_hdr_highest(uint32_t index)
+{
+    uint32_t shift;
+
+    if (index < 2 * METRICS_HDR_HALF)
+        return index;
+
+    shift = index / METRICS_HDR_HALF - 1;
+    return ((uint64_t)(index - shift * METRICS_HDR_HALF) << shift) +
+           (1ULL << shift) - 1;
+}
+
+#endif /* _METRICS_HDR_H */
@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "metrics_http.h"
+
+/*
+ * Metrics HTTP Endpoint Implementation
+ *
+ * Just enough HTTP/1.1 for a scraper: read up to the end of the request
+ * head, answer, close. Stopping shuts the listening socket down, which
+ * fails the pending accept() and lets the thread exit.
+ */
+
+static const char http_ok[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+    "Connection: close\r\n"
+    "Content-Length: %u\r\n\r\n";
+
+static const char http_not_found[] =
+    "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+static const char http_unavailable[] =
+    "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+
+static const char http_bad_method[] =
+    "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET\r\n"
+    "Connection: close\r\nContent-Length: 0\r\n\r\n";
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Render into the cached body unless it is fresh enough */
+static int http_render(struct metrics_http_server *server)
+{
+    uint64_t now = metrics_get_time_ns();
+    uint32_t len;
+
+    if (server->body_len && now - server->rendered_ns < server->cache_ns)
+        return 0;
+
+    len = metrics_export_prometheus(server->collector, server->body, server->body_size);
+    if (len >= server->body_size) {
+        /* Grown past the buffer: resize once, with room to spare */
+        uint32_t size = len + len / 4 + 1;
+        char *body = realloc(server->body, size);
+
+        if (!body)
+            return -1;
+        server->body = body;
+        server->body_size = size;
+        len = metrics_export_prometheus(server->collector, server->body, server->body_size);
+        if (len >= server->body_size)
+            return -1;
+    }
+
+    server->body_len = len;
+    server->rendered_ns = now;
+    atomic_fetch_add_explicit(&server->renders, 1, memory_order_relaxed);
+    return 0;
+}
+
+static void http_serve(struct metrics_http_server *server, int fd)
+{
+    char request[METRICS_HTTP_REQUEST_BYTES];
+    char head[sizeof(http_ok) + 16];
+    uint32_t len = 0;
+    const char *path;
+    int head_len;
+
+    /* Read the request head; the body, if any, is ignored */
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        len += (uint32_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n"))
+            break;
+    }
+    request[len] = '\0';
+
+    if (strncmp(request, "GET ", 4) != 0) {
+        send_all(fd, http_bad_method, sizeof(http_bad_method) - 1);
+        return;
+    }
+
+    path = request + 4;
+    if (strncmp(path, "/metrics", 8) != 0 ||
+        (path[8] != ' ' && path[8] != '?')) {
+        send_all(fd, http_not_found, sizeof(http_not_found) - 1);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&server->scrapes, 1, memory_order_relaxed);
+    if (http_render(server) != 0) {
+        send_all(fd, http_unavailable, sizeof(http_unavailable) - 1);
+        return;
+    }
+
+    head_len = snprintf(head, sizeof(head), http_ok, server->body_len);
+    if (send_all(fd, head, (size_t)head_len) == 0)
+        send_all(fd, server->body, server->body_len);
+}
+
+static void *http_thread_fn(void *arg)
+{
+    struct metrics_http_server *server = arg;
+    struct timeval timeout = {
+        .tv_sec = METRICS_HTTP_TIMEOUT_MS / 1000,
+        .tv_usec = (METRICS_HTTP_TIMEOUT_MS % 1000) * 1000,
+    };
+    struct sched_param param = { 0 };
+
+    /* Only run when the inference threads leave a CPU idle (best effort) */
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+    while (atomic_load_explicit(&server->running, memory_order_relaxed)) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;                  /* Shut down */
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        http_serve(server, fd);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/*
+ * Serve @collector on 127.0.0.1:@port (0 picks a free port), caching
+ * each render for @cache_ms (0 = METRICS_HTTP_CACHE_MS). Returns the
+ * port, or -1.
+ */
+int metrics_http_start(struct metrics_http_server *server,
+                       struct metrics_collector *collector,
+                       uint16_t port,
+                       uint32_t cache_ms)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int fd, one = 1;
+
+    if (!server || !collector)
+        return -1;
+
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->collector = collector;
+    server->cache_ns = (uint64_t)(cache_ms ? cache_ms : METRICS_HTTP_CACHE_MS) * 1000000ULL;
+    server->body = malloc(METRICS_HTTP_BUFFER_BYTES);
+    if (!server->body)
+        return -1;
+    server->body_size = METRICS_HTTP_BUFFER_BYTES;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+         listen(fd, 16) != 0 ||
+         getsockname(fd, (struct sockaddr *)&addr, &addr_len) != 0)) {
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0) {
+        fprintf(stderr, "metrics: cannot listen on 127.0.0.1:%u\n", port);
+        free(server->body);
+        server->body = NULL;
+        return -1;
+    }
+
+    server->listen_fd = fd;
+    server->port = ntohs(addr.sin_port);
+    atomic_store_explicit(&server->running, true, memory_order_relaxed);
+
+    if (pthread_create(&server->thread, NULL, http_thread_fn, server) != 0) {
+        atomic_store_explicit(&server->running, false, memory_order_relaxed);
+        close(fd);
+        server->listen_fd = -1;
+        free(server->body);
+        server->body = NULL;
+        return -1;
+    }
+
+    return (int)server->port;
+}
+
+void metrics_http_stop(struct metrics_http_server *server)
+{
+    if (!server || server->listen_fd < 0)
+        return;
+
+    atomic_store_explicit(&server->running, false, memory_order_relaxed);
+    shutdown(server->listen_fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    server->listen_fd = -1;
+
+    free(server->body);
+    server->body = NULL;
+    server->body_size = 0;
+    server->body_len = 0;
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _METRICS_HTTP_H
+#define _METRICS_HTTP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "performance_metrics.h"
+
+/*
+ * Loopback metrics endpoint.
+ *
+ * One thread, at SCHED_IDLE priority, answers GET /metrics on
+ * 127.0.0.1 with metrics_export_prometheus() output. A rendered
+ * document is served again to every scrape within cache_ms of it, so
+ * overlapping scrapers cost one render. Rendering allocates nothing
+ * once the buffer has grown to fit the document. It holds the collector
+ * mutex, as every reader and metrics_reset() do; recording threads never
+ * take it, so they never wait on a scrape. Connections are served one
+ * at a time with a short I/O timeout and closed after the response.
+ */
+
+#define METRICS_HTTP_DEFAULT_PORT 9464
+#define METRICS_HTTP_CACHE_MS 1000
+#define METRICS_HTTP_BUFFER_BYTES (64 * 1024)
+#define METRICS_HTTP_TIMEOUT_MS 1000
+#define METRICS_HTTP_REQUEST_BYTES 2048
+
+struct metrics_http_server {
+    struct metrics_collector *collector;
+    int listen_fd;
+    uint16_t port;
+    pthread_t thread;
+    _Atomic bool running;
+
+    /* Last rendered document (server thread only) */
+    char *body;
+    uint32_t body_size;
+    uint32_t body_len;
+    uint64_t rendered_ns;
+    uint64_t cache_ns;
+
+    /* Statistics */
+    _Atomic uint64_t scrapes;
+    _Atomic uint64_t renders;
+};
+
+/* Function prototypes */
+int metrics_http_start(struct metrics_http_server *server,
+                       struct metrics_collector *collector,
+                       uint16_t port,
+                       uint32_t cache_ms);
+void metrics_http_stop(struct metrics_http_server *server);
+
+#endif /* _METRICS_HTTP_H */
@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <math.h>
+#include <stdbool.h>
+#include "metrics_sketch.h"
+
+/*
+ * DDSketch Implementation
+ *
+ * The bins are a fixed dense array, so recording is one log() and a few
+ * relaxed atomic adds, and merging is a bin-by-bin add. Encoding writes
+ * the header field by field in little-endian order, skips the empty
+ * bins below and above the populated range and varint-codes the rest,
+ * so any host can read it. Decoding checks the message in full before
+ * merging any of it, so a malformed message leaves the destination
+ * untouched.
+ */
+
+#define SKETCH_LOG_GAMMA \
+    log((1.0 + METRICS_SKETCH_ALPHA) / (1.0 - METRICS_SKETCH_ALPHA))
+
+static uint32_t sketch_key(uint64_t value)
+{
+    double key = ceil(log((double)value) / SKETCH_LOG_GAMMA);
+
+    return key < METRICS_SKETCH_BINS ? (uint32_t)key : METRICS_SKETCH_BINS - 1;
+}
+
+/* Midpoint of bin @key in relative terms */
+static uint64_t sketch_value(uint32_t key)
+{
+    double gamma = exp(SKETCH_LOG_GAMMA);
+
+    return (uint64_t)llround(2.0 * exp((double)key * SKETCH_LOG_GAMMA) / (gamma + 1.0));
+}
+
+static void store_min(_Atomic uint64_t *min, uint64_t value)
+{
+    uint64_t cur = atomic_load_explicit(min, memory_order_relaxed);
+
+    while (value < cur &&
+           !atomic_compare_exchange_weak_explicit(min, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void store_max(_Atomic uint64_t *max, uint64_t value)
+{
+    uint64_t cur = atomic_load_explicit(max, memory_order_relaxed);
+
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(max, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+void metrics_sketch_reset(struct metrics_sketch *sketch)
+{
+    atomic_store_explicit(&sketch->count, 0, memory_order_relaxed);
+    atomic_store_explicit(&sketch->zero_count, 0, memory_order_relaxed);
+    atomic_store_explicit(&sketch->sum, 0, memory_order_relaxed);
+    atomic_store_explicit(&sketch->min, UINT64_MAX, memory_order_relaxed);
+    atomic_store_explicit(&sketch->max, 0, memory_order_relaxed);
+
+    for (uint32_t i = 0; i < METRICS_SKETCH_BINS; i++)
+        atomic_store_explicit(&sketch->bins[i], 0, memory_order_relaxed);
+}
+
+void metrics_sketch_record(struct metrics_sketch *sketch, uint64_t value)
+{
+    if (value == 0)
+        atomic_fetch_add_explicit(&sketch->zero_count, 1, memory_order_relaxed);
+    else
+        atomic_fetch_add_explicit(&sketch->bins[sketch_key(value)], 1,
+                                  memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&sketch->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sketch->sum, value, memory_order_relaxed);
+    store_min(&sketch->min, value);
+    store_max(&sketch->max, value);
+}
+
+void metrics_sketch_merge(struct metrics_sketch *dst, const struct metrics_sketch *src)
+{
+    uint64_t count = atomic_load_explicit(&src->count, memory_order_relaxed);
+
+    if (count == 0)
+        return;
+
+    for (uint32_t i = 0; i < METRICS_SKETCH_BINS; i++) {
+        uint64_t n = atomic_load_explicit(&src->bins[i], memory_order_relaxed);
+
+        if (n)
+            atomic_fetch_add_explicit(&dst->bins[i], n, memory_order_relaxed);
+    }
+
+    atomic_fetch_add_explicit(&dst->count, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->zero_count,
+                              atomic_load_explicit(&src->zero_count, memory_order_relaxed),
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->sum,
+                              atomic_load_explicit(&src->sum, memory_order_relaxed),
+                              memory_order_relaxed);
+    store_min(&dst->min, atomic_load_explicit(&src->min, memory_order_relaxed));
+    store_max(&dst->max, atomic_load_explicit(&src->max, memory_order_relaxed));
+}
+
+/* Nearest-rank value at @percentile (0-100), within alpha; 0 if empty */
+uint64_t metrics_sketch_value_at(const struct metrics_sketch *sketch, float percentile)
+{
+    uint64_t total, rank, seen, min, max;
+    double exact;
+
+    seen = atomic_load_explicit(&sketch->zero_count, memory_order_relaxed);
+    total = seen;
+    for (uint32_t i = 0; i < METRICS_SKETCH_BINS; i++)
+        total += atomic_load_explicit(&sketch->bins[i], memory_order_relaxed);
+
+    if (total == 0)
+        return 0;
+
+    if (percentile < 0.0f)
+        percentile = 0.0f;
+    if (percentile > 100.0f)
+        percentile = 100.0f;
+
+    exact = (double)percentile / 100.0 * (double)total;
+    rank = (uint64_t)exact;
+    if ((double)rank < exact || rank == 0)
+        rank++;
+
+    if (seen >= rank)
+        return 0;
+
+    min = atomic_load_explicit(&sketch->min, memory_order_relaxed);
+    max = atomic_load_explicit(&sketch->max, memory_order_relaxed);
+    for (uint32_t i = 0; i < METRICS_SKETCH_BINS; i++) {
+        seen += atomic_load_explicit(&sketch->bins[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t value = sketch_value(i);
+
+            if (value < min)
+                value = min;
+            return value < max ? value : max;
+        }
+    }
+
+    return max;
+}
+
+static uint8_t *put_le(uint8_t *out, uint64_t value, uint32_t bytes)
+{
+    for (uint32_t i = 0; i < bytes; i++)
+        *out++ = (uint8_t)(value >> (8 * i));
+    return out;
+}
+
+static const uint8_t *get_le(const uint8_t *in, uint64_t *value, uint32_t bytes)
+{
+    *value = 0;
+    for (uint32_t i = 0; i < bytes; i++)
+        *value |= (uint64_t)*in++ << (8 * i);
+    return in;
+}
+
+static void header_encode(const struct metrics_sketch_msg *msg, uint8_t *out)
+{
+    out = put_le(out, msg->version, 4);
+    out = put_le(out, msg->num_bins, 4);
+    out = put_le(out, msg->count, 8);
+    out = put_le(out, msg->zero_count, 8);
+    out = put_le(out, msg->sum, 8);
+    out = put_le(out, msg->min, 8);
+    out = put_le(out, msg->max, 8);
+    out = put_le(out, msg->first_key, 4);
+    put_le(out, msg->num_keys, 4);
+}
+
+static void header_decode(struct metrics_sketch_msg *msg, const uint8_t *in)
+{
+    uint64_t v;
+
+    in = get_le(in, &v, 4);
+    msg->version = (uint32_t)v;
+    in = get_le(in, &v, 4);
+    msg->num_bins = (uint32_t)v;
+    in = get_le(in, &msg->count, 8);
+    in = get_le(in, &msg->zero_count, 8);
+    in = get_le(in, &msg->sum, 8);
+    in = get_le(in, &msg->min, 8);
+    in = get_le(in, &msg->max, 8);
+    in = get_le(in, &v, 4);
+    msg->first_key = (uint32_t)v;
+    get_le(in, &v, 4);
+    msg->num_keys = (uint32_t)v;
+}
+
+/*
+ * Encode @sketch into @buffer. Returns the bytes written, or 0 if they
+ * would not fit (METRICS_SKETCH_MSG_MAX always does).
+ */
+uint32_t metrics_sketch_encode(const struct metrics_sketch *sketch, void *buffer,
+                               uint32_t buffer_size)
+{
+    struct metrics_sketch_msg msg = { 0 };
+    uint32_t first = 0, last = 0, len;
+    uint8_t *out = buffer;
+    bool any = false;
+
+    for (uint32_t i = 0; i < METRICS_SKETCH_BINS; i++) {
+        if (!atomic_load_explicit(&sketch->bins[i], memory_order_relaxed))
+            continue;
+        if (!any)
+            first = i;
+        last = i;
+        any = true;
+    }
+
+    msg.version = METRICS_SKETCH_VERSION;
+    msg.num_bins = METRICS_SKETCH_BINS;
+    msg.zero_count = atomic_load_explicit(&sketch->zero_count, memory_order_relaxed);
+    msg.sum = atomic_load_explicit(&sketch->sum, memory_order_relaxed);
+    msg.min = atomic_load_explicit(&sketch->min, memory_order_relaxed);
+    msg.max = atomic_load_explicit(&sketch->max, memory_order_relaxed);
+    msg.first_key = first;
+    msg.num_keys = any ? last - first + 1 : 0;
+
+    if (!buffer || buffer_size < METRICS_SKETCH_HEADER_BYTES)
+        return 0;
+
+    /* Count what is sent, so the message adds up with racing records */
+    len = METRICS_SKETCH_HEADER_BYTES;
+    msg.count = msg.zero_count;
+    for (uint32_t i = first; i < first + msg.num_keys; i++) {
+        uint64_t n = atomic_load_explicit(&sketch->bins[i], memory_order_relaxed);
+
+        msg.count += n;
+        do {
+            if (len == buffer_size)
+                return 0;
+            out[len++] = (uint8_t)(n & 0x7f) | (n > 0x7f ? 0x80 : 0);
+            n >>= 7;
+        } while (n);
+    }
+
+    header_encode(&msg, out);
+    return len;
+}
+
+/*
+ * Add an encoded sketch into @dst. Returns -1, merging nothing, if it
+ * is malformed or was built with other bins.
+ */
+int metrics_sketch_merge_encoded(struct metrics_sketch *dst, const void *payload,
+                                 uint32_t bytes)
+{
+    const uint8_t *in = payload;
+    struct metrics_sketch_msg msg;
+    uint64_t total;
+    uint32_t pos;
+
+    if (!dst || !payload || bytes < METRICS_SKETCH_HEADER_BYTES)
+        return -1;
+
+    header_decode(&msg, in);
+    if (msg.version != METRICS_SKETCH_VERSION || msg.num_bins != METRICS_SKETCH_BINS ||
+        msg.first_key >= METRICS_SKETCH_BINS ||
+        msg.num_keys > METRICS_SKETCH_BINS - msg.first_key)
+        return -1;
+
+    /* Validate everything first */
+    for (int apply = 0; apply < 2; apply++) {
+        pos = METRICS_SKETCH_HEADER_BYTES;
+        total = msg.zero_count;
+
+        for (uint32_t k = 0; k < msg.num_keys; k++) {
+            uint64_t n = 0;
+            uint32_t shift = 0;
+            uint8_t byte;
+
+            do {
+                if (pos == bytes || shift > 63)
+                    return -1;
+                byte = in[pos++];
+                n |= (uint64_t)(byte & 0x7f) << shift;
+                shift += 7;
+            } while (byte & 0x80);
+
+            if (apply && n)
+                atomic_fetch_add_explicit(&dst->bins[msg.first_key + k], n,
+                                          memory_order_relaxed);
+            total += n;
+        }
+
+        if (!apply && (pos != bytes || total != msg.count))
+            return -1;
+    }
+
+    if (msg.count == 0)
+        return 0;
+
+    atomic_fetch_add_explicit(&dst->count, msg.count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->zero_count, msg.zero_count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->sum, msg.sum, memory_order_relaxed);
+    store_min(&dst->min, msg.min);
+    store_max(&dst->max, msg.max);
+    return 0;
+}
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _METRICS_SKETCH_H
+#define _METRICS_SKETCH_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/*
+ * Mergeable latency quantile sketch (DDSketch, Masson et al., 2019).
+ *
+ * A value v > 0 (ns) is counted in bin ceil(log_gamma(v)) with gamma =
+ * (1 + alpha) / (1 - alpha), and a bin reads back as 2 gamma^k / (gamma
+ * + 1), so every quantile is within alpha = 1% of an actual sample's
+ * value. Every node uses the same bins, so sketches merge exactly by
+ * adding counts: merging per-node sketches gives the same fleet-wide
+ * quantiles as one sketch over every sample, which averaging per-node
+ * percentiles does not.
+ *
+ * On the wire a sketch is the fields of struct metrics_sketch_msg in
+ * order, each little-endian (METRICS_SKETCH_HEADER_BYTES in all),
+ * followed by one LEB128 varint count per bin from first_key to
+ * first_key + num_keys - 1, which is about 1 KiB for a typical latency
+ * distribution. Recording and merging use relaxed atomics and are safe
+ * from any thread.
+ */
+
+#define METRICS_SKETCH_ALPHA 0.01
+#define METRICS_SKETCH_BINS 1400        /* Up to gamma^1399 ns, ~25 min */
+#define METRICS_SKETCH_VERSION 1
+
+/* Encoded header size, and an upper bound on an encoded sketch */
+#define METRICS_SKETCH_HEADER_BYTES (2 * 4 + 5 * 8 + 2 * 4)
+#define METRICS_SKETCH_MSG_MAX \
+    (METRICS_SKETCH_HEADER_BYTES + METRICS_SKETCH_BINS * 10)
+
+struct metrics_sketch {
+    _Atomic uint64_t count;
+    _Atomic uint64_t zero_count;    /* Values of 0 */
+    _Atomic uint64_t sum;           /* ns */
+    _Atomic uint64_t min;           /* UINT64_MAX while empty */
+    _Atomic uint64_t max;
+    _Atomic uint64_t bins[METRICS_SKETCH_BINS];
+};
+
+/* Encoded sketch header, as decoded */
+struct metrics_sketch_msg {
+    uint32_t version;
+    uint32_t num_bins;              /* Must match METRICS_SKETCH_BINS */
+    uint64_t count;
+    uint64_t zero_count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint32_t first_key;
+    uint32_t num_keys;
+};
+
+/* Function prototypes */
+void metrics_sketch_reset(struct metrics_sketch *sketch);
+void metrics_sketch_record(struct metrics_sketch *sketch, uint64_t value);
+void metrics_sketch_merge(struct metrics_sketch *dst, const struct metrics_sketch *src);
+uint64_t metrics_sketch_value_at(const struct metrics_sketch *sketch, float percentile);
+uint32_t metrics_sketch_encode(const struct metrics_sketch *sketch, void *buffer,
+                               uint32_t buffer_size);
+int metrics_sketch_merge_encoded(struct metrics_sketch *dst, const void *payload,
+                                 uint32_t bytes);
+
+#endif /* _METRICS_SKETCH_H */
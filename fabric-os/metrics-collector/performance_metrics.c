@@ -0,0 +1,837 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "performance_metrics.h"
+
+/*
+ * Performance Metrics Collector Implementation
+ *
+ * A thread is handed a shard index on its first record and keeps it;
+ * the shard itself is allocated by whichever thread first needs it and
+ * published with a compare-and-swap. After that a record is a few
+ * relaxed atomic adds on memory no other thread writes, so decode
+ * threads never contend on a lock or a shared cache line. Readers sum
+ * the shards into a scratch shard under the collector lock and derive
+ * everything in struct performance_metrics from it.
+ */
+
+static _Atomic uint32_t next_thread_shard;
+static _Thread_local uint32_t thread_shard = UINT32_MAX;
+
+/* Clear what collector_merge_locked() sums; the sketches merge apart */
+static void shard_reset_merged(struct metrics_shard *shard)
+{
+    metrics_hdr_reset(&shard->ttft);
+    metrics_hdr_reset(&shard->decode);
+    metrics_hdr_reset(&shard->prefill);
+    metrics_hdr_reset(&shard->e2e);
+
+    atomic_store_explicit(&shard->tokens, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->batches, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->max_batch_size, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->energy_nj, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->power_time_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->power_peak_watts, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->power_watts, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->power_at_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->cache_hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->cache_misses, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->activations, 0, memory_order_relaxed);
+    atomic_store_explicit(&shard->active_activations, 0, memory_order_relaxed);
+}
+
+static void shard_reset(struct metrics_shard *shard)
+{
+    shard_reset_merged(shard);
+    for (uint32_t i = 0; i < METRICS_LATENCY_KINDS; i++)
+        metrics_sketch_reset(&shard->sketches[i]);
+}
+
+static struct metrics_shard *shard_alloc(void)
+{
+    struct metrics_shard *shard = aligned_alloc(METRICS_CACHE_LINE_BYTES,
+                                                sizeof(*shard));
+
+    if (shard)
+        shard_reset(shard);
+    return shard;
+}
+
+static void counter_max(_Atomic uint64_t *counter, uint64_t value)
+{
+    uint64_t cur = atomic_load_explicit(counter, memory_order_relaxed);
+
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(counter, &cur, value,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+        ;
+}
+
+static void counter_add(_Atomic uint64_t *dst, const _Atomic uint64_t *src)
+{
+    atomic_fetch_add_explicit(dst, atomic_load_explicit(src, memory_order_relaxed),
+                              memory_order_relaxed);
+}
+
+/* The calling thread's shard, or NULL if not collecting (no lock held) */
+static struct metrics_shard *collector_shard(struct metrics_collector *collector)
+{
+    struct metrics_shard *shard, *expected = NULL;
+
+    if (!collector || !atomic_load_explicit(&collector->collecting, memory_order_relaxed))
+        return NULL;
+
+    if (thread_shard == UINT32_MAX)
+        thread_shard = atomic_fetch_add_explicit(&next_thread_shard, 1,
+                                                 memory_order_relaxed) % METRICS_MAX_SHARDS;
+
+    shard = atomic_load_explicit(&collector->shards[thread_shard], memory_order_acquire);
+    if (shard)
+        return shard;
+
+    shard = shard_alloc();
+    if (!shard)
+        return NULL;
+
+    if (!atomic_compare_exchange_strong_explicit(&collector->shards[thread_shard],
+                                                 &expected, shard,
+                                                 memory_order_acq_rel,
+                                                 memory_order_acquire)) {
+        free(shard);                /* Another thread on this index won */
+        shard = expected;
+    }
+    return shard;
+}
+
+/* Sum every shard into collector->merged (collector locked) */
+static struct metrics_shard *collector_merge_locked(struct metrics_collector *collector)
+{
+    struct metrics_shard *merged = collector->merged;
+    uint64_t power_at = 0;
+
+    shard_reset_merged(merged);
+
+    for (uint32_t i = 0; i < METRICS_MAX_SHARDS; i++) {
+        struct metrics_shard *shard = atomic_load_explicit(&collector->shards[i],
+                                                           memory_order_acquire);
+        uint64_t at;
+
+        if (!shard)
+            continue;
+
+        metrics_hdr_merge(&merged->ttft, &shard->ttft);
+        metrics_hdr_merge(&merged->decode, &shard->decode);
+        metrics_hdr_merge(&merged->prefill, &shard->prefill);
+        metrics_hdr_merge(&merged->e2e, &shard->e2e);
+
+        counter_add(&merged->tokens, &shard->tokens);
+        counter_add(&merged->batches, &shard->batches);
+        counter_max(&merged->max_batch_size,
+                    atomic_load_explicit(&shard->max_batch_size, memory_order_relaxed));
+        counter_add(&merged->energy_nj, &shard->energy_nj);
+        counter_add(&merged->power_time_ns, &shard->power_time_ns);
+        counter_max(&merged->power_peak_watts,
+                    atomic_load_explicit(&shard->power_peak_watts, memory_order_relaxed));
+        at = atomic_load_explicit(&shard->power_at_ns, memory_order_acquire);
+        if (at > power_at) {
+            power_at = at;
+            atomic_store_explicit(&merged->power_watts,
+                                  atomic_load_explicit(&shard->power_watts,
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+        }
+        counter_add(&merged->cache_hits, &shard->cache_hits);
+        counter_add(&merged->cache_misses, &shard->cache_misses);
+        counter_add(&merged->activations, &shard->activations);
+        counter_add(&merged->active_activations, &shard->active_activations);
+    }
+
+    return merged;
+}
+
+/* Initialize collector */
+int metrics_init(struct metrics_collector *collector,
+                uint32_t history_size)
+{
+    if (!collector)
+        return -1;
+
+    memset(collector, 0, sizeof(*collector));
+
+    collector->merged = shard_alloc();
+    if (history_size)
+        collector->history = calloc(history_size, sizeof(struct performance_metrics));
+
+    if (!collector->merged || (history_size && !collector->history)) {
+        free(collector->merged);
+        free(collector->history);
+        memset(collector, 0, sizeof(*collector));
+        return -1;
+    }
+
+    collector->history_size = history_size;
+    pthread_mutex_init(&collector->lock, NULL);
+    return 0;
+}
+
+/* No thread may be recording */
+void metrics_cleanup(struct metrics_collector *collector)
+{
+    if (!collector)
+        return;
+
+    for (uint32_t i = 0; i < METRICS_MAX_SHARDS; i++)
+        free(atomic_load_explicit(&collector->shards[i], memory_order_relaxed));
+    free(collector->merged);
+    free(collector->history);
+    pthread_mutex_destroy(&collector->lock);
+    memset(collector, 0, sizeof(*collector));
+}
+
+int metrics_start_collection(struct metrics_collector *collector)
+{
+    if (!collector)
+        return -1;
+
+    pthread_mutex_lock(&collector->lock);
+    collector->collection_start_ns = metrics_get_time_ns();
+    atomic_store_explicit(&collector->collecting, true, memory_order_relaxed);
+    pthread_mutex_unlock(&collector->lock);
+    return 0;
+}
+
+void metrics_stop_collection(struct metrics_collector *collector)
+{
+    if (!collector)
+        return;
+
+    atomic_store_explicit(&collector->collecting, false, memory_order_relaxed);
+}
+
+/*
+ * Zero every counter and the history. Records racing with a reset may
+ * land on either side of it.
+ */
+void metrics_reset(struct metrics_collector *collector)
+{
+    if (!collector)
+        return;
+
+    pthread_mutex_lock(&collector->lock);
+
+    for (uint32_t i = 0; i < METRICS_MAX_SHARDS; i++) {
+        struct metrics_shard *shard = atomic_load_explicit(&collector->shards[i],
+                                                           memory_order_acquire);
+
+        if (shard)
+            shard_reset(shard);
+    }
+
+    memset(&collector->current, 0, sizeof(collector->current));
+    if (collector->history)
+        memset(collector->history, 0,
+               collector->history_size * sizeof(struct performance_metrics));
+    collector->history_index = 0;
+    collector->collection_start_ns = metrics_get_time_ns();
+
+    pthread_mutex_unlock(&collector->lock);
+}
+
+void metrics_record_ttft(struct metrics_collector *collector,
+                        uint64_t ttft_ns)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    metrics_hdr_record(&shard->ttft, ttft_ns);
+    metrics_sketch_record(&shard->sketches[METRICS_LATENCY_TTFT], ttft_ns);
+}
+
+void metrics_record_decode_latency(struct metrics_collector *collector,
+                                  uint64_t latency_ns)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    metrics_hdr_record(&shard->decode, latency_ns);
+    metrics_sketch_record(&shard->sketches[METRICS_LATENCY_DECODE], latency_ns);
+}
+
+void metrics_record_prefill_latency(struct metrics_collector *collector,
+                                   uint64_t latency_ns)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    metrics_hdr_record(&shard->prefill, latency_ns);
+    metrics_sketch_record(&shard->sketches[METRICS_LATENCY_PREFILL], latency_ns);
+}
+
+/* One request completed after @latency_ns */
+void metrics_record_e2e_latency(struct metrics_collector *collector,
+                               uint64_t latency_ns)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    metrics_hdr_record(&shard->e2e, latency_ns);
+    metrics_sketch_record(&shard->sketches[METRICS_LATENCY_E2E], latency_ns);
+}
+
+/* One decode step produced a token for each of @batch_size sequences */
+void metrics_record_token(struct metrics_collector *collector,
+                         uint32_t batch_size)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    atomic_fetch_add_explicit(&shard->tokens, batch_size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->batches, 1, memory_order_relaxed);
+    counter_max(&shard->max_batch_size, batch_size);
+}
+
+/* The device drew @power_watts for the last @duration_ns */
+void metrics_record_energy(struct metrics_collector *collector,
+                          uint32_t power_watts,
+                          uint64_t duration_ns)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    atomic_fetch_add_explicit(&shard->energy_nj, (uint64_t)power_watts * duration_ns,
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->power_time_ns, duration_ns, memory_order_relaxed);
+    counter_max(&shard->power_peak_watts, power_watts);
+    atomic_store_explicit(&shard->power_watts, power_watts, memory_order_relaxed);
+    atomic_store_explicit(&shard->power_at_ns, metrics_get_time_ns(), memory_order_release);
+}
+
+void metrics_record_cache_access(struct metrics_collector *collector,
+                                bool hit)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (shard)
+        atomic_fetch_add_explicit(hit ? &shard->cache_hits : &shard->cache_misses, 1,
+                                  memory_order_relaxed);
+}
+
+/* @active of @total activations were non-zero */
+void metrics_record_sparsity(struct metrics_collector *collector,
+                            uint64_t active,
+                            uint64_t total)
+{
+    struct metrics_shard *shard = collector_shard(collector);
+
+    if (!shard)
+        return;
+
+    atomic_fetch_add_explicit(&shard->activations, total, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->active_activations, active, memory_order_relaxed);
+}
+
+/* Latency percentiles of merged shard @m into current (collector locked) */
+static void fill_percentiles_locked(struct metrics_collector *collector,
+                                    const struct metrics_shard *m)
+{
+    struct latency_metrics *lat = &collector->current.latency;
+
+    lat->ttft_p50_ms = metrics_ns_to_ms(metrics_hdr_value_at(&m->ttft, 50.0f));
+    lat->ttft_p95_ms = metrics_ns_to_ms(metrics_hdr_value_at(&m->ttft, 95.0f));
+    lat->ttft_p99_ms = metrics_ns_to_ms(metrics_hdr_value_at(&m->ttft, 99.0f));
+    lat->e2e_p99_ms = metrics_ns_to_ms(metrics_hdr_value_at(&m->e2e, 99.0f));
+}
+
+/* Refresh the latency percentiles in collector->current from the histograms */
+void metrics_calculate_percentiles(struct metrics_collector *collector)
+{
+    if (!collector)
+        return;
+
+    pthread_mutex_lock(&collector->lock);
+    fill_percentiles_locked(collector, collector_merge_locked(collector));
+    pthread_mutex_unlock(&collector->lock);
+}
+
+/*
+ * Nearest-rank @percentile (0-100) of @samples, in their unit. Reorders
+ * @samples (quickselect, O(n) expected).
+ */
+float metrics_get_percentile(uint64_t *samples,
+                            uint32_t num_samples,
+                            float percentile)
+{
+    uint32_t lo = 0, hi, k;
+    double exact;
+
+    if (!samples || num_samples == 0)
+        return 0.0f;
+
+    if (percentile < 0.0f)
+        percentile = 0.0f;
+    if (percentile > 100.0f)
+        percentile = 100.0f;
+
+    exact = (double)percentile / 100.0 * (double)num_samples;
+    k = (uint32_t)exact;
+    if ((double)k < exact || k == 0)
+        k++;
+    k--;                            /* Rank to index */
+
+    /* Three-way partition, so runs of equal samples do not go quadratic */
+    hi = num_samples - 1;
+    while (lo < hi) {
+        uint64_t pivot = samples[lo + (hi - lo) / 2], tmp;
+        uint32_t lt = lo, gt = hi, i = lo;
+
+        while (i <= gt) {
+            if (samples[i] < pivot) {
+                tmp = samples[lt];
+                samples[lt++] = samples[i];
+                samples[i++] = tmp;
+            } else if (samples[i] > pivot) {
+                tmp = samples[gt];
+                samples[gt--] = samples[i];
+                samples[i] = tmp;
+            } else {
+                i++;
+            }
+        }
+
+        /* [lo, lt) < pivot, [lt, gt] == pivot, (gt, hi] > pivot */
+        if (k < lt)
+            hi = lt - 1;
+        else if (k > gt)
+            lo = gt + 1;
+        else
+            break;
+    }
+
+    return (float)samples[k];
+}
+
+/*
+ * Sum the shards' @kind latencies into @sketch, for shipping to another
+ * node. Takes no lock; records racing with it may or may not be in it.
+ */
+int metrics_get_sketch(struct metrics_collector *collector,
+                      enum metrics_latency kind,
+                      struct metrics_sketch *sketch)
+{
+    if (!collector || !sketch || kind >= METRICS_LATENCY_KINDS)
+        return -1;
+
+    metrics_sketch_reset(sketch);
+
+    for (uint32_t i = 0; i < METRICS_MAX_SHARDS; i++) {
+        struct metrics_shard *shard = atomic_load_explicit(&collector->shards[i],
+                                                           memory_order_acquire);
+
+        if (shard)
+            metrics_sketch_merge(sketch, &shard->sketches[kind]);
+    }
+    return 0;
+}
+
+static void fill_latency(const struct metrics_hdr *hdr, uint64_t *sum_ns,
+                         uint32_t *samples, float *avg_ms)
+{
+    uint64_t count = atomic_load_explicit(&hdr->count, memory_order_relaxed);
+
+    *sum_ns = atomic_load_explicit(&hdr->sum, memory_order_relaxed);
+    *samples = count > UINT32_MAX ? UINT32_MAX : (uint32_t)count;
+    *avg_ms = count ? metrics_ns_to_ms(*sum_ns) / (float)count : 0.0f;
+}
+
+/* All but the percentiles of merged shard @m into current (collector locked) */
+static void fill_averages_locked(struct metrics_collector *collector,
+                                 const struct metrics_shard *m)
+{
+    struct performance_metrics *cur = &collector->current;
+    uint64_t now, duration, tokens, requests, energy_nj, power_ns;
+    uint64_t hits, misses, activations, active;
+
+    now = metrics_get_time_ns();
+    duration = collector->collection_start_ns ? now - collector->collection_start_ns : 0;
+
+    cur->timestamp_ns = now;
+    clock_gettime(CLOCK_REALTIME, &cur->collection_time);
+
+    /* Latency */
+    fill_latency(&m->ttft, &cur->latency.ttft_sum_ns, &cur->latency.ttft_samples,
+                 &cur->latency.ttft_avg_ms);
+    fill_latency(&m->decode, &cur->latency.decode_sum_ns, &cur->latency.decode_samples,
+                 &cur->latency.decode_avg_ms);
+    fill_latency(&m->prefill, &cur->latency.prefill_sum_ns, &cur->latency.prefill_samples,
+                 &cur->latency.prefill_avg_ms);
+    fill_latency(&m->e2e, &cur->latency.e2e_sum_ns, &cur->latency.e2e_samples,
+                 &cur->latency.e2e_avg_ms);
+    cur->latency.ttft_ns = atomic_load_explicit(&m->ttft.last, memory_order_relaxed);
+    cur->latency.decode_latency_ns = atomic_load_explicit(&m->decode.last,
+                                                          memory_order_relaxed);
+    cur->latency.prefill_latency_ns = atomic_load_explicit(&m->prefill.last,
+                                                           memory_order_relaxed);
+    cur->latency.e2e_latency_ns = atomic_load_explicit(&m->e2e.last, memory_order_relaxed);
+    cur->latency.ttft_max_ns = atomic_load_explicit(&m->ttft.max, memory_order_relaxed);
+    cur->latency.ttft_min_ns = cur->latency.ttft_samples ?
+                               atomic_load_explicit(&m->ttft.min, memory_order_relaxed) : 0;
+
+    /* Throughput */
+    tokens = atomic_load_explicit(&m->tokens, memory_order_relaxed);
+    requests = atomic_load_explicit(&m->e2e.count, memory_order_relaxed);
+    cur->throughput.total_tokens_generated = tokens;
+    cur->throughput.tokens_per_second = metrics_calculate_tps(tokens, duration);
+    cur->throughput.total_requests_processed = requests;
+    cur->throughput.requests_per_second = metrics_calculate_tps(requests, duration);
+    cur->throughput.total_batches = atomic_load_explicit(&m->batches, memory_order_relaxed);
+    cur->throughput.max_batch_size =
+        (uint32_t)atomic_load_explicit(&m->max_batch_size, memory_order_relaxed);
+    cur->throughput.average_batch_size = cur->throughput.total_batches ?
+        (float)tokens / (float)cur->throughput.total_batches : 0.0f;
+    cur->throughput.tokens_per_second_per_user = cur->throughput.average_batch_size > 0.0f ?
+        cur->throughput.tokens_per_second / cur->throughput.average_batch_size : 0.0f;
+
+    /* Energy */
+    energy_nj = atomic_load_explicit(&m->energy_nj, memory_order_relaxed);
+    power_ns = atomic_load_explicit(&m->power_time_ns, memory_order_relaxed);
+    cur->energy.energy_consumed_joules = energy_nj / 1000000000ULL;
+    cur->energy.power_watts = atomic_load_explicit(&m->power_watts, memory_order_relaxed);
+    cur->energy.power_avg_watts = power_ns ? (uint32_t)(energy_nj / power_ns) : 0;
+    cur->energy.power_peak_watts =
+        (uint32_t)atomic_load_explicit(&m->power_peak_watts, memory_order_relaxed);
+    cur->energy.energy_per_token_joules = tokens ? (float)energy_nj / 1e9f / (float)tokens : 0.0f;
+    cur->energy.energy_per_request_joules = requests ?
+        (float)energy_nj / 1e9f / (float)requests : 0.0f;
+
+    /* KV cache */
+    hits = atomic_load_explicit(&m->cache_hits, memory_order_relaxed);
+    misses = atomic_load_explicit(&m->cache_misses, memory_order_relaxed);
+    cur->utilization.kv_cache_hits = hits;
+    cur->utilization.kv_cache_misses = misses;
+    cur->utilization.kv_cache_hit_rate = hits + misses ?
+        (float)hits / (float)(hits + misses) : 0.0f;
+
+    /* Sparsity */
+    activations = atomic_load_explicit(&m->activations, memory_order_relaxed);
+    active = atomic_load_explicit(&m->active_activations, memory_order_relaxed);
+    cur->sparsity.total_activations = activations;
+    cur->sparsity.zero_activations = activations > active ? activations - active : 0;
+    cur->sparsity.activation_sparsity_percent = activations ?
+        100.0f * (float)cur->sparsity.zero_activations / (float)activations : 0.0f;
+}
+
+/*
+ * Refresh collector->current (all but the percentiles) from the shards
+ * and append it to the history ring.
+ */
+void metrics_update_averages(struct metrics_collector *collector)
+{
+    if (!collector)
+        return;
+
+    pthread_mutex_lock(&collector->lock);
+
+    fill_averages_locked(collector, collector_merge_locked(collector));
+    if (collector->history_size) {
+        collector->history[collector->history_index] = collector->current;
+        collector->history_index = (collector->history_index + 1) % collector->history_size;
+    }
+
+    pthread_mutex_unlock(&collector->lock);
+}
+
+/*
+ * Export
+ *
+ * Renderers write straight into the caller's buffer and count what did
+ * not fit, like snprintf(): they allocate nothing and return the length
+ * the whole document needs, so a caller whose buffer was too small can
+ * grow it once and keep reusing it.
+ */
+
+struct metrics_writer {
+    char *buf;
+    uint32_t size;
+    uint32_t len;                   /* Needed so far, may exceed size */
+};
+
+static void __attribute__((format(printf, 2, 3)))
+emit(struct metrics_writer *w, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    if (w->len < w->size)
+        n = vsnprintf(w->buf + w->len, w->size - w->len, fmt, ap);
+    else
+        n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (n > 0)
+        w->len += (uint32_t)n;
+}
+
+static void emit_family(struct metrics_writer *w, const char *name, const char *type,
+                        const char *help)
+{
+    emit(w, "# HELP lightos_%s %s\n# TYPE lightos_%s %s\n", name, help, name, type);
+}
+
+static void emit_value(struct metrics_writer *w, const char *name, const char *type,
+                       const char *help, double value)
+{
+    emit_family(w, name, type, help);
+    emit(w, "lightos_%s %.9g\n", name, value);
+}
+
+/* Histogram bucket bounds, seconds */
+static const double export_bounds[] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0,
+};
+
+/*
+ * @hdr as a Prometheus histogram. Each bound is moved down to the HDR
+ * bucket edge at or below it, and that edge is what le says, so every
+ * bucket counts exactly the samples up to its le.
+ */
+static void emit_histogram(struct metrics_writer *w, const char *name, const char *help,
+                           const struct metrics_hdr *hdr)
+{
+    const uint32_t num_bounds = sizeof(export_bounds) / sizeof(export_bounds[0]);
+    uint64_t cumulative = 0;
+    uint32_t b = 0, i = 0;
+
+    emit_family(w, name, "histogram", help);
+
+    for (b = 0; b < num_bounds; b++) {
+        uint64_t bound_ns = (uint64_t)(export_bounds[b] * 1e9);
+
+        for (; i < METRICS_HDR_BUCKETS && metrics_hdr_highest(i) <= bound_ns; i++)
+            cumulative += atomic_load_explicit(&hdr->buckets[i], memory_order_relaxed);
+        emit(w, "lightos_%s_bucket{le=\"%.9f\"} %llu\n", name,
+             (double)metrics_hdr_highest(i - 1) / 1e9, (unsigned long long)cumulative);
+    }
+    for (; i < METRICS_HDR_BUCKETS; i++)
+        cumulative += atomic_load_explicit(&hdr->buckets[i], memory_order_relaxed);
+
+    emit(w, "lightos_%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cumulative);
+    emit(w, "lightos_%s_sum %.9g\n", name,
+         (double)atomic_load_explicit(&hdr->sum, memory_order_relaxed) / 1e9);
+    emit(w, "lightos_%s_count %llu\n", name, (unsigned long long)cumulative);
+}
+
+/* @hdr's quantiles as a Prometheus summary */
+static void emit_quantiles(struct metrics_writer *w, const char *name, const char *help,
+                           const struct metrics_hdr *hdr)
+{
+    static const float quantiles[] = { 50.0f, 95.0f, 99.0f, 99.9f };
+
+    emit_family(w, name, "summary", help);
+    for (uint32_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+        emit(w, "lightos_%s{quantile=\"%g\"} %.9g\n", name, quantiles[q] / 100.0f,
+             (double)metrics_hdr_value_at(hdr, quantiles[q]) / 1e9);
+    emit(w, "lightos_%s_sum %.9g\n", name,
+         (double)atomic_load_explicit(&hdr->sum, memory_order_relaxed) / 1e9);
+    emit(w, "lightos_%s_count %llu\n", name,
+         (unsigned long long)atomic_load_explicit(&hdr->count, memory_order_relaxed));
+}
+
+/*
+ * Render every metric family in the Prometheus text format (0.0.4),
+ * which OpenMetrics scrapers also accept. Returns the length of the full
+ * document; it was written whole (and NUL-terminated) if that is below
+ * @buffer_size.
+ */
+uint32_t metrics_export_prometheus(struct metrics_collector *collector,
+                                   char *buffer,
+                                   uint32_t buffer_size)
+{
+    struct metrics_writer w = { buffer, buffer ? buffer_size : 0, 0 };
+    const struct performance_metrics *cur;
+    const struct metrics_shard *m;
+
+    if (!collector)
+        return 0;
+    if (w.size)
+        buffer[0] = '\0';
+
+    pthread_mutex_lock(&collector->lock);
+
+    m = collector_merge_locked(collector);
+    fill_percentiles_locked(collector, m);
+    fill_averages_locked(collector, m);
+    cur = &collector->current;
+
+    /* Latency */
+    emit_histogram(&w, "ttft_seconds", "Time to first token.", &m->ttft);
+    emit_quantiles(&w, "ttft_quantile_seconds", "Time to first token quantiles.", &m->ttft);
+    emit_histogram(&w, "decode_latency_seconds", "Per-token decode latency.", &m->decode);
+    emit_histogram(&w, "prefill_latency_seconds", "Prompt prefill latency.", &m->prefill);
+    emit_histogram(&w, "request_latency_seconds", "End-to-end request latency.", &m->e2e);
+    emit_quantiles(&w, "request_latency_quantile_seconds",
+                   "End-to-end request latency quantiles.", &m->e2e);
+
+    /* Throughput */
+    emit_value(&w, "tokens_generated_total", "counter", "Tokens generated.",
+               (double)cur->throughput.total_tokens_generated);
+    emit_value(&w, "requests_total", "counter", "Requests completed.",
+               (double)cur->throughput.total_requests_processed);
+    emit_value(&w, "batches_total", "counter", "Decode steps.",
+               (double)cur->throughput.total_batches);
+    emit_value(&w, "tokens_per_second", "gauge", "Tokens generated per second.",
+               cur->throughput.tokens_per_second);
+    emit_value(&w, "requests_per_second", "gauge", "Requests completed per second.",
+               cur->throughput.requests_per_second);
+    emit_value(&w, "batch_size_average", "gauge", "Average decode batch size.",
+               cur->throughput.average_batch_size);
+    emit_value(&w, "batch_size_max", "gauge", "Largest decode batch.",
+               cur->throughput.max_batch_size);
+    emit_value(&w, "active_sequences", "gauge", "Sequences being decoded.",
+               cur->throughput.active_sequences);
+    emit_value(&w, "queued_sequences", "gauge", "Sequences waiting.",
+               cur->throughput.queued_sequences);
+
+    /* Energy */
+    emit_value(&w, "energy_joules_total", "counter", "Energy consumed.",
+               (double)atomic_load_explicit(&m->energy_nj, memory_order_relaxed) / 1e9);
+    emit_value(&w, "power_watts", "gauge", "Last reported power draw.",
+               cur->energy.power_watts);
+    emit_value(&w, "power_peak_watts", "gauge", "Peak power draw.",
+               cur->energy.power_peak_watts);
+    emit_value(&w, "energy_per_token_joules", "gauge", "Energy per generated token.",
+               cur->energy.energy_per_token_joules);
+    emit_value(&w, "temperature_celsius", "gauge", "Device temperature.",
+               cur->energy.temperature_mc / 1000.0);
+
+    /* Utilization */
+    emit_value(&w, "gpu_utilization_ratio", "gauge", "Accelerator utilization.",
+               cur->utilization.gpu_utilization_percent / 100.0);
+    emit_value(&w, "gpu_memory_utilization_ratio", "gauge", "Accelerator memory utilization.",
+               cur->utilization.gpu_memory_utilization_percent / 100.0);
+    emit_value(&w, "cpu_utilization_ratio", "gauge", "CPU utilization.",
+               cur->utilization.cpu_utilization_percent / 100.0);
+    emit_value(&w, "memory_used_bytes", "gauge", "Host memory in use.",
+               (double)cur->utilization.memory_used_bytes);
+    emit_value(&w, "kv_cache_used_bytes", "gauge", "KV cache memory in use.",
+               (double)cur->utilization.kv_cache_used_bytes);
+    emit_value(&w, "kv_cache_hits_total", "counter", "KV cache hits.",
+               (double)cur->utilization.kv_cache_hits);
+    emit_value(&w, "kv_cache_misses_total", "counter", "KV cache misses.",
+               (double)cur->utilization.kv_cache_misses);
+
+    /* Sparsity */
+    emit_value(&w, "activations_total", "counter", "Activations computed.",
+               (double)cur->sparsity.total_activations);
+    emit_value(&w, "zero_activations_total", "counter", "Activations that were zero.",
+               (double)cur->sparsity.zero_activations);
+    emit_value(&w, "expert_sparsity_ratio", "gauge", "Share of experts inactive.",
+               cur->sparsity.expert_sparsity_percent / 100.0);
+    emit_value(&w, "tokens_dropped_total", "counter", "Tokens dropped.",
+               (double)cur->sparsity.tokens_dropped);
+    emit_value(&w, "layers_skipped_total", "counter", "Layers skipped.",
+               (double)cur->sparsity.layers_skipped);
+
+    pthread_mutex_unlock(&collector->lock);
+
+    return w.len;
+}
+
+/* One JSON object of the current metrics; returns as metrics_export_prometheus() */
+uint32_t metrics_export_json(struct metrics_collector *collector,
+                             char *buffer,
+                             uint32_t buffer_size)
+{
+    struct metrics_writer w = { buffer, buffer ? buffer_size : 0, 0 };
+    const struct performance_metrics *cur;
+    const struct metrics_shard *m;
+
+    if (!collector)
+        return 0;
+    if (w.size)
+        buffer[0] = '\0';
+
+    pthread_mutex_lock(&collector->lock);
+
+    m = collector_merge_locked(collector);
+    fill_percentiles_locked(collector, m);
+    fill_averages_locked(collector, m);
+    cur = &collector->current;
+
+    emit(&w, "{\"timestamp_ns\":%llu,", (unsigned long long)cur->timestamp_ns);
+    emit(&w, "\"latency\":{\"ttft_avg_ms\":%.3f,\"ttft_p50_ms\":%.3f,"
+         "\"ttft_p95_ms\":%.3f,\"ttft_p99_ms\":%.3f,\"ttft_samples\":%u,"
+         "\"decode_avg_ms\":%.3f,\"prefill_avg_ms\":%.3f,"
+         "\"e2e_avg_ms\":%.3f,\"e2e_p99_ms\":%.3f},",
+         cur->latency.ttft_avg_ms, cur->latency.ttft_p50_ms, cur->latency.ttft_p95_ms,
+         cur->latency.ttft_p99_ms, cur->latency.ttft_samples, cur->latency.decode_avg_ms,
+         cur->latency.prefill_avg_ms, cur->latency.e2e_avg_ms, cur->latency.e2e_p99_ms);
+    emit(&w, "\"throughput\":{\"tokens_per_second\":%.3f,\"total_tokens\":%llu,"
+         "\"requests_per_second\":%.3f,\"total_requests\":%llu,"
+         "\"average_batch_size\":%.3f,\"max_batch_size\":%u},",
+         cur->throughput.tokens_per_second,
+         (unsigned long long)cur->throughput.total_tokens_generated,
+         cur->throughput.requests_per_second,
+         (unsigned long long)cur->throughput.total_requests_processed,
+         cur->throughput.average_batch_size, cur->throughput.max_batch_size);
+    emit(&w, "\"energy\":{\"joules\":%llu,\"power_watts\":%u,\"power_avg_watts\":%u,"
+         "\"power_peak_watts\":%u,\"joules_per_token\":%.6f},",
+         (unsigned long long)cur->energy.energy_consumed_joules, cur->energy.power_watts,
+         cur->energy.power_avg_watts, cur->energy.power_peak_watts,
+         cur->energy.energy_per_token_joules);
+    emit(&w, "\"utilization\":{\"gpu_percent\":%.2f,\"cpu_percent\":%.2f,"
+         "\"kv_cache_hit_rate\":%.4f},",
+         cur->utilization.gpu_utilization_percent, cur->utilization.cpu_utilization_percent,
+         cur->utilization.kv_cache_hit_rate);
+    emit(&w, "\"sparsity\":{\"activation_percent\":%.2f,\"expert_percent\":%.2f}}",
+         cur->sparsity.activation_sparsity_percent, cur->sparsity.expert_sparsity_percent);
+
+    pthread_mutex_unlock(&collector->lock);
+
+    return w.len;
+}
+
+void metrics_print_summary(struct metrics_collector *collector)
+{
+    struct performance_metrics *cur;
+
+    if (!collector)
+        return;
+
+    pthread_mutex_lock(&collector->lock);
+    cur = &collector->current;
+
+    printf("Performance Summary:\n");
+    printf("  TTFT: avg=%.1fms, p50=%.1fms, p95=%.1fms, p99=%.1fms (%u samples)\n",
+           cur->latency.ttft_avg_ms, cur->latency.ttft_p50_ms,
+           cur->latency.ttft_p95_ms, cur->latency.ttft_p99_ms,
+           cur->latency.ttft_samples);
+    printf("  Decode: avg=%.2fms/token, E2E: avg=%.1fms, p99=%.1fms\n",
+           cur->latency.decode_avg_ms, cur->latency.e2e_avg_ms,
+           cur->latency.e2e_p99_ms);
+    printf("  TPS: %.0f tokens/s (%.0f tokens/s/user)\n",
+           cur->throughput.tokens_per_second,
+           cur->throughput.tokens_per_second_per_user);
+    printf("  Energy: %.3f J per token, avg %u W, peak %u W\n",
+           cur->energy.energy_per_token_joules, cur->energy.power_avg_watts,
+           cur->energy.power_peak_watts);
+    printf("  Sparsity: %.0f%%\n", cur->sparsity.activation_sparsity_percent);
+    printf("  Cache hit rate: %.0f%%\n", 100.0f * cur->utilization.kv_cache_hit_rate);
+
+    pthread_mutex_unlock(&collector->lock);
+}
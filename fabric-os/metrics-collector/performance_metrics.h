@@ -4,17 +4,33 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <time.h>
+#include "metrics_hdr.h"
+#include "metrics_sketch.h"
 
 /*
  * Performance Metrics Collection
  *
  * Tracks Time-to-First-Token (TTFT), energy efficiency,
  * and other critical performance indicators.
+ *
+ * Recording never takes a lock: each thread writes to its own shard of
+ * relaxed atomic counters and HDR histograms (threads beyond
+ * METRICS_MAX_SHARDS share shards, still without locking). Readers
+ * merge the shards under the collector lock, so percentiles cost one
+ * pass over the histogram buckets whatever the number of samples.
+ *
+ * Latencies also go into DDSketches (metrics_sketch.h), which a node
+ * encodes with metrics_get_sketch() and metrics_sketch_encode() and a
+ * control plane merges with metrics_sketch_merge_encoded() into exact
+ * fleet-wide quantiles (within 1%).
  */
 
-#define METRICS_MAX_SAMPLES 10000
 #define METRICS_PERCENTILES 5
+#define METRICS_MAX_SHARDS 64
+#define METRICS_CACHE_LINE_BYTES 64
 
 /* Metric types */
 enum metric_type {
@@ -27,10 +43,19 @@ enum metric_type {
     METRIC_THERMAL = 6,
 };
 
+/* Latencies kept as mergeable sketches */
+enum metrics_latency {
+    METRICS_LATENCY_TTFT = 0,
+    METRICS_LATENCY_DECODE = 1,
+    METRICS_LATENCY_PREFILL = 2,
+    METRICS_LATENCY_E2E = 3,
+    METRICS_LATENCY_KINDS = 4,
+};
+
 /* Latency metrics */
 struct latency_metrics {
     /* Time to First Token (TTFT) */
-    uint64_t ttft_ns;              /* Last TTFT measurement */
+    uint64_t ttft_ns;              /* Last TTFT measurement (of one thread) */
     uint64_t ttft_sum_ns;          /* Sum for average */
     uint64_t ttft_min_ns;          /* Minimum TTFT */
     uint64_t ttft_max_ns;          /* Maximum TTFT */
@@ -190,6 +215,36 @@ struct performance_metrics {
     uint32_t requests_failed;
 };
 
+/* One recording thread's counters */
+struct metrics_shard {
+    /* Latency histograms (ns) */
+    struct metrics_hdr ttft;
+    struct metrics_hdr decode;
+    struct metrics_hdr prefill;
+    struct metrics_hdr e2e;
+    struct metrics_sketch sketches[METRICS_LATENCY_KINDS];
+
+    /* Throughput */
+    _Atomic uint64_t tokens;
+    _Atomic uint64_t batches;
+    _Atomic uint64_t max_batch_size;
+
+    /* Energy */
+    _Atomic uint64_t energy_nj;
+    _Atomic uint64_t power_time_ns;    /* Covered by energy samples */
+    _Atomic uint64_t power_peak_watts;
+    _Atomic uint32_t power_watts;      /* Last reported draw ... */
+    _Atomic uint64_t power_at_ns;      /* ... and when; newest shard wins */
+
+    /* KV cache */
+    _Atomic uint64_t cache_hits;
+    _Atomic uint64_t cache_misses;
+
+    /* Sparsity */
+    _Atomic uint64_t activations;
+    _Atomic uint64_t active_activations;
+} __attribute__((aligned(METRICS_CACHE_LINE_BYTES)));
+
 /* Metrics collector */
 struct metrics_collector {
     struct performance_metrics current;
@@ -197,14 +252,14 @@ struct metrics_collector {
     uint32_t history_size;
     uint32_t history_index;
 
-    /* Percentile tracking */
-    uint64_t *ttft_samples;
-    uint32_t num_ttft_samples;
+    /* Recording shards, allocated on a thread's first record */
+    _Atomic(struct metrics_shard *) shards[METRICS_MAX_SHARDS];
+    struct metrics_shard *merged;   /* Readers' scratch */
 
     /* Collection state */
-    bool collecting;
+    _Atomic bool collecting;
     uint64_t collection_start_ns;
-    pthread_mutex_t lock;
+    pthread_mutex_t lock;           /* Readers: current, history, merged */
 };
 
 /* Function prototypes */
@@ -224,6 +279,10 @@ void metrics_record_ttft(struct metrics_collector *collector,
                         uint64_t ttft_ns);
 void metrics_record_decode_latency(struct metrics_collector *collector,
                                   uint64_t latency_ns);
+void metrics_record_prefill_latency(struct metrics_collector *collector,
+                                   uint64_t latency_ns);
+void metrics_record_e2e_latency(struct metrics_collector *collector,
+                               uint64_t latency_ns);
 void metrics_record_token(struct metrics_collector *collector,
                          uint32_t batch_size);
 void metrics_record_energy(struct metrics_collector *collector,
@@ -241,14 +300,17 @@ float metrics_get_percentile(uint64_t *samples,
                             uint32_t num_samples,
                             float percentile);
 void metrics_update_averages(struct metrics_collector *collector);
+int metrics_get_sketch(struct metrics_collector *collector,
+                      enum metrics_latency kind,
+                      struct metrics_sketch *sketch);
 
 /* Export */
-void metrics_export_json(struct metrics_collector *collector,
-                        char *buffer,
-                        uint32_t buffer_size);
-void metrics_export_prometheus(struct metrics_collector *collector,
-                              char *buffer,
-                              uint32_t buffer_size);
+uint32_t metrics_export_json(struct metrics_collector *collector,
+                             char *buffer,
+                             uint32_t buffer_size);
+uint32_t metrics_export_prometheus(struct metrics_collector *collector,
+                                   char *buffer,
+                                   uint32_t buffer_size);
 void metrics_print_summary(struct metrics_collector *collector);
 
 /* Utility functions */